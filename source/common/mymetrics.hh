@@ -0,0 +1,497 @@
+#ifndef MYMETRICS_H_
+#define MYMETRICS_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Process-wide metrics: counters, gauges and latency histograms.
+//
+// Metrics are registered once by name in Registry::instance(), the returned
+// reference stays valid for the process, so hot paths keep it in a static or a
+// member and never look it up again. A name may carry prometheus labels, e.g.
+// daq_packets_total{layer="200p2"}. Counters and histograms are sharded per
+// thread on their own cache lines, recording is a relaxed atomic add, reading
+// sums the shards.
+//
+// Histograms are log-linear: each power of two is split into 2^s_sub_bits
+// buckets, quantiles are exact to 1/2^s_sub_bits of the value.
+//
+// Exporter serves the registry over HTTP on a tcp or unix socket, GET /metrics
+// in prometheus text and GET /metrics.json in json, and can dump the json to a
+// file periodically. Exporter::FromEnv() starts one as the environment asks:
+//   ALTEL_METRICS_ENDPOINT   127.0.0.1:9100 or unix:/tmp/altel.sock
+//   ALTEL_METRICS_DUMP       file rewritten with the json
+//   ALTEL_METRICS_PERIOD_MS  dump period (default 1000)
+namespace mymetrics{
+  static constexpr size_t s_cache_line = 64;
+  static constexpr size_t s_shard_n = 16;
+
+  // shard of the calling thread, threads are spread round-robin
+  inline size_t shardIndex(){
+    static std::atomic<size_t> s_thread_n{0};
+    thread_local size_t t_shard = s_thread_n.fetch_add(1, std::memory_order_relaxed) % s_shard_n;
+    return t_shard;
+  }
+
+  class Counter{
+  public:
+    void add(uint64_t n = 1){
+      m_shards[shardIndex()].v.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const{
+      uint64_t sum = 0;
+      for(auto &s: m_shards){
+        sum += s.v.load(std::memory_order_relaxed);
+      }
+      return sum;
+    }
+  private:
+    struct alignas(s_cache_line) Shard{
+      std::atomic<uint64_t> v{0};
+    };
+    std::array<Shard, s_shard_n> m_shards;
+  };
+
+  // last value set, by one owner usually
+  class Gauge{
+  public:
+    void set(int64_t v){m_v.store(v, std::memory_order_relaxed);}
+    void add(int64_t n){m_v.fetch_add(n, std::memory_order_relaxed);}
+    int64_t value() const{return m_v.load(std::memory_order_relaxed);}
+  private:
+    alignas(s_cache_line) std::atomic<int64_t> m_v{0};
+  };
+
+  class Histogram{
+  public:
+    static constexpr unsigned s_sub_bits = 3;
+    static constexpr size_t s_bucket_n = (65 - s_sub_bits) << s_sub_bits;
+
+    static size_t bucketOf(uint64_t v){
+      if(v < (uint64_t(1)<<s_sub_bits)){
+        return v;
+      }
+      unsigned e = 63 - __builtin_clzll(v);
+      uint64_t sub = (v >> (e - s_sub_bits)) & ((uint64_t(1)<<s_sub_bits) - 1);
+      return ((e - s_sub_bits + 1) << s_sub_bits) + sub;
+    }
+
+    static uint64_t bucketLower(size_t b){
+      if(b < (size_t(1)<<s_sub_bits)){
+        return b;
+      }
+      unsigned e = (b >> s_sub_bits) + s_sub_bits - 1;
+      uint64_t sub = b & ((uint64_t(1)<<s_sub_bits) - 1);
+      return (uint64_t(1)<<e) | (sub << (e - s_sub_bits));
+    }
+
+    static uint64_t bucketUpper(size_t b){
+      return b + 1 < s_bucket_n? bucketLower(b + 1) - 1 : ~uint64_t(0);
+    }
+
+    struct Snapshot{
+      std::vector<uint64_t> buckets;
+      uint64_t count{0};
+      uint64_t sum{0};
+
+      // upper edge of the bucket holding quantile q, 0 when empty
+      uint64_t quantile(double q) const{
+        if(!count){
+          return 0;
+        }
+        uint64_t rank = uint64_t(q * (count - 1)) + 1;
+        uint64_t acc = 0;
+        for(size_t b = 0; b < buckets.size(); b++){
+          acc += buckets[b];
+          if(acc >= rank){
+            return bucketUpper(b);
+          }
+        }
+        return bucketUpper(buckets.size() - 1);
+      }
+      double mean() const{return count? double(sum) / count : 0;}
+    };
+
+    Histogram():m_shards(new Shard[s_shard_n]){};
+
+    void record(uint64_t v){
+      Shard &s = m_shards[shardIndex()];
+      s.buckets[bucketOf(v)].fetch_add(1, std::memory_order_relaxed);
+      s.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const{
+      Snapshot snap;
+      snap.buckets.assign(s_bucket_n, 0);
+      for(size_t n = 0; n < s_shard_n; n++){
+        const Shard &s = m_shards[n];
+        for(size_t b = 0; b < s_bucket_n; b++){
+          uint64_t c = s.buckets[b].load(std::memory_order_relaxed);
+          snap.buckets[b] += c;
+          snap.count += c;
+        }
+        snap.sum += s.sum.load(std::memory_order_relaxed);
+      }
+      return snap;
+    }
+
+  private:
+    struct alignas(s_cache_line) Shard{
+      std::array<std::atomic<uint64_t>, s_bucket_n> buckets{};
+      std::atomic<uint64_t> sum{0};
+    };
+    std::unique_ptr<Shard[]> m_shards;
+  };
+
+  // records the nanoseconds of its scope
+  class ScopedTimer{
+  public:
+    explicit ScopedTimer(Histogram& h):m_h(h), m_tp_start(std::chrono::steady_clock::now()){};
+    ~ScopedTimer(){
+      m_h.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - m_tp_start).count());
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+  private:
+    Histogram& m_h;
+    std::chrono::steady_clock::time_point m_tp_start;
+  };
+
+  class Registry{
+  public:
+    static Registry& instance(){
+      static Registry s_registry;
+      return s_registry;
+    }
+
+    Counter& counter(const std::string& name, const std::string& help = ""){
+      return *get(name, help, Kind::COUNTER).counter;
+    }
+    Gauge& gauge(const std::string& name, const std::string& help = ""){
+      return *get(name, help, Kind::GAUGE).gauge;
+    }
+    Histogram& histogram(const std::string& name, const std::string& help = ""){
+      return *get(name, help, Kind::HISTOGRAM).histogram;
+    }
+
+    std::string json(){
+      std::unique_lock<std::mutex> lk(m_mx);
+      std::string str[3];
+      char buf[256];
+      for(auto &it: m_entries){
+        const Entry &e = it.second;
+        size_t k = size_t(e.kind);
+        str[k] += str[k].empty()? "\n    " : ",\n    ";
+        str[k] += "\"" + escape(it.first) + "\": ";
+        if(e.kind == Kind::COUNTER){
+          str[k] += std::to_string(e.counter->value());
+        }
+        else if(e.kind == Kind::GAUGE){
+          str[k] += std::to_string(e.gauge->value());
+        }
+        else{
+          auto snap = e.histogram->snapshot();
+          std::snprintf(buf, sizeof(buf),
+                        "{\"count\": %lu, \"sum\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu}",
+                        snap.count, snap.sum, snap.mean(), snap.quantile(0.5), snap.quantile(0.9),
+                        snap.quantile(0.99), snap.quantile(1));
+          str[k] += buf;
+        }
+      }
+      return "{\n  \"counters\": {" + str[0] + "\n  },\n  \"gauges\": {" + str[1] +
+        "\n  },\n  \"histograms\": {" + str[2] + "\n  }\n}\n";
+    }
+
+    // histograms are exported as summaries
+    std::string prometheus(){
+      std::unique_lock<std::mutex> lk(m_mx);
+      std::string str;
+      std::string base_last;
+      char buf[256];
+      for(auto &it: m_entries){
+        const Entry &e = it.second;
+        std::string base = it.first.substr(0, it.first.find('{'));
+        std::string labels = it.first.size() > base.size()? it.first.substr(base.size() + 1, it.first.size() - base.size() - 2) : "";
+        if(base != base_last){
+          static const char* s_types[] = {"counter", "gauge", "summary"};
+          if(!e.help.empty()){
+            str += "# HELP " + base + " " + e.help + "\n";
+          }
+          str += "# TYPE " + base + " " + s_types[size_t(e.kind)] + "\n";
+          base_last = base;
+        }
+        if(e.kind == Kind::COUNTER){
+          str += it.first + " " + std::to_string(e.counter->value()) + "\n";
+        }
+        else if(e.kind == Kind::GAUGE){
+          str += it.first + " " + std::to_string(e.gauge->value()) + "\n";
+        }
+        else{
+          auto snap = e.histogram->snapshot();
+          for(double q: {0.5, 0.9, 0.99, 1.}){
+            std::snprintf(buf, sizeof(buf), "%s{%s%squantile=\"%g\"} %lu\n", base.c_str(), labels.c_str(),
+                          labels.empty()? "" : ",", q, snap.quantile(q));
+            str += buf;
+          }
+          std::string suffix = labels.empty()? "" : "{" + labels + "}";
+          str += base + "_sum" + suffix + " " + std::to_string(snap.sum) + "\n";
+          str += base + "_count" + suffix + " " + std::to_string(snap.count) + "\n";
+        }
+      }
+      return str;
+    }
+
+  private:
+    enum class Kind {COUNTER = 0, GAUGE = 1, HISTOGRAM = 2};
+    struct Entry{
+      Kind kind;
+      std::string help;
+      std::unique_ptr<Counter> counter;
+      std::unique_ptr<Gauge> gauge;
+      std::unique_ptr<Histogram> histogram;
+    };
+
+    Entry& get(const std::string& name, const std::string& help, Kind kind){
+      std::unique_lock<std::mutex> lk(m_mx);
+      Entry &e = m_entries[name];
+      if(!e.counter && !e.gauge && !e.histogram){
+        e.kind = kind;
+        e.help = help;
+        if(kind == Kind::COUNTER){
+          e.counter.reset(new Counter);
+        }
+        else if(kind == Kind::GAUGE){
+          e.gauge.reset(new Gauge);
+        }
+        else{
+          e.histogram.reset(new Histogram);
+        }
+      }
+      else if(e.kind != kind){
+        std::fprintf(stderr, "mymetrics: %s is registered as another kind of metric\n", name.c_str());
+        throw;
+      }
+      return e;
+    }
+
+    static std::string escape(const std::string& s){
+      std::string r;
+      for(char c: s){
+        if(c == '"' || c == '\\'){
+          r.push_back('\\');
+        }
+        r.push_back(c);
+      }
+      return r;
+    }
+
+    std::mutex m_mx;
+    std::map<std::string, Entry> m_entries; // sorted, so labels of one metric are adjacent
+  };
+
+  class Exporter{
+  public:
+    // endpoint "host:port" or "unix:path", empty for no server; dumpPath empty for no dump
+    Exporter(const std::string& endpoint, const std::string& dumpPath = "",
+             std::chrono::milliseconds period = std::chrono::milliseconds(1000))
+      :m_endpoint(endpoint), m_dump_path(dumpPath), m_period(period){
+      if(!m_endpoint.empty()){
+        m_sock = listenOn(m_endpoint);
+        if(m_sock < 0){
+          std::fprintf(stderr, "mymetrics: unable to listen on %s, errno %d\n", m_endpoint.c_str(), errno);
+          throw;
+        }
+        std::fprintf(stdout, "mymetrics: serving /metrics and /metrics.json on %s\n", m_endpoint.c_str());
+      }
+      m_thread = std::thread(&Exporter::threadServe, this);
+    }
+
+    ~Exporter(){
+      m_is_running = false;
+      if(m_thread.joinable()){
+        m_thread.join();
+      }
+      if(m_sock >= 0){
+        close(m_sock);
+        if(m_endpoint.compare(0, 5, "unix:") == 0){
+          unlink(m_endpoint.c_str() + 5);
+        }
+      }
+      if(!m_dump_path.empty()){
+        dump();
+      }
+    }
+
+    Exporter(const Exporter&) = delete;
+    Exporter& operator=(const Exporter&) = delete;
+
+    static std::unique_ptr<Exporter> FromEnv(){
+      const char* endpoint = std::getenv("ALTEL_METRICS_ENDPOINT");
+      const char* dumpPath = std::getenv("ALTEL_METRICS_DUMP");
+      const char* period = std::getenv("ALTEL_METRICS_PERIOD_MS");
+      if(!endpoint && !dumpPath){
+        return nullptr;
+      }
+      return std::unique_ptr<Exporter>(
+        new Exporter(endpoint? endpoint : "", dumpPath? dumpPath : "",
+                     std::chrono::milliseconds(period? std::stoul(period) : 1000)));
+    }
+
+    // json into a temporary file renamed over the dump, readers never see half of it
+    void dump(){
+      std::string tmp = m_dump_path + ".tmp";
+      std::FILE *fp = std::fopen(tmp.c_str(), "w");
+      if(!fp){
+        return;
+      }
+      std::string str = Registry::instance().json();
+      std::fwrite(str.data(), 1, str.size(), fp);
+      std::fclose(fp);
+      std::rename(tmp.c_str(), m_dump_path.c_str());
+    }
+
+  private:
+    static int listenOn(const std::string& endpoint){
+      int sockfd = -1;
+      auto fail = [&sockfd](){
+                    int err = errno; // for the caller
+                    close(sockfd);
+                    errno = err;
+                    return -1;
+                  };
+      if(endpoint.compare(0, 5, "unix:") == 0){
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, endpoint.c_str() + 5, sizeof(addr.sun_path) - 1);
+        unlink(addr.sun_path);
+        sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(sockfd < 0){
+          return -1;
+        }
+        if(bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+          return fail();
+        }
+      }
+      else{
+        size_t colon = endpoint.rfind(':');
+        std::string host = colon == std::string::npos? "127.0.0.1" : endpoint.substr(0, colon);
+        uint16_t port = std::stoul(colon == std::string::npos? endpoint : endpoint.substr(colon + 1));
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = inet_addr(host.c_str());
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if(sockfd < 0){
+          return -1;
+        }
+        int one = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+          return fail();
+        }
+      }
+      if(listen(sockfd, 4) != 0){
+        return fail();
+      }
+      return sockfd;
+    }
+
+    void serveClient(int sockfd){
+      timeval tv_timeout;
+      tv_timeout.tv_sec = 0;
+      tv_timeout.tv_usec = 200000;
+      setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv_timeout, sizeof(tv_timeout));
+      std::string req;
+      char buf[1024];
+      while(req.find("\r\n\r\n") == std::string::npos && req.size() < 8192){
+        ssize_t n = recv(sockfd, buf, sizeof(buf), 0);
+        if(n <= 0){
+          break;
+        }
+        req.append(buf, n);
+      }
+      std::string status = "200 OK";
+      std::string type = "text/plain; version=0.0.4";
+      std::string body;
+      if(req.compare(0, 18, "GET /metrics.json ") == 0){
+        type = "application/json";
+        body = Registry::instance().json();
+      }
+      else if(req.compare(0, 13, "GET /metrics ") == 0 || req.compare(0, 6, "GET / ") == 0){
+        body = Registry::instance().prometheus();
+      }
+      else{
+        status = "404 Not Found";
+        body = "GET /metrics or /metrics.json\n";
+      }
+      std::string resp = "HTTP/1.0 " + status + "\r\nContent-Type: " + type +
+        "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+      const char *p = resp.data();
+      size_t len = resp.size();
+      while(len){
+        ssize_t n = send(sockfd, p, len, MSG_NOSIGNAL);
+        if(n <= 0){
+          break;
+        }
+        p += n;
+        len -= n;
+      }
+    }
+
+    void threadServe(){
+      auto tp_dump = std::chrono::steady_clock::now() + m_period;
+      while(m_is_running){
+        if(m_sock >= 0){
+          struct pollfd pfd;
+          pfd.fd = m_sock;
+          pfd.events = POLLIN;
+          if(poll(&pfd, 1, 100) > 0){
+            int sockfd = accept(m_sock, nullptr, nullptr);
+            if(sockfd >= 0){
+              serveClient(sockfd);
+              close(sockfd);
+            }
+          }
+        }
+        else{
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if(!m_dump_path.empty() && std::chrono::steady_clock::now() >= tp_dump){
+          dump();
+          tp_dump += m_period;
+        }
+      }
+    }
+
+    std::string m_endpoint;
+    std::string m_dump_path;
+    std::chrono::milliseconds m_period;
+    int m_sock{-1};
+    std::atomic<bool> m_is_running{true};
+    std::thread m_thread;
+  };
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef MYQUEUE_H_
+#define MYQUEUE_H_
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Blocking FIFO with fixed capacity, for handing work between threads.
+// push() blocks while full, pop() blocks while empty.
+// After close(), push() fails and pop() drains the remaining items, then fails.
+template<typename T>
+class BoundedQueue{
+public:
+  explicit BoundedQueue(size_t capacity)
+    :m_capacity(capacity>0? capacity : 1){};
+
+  bool push(T&& item){
+    std::unique_lock<std::mutex> lk(m_mtx);
+    m_cv_not_full.wait(lk, [&]{return m_closed || m_queue.size() < m_capacity;});
+    if(m_closed){
+      return false;
+    }
+    m_queue.push_back(std::move(item));
+    lk.unlock();
+    m_cv_not_empty.notify_one();
+    return true;
+  }
+
+  bool pop(T& item){
+    std::unique_lock<std::mutex> lk(m_mtx);
+    m_cv_not_empty.wait(lk, [&]{return m_closed || !m_queue.empty();});
+    if(m_queue.empty()){
+      return false;
+    }
+    item = std::move(m_queue.front());
+    m_queue.pop_front();
+    lk.unlock();
+    m_cv_not_full.notify_one();
+    return true;
+  }
+
+  void close(){
+    {
+      std::lock_guard<std::mutex> lk(m_mtx);
+      m_closed = true;
+    }
+    m_cv_not_full.notify_all();
+    m_cv_not_empty.notify_all();
+  }
+
+  size_t size(){
+    std::lock_guard<std::mutex> lk(m_mtx);
+    return m_queue.size();
+  }
+
+private:
+  size_t m_capacity;
+  bool m_closed{false};
+  std::deque<T> m_queue;
+  std::mutex m_mtx;
+  std::condition_variable m_cv_not_full;
+  std::condition_variable m_cv_not_empty;
+};
+
+#endif
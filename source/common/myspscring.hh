@@ -0,0 +1,205 @@
+#ifndef MYSPSCRING_H_
+#define MYSPSCRING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+// Single-producer single-consumer ring.
+//
+// The producer owns m_write, the consumer owns m_read. A slot is published by
+// a release store of m_write after it is written, and handed back by a
+// release store of m_read after it is reset, the other side loads with
+// acquire. Both counters sit on their own cache line together with the
+// owner's cached copy of the other counter, so the hot path touches the
+// shared line only when the cache runs out.
+//
+// A consumer can block in wait_for(); the producer only takes the mutex when
+// the consumer announced it is waiting.
+template<typename T>
+class SpscRing{
+public:
+  static constexpr size_t s_cache_line = 64;
+
+  // capacity is rounded up to power of 2
+  explicit SpscRing(size_t capacity){
+    size_t n = 1;
+    while(n < capacity){
+      n <<= 1;
+    }
+    m_buf.resize(n);
+    m_mask = n - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  size_t capacity() const {return m_mask + 1;}
+
+  // approximate unless called by producer or consumer
+  size_t size() const {
+    return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire);
+  }
+
+  bool empty() const {return size() == 0;}
+
+  ///////////// producer
+  // false when the ring is full, item is untouched then
+  bool push(T&& item){
+    uint64_t w = m_write.load(std::memory_order_relaxed);
+    if(w - m_read_cached == capacity()){
+      m_read_cached = m_read.load(std::memory_order_acquire);
+      if(w - m_read_cached == capacity()){
+        return false;
+      }
+    }
+    m_buf[w & m_mask] = std::move(item);
+    m_write.store(w + 1, std::memory_order_release);
+    notify_if_waiting();
+    return true;
+  }
+
+  bool push(const T& item){
+    T copy(item);
+    return push(std::move(copy));
+  }
+
+  // moves up to n items from first, returns number of moved items
+  template<typename It>
+  size_t push_batch(It first, size_t n){
+    uint64_t w = m_write.load(std::memory_order_relaxed);
+    size_t space = capacity() - (w - m_read_cached);
+    if(space < n){
+      m_read_cached = m_read.load(std::memory_order_acquire);
+      space = capacity() - (w - m_read_cached);
+    }
+    size_t m = n < space ? n : space;
+    for(size_t i = 0; i < m; i++, ++first){
+      m_buf[(w + i) & m_mask] = std::move(*first);
+    }
+    if(m){
+      m_write.store(w + m, std::memory_order_release);
+      notify_if_waiting();
+    }
+    return m;
+  }
+
+  ///////////// consumer
+  // nullptr when the ring is empty
+  T* front(){
+    uint64_t r = m_read.load(std::memory_order_relaxed);
+    if(r == m_write_cached){
+      m_write_cached = m_write.load(std::memory_order_acquire);
+      if(r == m_write_cached){
+        return nullptr;
+      }
+    }
+    return &m_buf[r & m_mask];
+  }
+
+  // slot is reset, so shared objects are released at pop
+  void pop(){
+    uint64_t r = m_read.load(std::memory_order_relaxed);
+    if(r == m_write_cached){
+      m_write_cached = m_write.load(std::memory_order_acquire);
+      if(r == m_write_cached){
+        return;
+      }
+    }
+    m_buf[r & m_mask] = T();
+    m_read.store(r + 1, std::memory_order_release);
+  }
+
+  bool pop(T& item){
+    T* p = front();
+    if(!p){
+      return false;
+    }
+    item = std::move(*p);
+    pop();
+    return true;
+  }
+
+  // moves up to maxN items to out, returns number of moved items
+  template<typename OutIt>
+  size_t pop_batch(OutIt out, size_t maxN){
+    uint64_t r = m_read.load(std::memory_order_relaxed);
+    size_t avail = m_write_cached - r;
+    if(avail < maxN){
+      m_write_cached = m_write.load(std::memory_order_acquire);
+      avail = m_write_cached - r;
+    }
+    size_t m = maxN < avail ? maxN : avail;
+    for(size_t i = 0; i < m; i++, ++out){
+      T& slot = m_buf[(r + i) & m_mask];
+      *out = std::move(slot);
+      slot = T();
+    }
+    if(m){
+      m_read.store(r + m, std::memory_order_release);
+    }
+    return m;
+  }
+
+  // drops all items, safe while the producer is running
+  void clear(){
+    while(front()){
+      pop();
+    }
+  }
+
+  // blocks until an item is available or timeout, returns !empty
+  template<typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period>& timeout){
+    if(front()){
+      return true;
+    }
+    std::unique_lock<std::mutex> lk(m_mtx_wait);
+    m_consumer_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_cv_wait.wait_for(lk, timeout, [&]{return front() != nullptr || m_wakeup;});
+    m_consumer_waiting.store(false, std::memory_order_relaxed);
+    m_wakeup = false;
+    return front() != nullptr;
+  }
+
+  // wakes a waiting consumer, e.g. for shutdown
+  void notify(){
+    {
+      std::lock_guard<std::mutex> lk(m_mtx_wait);
+      m_wakeup = true;
+    }
+    m_cv_wait.notify_one();
+  }
+
+private:
+  void notify_if_waiting(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_consumer_waiting.load(std::memory_order_relaxed)){
+      {
+        std::lock_guard<std::mutex> lk(m_mtx_wait);
+      }
+      m_cv_wait.notify_one();
+    }
+  }
+
+  alignas(s_cache_line) std::atomic<uint64_t> m_write{0};
+  uint64_t m_read_cached{0};  // producer's copy of m_read
+
+  alignas(s_cache_line) std::atomic<uint64_t> m_read{0};
+  uint64_t m_write_cached{0}; // consumer's copy of m_write
+
+  alignas(s_cache_line) std::atomic<bool> m_consumer_waiting{false};
+  bool m_wakeup{false};
+  std::mutex m_mtx_wait;
+  std::condition_variable m_cv_wait;
+
+  alignas(s_cache_line) std::vector<T> m_buf;
+  size_t m_mask{0};
+};
+
+#endif
@@ -1,13 +1,13 @@
-#include "TelEventTTreeWriter.hpp"
+#include "TelEventTTreeStreamWriter.hpp"
 #include "TelActs.hh"
 #include "getopt.h"
 #include "myrapidjson.h"
 
-#include "eudaq/FileReader.hh"
-#include "CvtEudaqAltelRaw.hh"
+#include "EudaqRawReader.hh"
 
 #include <numeric>
 #include <chrono>
+#include <thread>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -36,6 +36,11 @@ Usage:
   -rootFile       <PATH>            path to root file (output)
   -particleEnergy <FLOAT>           energy of beam particle, electron, (Gev)
   -targetIds    <<INT0> [INT1]...>  IDs of target detector which are complectely excluded from track fitting. Residual are caculated.
+  -nThreads       <INT>             number of eudaq raw decoding threads (default: number of cores)
+
+root file: written while running, ALTEL_TTREE_AUTOFLUSH, ALTEL_TTREE_AUTOSAVE (TTree entries if >0, bytes if <0),
+           ALTEL_TTREE_BASKETSIZE (bytes), ALTEL_TTREE_COMPRESSION (algorithm*100+level) and ALTEL_TTREE_QUEUE (events) tune it,
+           ALTEL_TTREE_DROP (raws,dirs,resids) leaves out raw pixel, fit direction and residual branches
 
 examples:
 ./bin/TelDetectorResidual -eudaqFiles eudaqRaw/altel_Run069017_200824002945.raw -geometryFile calice_geo_align4.json -rootFile detresid.root -targetIds 5 -eventMax 10000
@@ -56,6 +61,7 @@ int main(int argc, char *argv[]) {
   std::vector<std::string> rawFilePathCol;
   std::string geometryFilePath;
   std::string rootFilePath;
+  size_t threadNum = std::thread::hardware_concurrency();
 
   double particleQ = 1;
   double particleMass = 0.511 * Acts::UnitConstants::MeV;
@@ -77,6 +83,7 @@ int main(int argc, char *argv[]) {
                                 {"geometryFile", required_argument, NULL, 'g'},
                                 {"particleEnergy", required_argument, NULL, 'e'},
                                 {"targetIds", required_argument, NULL, 'd'},
+                                {"nThreads", required_argument, NULL, 'j'},
                                 {0, 0, 0, 0}};
 
     if(argc == 1){
@@ -115,6 +122,9 @@ int main(int argc, char *argv[]) {
       case 'e':
         particleEnergy = std::stod(optarg) * Acts::UnitConstants::GeV;
         break;
+      case 'j':
+        threadNum = std::stoul(optarg);
+        break;
       case 'd':{
         //optind is increased by 2 when option is set to required_argument
         for(int i = optind-1; i < argc && *argv[i] != '-'; i++){
@@ -327,57 +337,35 @@ int main(int argc, char *argv[]) {
   pOptions.mass = particleMass;
 
   auto kfLogger = Acts::getDefaultLogger("CKF", logLevel);
-  Acts::CombinatorialKalmanFilterOptions<Acts::CKFSourceLinkSelector> ckfOptions(
+  TelActs::CKFOptions ckfOptions(
     gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions,
     refSurface.get());
 
-  altel::TelEventTTreeWriter ttreeWriter;
-  TTree *pTree = new TTree("eventTree", "eventTree");
-  ttreeWriter.setTTree(pTree);
+  altel::TelEventTTreeStreamWriter ttreeWriter(rootFilePath);
 
   TelFW telfw(800, 400, "test");
   glfw_test telfwtest(geometryFilePath);
   telfw.startAsync<glfw_test>(&telfwtest, &glfw_test::beginHook, &glfw_test::clearHook, &glfw_test::drawHook);
 
-  uint32_t rawFileNum=0;
-  size_t readEventNum = 0;
   size_t emptyEventNum = 0;
   size_t eventNum = 0;
   size_t trackNum = 0;
   size_t droppedTrackNum = 0;
   auto tp_start = std::chrono::system_clock::now();
 
-  eudaq::FileReaderUP reader;
+  std::fprintf(stdout, "processing %zu raw files\n", rawFilePathCol.size());
+  altel::EudaqRawReader rawreader(rawFilePathCol, threadNum, eventSkipNum);
 
   while(1){
     if(eventNum> eventMaxNum && eventMaxNum>0){
       break;
     }
-    if(!reader){
-      if(rawFileNum<rawFilePathCol.size()){
-        std::fprintf(stdout, "processing raw file: %s\n", rawFilePathCol[rawFileNum].c_str());
-        reader = eudaq::Factory<eudaq::FileReader>::MakeUnique(eudaq::str2hash("native"), rawFilePathCol[rawFileNum]);
-        rawFileNum++;
-      }
-      else{
-        std::fprintf(stdout, "processed %d raw files, quit\n", rawFileNum);
-        break;
-      }
-    }
-    auto eudaqEvent = reader->GetNextEvent();
-    if(!eudaqEvent){
-      reader.reset();
-      continue; // goto for next raw file
-    }
-    // std::cout<<"reading"<<std::endl;
-
-    readEventNum++;
-    if(readEventNum<=eventSkipNum){
-      continue;
+    std::shared_ptr<altel::TelEvent> fullEvent = rawreader.GetNextEvent();
+    if(!fullEvent){
+      std::fprintf(stdout, "processed %zu raw files, quit\n", rawFilePathCol.size());
+      break;
     }
     eventNum++;
-
-    std::shared_ptr<altel::TelEvent> fullEvent  = altel::createTelEvent(eudaqEvent);
     // TODO test nullptr
     std::shared_ptr<altel::TelEvent> detEvent(new altel::TelEvent(fullEvent->runN(),
                                                                   fullEvent->eveN(),
@@ -441,9 +429,7 @@ int main(int argc, char *argv[]) {
   std::fprintf(stdout, "event rate: %.0fhz, non-empty event rate: %.0fhz, empty event rate: %.0fhz, track rate: %.0fhz\n",
                eventNum/time_s, (eventNum-emptyEventNum)/time_s, emptyEventNum/time_s, trackNum/time_s);
 
-  TFile tfile(rootFilePath.c_str(),"recreate");
-  pTree->Write();
-  tfile.Close();
+  ttreeWriter.close();
 
   if(do_wait){
     std::cout<<"waiting, press any key to conitnue"<<std::endl;
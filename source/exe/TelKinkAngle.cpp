@@ -1,10 +1,14 @@
 #include "TelEventTTreeWriter.hpp"
+#include "TelEventBinary.hpp"
+#include "TelEventJson.hpp"
 #include "TelActs.hh"
 #include "getopt.h"
 #include "myrapidjson.h"
 
 #include <numeric>
 #include <chrono>
+#include <regex>
+#include <thread>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -29,7 +33,7 @@ Usage:
   -eventSkip      <int>        number of events to skip before start processing
   -eventMax       <int>        max number of events to process
   -geometryFile   <path>       path to geometry input file (input)
-  -hitFile        <path>       path data input file (input)
+  -hitFile        <path>       path data input file, json or TelEvent binary .teb (input)
   -rootFile       <path>       path to root file (output)
   -particleEnergy <float>      energy of beam particle, electron, (Gev)
   -targetId       <int>...     IDs of target detector which are complectely excluded from track fitting. Residual are caculated.
@@ -302,7 +306,7 @@ int main(int argc, char *argv[]) {
   pOptions.mass = particleMass;
 
   auto kfLogger = Acts::getDefaultLogger("CKF", logLevel);
-  Acts::CombinatorialKalmanFilterOptions<Acts::CKFSourceLinkSelector> ckfOptions(
+  TelActs::CKFOptions ckfOptions(
     gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions,
     refSurface.get());
 
@@ -314,14 +318,28 @@ int main(int argc, char *argv[]) {
   TProfile2D *tp2Kink=new TProfile2D("tp2Kink","tp2Kink", 300, -15.0, 15.0 , 150, -7.5, 7.5);
   TH1F *hkink_angle =  new TH1F("hkink_angle", " hkink_angle;kA_{dir_after-dir_before};Entries [100bin]", 100, -0.001, 0.001);
 
-  JsonFileDeserializer jsfd(hitFilePath);
+  std::unique_ptr<altel::TelEventJsonReader> jsreader;
+  std::unique_ptr<altel::TelEventBinaryReader> binreader;
+  size_t binEventN = 0;
  // eudaq::FileReaderUP reader(daqFilePath);
-  
-  for(size_t i=0; i< eventSkipNum; i++){
-    auto evpack = jsfd.getNextJsonDocument();
-    if(evpack.IsNull()){
-      std::fprintf(stdout, "reach null object after skip %d event, possible end of file\n", i);
+  if(std::regex_match(hitFilePath, std::regex("\\S+.teb"))){
+    binreader.reset(new altel::TelEventBinaryReader(hitFilePath));
+    binEventN = eventSkipNum;
+  }
+  else{
+    jsreader.reset(new altel::TelEventJsonReader(hitFilePath, std::thread::hardware_concurrency()));
+    if(eventSkipNum >= jsreader->numEvents()){
+      std::fprintf(stdout, "reach end of file after skip %zu event\n", jsreader->numEvents());
     }
+    jsreader->setNextEvent(eventSkipNum);
+  }
+  std::vector<uint16_t> detId_dets;
+  for(auto &[detId, planeLayer] :mapDetId2PlaneLayer_dets){
+    detId_dets.push_back(detId);
+  }
+  std::vector<uint16_t> detId_targets;
+  for(auto &[detId, planeLayer] :mapDetId2PlaneLayer_targets){
+    detId_targets.push_back(detId);
   }
 
 
@@ -330,13 +348,33 @@ int main(int argc, char *argv[]) {
   size_t trackNum = 0;
   size_t droppedTrackNum = 0;
   auto tp_start = std::chrono::system_clock::now();
-  while(jsfd && (eventNum< eventMaxNum || eventMaxNum<0)){
-
-    auto evpack = jsfd.getNextJsonDocument();
-    if(evpack.IsNull()){
-      std::fprintf(stdout, "reach null object, possible end of file\n");
+  while(eventNum< eventMaxNum || eventMaxNum<0){
+    size_t runN = 0;
+    size_t setupN = 0;
+    std::shared_ptr<altel::TelEvent> detEvent;
+    std::shared_ptr<altel::TelEvent> targetEvent;
+    std::shared_ptr<altel::TelEvent> fullEvent;
+    if(binreader){
+      fullEvent = binreader->createTelEvent(binEventN++);
+    }
+    else{
+      fullEvent = jsreader->createNextTelEvent();
+    }
+    if(!fullEvent){
+      std::fprintf(stdout, "reach end of file\n");
       break;
     }
+    detEvent.reset(new altel::TelEvent(runN, eventNum, setupN, fullEvent->clkN()));
+    detEvent->measHits() = fullEvent->measHits(detId_dets);
+    targetEvent.reset(new altel::TelEvent(runN, eventNum, setupN, fullEvent->clkN()));
+    targetEvent->measHits() = fullEvent->measHits(detId_targets);
+    if(do_verbose){
+      std::fprintf(stdout, "\n\n\n");
+      for(const auto &aMeasHit: fullEvent->measHits()){
+        std::fprintf(stdout, "[%f, %f, %d] ", aMeasHit->u(), aMeasHit->v(), aMeasHit->detN());
+      }
+      std::fprintf(stdout, "\n");
+    }
  
   /*  //-------------------------------------------------
     auto eudaqEvent = reader->GetNextEvent();
@@ -346,9 +384,6 @@ int main(int argc, char *argv[]) {
     }
     //-----------------------------------------------
     */
-    size_t runN = 0;
-    size_t setupN = 0;
-    std::shared_ptr<altel::TelEvent> detEvent  = TelActs::createTelEvent(evpack, runN, eventNum, setupN, mapDetId2PlaneLayer_dets);
     std::vector<TelActs::TelSourceLink> sourcelinks  = TelActs::createSourceLinks(detEvent, mapDetId2PlaneLayer_dets);
 
     if(sourcelinks.empty()) {
@@ -357,13 +392,6 @@ int main(int argc, char *argv[]) {
       continue;
     }
 
-    if(do_verbose){
-      std::fprintf(stdout, "\n\n\n");
-      for(const auto& l: evpack["layers"].GetArray()){
-        JsonUtils::printJsonValue(l, false);
-      }
-    }
-
     ////////////////////////////////
     auto result = trackFindFun(sourcelinks, seedParameters, ckfOptions);
     if (!result.ok()){
@@ -374,7 +402,6 @@ int main(int argc, char *argv[]) {
 
     TelActs::fillTelTrajectories(gctx, result.value(), detEvent, mapGeoId2DetId);
 
-    std::shared_ptr<altel::TelEvent> targetEvent  = TelActs::createTelEvent(evpack, runN, eventNum, setupN, mapDetId2PlaneLayer_targets);
     TelActs::mergeAndMatchExtraTelEvent(detEvent, targetEvent, 100_um, 3);
 
     for(auto &aTraj: detEvent->TJs){
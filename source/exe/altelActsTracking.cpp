@@ -1,15 +1,21 @@
-#include "TelEventTTreeWriter.hpp"
+#include "TelEventTTreeStreamWriter.hpp"
+#include "TelEventBinary.hpp"
+#include "TelEventJson.hpp"
 #include "TelActs.hh"
+#include "TelStraightLineFinder.hpp"
+#include "TelSeedFinder.hpp"
 #include "getopt.h"
 #include "myrapidjson.h"
 
-#include "eudaq/FileReader.hh"
-#include "CvtEudaqAltelRaw.hh"
+#include "EudaqRawReader.hh"
 
 #include <numeric>
 #include <chrono>
 #include <regex>
+#include <thread>
+#include <condition_variable>
 
+#include <TROOT.h>
 #include <TFile.h>
 #include <TTree.h>
 #include <Math/SpecFunc.h>
@@ -23,6 +29,8 @@
 
 #include "linenoise.h"
 #include "myrapidjson.h"
+#include "myqueue.hh"
+#include "mymetrics.hh"
 
 using namespace Acts::UnitLiterals;
 
@@ -37,7 +45,17 @@ Usage:
   -beamSize       <FLOAT>           mm, size of beam collimator (default 40)
   -beamPosition   <FLOAT>           mm, positon beam collimator (range [-5000 5000],  default -5000). Direction is toward ORIGIN point
   -beamEnergy     <FLOAT>           energy of beam particle, electron, (Gev, default 5)
-  -daqFiles  <<PATH0> [PATH1]...>   paths to input daq data files (input). old option -eudaqFiles
+  -seedAtCollimator                 start track finding at beamPosition, as before, instead of just upstream of the first plane
+  -seeding        <beam|pair|triplet> CKF seeds: one seed as wide as the beam with 10 branches on the first plane, or one
+                                    narrow seed per hit pair of the first and third plane, confirmed by a hit on the second
+                                    plane for triplet, with duplicate tracks removed. A particle missed by one of these
+                                    planes is seeded from the other two, an event without any pair from the beam
+                                    (default beam)
+  -seedAngle      <FLOAT>           mrad, max angle of pair and triplet seeds to the beam axis (default 10)
+  -matchPolicy    <greedy|optimal|closest>
+                                    matching of target hits to tracks within 400 um, one to one by closest pairs first or
+                                    most pairs with least total distance, or the closest hit per track (default greedy)
+  -daqFiles  <<PATH0> [PATH1]...>   paths to input daq data files, eudaq raw, json or TelEvent binary .teb (input). old option -eudaqFiles
   -rootFile       <PATH>            path to out root file of reconstructed trajactories (output)
   -includeIds   <<INT0> [INT1]...>  IDs of detector contrubuted to track fitting. If not set, all detector geometries are set as the geometry file.
   -excludeIds   <<INT0> [INT1]...>  IDs of detector which are complectely excluded from track fitting. Detector geometry is excluded.
@@ -46,6 +64,19 @@ Usage:
   -cutChiSquared  <FLOAT>           cut of 2-DoF Chi-Squared PDF (default 13.816 <cdf=0.999>). Override default cutProbability.
   -planeSiThick  <INT_ID> <FLOAT_THICK> mm, silicon thickness of a layer
   -siThick  <FLOAT>                 mm, silicon thickness when option planeSiThick does not assign the thickness to a layer. (default 0.1 , using geometry file if negetive value)
+  -nThreads       <INT>             number of track finding threads. 1 reader + N workers + 1 writer when N>1 (default 1, serial)
+                                    eudaq raw files are decoded by N threads as well
+  -trackEngine    <ckf|line>        track finding by Acts CombinatorialKalmanFilter, or by closed-form straight line fits
+                                    for runs without magnetic field, with the same hit selection (default ckf)
+  -compareEngines                   run both engines per event, write the tracks of -trackEngine and print per detector
+                                    residuals of both and the difference of their fitted positions at the end
+
+root file: written while running, ALTEL_TTREE_AUTOFLUSH, ALTEL_TTREE_AUTOSAVE (TTree entries if >0, bytes if <0),
+           ALTEL_TTREE_BASKETSIZE (bytes), ALTEL_TTREE_COMPRESSION (algorithm*100+level) and ALTEL_TTREE_QUEUE (events) tune it,
+           ALTEL_TTREE_DROP (raws,dirs,resids) leaves out raw pixel, fit direction and residual branches
+
+metrics: set ALTEL_METRICS_ENDPOINT (127.0.0.1:9100 or unix:<PATH>) to serve them over HTTP,
+         ALTEL_METRICS_DUMP <PATH> to rewrite them as json every ALTEL_METRICS_PERIOD_MS (default 1000)
 
 examples:
 ./altelActsTrack -cutChiSquared 13.816 -daqFiles ../../testbeam_data_2507/DATA/run000030.raw -geometryFile ../../testbeam_data_2507/RUN/geo_setup2_align3_0p04.json -rootFile  detresid.root -targetIds 32 -eventMax  1000000
@@ -77,6 +108,16 @@ int main(int argc, char *argv[]) {
   double cutProbability = 0.999;
   double cutChiSquared = 13.816;
 
+  size_t threadNum = 1;
+
+  bool seedAtCollimator = false;
+  bool isHitSeeding = false;
+  TelActs::TelSeedFinder::Config seedConf;
+  TelActs::TelHitMatcher::Policy matchPolicy = TelActs::TelHitMatcher::Policy::Greedy;
+
+  bool isLineEngine = false;
+  bool compareEngines = false;
+
   int do_wait = 0;
 
   int do_verbose = 0;
@@ -94,6 +135,10 @@ int main(int argc, char *argv[]) {
                                 {"beamEnergy", required_argument, NULL, 'e'},
                                 {"beamSize", required_argument, NULL, 'z'},
                                 {"beamPosition", required_argument, NULL, 'n'},
+                                {"seedAtCollimator", no_argument, NULL, 'a'},
+                                {"seeding", required_argument, NULL, 'x'},
+                                {"seedAngle", required_argument, NULL, 'y'},
+                                {"matchPolicy", required_argument, NULL, 'o'},
                                 {"includeIds", required_argument, NULL, 'i'},
                                 {"excludeIds", required_argument, NULL, 'p'},
                                 {"targetIds", required_argument, NULL, 'd'},
@@ -101,6 +146,9 @@ int main(int argc, char *argv[]) {
                                 {"cutChiSquared", required_argument, NULL, 'u'},
                                 {"planeSiThick", required_argument, NULL, 't'},
                                 {"siThick", required_argument, NULL, 'k'},
+                                {"nThreads", required_argument, NULL, 'j'},
+                                {"trackEngine", required_argument, NULL, 'l'},
+                                {"compareEngines", no_argument, NULL, 'q'},
                                 {0, 0, 0, 0}};
 
     if(argc == 1){
@@ -142,6 +190,21 @@ int main(int argc, char *argv[]) {
       case 'k':
         siThick = std::stod(optarg);
         break;
+      case 'j':
+        threadNum = std::stoul(optarg);
+        break;
+      case 'l':
+        if(std::string(optarg) == "line"){
+          isLineEngine = true;
+        }
+        else if(std::string(optarg) != "ckf"){
+          std::fprintf(stderr, "%s: unknown track engine %s\n", argv[0], optarg);
+          std::exit(1);
+        }
+        break;
+      case 'q':
+        compareEngines = true;
+        break;
       case 't':{
         optind--;
         std::vector<size_t> optindVec;
@@ -173,6 +236,31 @@ int main(int argc, char *argv[]) {
       case 'n':
         beamPosition = std::stod(optarg) * Acts::UnitConstants::mm;
         break;
+      case 'a':
+        seedAtCollimator = true;
+        break;
+      case 'x':
+        if(std::string(optarg) == "pair"){
+          isHitSeeding = true;
+          seedConf.tripletWindow = 0;
+        }
+        else if(std::string(optarg) == "triplet"){
+          isHitSeeding = true;
+        }
+        else if(std::string(optarg) != "beam"){
+          std::fprintf(stderr, "%s: unknown seeding %s\n", argv[0], optarg);
+          std::exit(1);
+        }
+        break;
+      case 'y':
+        seedConf.maxAngle = std::stod(optarg) * 0.001;
+        break;
+      case 'o':
+        if(!TelActs::TelHitMatcher::parsePolicy(optarg, matchPolicy)){
+          std::fprintf(stderr, "%s: unknown match policy %s\n", argv[0], optarg);
+          std::exit(1);
+        }
+        break;
       case 'd':{
         //optind is increased by 2 when option is set to required_argument
         for(int i = optind-1; i < argc && *argv[i] != '-'; i++){
@@ -246,6 +334,16 @@ int main(int argc, char *argv[]) {
     }
   }/////////getopt end////////////////
 
+  std::unique_ptr<mymetrics::Exporter> metricsExporter = mymetrics::Exporter::FromEnv();
+  auto& mt = mymetrics::Registry::instance();
+  auto& mtEvents = mt.counter("trk_events_total", "events through track finding");
+  auto& mtCkfNs = mt.histogram("trk_ckf_ns", "combinatorial kalman filter track finding of one event");
+  auto& mtLineNs = mt.histogram("trk_line_ns", "straight line track finding of one event");
+  auto& mtMatchNs = mt.histogram("trk_match_ns", "matching of target detector hits to the tracks of one event");
+  auto& mtSeeds = mt.counter("trk_seeds_total", "pair and triplet seeds of track finding");
+  auto& mtDuplicates = mt.counter("trk_duplicates_total", "tracks of pair and triplet seeds removed as duplicates");
+  auto& mtBeamSeeds = mt.counter("trk_beam_seeds_total", "events seeded from the beam, without pair or triplet seed");
+
   if(hasCutProbability && !hasCutChiSquared){
     cutChiSquared = ROOT::Math::chisquared_quantile(cutProbability , 2);
   }
@@ -283,6 +381,8 @@ int main(int argc, char *argv[]) {
   std::fprintf(stdout, "cutProbability:   %f\n", cutProbability);
   std::fprintf(stdout, "cutChiSquared:    %f\n", cutChiSquared);
 
+  std::fprintf(stdout, "nThreads:         %zu\n", threadNum);
+  std::fprintf(stdout, "trackEngine:      %s%s\n", isLineEngine? "line" : "ckf", compareEngines? ", compared" : "");
   std::fprintf(stdout, "siThick:          %f\n", siThick);
   std::fprintf(stdout, "planeSiThick:");
   for(auto &[id, th]:   planeSiThick){
@@ -405,8 +505,34 @@ int main(int argc, char *argv[]) {
   std::fprintf(stdout, "elementN = %d, detN = %d, targetN = %d\n",
                mapDetId2PlaneLayer.size(), mapDetId2PlaneLayer_dets.size(), mapDetId2PlaneLayer_targets.size());
 
+  ///////////// beam configure
+  // The seed leaves the collimator along x toward the origin. Without field and material
+  // before the telescope, it is moved along the beam to just upstream of the first plane,
+  // with its covariance transported over the flight, so that CKF does not step through
+  // metres of empty world. The trajectories are the same.
+  double seedPhi = beamPosition<=0? 0: M_PI;
+  double seedTheta = 0.5*M_PI;
+  double seedX = beamPosition;
+  double seedFlight = 0;
+  {
+    const auto& firstLayer = beamPosition<=0? layerDets.front() : layerDets.back(); // x sorted layers
+    double firstX = firstLayer->center(gctx).x();
+    double firstUpstreamX = beamPosition<=0?
+      firstX - 0.5*firstLayer->thickness() - 10_mm : firstX + 0.5*firstLayer->thickness() + 10_mm;
+    if(!seedAtCollimator && std::abs(firstUpstreamX) < std::abs(beamPosition)){
+      seedX = firstUpstreamX;
+      seedFlight = std::abs(beamPosition - seedX);
+    }
+  }
+  std::fprintf(stdout, "seed:             x = %.1f mm, %.1f mm downstream of beamPosition\n", seedX, seedFlight);
+
+  // world only as long as the planes and the seed need
+  double worldHalfX = std::abs(seedX);
+  for(auto& aPlaneLayer: allPlaneLayers){
+    worldHalfX = std::max(worldHalfX, std::abs(aPlaneLayer->center(gctx).x()) + 0.5*aPlaneLayer->thickness());
+  }
   std::shared_ptr<const Acts::TrackingGeometry> worldGeo =
-    TelActs::createWorld(gctx, 11.0_m, 0.1_m, 0.1_m,  allPlaneLayers);
+    TelActs::createWorld(gctx, 2*(worldHalfX + 10_mm), 0.1_m, 0.1_m,  allPlaneLayers);
 // geometry closed, geometry ID only valid after geometry closing
 
   std::map<Acts::GeometryIdentifier, size_t> mapGeoId2DetId;
@@ -416,11 +542,7 @@ int main(int argc, char *argv[]) {
   }
 
 
-  ///////////// beam configure
-  // TODO: get first layer from geometry , and configure Phi/theta
-  double seedPhi = beamPosition<=0? 0: M_PI;
-  double seedTheta = 0.5*M_PI;
-  Acts::Vector4D seedPos4(beamPosition, 0, 0, 0);
+  Acts::Vector4D seedPos4(seedX, 0, 0, 0);
 
   double seedResX = 0.5*beamSize;
   double seedResY = 0.5*beamSize;
@@ -441,6 +563,13 @@ int main(int argc, char *argv[]) {
     0.,       0.,       0.,         0.,           0.0001, 0.,
     0.,       0.,       0.,         0.,           0.,     1.;
 
+  // straight line transport: loc0 = loc0 + flight*phi, loc1 = loc1 - flight*theta
+  // in the curvilinear frame of a track along +x or -x
+  seedCov(0, 0) += seedFlight * seedFlight * seedResPhi2;
+  seedCov(0, 2) = seedCov(2, 0) = seedFlight * seedResPhi2;
+  seedCov(1, 1) += seedFlight * seedFlight * seedResTheta2;
+  seedCov(1, 3) = seedCov(3, 1) = -seedFlight * seedResTheta2;
+
   Acts::CurvilinearTrackParameters seedParameters(seedPos4, seedPhi, seedTheta,
                                                   beamEnergy, particleQ, seedCov);
 
@@ -448,10 +577,23 @@ int main(int argc, char *argv[]) {
   ///////////// trackfind conf
   auto trackFindFun = TelActs::makeTrackFinderFunction(worldGeo, magneticField);
 
+  TelActs::TelStraightLineFinder::Config lineConf;
+  lineConf.beamPosition = beamPosition;
+  lineConf.seedResX = seedResX;
+  lineConf.seedResY = seedResY;
+  lineConf.seedResPhi = seedResPhi;
+  lineConf.seedResTheta = seedResTheta;
+  lineConf.beamEnergy = beamEnergy;
+  lineConf.particleMass = particleMass;
+  lineConf.particleQ = particleQ;
+  lineConf.cutChiSquared = cutChiSquared;
+
   std::vector<Acts::CKFSourceLinkSelector::Config::InputElement> ckfConfigEle_vec;
   for(auto& [detId, aPlaneLayer]: mapDetId2PlaneLayer){
     if( beamPosition<=0? aPlaneLayer==layerDets.front() : aPlaneLayer==layerDets.back()){ // x sorted layers
-      ckfConfigEle_vec.push_back({aPlaneLayer->geometryId(), {cutChiSquared,10}}); //first layer can have multi-branches
+      // first layer can have multi-branches, one per seed instead with pair and triplet seeds
+      ckfConfigEle_vec.push_back({aPlaneLayer->geometryId(), {cutChiSquared, isHitSeeding? size_t(1) : size_t(10)}});
+      lineConf.maxBranches[detId] = 10;
     }
     else{
       ckfConfigEle_vec.push_back({aPlaneLayer->geometryId(), {cutChiSquared,1}}); //chi2, max branches
@@ -459,25 +601,28 @@ int main(int argc, char *argv[]) {
   }
   Acts::CKFSourceLinkSelector::Config sourcelinkSelectorCfg(ckfConfigEle_vec);
 
+  // beam prior and material from the same geometry as CKF, the seed is not moved for it
+  TelActs::TelStraightLineFinder lineFinder(lineConf, TelActs::TelStraightLineFinder::createPlanes(gctx, mapDetId2PlaneLayer));
+
+  seedConf.beamPosition = beamPosition;
+  seedConf.beamEnergy = beamEnergy;
+  seedConf.particleQ = particleQ;
+  std::unique_ptr<TelActs::TelSeedFinder> seedFinder;
+  if(isHitSeeding){
+    seedFinder.reset(new TelActs::TelSeedFinder(seedConf, gctx, mapDetId2PlaneLayer_dets));
+  }
+
   Acts::PropagatorPlainOptions pOptions;
   pOptions.maxSteps = 10000;
   pOptions.mass = particleMass;
 
-  auto kfLogger = Acts::getDefaultLogger("CKF", logLevel);
-  Acts::CombinatorialKalmanFilterOptions<Acts::CKFSourceLinkSelector> ckfOptions(
-    gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions,
-    nullptr);
-
-  altel::TelEventTTreeWriter ttreeWriter;
-  TTree *pTree = new TTree("eventTree", "eventTree");
-  ttreeWriter.setTTree(pTree);
+  altel::TelEventTTreeStreamWriter ttreeWriter(rootFilePath);
 
   // TelFW telfw(800, 400, "test");
   // glfw_test telfwtest(geometryFilePath);
   // telfw.startAsync<glfw_test>(&telfwtest, &glfw_test::beginHook, &glfw_test::clearHook, &glfw_test::drawHook);
 
   uint32_t rawFileNum=0;
-  size_t readEventNum = 0;
   size_t emptyEventNum = 0;
   size_t eventNum = 0;
   size_t trackNum = 0;
@@ -485,63 +630,177 @@ int main(int argc, char *argv[]) {
   size_t goodEventNum = 0;
   auto tp_start = std::chrono::system_clock::now();
 
-  eudaq::FileReaderUP reader;
-  std::unique_ptr<JsonFileDeserializer> jsreader;
+  std::unique_ptr<altel::EudaqRawReader> rawreader;
+  std::unique_ptr<altel::TelEventJsonReader> jsreader;
+  std::unique_ptr<altel::TelEventBinaryReader> binreader;
+  size_t binEventN = 0;
+  size_t fileSkipNum = eventSkipNum;
 
   bool is_eudaq_raw = true;
+  bool is_binary = false;
   if(std::regex_match(rawFilePathCol.front(), std::regex("\\S+.json")) ){
     is_eudaq_raw= false;
   }
-  while(1){
-    if(eventNum> eventMaxNum && eventMaxNum>0){
-      break;
-    }
+  if(std::regex_match(rawFilePathCol.front(), std::regex("\\S+.teb")) ){
+    is_eudaq_raw= false;
+    is_binary = true;
+  }
+
+  // one input event
+  struct EventTask{
+    size_t seqN{0};
+    size_t eventN{0};
     std::shared_ptr<altel::TelEvent> fullEvent;
-    if(is_eudaq_raw){
-      if(!reader){
-        if(rawFileNum<rawFilePathCol.size()){
-          std::fprintf(stdout, "processing raw file: %s\n", rawFilePathCol[rawFileNum].c_str());
-          reader = eudaq::Factory<eudaq::FileReader>::MakeUnique(eudaq::str2hash("native"), rawFilePathCol[rawFileNum]);
-          rawFileNum++;
+  };
+
+  // reads next event, returns false at end of input
+  auto readNextEvent = [&](EventTask& task)->bool{
+    task = EventTask();
+    while(1){
+      if(eventNum> eventMaxNum && eventMaxNum>0){
+        return false;
+      }
+      if(is_eudaq_raw){
+        if(!rawreader){
+          std::fprintf(stdout, "processing %zu raw files\n", rawFilePathCol.size());
+          // skipped events are not decoded
+          rawreader.reset(new altel::EudaqRawReader(rawFilePathCol, std::max<size_t>(threadNum, 1), eventSkipNum));
         }
-        else{
-          std::fprintf(stdout, "processed %d raw files, quit\n", rawFileNum);
-          break;
+        auto fullEvent = rawreader->GetNextEvent();
+        if(!fullEvent){
+          std::fprintf(stdout, "processed %zu raw files, quit\n", rawFilePathCol.size());
+          return false;
         }
+        eventNum++;
+        task.fullEvent = fullEvent;
       }
-      auto eudaqEvent = reader->GetNextEvent();
-      if(!eudaqEvent){
-        reader.reset();
-        continue; // goto for next raw file
+      else if(is_binary){
+        if(!binreader){
+          if(rawFileNum<rawFilePathCol.size()){
+            std::fprintf(stdout, "processing binary file: %s\n", rawFilePathCol[rawFileNum].c_str());
+            binreader.reset(new altel::TelEventBinaryReader(rawFilePathCol[rawFileNum]));
+            rawFileNum++;
+            // skip by seeking, whole files are skipped without reading
+            binEventN = std::min(fileSkipNum, binreader->numEvents());
+            fileSkipNum -= binEventN;
+          }
+          else{
+            std::fprintf(stdout, "processed %d raw files, quit\n", rawFileNum);
+            return false;
+          }
+        }
+        auto fullEvent = binreader->createTelEvent(binEventN);
+        if(!fullEvent){
+          binreader.reset();
+          continue;
+        }
+        binEventN++;
+        eventNum++;
+        task.fullEvent = fullEvent;
       }
-      readEventNum++;
-      if(readEventNum<=eventSkipNum){
-        continue;
+      else{
+        if(!jsreader){
+          if(rawFileNum<rawFilePathCol.size()){
+            std::fprintf(stdout, "processing js file: %s\n", rawFilePathCol[rawFileNum].c_str());
+            jsreader.reset(new altel::TelEventJsonReader(rawFilePathCol[rawFileNum], std::max<size_t>(threadNum, 1)));
+            rawFileNum++;
+            size_t jsSkipNum = std::min(fileSkipNum, jsreader->numEvents());
+            jsreader->setNextEvent(jsSkipNum);
+            fileSkipNum -= jsSkipNum;
+          }
+          else{
+            std::fprintf(stdout, "processed %d raw files, quit\n", rawFileNum);
+            return false;
+          }
+        }
+        auto fullEvent = jsreader->createNextTelEvent();
+        if(!fullEvent){
+          jsreader.reset();
+          continue;
+        }
+        eventNum++;
+        fullEvent->EN = eventNum;
+        task.fullEvent = fullEvent;
       }
-      eventNum++;
-      fullEvent  = altel::createTelEvent(eudaqEvent);
+      task.seqN = eventNum;
+      task.eventN = eventNum;
+      return true;
     }
-    else{
-      if(!jsreader){
-        if(rawFileNum<rawFilePathCol.size()){
-          std::fprintf(stdout, "processing js file: %s\n", rawFilePathCol[rawFileNum].c_str());
-          jsreader.reset(new JsonFileDeserializer(rawFilePathCol[rawFileNum]));
-          rawFileNum++;
-        }
-        else{
-          std::fprintf(stdout, "processed %d raw files, quit\n", rawFileNum);
-          break;
+  };
+
+  // per detector sums of the engine comparison, residuals in u and v
+  struct CompareSum{
+    size_t n{0};
+    double s[2]{0, 0};
+    double s2[2]{0, 0};
+    void add(double du, double dv){
+      n++;
+      s[0] += du;
+      s[1] += dv;
+      s2[0] += du * du;
+      s2[1] += dv * dv;
+    }
+    double mean(size_t i) const {return n? s[i] / n : 0;}
+    double rms(size_t i) const {return n? std::sqrt(s2[i] / n) : 0;}
+  };
+  std::mutex mtxCompare;
+  std::map<uint16_t, CompareSum> compareResidCkf;
+  std::map<uint16_t, CompareSum> compareResidLine;
+  std::map<uint16_t, CompareSum> compareFitDiff;
+  size_t compareTrackCkf = 0;
+  size_t compareTrackLine = 0;
+  size_t compareTrackMatched = 0;
+
+  // tracks of both engines with the same measure hits are compared plane by plane
+  auto compareEvent = [&](const altel::TelEvent& ckfEvent, const altel::TelEvent& lineEvent){
+    auto trajKey = [](const altel::TelTrajectory& traj){
+                     std::vector<const altel::TelMeasHit*> key;
+                     for(auto &aTrajHit: traj.THs){
+                       if(aTrajHit->hasOriginMeasHit()){
+                         key.push_back(aTrajHit->FH->OM.get());
+                       }
+                     }
+                     return key;
+                   };
+    std::map<std::vector<const altel::TelMeasHit*>, std::shared_ptr<altel::TelTrajectory>> mapKey2CkfTraj;
+    for(auto &aTraj: ckfEvent.TJs){
+      mapKey2CkfTraj[trajKey(*aTraj)] = aTraj;
+    }
+    std::lock_guard<std::mutex> lk(mtxCompare);
+    for(auto &[event, sums]: {std::make_pair(&ckfEvent, &compareResidCkf), std::make_pair(&lineEvent, &compareResidLine)}){
+      for(auto &aTraj: event->TJs){
+        for(auto &aTrajHit: aTraj->THs){
+          if(aTrajHit->hasOriginMeasHit()){
+            auto &fh = *aTrajHit->FH;
+            (*sums)[fh.DN].add(fh.OM->PLs[0] - fh.PLs[0], fh.OM->PLs[1] - fh.PLs[1]);
+          }
         }
       }
-      auto evpack = jsreader->getNextJsonDocument();
-      if(evpack.IsNull()){
-        jsreader.reset();
+    }
+    compareTrackCkf += ckfEvent.TJs.size();
+    compareTrackLine += lineEvent.TJs.size();
+    for(auto &aTraj: lineEvent.TJs){
+      auto it = mapKey2CkfTraj.find(trajKey(*aTraj));
+      if(it == mapKey2CkfTraj.end()){
         continue;
       }
-      eventNum++;
-      fullEvent  = TelActs::createTelEvent(evpack, 0, eventNum, 0);
+      compareTrackMatched++;
+      for(auto &aTrajHit: aTraj->THs){
+        auto ckfTrajHit = it->second->trajHit(aTrajHit->DN);
+        if(!ckfTrajHit || !ckfTrajHit->hasFitHit()){
+          continue;
+        }
+        compareFitDiff[aTrajHit->DN].add(aTrajHit->FH->PLs[0] - ckfTrajHit->FH->PLs[0],
+                                         aTrajHit->FH->PLs[1] - ckfTrajHit->FH->PLs[1]);
+      }
     }
+  };
 
+  // tracking of one event, returns nullptr for event without any source link
+  auto processEvent = [&](EventTask& task,
+                          const TelActs::TrackFinderFunction& trackFind,
+                          const TelActs::CKFOptions& ckfOpt)->std::shared_ptr<altel::TelEvent>{
+    std::shared_ptr<altel::TelEvent> fullEvent = task.fullEvent;
     // TODO test nullptr
     std::shared_ptr<altel::TelEvent> detEvent(new altel::TelEvent(fullEvent->runN(),
                                                                   fullEvent->eveN(),
@@ -549,24 +808,58 @@ int main(int argc, char *argv[]) {
                                                                   fullEvent->clkN()));
     detEvent->measHits()=fullEvent->measHits(detId_dets);
     // std::shared_ptr<altel::TelEvent> detEvent  = TelActs::createTelEvent(evpack, runN, eventNum, setupN, mapDetId2PlaneLayer_dets);
-    std::vector<TelActs::TelSourceLink> sourcelinks  = TelActs::createSourceLinks(detEvent, mapDetId2PlaneLayer_dets);
 
-    if(sourcelinks.empty()) {
-      emptyEventNum ++;
-      //eventNum ++;
-      // std::cout<<"empty"<<std::endl;
-      continue;
+    if(detEvent->measHits().empty()) {
+      return nullptr;
     }
 
     ////////////////////////////////
-    auto result = trackFindFun(sourcelinks, seedParameters, ckfOptions);
-    if (!result.ok()){
-      std::fprintf(stderr, "Track finding failed in Event<%lu> , with error \n",
-                   eventNum, result.error().message().c_str());
-      throw;
+    mtEvents.add();
+    std::shared_ptr<altel::TelEvent> lineEvent;
+    std::shared_ptr<altel::TelEvent> ckfEvent;
+    if(isLineEngine || compareEngines){
+      lineEvent = isLineEngine? detEvent : std::make_shared<altel::TelEvent>(*detEvent);
+      auto tp_line = std::chrono::steady_clock::now();
+      lineFinder.findTracks(lineEvent);
+      mtLineNs.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tp_line).count());
+    }
+    if(!isLineEngine || compareEngines){
+      ckfEvent = isLineEngine? std::make_shared<altel::TelEvent>(*detEvent) : detEvent;
+      std::vector<TelActs::TelSourceLink> sourcelinks  = TelActs::createSourceLinks(ckfEvent, mapDetId2PlaneLayer_dets);
+      auto tp_ckf = std::chrono::steady_clock::now();
+      if(!seedFinder){
+        auto result = trackFind(sourcelinks, seedParameters, ckfOpt);
+        if (!result.ok()){
+          std::fprintf(stderr, "Track finding failed in Event<%lu> , with error \n",
+                       task.eventN, result.error().message().c_str());
+          throw;
+        }
+        TelActs::fillTelTrajectories(gctx, result.value(), ckfEvent, mapGeoId2DetId);
+      }
+      else{
+        std::vector<Acts::CurvilinearTrackParameters> seeds = seedFinder->createSeeds(*ckfEvent);
+        mtSeeds.add(seeds.size());
+        if(seeds.empty()){
+          // no pair on the first planes, at most one track through the wide beam seed
+          seeds.push_back(seedParameters);
+          mtBeamSeeds.add();
+        }
+        for(auto& aSeed: seeds){
+          auto result = trackFind(sourcelinks, aSeed, ckfOpt);
+          if (!result.ok()){
+            std::fprintf(stderr, "Track finding failed in Event<%lu> , with error \n",
+                         task.eventN, result.error().message().c_str());
+            throw;
+          }
+          TelActs::fillTelTrajectories(gctx, result.value(), ckfEvent, mapGeoId2DetId);
+        }
+        mtDuplicates.add(TelActs::TelSeedFinder::removeDuplicates(*ckfEvent));
+      }
+      mtCkfNs.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tp_ckf).count());
+    }
+    if(compareEngines){
+      compareEvent(*ckfEvent, *lineEvent);
     }
-
-    TelActs::fillTelTrajectories(gctx, result.value(), detEvent, mapGeoId2DetId);
 
     std::shared_ptr<altel::TelEvent> targetEvent(new altel::TelEvent(fullEvent->runN(),
                                                                      fullEvent->eveN(),
@@ -574,7 +867,19 @@ int main(int argc, char *argv[]) {
                                                                      fullEvent->clkN()));
     targetEvent->measHits()=fullEvent->measHits(detId_targets);
 
-    TelActs::mergeAndMatchExtraTelEvent(detEvent, targetEvent, 400_um, 2);
+    {
+      mymetrics::ScopedTimer timer(mtMatchNs);
+      TelActs::mergeAndMatchExtraTelEvent(detEvent, targetEvent, 400_um, 2, matchPolicy);
+    }
+    return detEvent;
+  };
+
+  // statistics and output, called in event order
+  auto writeEvent = [&](std::shared_ptr<altel::TelEvent> detEvent){
+    if(!detEvent){
+      emptyEventNum ++;
+      return;
+    }
     bool hasGoodTrack = false;
     for(auto &aTraj: detEvent->TJs){
       size_t orginHitNum = aTraj->numOriginMeasHit();
@@ -587,18 +892,101 @@ int main(int argc, char *argv[]) {
       hasGoodTrack = true;
     }
     if(hasGoodTrack) {
-      goodEventNum++; 
+      goodEventNum++;
     }
 
     ttreeWriter.fillTelEvent(detEvent);
-  //  eventNum ++;
+    //  telfwtest.pushBufferEvent(detEvent);
+  };
+
+  if(threadNum <= 1){
+    auto kfLogger = Acts::getDefaultLogger("CKF", logLevel);
+    TelActs::CKFOptions ckfOptions(
+      gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions,
+      nullptr);
+    EventTask task;
+    while(readNextEvent(task)){
+      writeEvent(processEvent(task, trackFindFun, ckfOptions));
+      if(do_wait){
+        std::cout<<"waiting, press any key to conitnue"<<std::endl;
+        std::getc(stdin);
+      }
+    }
+  }
+  else{
+    // reader -> N ckf workers -> ordered writer
+    ROOT::EnableThreadSafety();
+    struct EventResult{
+      size_t seqN{0};
+      std::shared_ptr<altel::TelEvent> detEvent;
+    };
+    BoundedQueue<EventTask> queueTask(4*threadNum);
+    BoundedQueue<EventResult> queueResult(4*threadNum);
+
+    // limit the reorder buffer of writer, reader waits for slow events
+    const size_t windowSize = 16*threadNum;
+    std::mutex mtxWindow;
+    std::condition_variable cvWindow;
+    size_t seqWritten = 0;
+
+    std::thread threadReader([&](){
+      EventTask task;
+      while(readNextEvent(task)){
+        {
+          std::unique_lock<std::mutex> lk(mtxWindow);
+          cvWindow.wait(lk, [&]{return task.seqN <= seqWritten + windowSize;});
+        }
+        if(!queueTask.push(std::move(task))){
+          break;
+        }
+      }
+      queueTask.close();
+    });
+
+    std::vector<std::thread> threadWorkers;
+    for(size_t n = 0; n < threadNum; n++){
+      threadWorkers.emplace_back([&, n](){
+        auto kfLogger = Acts::getDefaultLogger("CKF"+std::to_string(n), logLevel);
+        TelActs::CKFOptions ckfOptions(
+          gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions,
+          nullptr);
+        auto workerTrackFindFun = TelActs::makeTrackFinderFunction(worldGeo, magneticField);
+        EventTask task;
+        while(queueTask.pop(task)){
+          EventResult result{task.seqN, processEvent(task, workerTrackFindFun, ckfOptions)};
+          queueResult.push(std::move(result));
+        }
+      });
+    }
 
-   //  telfwtest.pushBufferEvent(detEvent);
+    std::thread threadWriter([&](){
+      std::map<size_t, std::shared_ptr<altel::TelEvent>> mapPending;
+      size_t seqNext = seqWritten + 1;
+      EventResult result;
+      while(queueResult.pop(result)){
+        mapPending[result.seqN] = std::move(result.detEvent);
+        while(!mapPending.empty() && mapPending.begin()->first == seqNext){
+          writeEvent(std::move(mapPending.begin()->second));
+          mapPending.erase(mapPending.begin());
+          {
+            std::lock_guard<std::mutex> lk(mtxWindow);
+            seqWritten = seqNext;
+          }
+          cvWindow.notify_one();
+          seqNext++;
+        }
+      }
+      if(!mapPending.empty()){
+        std::fprintf(stderr, "Error: %zu events are not written in order\n", mapPending.size());
+      }
+    });
 
-    if(do_wait){
-      std::cout<<"waiting, press any key to conitnue"<<std::endl;
-      std::getc(stdin);
+    threadReader.join();
+    for(auto &th: threadWorkers){
+      th.join();
     }
+    queueResult.close();
+    threadWriter.join();
   }
 
   auto tp_end = std::chrono::system_clock::now();
@@ -608,10 +996,31 @@ int main(int argc, char *argv[]) {
                time_s, eventNum, emptyEventNum,(eventNum-emptyEventNum), trackNum, droppedTrackNum,goodEventNum);
   std::fprintf(stdout, "event rate: %.0fhz, non-empty event rate: %.0fhz, empty event rate: %.0fhz, track rate: %.0fhz,, good event rate: %.0fhz\n",
                eventNum/time_s, (eventNum-emptyEventNum)/time_s, emptyEventNum/time_s, trackNum/time_s,goodEventNum/time_s);
+  for(auto &[name, hist]: {std::make_pair("ckf", &mtCkfNs), std::make_pair("line", &mtLineNs)}){
+    auto snap = hist->snapshot();
+    if(snap.count){
+      std::fprintf(stdout, "%s track finding per event: mean %.1fus, p50 %.1fus, p99 %.1fus, of %lu events\n",
+                   name, snap.mean()/1e3, snap.quantile(0.5)/1e3, snap.quantile(0.99)/1e3, snap.count);
+    }
+  }
+  if(seedFinder){
+    std::fprintf(stdout, "seeds: %lu, events seeded from the beam: %lu, tracks removed as duplicates: %lu\n",
+                 mtSeeds.value(), mtBeamSeeds.value(), mtDuplicates.value());
+  }
+  if(compareEngines){
+    std::fprintf(stdout, "engine comparison: ckf tracks %zu, line tracks %zu, with the same hits %zu\n",
+                 compareTrackCkf, compareTrackLine, compareTrackMatched);
+    std::fprintf(stdout, "  det   residual rms u ckf/line    residual rms v ckf/line    line-ckf u mean/rms    line-ckf v mean/rms (um)\n");
+    for(auto &[detId, fitDiff]: compareFitDiff){
+      auto &residCkf = compareResidCkf[detId];
+      auto &residLine = compareResidLine[detId];
+      std::fprintf(stdout, "  %3u   %10.3f %10.3f   %10.3f %10.3f   %9.3f %9.3f   %9.3f %9.3f\n", detId,
+                   residCkf.rms(0)*1e3, residLine.rms(0)*1e3, residCkf.rms(1)*1e3, residLine.rms(1)*1e3,
+                   fitDiff.mean(0)*1e3, fitDiff.rms(0)*1e3, fitDiff.mean(1)*1e3, fitDiff.rms(1)*1e3);
+    }
+  }
 
-  TFile tfile(rootFilePath.c_str(),"recreate");
-  pTree->Write();
-  tfile.Close();
+  ttreeWriter.close();
 
   if(do_wait){
     std::cout<<"waiting, press any key to conitnue"<<std::endl;
@@ -0,0 +1,257 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "TelActs.hh"
+#include "TelEvent.hpp"
+#include "myrapidjson.h"
+
+#include "getopt.h"
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -verbose                     verbose flag
+  -eventMax       <INT>        events per occupancy (default 1000)
+  -seed           <INT>        random seed (default 1)
+
+Compares the CKF track finding with the indexed source link selector of makeTrackFinderFunction
+against Acts::CKFSourceLinkSelector of makeLinearTrackFinderFunction, on 6 planes with one true
+track and uniform noise hits, for 1 to 50 hits per plane. The found tracks are checked to take
+the same measure hits.
+
+examples:
+./altelCkfSelectorBench -eventMax 1000
+)";
+
+using namespace Acts::UnitLiterals;
+
+namespace{
+  const std::string s_geometry = R"({"geometry": {"detectors": [
+    {"id": 0, "center": {"x": 0, "y": 0, "z": -300}, "rotation": {"x": 0, "y": 0, "z": 0}, "size": {"x": 30, "y": 15, "z": 0.1}},
+    {"id": 1, "center": {"x": 0, "y": 0, "z": -200}, "rotation": {"x": 0, "y": 0, "z": 0}, "size": {"x": 30, "y": 15, "z": 0.1}},
+    {"id": 2, "center": {"x": 0, "y": 0, "z": -100}, "rotation": {"x": 0, "y": 0, "z": 0}, "size": {"x": 30, "y": 15, "z": 0.1}},
+    {"id": 3, "center": {"x": 0, "y": 0, "z":  100}, "rotation": {"x": 0, "y": 0, "z": 0}, "size": {"x": 30, "y": 15, "z": 0.1}},
+    {"id": 4, "center": {"x": 0, "y": 0, "z":  200}, "rotation": {"x": 0, "y": 0, "z": 0}, "size": {"x": 30, "y": 15, "z": 0.1}},
+    {"id": 5, "center": {"x": 0, "y": 0, "z":  300}, "rotation": {"x": 0, "y": 0, "z": 0}, "size": {"x": 30, "y": 15, "z": 0.1}}
+  ]}})";
+
+  // planes are not rotated and centered on the beam axis, local u, v are global y, z
+  std::shared_ptr<altel::TelEvent> generateEvent(std::mt19937_64& gen, size_t hitN, uint32_t eventN,
+                                                 const std::map<size_t, double>& planeX){
+    std::uniform_real_distribution<double> uDist(-15_mm, 15_mm);
+    std::uniform_real_distribution<double> vDist(-7.5_mm, 7.5_mm);
+    std::uniform_real_distribution<double> slopeDist(-0.001, 0.001);
+    std::normal_distribution<double> resDist(0, 6_um);
+
+    auto telEvent = std::make_shared<altel::TelEvent>(0, eventN, 0, 0);
+    double y0 = 0.5*uDist(gen);
+    double z0 = 0.5*vDist(gen);
+    double ty = slopeDist(gen);
+    double tz = slopeDist(gen);
+    for(auto& [detId, x]: planeX){
+      telEvent->MHs.push_back(std::make_shared<altel::TelMeasHit>(detId, y0 + ty*x + resDist(gen), z0 + tz*x + resDist(gen),
+                                                                 std::vector<altel::TelMeasRaw>()));
+      for(size_t n = 1; n < hitN; n++){
+        telEvent->MHs.push_back(std::make_shared<altel::TelMeasHit>(detId, uDist(gen), vDist(gen),
+                                                                   std::vector<altel::TelMeasRaw>()));
+      }
+    }
+    return telEvent;
+  }
+
+  bool isSameTracks(const altel::TelEvent& a, const altel::TelEvent& b){
+    if(a.TJs.size() != b.TJs.size()){
+      return false;
+    }
+    for(size_t n = 0; n < a.TJs.size(); n++){
+      auto& ths_a = a.TJs[n]->THs;
+      auto& ths_b = b.TJs[n]->THs;
+      if(ths_a.size() != ths_b.size()){
+        return false;
+      }
+      for(size_t k = 0; k < ths_a.size(); k++){
+        auto om_a = ths_a[k]->FH? ths_a[k]->FH->OM : nullptr;
+        auto om_b = ths_b[k]->FH? ths_b[k]->FH->OM : nullptr;
+        if(om_a != om_b){
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int64_t eventMaxNum = 1000;
+  uint64_t seed = 1;
+
+  int do_verbose = 0;
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},//option -W is reserved by getopt
+                                {"verbose", no_argument, NULL, 'v'},//val
+                                {"eventMax", required_argument, NULL, 'm'},
+                                {"seed", required_argument, NULL, 'r'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'm':
+        eventMaxNum = std::stoul(optarg);
+        break;
+      case 'r':
+        seed = std::stoul(optarg);
+        break;
+        // help and verbose
+      case 'v':
+        do_verbose=1;
+        //option is set to no_argument
+        if(optind < argc && *argv[optind] != '-'){
+          do_verbose = std::stoul(argv[optind]);
+          optind++;
+        }
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+        /////generic part below///////////
+      case 0:
+        break;
+      case 1:
+        std::fprintf(stderr, "%s: unexpected non-option argument %s\n",
+                     argv[0], optarg);
+        std::exit(1);
+        break;
+      case ':':
+        std::fprintf(stderr, "%s: missing argument for option %s\n",
+                     argv[0], longopts[longindex].name);
+        std::exit(1);
+        break;
+      case '?':
+        std::exit(1);
+        break;
+      default:
+        std::fprintf(stderr, "%s: missing getopt branch %c for option %s\n",
+                     argv[0], c, longopts[longindex].name);
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  Acts::GeometryContext gctx;
+  Acts::MagneticFieldContext mctx;
+  Acts::CalibrationContext cctx;
+  auto magneticField = std::make_shared<Acts::ConstantBField>(0_T, 0_T, 0_T);
+
+  JsonDocument jsd_geo = JsonUtils::createJsonDocument(s_geometry);
+  std::map<size_t, std::shared_ptr<const Acts::PlaneLayer>> mapDetId2PlaneLayer;
+  std::vector<std::shared_ptr<const Acts::PlaneLayer>> allPlaneLayers;
+  for(auto& js_det: jsd_geo["geometry"]["detectors"].GetArray()){
+    auto [detId, planeLayer] = TelActs::createPlaneLayer(js_det);
+    mapDetId2PlaneLayer[detId] = planeLayer;
+    allPlaneLayers.push_back(planeLayer);
+  }
+  std::shared_ptr<const Acts::TrackingGeometry> worldGeo =
+    TelActs::createWorld(gctx, 1_m, 0.1_m, 0.1_m, allPlaneLayers);
+
+  std::map<Acts::GeometryIdentifier, size_t> mapGeoId2DetId;
+  std::map<size_t, double> planeX;
+  std::vector<Acts::CKFSourceLinkSelector::Config::InputElement> ckfConfigEle_vec;
+  for(auto& [detId, aPlaneLayer]: mapDetId2PlaneLayer){
+    mapGeoId2DetId[aPlaneLayer->geometryId()] = detId;
+    planeX[detId] = aPlaneLayer->center(gctx).x();
+    ckfConfigEle_vec.push_back({aPlaneLayer->geometryId(), {13.816, detId==0? size_t(10) : size_t(1)}}); // first layer can have multi-branches
+  }
+  Acts::CKFSourceLinkSelector::Config sourcelinkSelectorCfg(ckfConfigEle_vec);
+
+  // seed 10 mm upstream of the first plane
+  double seedRes = 10_mm;
+  double seedResAngle = 0.01;
+  Acts::BoundSymMatrix seedCov = Acts::BoundSymMatrix::Zero();
+  seedCov(0, 0) = seedRes * seedRes;
+  seedCov(1, 1) = seedRes * seedRes;
+  seedCov(2, 2) = seedResAngle * seedResAngle;
+  seedCov(3, 3) = seedResAngle * seedResAngle;
+  seedCov(4, 4) = 0.0001;
+  seedCov(5, 5) = 1.;
+  Acts::CurvilinearTrackParameters seedParameters(Acts::Vector4D(planeX[0] - 10_mm, 0, 0, 0), 0, 0.5*M_PI,
+                                                  4_GeV, 1, seedCov);
+
+  Acts::PropagatorPlainOptions pOptions;
+  pOptions.maxSteps = 10000;
+  pOptions.mass = 0.511_MeV;
+  auto kfLogger = Acts::getDefaultLogger("CKF", do_verbose? Acts::Logging::VERBOSE : Acts::Logging::INFO);
+  TelActs::CKFOptions ckfOptions(gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions);
+  TelActs::CKFLinearOptions ckfLinearOptions(gctx, mctx, cctx, sourcelinkSelectorCfg, Acts::LoggerWrapper{*kfLogger}, pOptions);
+
+  auto trackFindFun = TelActs::makeTrackFinderFunction(worldGeo, magneticField);
+  auto linearTrackFindFun = TelActs::makeLinearTrackFinderFunction(worldGeo, magneticField);
+
+  std::mt19937_64 gen(seed);
+  std::fprintf(stdout, "%8s %14s %14s %10s %8s %6s\n",
+               "hit/pl", "linear[us/ev]", "indexed[us/ev]", "speedup", "tracks", "same");
+  for(size_t hitN : {1, 2, 5, 10, 20, 50}){
+    std::vector<std::shared_ptr<altel::TelEvent>> events;
+    for(int64_t n = 0; n < eventMaxNum; n++){
+      events.push_back(generateEvent(gen, hitN, n, planeX));
+    }
+
+    std::vector<altel::TelEvent> linearEvents;
+    std::chrono::nanoseconds linearTime{0};
+    for(auto& ev: events){
+      auto telEvent = std::make_shared<altel::TelEvent>(*ev);
+      auto sourcelinks = TelActs::createSourceLinks(telEvent, mapDetId2PlaneLayer);
+      auto tp_start = std::chrono::steady_clock::now();
+      auto result = linearTrackFindFun(sourcelinks, seedParameters, ckfLinearOptions);
+      linearTime += std::chrono::steady_clock::now() - tp_start;
+      if(!result.ok()){
+        std::fprintf(stderr, "Track finding failed in Event<%u> , with error %s\n", ev->eveN(), result.error().message().c_str());
+        throw;
+      }
+      TelActs::fillTelTrajectories(gctx, result.value(), telEvent, mapGeoId2DetId);
+      linearEvents.push_back(*telEvent);
+    }
+
+    std::chrono::nanoseconds indexedTime{0};
+    size_t trackN = 0;
+    bool isSame = true;
+    for(size_t n = 0; n < events.size(); n++){
+      auto telEvent = std::make_shared<altel::TelEvent>(*events[n]);
+      auto sourcelinks = TelActs::createSourceLinks(telEvent, mapDetId2PlaneLayer);
+      auto tp_start = std::chrono::steady_clock::now();
+      auto result = trackFindFun(sourcelinks, seedParameters, ckfOptions);
+      indexedTime += std::chrono::steady_clock::now() - tp_start;
+      if(!result.ok()){
+        std::fprintf(stderr, "Track finding failed in Event<%u> , with error %s\n", telEvent->eveN(), result.error().message().c_str());
+        throw;
+      }
+      TelActs::fillTelTrajectories(gctx, result.value(), telEvent, mapGeoId2DetId);
+      trackN += telEvent->TJs.size();
+      if(!isSameTracks(*telEvent, linearEvents[n])){
+        isSame = false;
+        if(do_verbose){
+          std::fprintf(stdout, "event %zu, hits per plane %zu: tracks differ\n", n, hitN);
+        }
+      }
+    }
+
+    double linearUs = std::chrono::duration<double, std::micro>(linearTime).count() / events.size();
+    double indexedUs = std::chrono::duration<double, std::micro>(indexedTime).count() / events.size();
+    std::fprintf(stdout, "%8zu %14.2f %14.2f %10.2f %8.3f %6s\n",
+                 hitN, linearUs, indexedUs, linearUs / indexedUs, double(trackN) / events.size(), isSame? "yes" : "NO");
+    if(!isSame){
+      std::fprintf(stderr, "indexed selection differs from linear at %zu hits per plane\n", hitN);
+      return 1;
+    }
+  }
+  return 0;
+}
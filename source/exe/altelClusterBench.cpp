@@ -0,0 +1,147 @@
+#include "TelEvent.hpp"
+#include "getopt.h"
+
+#include <random>
+#include <chrono>
+#include <cstdio>
+
+static const std::string help_usage = R"(
+Usage:
+  -help                             help message
+  -eventMax       <INT>             number of generated planes per occupancy point (default 1000)
+  -seed           <INT>             random seed (default 1)
+
+Compares TelMeasHit::clustering_UVDCus with the reference TelMeasHit::clustering_UVDCus_naive
+at 1, 10, 100 and 1000 fired pixels per plane, and checks both give identical clusters.
+
+examples:
+./altelClusterBench -eventMax 2000
+)";
+
+namespace{
+  // fired pixels are generated as small blobs, so that multi-pixel clusters are present
+  std::vector<altel::TelMeasRaw> generatePlane(std::mt19937_64& gen, size_t pixelN, uint16_t detN, uint16_t clkN){
+    std::uniform_int_distribution<int> distU(0, 1023);
+    std::uniform_int_distribution<int> distV(0, 511);
+    std::uniform_int_distribution<int> distSize(1, 4);
+    std::uniform_int_distribution<int> distStep(-1, 1);
+    std::vector<altel::TelMeasRaw> mrs;
+    while(mrs.size() < pixelN){
+      int u = distU(gen);
+      int v = distV(gen);
+      int blobN = distSize(gen);
+      for(int i = 0; i < blobN && mrs.size() < pixelN; i++){
+        mrs.emplace_back(uint16_t(u), uint16_t(v), detN, clkN);
+        u = std::min(std::max(u + distStep(gen), 0), 1023);
+        v = std::min(std::max(v + distStep(gen), 0), 511);
+      }
+    }
+    return mrs;
+  }
+
+  bool sameClusters(const std::vector<std::shared_ptr<altel::TelMeasHit>>& a,
+                    const std::vector<std::shared_ptr<altel::TelMeasHit>>& b){
+    if(a.size() != b.size()){
+      return false;
+    }
+    for(size_t i = 0; i < a.size(); i++){
+      if(a[i]->DN != b[i]->DN || a[i]->PLs[0] != b[i]->PLs[0] || a[i]->PLs[1] != b[i]->PLs[1] ||
+         a[i]->MRs != b[i]->MRs){
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int64_t eventMaxNum = 1000;
+  uint64_t seed = 1;
+
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},//option -W is reserved by getopt
+                                {"eventMax", required_argument, NULL, 'm'},
+                                {"seed", required_argument, NULL, 'r'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'm':
+        eventMaxNum = std::stoul(optarg);
+        break;
+      case 'r':
+        seed = std::stoul(optarg);
+        break;
+        // help
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+        /////generic part below///////////
+      case 0:
+        break;
+      case 1:
+        std::fprintf(stderr, "%s: unexpected non-option argument %s\n",
+                     argv[0], optarg);
+        std::exit(1);
+        break;
+      case ':':
+        std::fprintf(stderr, "%s: missing argument for option %s\n",
+                     argv[0], longopts[longindex].name);
+        std::exit(1);
+        break;
+      case '?':
+        std::exit(1);
+        break;
+      default:
+        std::fprintf(stderr, "%s: missing getopt branch %c for option %s\n",
+                     argv[0], c, longopts[longindex].name);
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  std::mt19937_64 gen(seed);
+  std::fprintf(stdout, "%8s %10s %14s %14s %10s %6s\n",
+               "pix/pl", "planes", "naive[us/pl]", "engine[us/pl]", "speedup", "same");
+  for(size_t pixelN : {1, 10, 100, 1000}){
+    std::vector<std::vector<altel::TelMeasRaw>> planes;
+    for(int64_t n = 0; n < eventMaxNum; n++){
+      planes.push_back(generatePlane(gen, pixelN, uint16_t(n%6), uint16_t(n)));
+    }
+
+    // the naive version is quadratic, limit its share at high occupancy
+    size_t naiveN = pixelN >= 1000 ? std::min<size_t>(planes.size(), 100) : planes.size();
+
+    std::vector<std::vector<std::shared_ptr<altel::TelMeasHit>>> resultNaive;
+    auto tp_naive_start = std::chrono::steady_clock::now();
+    for(size_t n = 0; n < naiveN; n++){
+      resultNaive.push_back(altel::TelMeasHit::clustering_UVDCus_naive(planes[n]));
+    }
+    auto tp_naive_end = std::chrono::steady_clock::now();
+
+    std::vector<std::vector<std::shared_ptr<altel::TelMeasHit>>> resultEngine;
+    auto tp_engine_start = std::chrono::steady_clock::now();
+    for(auto& plane: planes){
+      resultEngine.push_back(altel::TelMeasHit::clustering_UVDCus(plane));
+    }
+    auto tp_engine_end = std::chrono::steady_clock::now();
+
+    bool same = true;
+    for(size_t n = 0; n < naiveN; n++){
+      same = same && sameClusters(resultNaive[n], resultEngine[n]);
+    }
+
+    double usNaive = std::chrono::duration<double, std::micro>(tp_naive_end - tp_naive_start).count() / naiveN;
+    double usEngine = std::chrono::duration<double, std::micro>(tp_engine_end - tp_engine_start).count() / planes.size();
+    std::fprintf(stdout, "%8zu %10zu %14.3f %14.3f %10.1f %6s\n",
+                 pixelN, planes.size(), usNaive, usEngine, usNaive/usEngine, same?"yes":"NO");
+    if(!same){
+      return 1;
+    }
+  }
+  return 0;
+}
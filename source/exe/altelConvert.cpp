@@ -1,14 +1,16 @@
-#include "TelEventTTreeWriter.hpp"
+#include "TelEventTTreeStreamWriter.hpp"
+#include "TelEventBinary.hpp"
+#include "TelEventJson.hpp"
 #include "TelActs.hh"
 #include "getopt.h"
 #include "myrapidjson.h"
 
-#include "eudaq/FileReader.hh"
-#include "CvtEudaqAltelRaw.hh"
+#include "EudaqRawReader.hh"
 
 #include <numeric>
 #include <chrono>
 #include <regex>
+#include <thread>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -28,9 +30,16 @@ Usage:
   -eventMax       <INT>             max number of events to process  (default -1, disabled)
   -daqFiles  <<PATH0> [PATH1]...>   paths to input daq data files (input). old option -eudaqFiles
   -rootFile       <PATH>            path to out root file of reconstructed trajactories (output)
+  -binFile        <PATH>            path to out TelEvent binary file, .teb (output)
+  -nThreads       <INT>             number of eudaq raw decoding or json parsing threads (default: number of cores)
+
+root file: written while running, ALTEL_TTREE_AUTOFLUSH, ALTEL_TTREE_AUTOSAVE (TTree entries if >0, bytes if <0),
+           ALTEL_TTREE_BASKETSIZE (bytes), ALTEL_TTREE_COMPRESSION (algorithm*100+level) and ALTEL_TTREE_QUEUE (events) tune it,
+           ALTEL_TTREE_DROP (raws,dirs,resids) leaves out raw pixel, fit direction and residual branches
 
 examples:
 ./altelConvert  -daqFiles eudaqRaw/altel_Run069017_200824002945.raw  -rootFile detresid.root -eventMax 10000
+./altelConvert  -daqFiles eudaqRaw/altel_Run069017_200824002945.raw  -binFile altel_Run069017.teb
 )";
 
 int main(int argc, char *argv[]) {
@@ -43,7 +52,8 @@ int main(int argc, char *argv[]) {
   std::vector<std::string> rawFilePathCol;
   std::string geometryFilePath;
   std::string rootFilePath;
-
+  std::string binFilePath;
+  size_t threadNum = std::thread::hardware_concurrency();
 
   int do_verbose = 0;
   {////////////getopt begin//////////////////
@@ -53,6 +63,8 @@ int main(int argc, char *argv[]) {
                                 {"eventMax", required_argument, NULL, 'm'},
                                 {"daqFiles", required_argument, NULL, 'f'},
                                 {"rootFile", required_argument, NULL, 'b'},
+                                {"binFile", required_argument, NULL, 'o'},
+                                {"nThreads", required_argument, NULL, 'j'},
                                 {0, 0, 0, 0}};
 
     if(argc == 1){
@@ -85,6 +97,12 @@ int main(int argc, char *argv[]) {
       case 'b':
         rootFilePath = optarg;
         break;
+      case 'o':
+        binFilePath = optarg;
+        break;
+      case 'j':
+        threadNum = std::stoul(optarg);
+        break;
         // help and verbose
       case 'v':
         do_verbose=1;
@@ -137,25 +155,30 @@ int main(int argc, char *argv[]) {
   }
 
   if (rawFilePathCol.empty() ||
-      rootFilePath.empty() ) {
+      (rootFilePath.empty() && binFilePath.empty()) ) {
     std::fprintf(stderr, "%s\n", help_usage.c_str());
     std::exit(1);
   }
   /////////////////////////////////////
 
-  altel::TelEventTTreeWriter ttreeWriter;
-  TTree *pTree = new TTree("eventTree", "eventTree");
-  ttreeWriter.setTTree(pTree);
+  std::unique_ptr<altel::TelEventTTreeStreamWriter> ttreeWriter;
+  if(!rootFilePath.empty()){
+    ttreeWriter.reset(new altel::TelEventTTreeStreamWriter(rootFilePath));
+  }
+
+  std::unique_ptr<altel::TelEventBinaryWriter> binWriter;
+  if(!binFilePath.empty()){
+    binWriter.reset(new altel::TelEventBinaryWriter(binFilePath));
+  }
 
 
   uint32_t rawFileNum=0;
-  size_t readEventNum = 0;
   size_t emptyEventNum = 0;
   size_t eventNum = 0;
   auto tp_start = std::chrono::system_clock::now();
 
-  eudaq::FileReaderUP reader;
-  std::unique_ptr<JsonFileDeserializer> jsreader;
+  std::unique_ptr<altel::EudaqRawReader> rawreader;
+  std::unique_ptr<altel::TelEventJsonReader> jsreader;
 
   bool is_eudaq_raw = true;
   if(std::regex_match(rawFilePathCol.front(), std::regex("\\S+.json")) ){
@@ -167,34 +190,22 @@ int main(int argc, char *argv[]) {
     }
     std::shared_ptr<altel::TelEvent> fullEvent;
     if(is_eudaq_raw){
-      if(!reader){
-        if(rawFileNum<rawFilePathCol.size()){
-          std::fprintf(stdout, "processing raw file: %s\n", rawFilePathCol[rawFileNum].c_str());
-          reader = eudaq::Factory<eudaq::FileReader>::MakeUnique(eudaq::str2hash("native"), rawFilePathCol[rawFileNum]);
-          rawFileNum++;
-        }
-        else{
-          std::fprintf(stdout, "processed %d raw files, quit\n", rawFileNum);
-          break;
-        }
+      if(!rawreader){
+        std::fprintf(stdout, "processing %zu raw files\n", rawFilePathCol.size());
+        rawreader.reset(new altel::EudaqRawReader(rawFilePathCol, threadNum, eventSkipNum));
       }
-      auto eudaqEvent = reader->GetNextEvent();
-      if(!eudaqEvent){
-        reader.reset();
-        continue; // goto for next raw file
-      }
-      readEventNum++;
-      if(readEventNum<=eventSkipNum){
-        continue;
+      fullEvent = rawreader->GetNextEvent();
+      if(!fullEvent){
+        std::fprintf(stdout, "processed %zu raw files, quit\n", rawFilePathCol.size());
+        break;
       }
       eventNum++;
-      fullEvent  = altel::createTelEvent(eudaqEvent);
     }
     else{
       if(!jsreader){
         if(rawFileNum<rawFilePathCol.size()){
           std::fprintf(stdout, "processing js file: %s\n", rawFilePathCol[rawFileNum].c_str());
-          jsreader.reset(new JsonFileDeserializer(rawFilePathCol[rawFileNum]));
+          jsreader.reset(new altel::TelEventJsonReader(rawFilePathCol[rawFileNum], threadNum));
           rawFileNum++;
         }
         else{
@@ -202,17 +213,22 @@ int main(int argc, char *argv[]) {
           break;
         }
       }
-      auto evpack = jsreader->getNextJsonDocument();
-      if(evpack.IsNull()){
+      fullEvent = jsreader->createNextTelEvent();
+      if(!fullEvent){
         jsreader.reset();
         continue;
       }
       eventNum++;
-      fullEvent  = TelActs::createTelEvent(evpack, 0, eventNum, 0);
+      fullEvent->EN = eventNum;
     }
 
 
-    ttreeWriter.fillTelEvent(fullEvent);
+    if(ttreeWriter){
+      ttreeWriter->fillTelEvent(fullEvent);
+    }
+    if(binWriter){
+      binWriter->fillTelEvent(fullEvent);
+    }
     eventNum ++;
   }
 
@@ -220,8 +236,11 @@ int main(int argc, char *argv[]) {
   std::chrono::duration<double> dur_diff = tp_end-tp_start;
   double time_s = dur_diff.count();
 
-  TFile tfile(rootFilePath.c_str(),"recreate");
-  pTree->Write();
-  tfile.Close();
+  if(binWriter){
+    binWriter->close();
+  }
+  if(ttreeWriter){
+    ttreeWriter->close();
+  }
   return 0;
 }
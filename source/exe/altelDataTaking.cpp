@@ -26,6 +26,7 @@
 
 #include "linenoise.h"
 #include "myrapidjson.h"
+#include "mymetrics.hh"
 
 #include "TelFW.hh"
 #include "glfw_test.hh"
@@ -73,6 +74,9 @@ Usage:
   -geometryFile   <PATH>            path to viewer geometry input file (input)
   -rbcpConfFile   <PATH>            path to datataking  configure file (input)
   -rootDataFile   <PATH>            path to root file for data saving  (output)
+
+metrics: set ALTEL_METRICS_ENDPOINT (127.0.0.1:9100 or unix:<PATH>) to serve them over HTTP,
+         ALTEL_METRICS_DUMP <PATH> to rewrite them as json every ALTEL_METRICS_PERIOD_MS (default 1000)
 examples:
  ./bin/altelDataTaking  -geo geo_viewer.json -rb geo_datataking.json -root data.root
 
@@ -167,6 +171,8 @@ int main(int argc, char *argv[]) {
     }
   }/////////getopt end////////////////
 
+  std::unique_ptr<mymetrics::Exporter> metricsExporter = mymetrics::Exporter::FromEnv();
+
   std::fprintf(stdout, "\n");
   std::fprintf(stdout, "geometryFile:  <%s>\n", geometryFilePath.c_str());
   std::fprintf(stdout, "rbcpConfFileFile:  <%s>\n", rbcpConfFilePath.c_str());
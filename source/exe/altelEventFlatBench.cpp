@@ -0,0 +1,196 @@
+#include "TelEvent.hpp"
+#include "TelEventFlat.hpp"
+#include "getopt.h"
+
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <deque>
+#include <new>
+
+static const std::string help_usage = R"(
+Usage:
+  -help                             help message
+  -eventMax       <INT>             number of events per representation (default 1000000)
+  -pixelN         <INT>             fired pixels per plane (default 20)
+  -trajN          <INT>             trajectories per event (default 3)
+  -inflight       <INT>             events held by the consumer before release (default 256)
+
+Builds the same events, raw hits, clusters and trajectories on 6 planes, once as TelEvent
+(shared_ptr per hit) and once into a reused TelEventFlat, and prints time, heap allocations
+per event and resident memory. Events are kept for a while, as a writer queue does.
+
+examples:
+./altelEventFlatBench -eventMax 2000000 -pixelN 50
+)";
+
+// counts heap allocations of the whole process
+static std::atomic<uint64_t> g_n_alloc{0};
+
+void* operator new(std::size_t n){
+  g_n_alloc ++;
+  if(void *p = std::malloc(n ? n : 1)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+  std::free(p);
+}
+
+namespace{
+  const uint16_t s_planeN = 6;
+
+  // resident set size in MB
+  double residentMB(){
+    long pages = 0;
+    long rss = 0;
+    if(std::FILE *f = std::fopen("/proc/self/statm", "r")){
+      if(std::fscanf(f, "%ld %ld", &pages, &rss) != 2){
+        rss = 0;
+      }
+      std::fclose(f);
+    }
+    return rss * 4096.0 / (1024*1024);
+  }
+
+  void generateRaws(std::mt19937_64& gen, size_t pixelN, uint16_t clkN, std::vector<altel::TelMeasRaw>& mrs){
+    std::uniform_int_distribution<int> distU(0, 1022);
+    std::uniform_int_distribution<int> distV(0, 510);
+    mrs.clear();
+    for(uint16_t detN = 0; detN < s_planeN; detN++){
+      for(size_t n = 0; n + 1 < pixelN; n += 2){
+        uint16_t u = distU(gen);
+        uint16_t v = distV(gen);
+        mrs.emplace_back(u, v, detN, clkN);
+        mrs.emplace_back(u+1, v, detN, clkN);
+      }
+    }
+  }
+
+  template<typename F>
+  void runBench(const char* name, size_t eventMax, F&& makeEvent){
+    double rssBegin = residentMB();
+    uint64_t n_alloc_begin = g_n_alloc;
+    auto tp_start = std::chrono::steady_clock::now();
+    for(size_t n = 0; n < eventMax; n++){
+      makeEvent(n);
+    }
+    auto tp_end = std::chrono::steady_clock::now();
+    uint64_t n_alloc = g_n_alloc - n_alloc_begin;
+    double sec = std::chrono::duration<double>(tp_end - tp_start).count();
+    std::fprintf(stdout, "%-10s %10.0f events/s %10.2f allocations/event   RSS %7.1f MB (+%.1f MB)\n",
+                 name, eventMax/sec, 1.0*n_alloc/eventMax, residentMB(), residentMB() - rssBegin);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t eventMax = 1000000;
+  size_t pixelN = 20;
+  size_t trajN = 3;
+  size_t inflight = 256;
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"eventMax", required_argument, NULL, 'm'},
+                                {"pixelN", required_argument, NULL, 'p'},
+                                {"trajN", required_argument, NULL, 't'},
+                                {"inflight", required_argument, NULL, 'i'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'm':
+        eventMax = std::stoul(optarg);
+        break;
+      case 'p':
+        pixelN = std::stoul(optarg);
+        break;
+      case 't':
+        trajN = std::stoul(optarg);
+        break;
+      case 'i':
+        inflight = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  std::fprintf(stdout, "planes %u, pixels per plane %zu, trajectories per event %zu, events in flight %zu\n",
+               s_planeN, pixelN, trajN, inflight);
+
+  {
+    std::mt19937_64 gen(1);
+    std::vector<altel::TelMeasRaw> mrs;
+    std::deque<std::shared_ptr<altel::TelEvent>> consumer;
+    runBench("TelEvent", eventMax, [&](size_t n){
+      generateRaws(gen, pixelN, uint16_t(n), mrs);
+      auto ev = std::make_shared<altel::TelEvent>(0, n, 0, n);
+      ev->MRs = mrs;
+      ev->MHs = altel::TelMeasHit::clustering_UVDCus(ev->MRs);
+      size_t hitN = ev->MHs.size();
+      for(size_t t = 0; t < trajN && hitN; t++){
+        auto aTraj = std::make_shared<altel::TelTrajectory>();
+        aTraj->TN = t;
+        for(uint16_t detN = 0; detN < s_planeN; detN++){
+          auto &mh = ev->MHs[(t*s_planeN + detN) % hitN];
+          auto aFitHit = std::make_shared<altel::TelFitHit>(detN, mh->u(), mh->v(), 0.005, 0.005,
+                                                            mh->u(), mh->v(), detN*20., 0., 0., 1., mh);
+          aTraj->THs.push_back(std::make_shared<altel::TelTrajHit>(detN, aFitHit, mh));
+        }
+        ev->TJs.push_back(aTraj);
+      }
+      consumer.push_back(ev);
+      if(consumer.size() > inflight){
+        consumer.pop_front();
+      }
+    });
+  }
+
+  {
+    std::mt19937_64 gen(1);
+    // one arena per event in flight, reused round-robin
+    std::vector<altel::TelEventFlat> ring(inflight + 1);
+    runBench("flat", eventMax, [&](size_t n){
+      altel::TelEventFlat &ev = ring[n % ring.size()];
+      ev.clear();
+      ev.EN = n;
+      ev.CK = n;
+      generateRaws(gen, pixelN, uint16_t(n), ev.MRs);
+      ev.clusterMeasRaws();
+      size_t hitN = ev.MHs.size();
+      for(size_t t = 0; t < trajN && hitN; t++){
+        ev.beginTrajectory(t);
+        for(uint16_t detN = 0; detN < s_planeN; detN++){
+          int32_t mh = (t*s_planeN + detN) % hitN;
+          altel::TelEventFlat::FitHit fh;
+          fh.DN = detN;
+          fh.PLs[0] = fh.PGs[0] = ev.MHs[mh].PLs[0];
+          fh.PLs[1] = fh.PGs[1] = ev.MHs[mh].PLs[1];
+          fh.PLsE[0] = fh.PLsE[1] = 0.005;
+          fh.PGs[2] = detN*20.;
+          fh.DGs[2] = 1.;
+          fh.OM = mh;
+          ev.addTrajHit(detN, ev.addFitHit(fh), mh);
+        }
+      }
+    });
+  }
+  return 0;
+}
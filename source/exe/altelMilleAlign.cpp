@@ -1,13 +1,15 @@
 #include "TelMille.hh"
+#include "TelAlignSolver.hh"
 
 #include "getopt.h"
 
-#include "eudaq/FileReader.hh"
-#include "CvtEudaqAltelRaw.hh"
+#include "EudaqRawReader.hh"
 
 #include <iostream>
 #include <algorithm>
 #include <set>
+#include <thread>
+#include <chrono>
 
 static const std::string help_usage = R"(
 Usage:
@@ -19,13 +21,19 @@ Usage:
   -pedeSteeringFile  <PATH>          path to pede steering file (output)
   -milleBinaryFile   <PATH>          path to mille binary file (output)
   -inputGeometryFile <PATH>          geometry input file
+  -outputGeometryFile <PATH>         aligned geometry file, solved in process instead of by pede (output)
+  -alignIterations   <int>           in process alignment iterations (default 3)
+  -huberCut          <float>         residual/sigma beyond which measurements are down-weighted from the 2nd iteration (default 3, 0 for none)
+  -chi2NdfCut        <float>         tracks beyond are dropped from the 2nd iteration (default 0, none)
   -resolDefault   <  <float_UV>|<float_U float_V> >
                                     default U/V resolution for all detectors
   -resolDetector  <<int_ID>  <<float_UV>|<float_U float_V> >>
                                     U/V resolution(s) for a specific detector by int_ID
+  -nThreads          <int>           number of eudaq raw decoding and alignment threads (default: number of cores)
 
 example:
 ./altelMilleBin -pede pede.txt -mille mille.bin  -eudaqFiles  eudaqRaw/altel_Run069017_200824002945.raw eudaqRaw/altel_Run069018_200824003322.raw -input ../init_geo.json -maxE 1000000 -resolDefault 0.04 -resolDet 1 0.1 0.09
+./altelMilleBin -outputGeometryFile aligned_geo.json -eudaqFiles eudaqRaw/altel_Run069017_200824002945.raw -input ../init_geo.json -maxE 1000000 -resolDefault 0.04 -alignIterations 5
 )";
 
 int main(int argc, char *argv[]) {
@@ -35,20 +43,28 @@ int main(int argc, char *argv[]) {
                               {"verbose", no_argument, &do_verbose, 1},
                               {"eudaqFiles", required_argument, NULL, 'f'},
                               {"inputGeometryFile", required_argument, NULL, 'g'},
+                              {"outputGeometryFile", required_argument, NULL, 'o'},
+                              {"alignIterations", required_argument, NULL, 'i'},
+                              {"huberCut", required_argument, NULL, 'w'},
+                              {"chi2NdfCut", required_argument, NULL, 'c'},
                               {"pedeSteeringFile", required_argument, NULL, 'u'},
                               {"milleBinaryFile", required_argument, NULL, 'q'},
                               {"resolDefault", required_argument, NULL, 'r'},
                               {"resolDetector", required_argument, NULL, 's'},
                               {"maxEventNumber", required_argument, NULL, 'm'},
                               {"maxTrackNumber", required_argument, NULL, 'n'},
+                              {"nThreads", required_argument, NULL, 'j'},
                              {0, 0, 0, 0}};
 
   std::vector<std::string> rawFilePathCol;
   std::string inputGeometryFile_path;
   std::string pedeSteeringFile_path;
   std::string milleBinaryFile_path;
+  std::string outputGeometryFile_path;
+  altel::TelAlignSolver::Config solverConf;
   size_t maxTrackNumber = -1;
   size_t maxEventNumber = -1;
+  size_t threadNum = std::thread::hardware_concurrency();
 
   std::map<uint16_t, std::pair<double, double>> mapResolDet;
   double resolDefaultU =0.03;
@@ -72,6 +88,18 @@ int main(int argc, char *argv[]) {
     case 'u':
       pedeSteeringFile_path = optarg;
       break;
+    case 'o':
+      outputGeometryFile_path = optarg;
+      break;
+    case 'i':
+      solverConf.iterations = std::stoull(optarg);
+      break;
+    case 'w':
+      solverConf.huberCut = std::stod(optarg);
+      break;
+    case 'c':
+      solverConf.chi2NdfCut = std::stod(optarg);
+      break;
     case 'q':
       milleBinaryFile_path = optarg;
       break;
@@ -119,6 +147,9 @@ int main(int argc, char *argv[]) {
     case 'n':
       maxTrackNumber = std::stoull(optarg);
       break;
+    case 'j':
+      threadNum = std::stoull(optarg);
+      break;
       /////generic part below///////////
     case 0: /* getopt_long() set a variable, just keep going */
       break;
@@ -141,10 +172,10 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  bool isMille = !milleBinaryFile_path.empty() && !pedeSteeringFile_path.empty();
   if (rawFilePathCol.empty() ||
       inputGeometryFile_path.empty()||
-      milleBinaryFile_path.empty()||
-      pedeSteeringFile_path.empty()
+      (!isMille && outputGeometryFile_path.empty())
     ) {
     std::fprintf(stderr, "%s\n", help_usage.c_str());
     std::exit(0);
@@ -158,6 +189,7 @@ int main(int argc, char *argv[]) {
   std::fprintf(stdout, "inputGeometryFile:  %s\n", inputGeometryFile_path.c_str());
   std::fprintf(stdout, "milleBinaryFile:    %s\n", milleBinaryFile_path.c_str());
   std::fprintf(stdout, "pedeSteeringFile:   %s\n", pedeSteeringFile_path.c_str());
+  std::fprintf(stdout, "outputGeometryFile: %s\n", outputGeometryFile_path.c_str());
   std::fprintf(stdout, "resolDefault:       [%f   %f]\n", resolDefaultU, resolDefaultV);
   std::fprintf(stdout, "resolDetector:\n");
   for(auto &[detN, resolUV]: mapResolDet){
@@ -194,41 +226,32 @@ int main(int argc, char *argv[]) {
   for(auto& [detN, resolUV ]: mapResolDet){
     telmille.setResolution(detN, resolUV.first, resolUV.second);
   }
-  telmille.startMilleBinary(milleBinaryFile_path);
+  if(isMille){
+    telmille.startMilleBinary(milleBinaryFile_path);
+  }
+  solverConf.threadN = threadNum;
+  altel::TelAlignSolver solver(telmille, solverConf);
 
   JsonAllocator jsa;
 
   size_t nTracks = 0;
   size_t nEvents = 0;
-  uint32_t rawFileN=0;
 
-  eudaq::FileReaderUP reader;
+  std::fprintf(stdout, "processing %zu raw files\n", rawFilePathCol.size());
+  altel::EudaqRawReader rawreader(rawFilePathCol, threadNum);
 
   while(1){
     if (nTracks >= maxTrackNumber || nEvents >= maxEventNumber ) {
       break;
     }
 
-    if(!reader){
-      if(rawFileN<rawFilePathCol.size()){
-        std::fprintf(stdout, "processing raw file: %s\n", rawFilePathCol[rawFileN].c_str());
-        reader = eudaq::Factory<eudaq::FileReader>::MakeUnique(eudaq::str2hash("native"), rawFilePathCol[rawFileN]);
-        rawFileN++;
-      }
-      else{
-        std::fprintf(stdout, "processed %d raw files, quit\n", rawFileN);
-        break;
-      }
-    }
-    auto eudaqEvent = reader->GetNextEvent();
-    if(!eudaqEvent){
-      reader.reset();
-      continue; // goto for next raw file
+    std::shared_ptr<altel::TelEvent> telEvent = rawreader.GetNextEvent();
+    if(!telEvent){
+      std::fprintf(stdout, "processed %zu raw files, quit\n", rawFilePathCol.size());
+      break;
     }
     nEvents++;
 
-    std::shared_ptr<altel::TelEvent> telEvent = altel::createTelEvent(eudaqEvent);
-
     // TODO: TelEvent to json
     JsonValue js_track_filtered(rapidjson::kArrayType);
     std::set<uint16_t> measDetNs;
@@ -261,12 +284,43 @@ int main(int argc, char *argv[]) {
     }
 
     nTracks++;
-    telmille.fillTrackXYRz(js_track_filtered);
+    if(isMille){
+      telmille.fillTrackXYRz(js_track_filtered);
+    }
+    if(!outputGeometryFile_path.empty()){
+      solver.addTrack(js_track_filtered);
+    }
   }
   std::fprintf(stdout, "%i tracks are picked from %i events\n", nTracks, nEvents);
 
-  telmille.endMilleBinary();
-  telmille.createPedeStreeringModeXYRz(pedeSteeringFile_path);
+  if(isMille){
+    telmille.endMilleBinary();
+    telmille.createPedeStreeringModeXYRz(pedeSteeringFile_path);
+  }
+
+  if(!outputGeometryFile_path.empty()){
+    auto tp_start = std::chrono::steady_clock::now();
+    auto corrections = solver.solve();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_start).count();
+    std::fprintf(stdout, "alignment of %zu tracks solved in %f s\n", solver.numTracks(), sec);
+
+    // as altelGeoUpdate with a pede result
+    for(auto& js_det : jsd_geo["geometry"]["detectors"].GetArray()){
+      auto& [dx, dy, drz] = corrections.at(js_det["id"].GetUint());
+      js_det["center"]["x"] = dx + js_det["center"]["x"].GetDouble();
+      js_det["center"]["y"] = dy + js_det["center"]["y"].GetDouble();
+      js_det["rotation"]["z"] = drz + js_det["rotation"]["z"].GetDouble();
+      JsonUtils::printJsonValue(js_det, false);
+    }
+    std::string jsstr = JsonUtils::stringJsonValue(jsd_geo, true);
+    std::FILE *fp = std::fopen(outputGeometryFile_path.c_str(), "w");
+    if(!fp){
+      std::fprintf(stderr, "unable to open geometry file <%s>\n", outputGeometryFile_path.c_str());
+      throw;
+    }
+    std::fwrite(jsstr.data(), 1, jsstr.size(), fp);
+    std::fclose(fp);
+  }
 
   return 0;
 }
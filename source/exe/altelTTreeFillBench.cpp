@@ -0,0 +1,304 @@
+#include "TelEvent.hpp"
+#include "TelEventTTreeWriter.hpp"
+#include "getopt.h"
+
+#include <map>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static const std::string help_usage = R"(
+Usage:
+  -help                             help message
+  -eventMax       <INT>             number of events (default 100000)
+  -pixelN         <INT>             fired pixels per plane (default 20)
+  -trajN          <INT>             trajectories per event (default 3)
+
+Fills the TelEventTTreeWriter branch vectors of the same events, without TTree::Fill, by the
+std::map pools as before and by the index tables of fillTelEvent, checks that both give the
+same branches, and prints the time per event. The last line leaves out the raw pixel, fit
+direction and residual branch groups.
+
+examples:
+./altelTTreeFillBench -eventMax 100000 -pixelN 50 -trajN 5
+)";
+
+namespace{
+  // the std::map pools of the objects, as TelEventTTreeWriter filled the branches before its index tables
+  class MapPoolWriter : public altel::TelEventTTreeWriter{
+  public:
+    void fillBranches_mapPool(const altel::TelEvent& telEvent){
+      clearBranches();
+
+      std::map<altel::TelMeasRaw, int16_t> poolMapRawMeas;
+      std::map<std::shared_ptr<altel::TelMeasHit>, int16_t> poolMapHitMeas;
+      std::map<std::shared_ptr<altel::TelFitHit>, int16_t> poolMapHitFit;
+
+      for(auto &aHitMeas: telEvent.measHits()){
+        auto [it, inserted] = poolMapHitMeas.emplace( aHitMeas, int16_t(rHitMeasVec_DetN.size()) );
+        if(inserted){
+          // inserted and return true, when no exist
+          rHitMeasVec_DetN.push_back(aHitMeas->detN());
+          rHitMeasVec_U.push_back(aHitMeas->u());
+          rHitMeasVec_V.push_back(aHitMeas->v());
+
+          rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
+          for(auto &aRawMeas: aHitMeas->measRaws()){
+            auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()));
+            if(inserted){
+              rRawMeasVec_U.push_back(aRawMeas.u());
+              rRawMeasVec_V.push_back(aRawMeas.v());
+              rRawMeasVec_DetN.push_back(aRawMeas.detN());
+              rRawMeasVec_Clk.push_back(aRawMeas.clkN());
+            }
+            rHitMeasVec_Index_To_RawMeas.push_back(it->second);
+          }
+          rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(aHitMeas->measRaws().size()));
+        }
+      }
+
+      rNumTraj_PerEvent = 0;
+      for(auto &aTraj: telEvent.trajs()){
+        rNumTraj_PerEvent ++;
+        rTrajVec_Index_To_HitFit.push_back(-1);//traj: -1 {M-N} -1 {M-N}
+
+        int16_t aNumHitFit_PerTraj = 0;
+        int16_t aNumHitMeas_Origin_PerTraj = 0;
+        int16_t aNumHitMeas_Matched_PerTraj = 0;
+
+        for(auto &aHit: aTraj->trajHits()){
+          aNumHitFit_PerTraj++;
+          auto aHitFit = aHit->fitHit();
+          auto [it, inserted] = poolMapHitFit.emplace( aHitFit, int16_t(rHitFitVec_DetN.size()) );
+          if(!inserted){
+            //TODO: handle this case for ambiguility case
+            std::fprintf(stderr, "a shared hitfit by multi-traj, WRONG\n");
+            throw;
+          }
+
+          rTrajVec_Index_To_HitFit.push_back(it->second);
+          rHitFitVec_TrajN.push_back(int16_t(rTrajVec_NumHitFit_PerTraj.size()));
+          rHitFitVec_DetN.push_back(aHitFit->detN());
+          rHitFitVec_U.push_back(aHitFit->u());
+          rHitFitVec_V.push_back(aHitFit->v());
+
+          rHitFitVec_U_err.push_back(aHitFit->u_err());
+          rHitFitVec_V_err.push_back(aHitFit->v_err());
+
+          rHitFitVec_X.push_back(aHitFit->x());
+          rHitFitVec_Y.push_back(aHitFit->y());
+          rHitFitVec_Z.push_back(aHitFit->z());
+          rHitFitVec_DirX.push_back(aHitFit->dx());
+          rHitFitVec_DirY.push_back(aHitFit->dy());
+          rHitFitVec_DirZ.push_back(aHitFit->dz());
+
+          int16_t indexHitMeasOri = -1;
+          auto aHitMeasOri = aHitFit->OM;
+          if(aHitMeasOri){
+            aNumHitMeas_Origin_PerTraj ++;
+            auto [it, inserted] = poolMapHitMeas.emplace( aHitMeasOri, int16_t(rHitMeasVec_DetN.size()));
+            if(inserted){
+              rHitMeasVec_DetN.push_back(aHitMeasOri->detN());
+              rHitMeasVec_U.push_back(aHitMeasOri->u());
+              rHitMeasVec_V.push_back(aHitMeasOri->v());
+
+              rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
+              for(auto &aRawMeas: aHitMeasOri->measRaws()){
+                auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()));
+                if(inserted){
+                  rRawMeasVec_U.push_back(aRawMeas.u());
+                  rRawMeasVec_V.push_back(aRawMeas.v());
+                  rRawMeasVec_DetN.push_back(aRawMeas.detN());
+                  rRawMeasVec_Clk.push_back(aRawMeas.clkN());
+                }
+                rHitMeasVec_Index_To_RawMeas.push_back(it->second);
+              }
+              rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(aHitMeasOri->measRaws().size()));
+            }
+            indexHitMeasOri = it->second;
+          }
+          rHitFitVec_Index_To_Origin_HitMeas.push_back(indexHitMeasOri);
+
+          int16_t  indexHitMeasMatched = -1;
+          auto aHitMeasMatched = aHit->MM;
+          if(aHitMeasMatched){
+            aNumHitMeas_Matched_PerTraj++;
+            auto [it, inserted] = poolMapHitMeas.emplace( aHitMeasMatched, int16_t(rHitMeasVec_DetN.size()));
+            if(inserted){
+              rHitMeasVec_DetN.push_back(aHitMeasMatched->detN());
+              rHitMeasVec_U.push_back(aHitMeasMatched->u());
+              rHitMeasVec_V.push_back(aHitMeasMatched->v());
+
+              rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
+              for(auto &aRawMeas: aHitMeasMatched->measRaws()){
+                auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()));
+                if(inserted){
+                  rRawMeasVec_U.push_back(aRawMeas.u());
+                  rRawMeasVec_V.push_back(aRawMeas.v());
+                  rRawMeasVec_DetN.push_back(aRawMeas.detN());
+                  rRawMeasVec_Clk.push_back(aRawMeas.clkN());
+                }
+                rHitMeasVec_Index_To_RawMeas.push_back(it->second);
+              }
+              rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(aHitMeasMatched->measRaws().size()));
+              //
+
+            }
+            indexHitMeasMatched = it->second;
+          }
+          rHitFitVec_Index_To_Matched_HitMeas.push_back(indexHitMeasMatched);
+
+          //ana matched
+          if(aHitMeasMatched){
+            rAnaVec_Matched_DetN.push_back(aHitMeasMatched->detN());
+            rAnaVec_Matched_ResdU.push_back(aHitMeasMatched->u() - aHitFit->u());
+            rAnaVec_Matched_ResdV.push_back(aHitMeasMatched->v() - aHitFit->v());
+          }
+        }
+        rTrajVec_NumHitFit_PerTraj.push_back(aNumHitFit_PerTraj);
+        rTrajVec_NumHitMeas_Origin_PerTraj.push_back(aNumHitMeas_Origin_PerTraj);
+        rTrajVec_NumHitMeas_Matched_PerTraj.push_back(aNumHitMeas_Matched_PerTraj);
+      }
+
+      rRunN = telEvent.runN();
+      rEventN = telEvent.eveN();
+      rConfigN = telEvent.detN();
+      rClock = telEvent.clkN();
+      rNumMeasHits_PerEvent = poolMapHitMeas.size();
+    }
+
+    bool isSameBranches(const MapPoolWriter& o) const{
+      return rRunN == o.rRunN && rEventN == o.rEventN && rConfigN == o.rConfigN && rClock == o.rClock &&
+        rNumTraj_PerEvent == o.rNumTraj_PerEvent && rNumMeasHits_PerEvent == o.rNumMeasHits_PerEvent &&
+        rRawMeasVec_DetN == o.rRawMeasVec_DetN && rRawMeasVec_U == o.rRawMeasVec_U &&
+        rRawMeasVec_V == o.rRawMeasVec_V && rRawMeasVec_Clk == o.rRawMeasVec_Clk &&
+        rHitMeasVec_DetN == o.rHitMeasVec_DetN && rHitMeasVec_U == o.rHitMeasVec_U && rHitMeasVec_V == o.rHitMeasVec_V &&
+        rHitMeasVec_NumRawMeas_PerHitMeas == o.rHitMeasVec_NumRawMeas_PerHitMeas &&
+        rHitMeasVec_Index_To_RawMeas == o.rHitMeasVec_Index_To_RawMeas &&
+        rHitFitVec_TrajN == o.rHitFitVec_TrajN && rHitFitVec_DetN == o.rHitFitVec_DetN &&
+        rHitFitVec_U == o.rHitFitVec_U && rHitFitVec_V == o.rHitFitVec_V &&
+        rHitFitVec_U_err == o.rHitFitVec_U_err && rHitFitVec_V_err == o.rHitFitVec_V_err &&
+        rHitFitVec_X == o.rHitFitVec_X && rHitFitVec_Y == o.rHitFitVec_Y && rHitFitVec_Z == o.rHitFitVec_Z &&
+        rHitFitVec_DirX == o.rHitFitVec_DirX && rHitFitVec_DirY == o.rHitFitVec_DirY && rHitFitVec_DirZ == o.rHitFitVec_DirZ &&
+        rHitFitVec_Index_To_Origin_HitMeas == o.rHitFitVec_Index_To_Origin_HitMeas &&
+        rHitFitVec_Index_To_Matched_HitMeas == o.rHitFitVec_Index_To_Matched_HitMeas &&
+        rTrajVec_NumHitFit_PerTraj == o.rTrajVec_NumHitFit_PerTraj &&
+        rTrajVec_NumHitMeas_Origin_PerTraj == o.rTrajVec_NumHitMeas_Origin_PerTraj &&
+        rTrajVec_NumHitMeas_Matched_PerTraj == o.rTrajVec_NumHitMeas_Matched_PerTraj &&
+        rTrajVec_Index_To_HitFit == o.rTrajVec_Index_To_HitFit &&
+        rAnaVec_Matched_DetN == o.rAnaVec_Matched_DetN &&
+        rAnaVec_Matched_ResdU == o.rAnaVec_Matched_ResdU && rAnaVec_Matched_ResdV == o.rAnaVec_Matched_ResdV;
+    }
+  };
+
+  const uint16_t s_planeN = 6;
+  const uint16_t s_dutN = 32;
+
+  // pixel pairs as hits on 6 planes and a DUT, trajectories through hits of the planes,
+  // matched to a DUT hit
+  std::shared_ptr<altel::TelEvent> generateEvent(std::mt19937_64& gen, size_t pixelN, size_t trajN, uint32_t eventN){
+    std::uniform_int_distribution<int> distU(0, 1022);
+    std::uniform_int_distribution<int> distV(0, 510);
+    auto telEvent = std::make_shared<altel::TelEvent>(0, eventN, 0, eventN);
+    std::vector<std::vector<std::shared_ptr<altel::TelMeasHit>>> planeHits(s_planeN + 1);
+    for(uint16_t plane = 0; plane <= s_planeN; plane++){
+      uint16_t detN = plane < s_planeN? plane : s_dutN;
+      for(size_t n = 0; n + 1 < pixelN; n += 2){
+        uint16_t u = distU(gen);
+        uint16_t v = distV(gen);
+        std::vector<altel::TelMeasRaw> mrs{{u, v, detN, uint16_t(eventN)}, {uint16_t(u+1), v, detN, uint16_t(eventN)}};
+        auto hit = std::make_shared<altel::TelMeasHit>(detN, u*0.029, v*0.027, mrs);
+        planeHits[plane].push_back(hit);
+        telEvent->MHs.push_back(hit);
+      }
+    }
+    for(size_t t = 0; t < trajN; t++){
+      auto traj = std::make_shared<altel::TelTrajectory>();
+      traj->TN = t;
+      for(uint16_t plane = 0; plane <= s_planeN; plane++){
+        auto& hits = planeHits[plane];
+        auto hit = hits.empty()? nullptr : hits[t % hits.size()];
+        uint16_t detN = plane < s_planeN? plane : s_dutN;
+        auto fitHit = std::make_shared<altel::TelFitHit>(detN, 0.1*t, 0.2*t, 0.005, 0.005, 100.*plane, 0.1*t, 0.2*t, 1, 0, 0,
+                                                         plane < s_planeN? hit : nullptr);
+        traj->THs.push_back(std::make_shared<altel::TelTrajHit>(detN, fitHit, plane < s_planeN? nullptr : hit));
+      }
+      telEvent->TJs.push_back(traj);
+    }
+    return telEvent;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t eventMax = 100000;
+  size_t pixelN = 20;
+  size_t trajN = 3;
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"eventMax", required_argument, NULL, 'm'},
+                                {"pixelN", required_argument, NULL, 'p'},
+                                {"trajN", required_argument, NULL, 't'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'm':
+        eventMax = std::stoul(optarg);
+        break;
+      case 'p':
+        pixelN = std::stoul(optarg);
+        break;
+      case 't':
+        trajN = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  std::fprintf(stdout, "planes %u + 1 DUT, pixels per plane %zu, trajectories per event %zu\n",
+               s_planeN, pixelN, trajN);
+
+  std::mt19937_64 gen(1);
+  std::vector<std::shared_ptr<altel::TelEvent>> events;
+  for(size_t n = 0; n < eventMax; n++){
+    events.push_back(generateEvent(gen, pixelN, trajN, n));
+  }
+
+  MapPoolWriter writerMap;
+  MapPoolWriter writerIndex;
+  for(auto& ev: events){
+    writerMap.fillBranches_mapPool(*ev);
+    writerIndex.fillBranches(*ev);
+    if(!writerIndex.isSameBranches(writerMap)){
+      std::fprintf(stderr, "branches differ at event %u\n", ev->eveN());
+      return 1;
+    }
+  }
+
+  auto timeFill = [&](const char* name, auto&& fill){
+                    auto tp_start = std::chrono::steady_clock::now();
+                    for(auto& ev: events){
+                      fill(*ev);
+                    }
+                    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - tp_start).count();
+                    std::fprintf(stdout, "%-24s %10.0f ns/event\n", name, ns / events.size());
+                    return ns;
+                  };
+  double nsMap = timeFill("map pools", [&](const altel::TelEvent& ev){writerMap.fillBranches_mapPool(ev);});
+  double nsIndex = timeFill("index tables", [&](const altel::TelEvent& ev){writerIndex.fillBranches(ev);});
+  altel::TelEventTTreeWriter writerSlim({false, false, false});
+  double nsSlim = timeFill("index tables, slim", [&](const altel::TelEvent& ev){writerSlim.fillBranches(ev);});
+  std::fprintf(stdout, "speedup %.2f, slim %.2f, same branches\n", nsMap / nsIndex, nsMap / nsSlim);
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "TelEvent.hpp"
+#include "TelEventTTreeReader.hpp"
+#include "getopt.h"
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <memory>
+
+static const std::string help_usage = R"(
+Usage:
+  -help                             help message
+  -rootFile       <PATH>            path to root file of reconstructed trajactories, e.g. by altelActsTrack (input)
+  -eventMax       <INT>             max number of events to read (default all)
+  -threads        <INT>             workers of the parallel reading (default hardware threads)
+
+Reads the eventTree of a file into TelEvents, all branches sequentially, then only measure
+hits, only trajectories, and all branches by TTree clusters in parallel, and prints the time
+per event. The numbers of hits and trajectories read must agree between the ways.
+
+examples:
+./altelTTreeReadBench -rootFile runxxx_track.root -threads 8
+)";
+
+namespace{
+  struct Count{
+    std::atomic<size_t> measHitN{0};
+    std::atomic<size_t> trajN{0};
+
+    void add(const altel::TelEvent& ev){
+      measHitN += ev.measHits().size();
+      trajN += ev.trajs().size();
+    }
+  };
+}
+
+int main(int argc, char *argv[]) {
+  std::string rootFilePath;
+  size_t eventMax = SIZE_MAX;
+  size_t threadN = std::max(1u, std::thread::hardware_concurrency());
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"rootFile", required_argument, NULL, 'r'},
+                                {"eventMax", required_argument, NULL, 'm'},
+                                {"threads", required_argument, NULL, 't'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'r':
+        rootFilePath = optarg;
+        break;
+      case 'm':
+        eventMax = std::stoul(optarg);
+        break;
+      case 't':
+        threadN = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  if(rootFilePath.empty()){
+    std::fprintf(stderr, "%s\n", help_usage.c_str());
+    std::exit(1);
+  }
+
+  auto readSequential = [&](const altel::TelEventTTreeReader::Config& conf, Count& count){
+                          std::unique_ptr<TFile> file(TFile::Open(rootFilePath.c_str(), "READ"));
+                          if(!file || file->IsZombie()){
+                            std::fprintf(stderr, "ROOT TFile opening failed: %s\n", rootFilePath.c_str());
+                            throw;
+                          }
+                          TTree *pTree = nullptr;
+                          file->GetObject("eventTree", pTree);
+                          altel::TelEventTTreeReader reader(conf);
+                          reader.setTTree(pTree);
+                          size_t end = std::min(eventMax, reader.numEvents());
+                          reader.setEntryRange(0, end);
+                          for(size_t n = 0; n < end; n++){
+                            count.add(*reader.createTelEvent(n));
+                          }
+                          return end;
+                        };
+
+  altel::TelEventTTreeReader::Config confAll;
+  altel::TelEventTTreeReader::Config confHits;
+  confHits.trajs = false;
+  altel::TelEventTTreeReader::Config confTrajs;
+  confTrajs.measRaws = false;
+  confTrajs.measHits = false;
+
+  auto timeRead = [](const char* name, auto&& read, const Count& count){
+                    auto tp_start = std::chrono::steady_clock::now();
+                    size_t eventN = read();
+                    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - tp_start).count();
+                    std::fprintf(stdout, "%-24s %10zu events %10.0f ns/event, %zu measure hits, %zu trajectories\n",
+                                 name, eventN, eventN? ns / eventN : 0., size_t(count.measHitN), size_t(count.trajN));
+                    return ns;
+                  };
+
+  Count countAll;
+  Count countHits;
+  Count countTrajs;
+  Count countParallel;
+  double nsAll = timeRead("all branches", [&](){return readSequential(confAll, countAll);}, countAll);
+  timeRead("measure hits", [&](){return readSequential(confHits, countHits);}, countHits);
+  timeRead("trajectories", [&](){return readSequential(confTrajs, countTrajs);}, countTrajs);
+  std::string nameParallel = "all branches, " + std::to_string(threadN) + " threads";
+  double nsParallel = timeRead(nameParallel.c_str(), [&](){
+                                 return altel::TelEventTTreeReader::forEachTelEvent(
+                                   rootFilePath, confAll, threadN, 0, eventMax,
+                                   [&countParallel](std::shared_ptr<altel::TelEvent> ev, size_t){
+                                     countParallel.add(*ev);
+                                   });
+                               }, countParallel);
+
+  if(countHits.measHitN != countAll.measHitN || countTrajs.trajN != countAll.trajN ||
+     countParallel.measHitN != countAll.measHitN || countParallel.trajN != countAll.trajN){
+    std::fprintf(stderr, "different numbers of hits or trajectories\n");
+    return 1;
+  }
+  std::fprintf(stdout, "parallel speedup %.2f\n", nsAll / nsParallel);
+  return 0;
+}
@@ -173,6 +173,7 @@ int main(int argc, char *argv[]) {
  
     size_t totalNumEvents = ttreeReader.numEvents();
     std::fprintf(stdout, "Total events in file: %zu\n", totalNumEvents);
+    ttreeReader.setEntryRange(eventSkipNum, eventMaxNum > 0? eventSkipNum + eventMaxNum : totalNumEvents);
  
     for(size_t eventNum = eventSkipNum; eventNum < totalNumEvents; eventNum++){
         if(eventMaxNum > 0 && eventNum >= eventSkipNum + eventMaxNum){
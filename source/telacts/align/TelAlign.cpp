@@ -1,6 +1,9 @@
 #include "TelActs.hh"
+#include "TelEventJson.hpp"
 #include "getopt.h"
 
+#include <thread>
+
 using namespace Acts::UnitLiterals;
 
 static const std::string help_usage = R"(
@@ -238,33 +241,28 @@ int main(int argc, char *argv[]) {
 
     //
     size_t n_datapack_select_opt = 20000;
-    JsonFileDeserializer jsf(datafile_name);
+    altel::TelEventJsonReader jsreader(datafile_name, std::thread::hardware_concurrency(),
+                                       -0.02924 * 1024 / 2.0, -0.02688 * 512 / 2.0);
     std::vector<std::vector<TelActs::PixelSourceLink>> sourcelinkTracks;
-    while (jsf) {
+    while (1) {
       if (sourcelinkTracks.size() > n_datapack_select_opt) {
         break;
       }
-      auto evpack = jsf.getNextJsonDocument();
-      if(evpack.IsNull()){
-        std::fprintf(stdout, "reach null object, end of file\n");
+      auto telEvent = jsreader.createNextTelEvent();
+      if(!telEvent){
+        std::fprintf(stdout, "reach end of file\n");
         break;
       }
       std::vector<TelActs::PixelSourceLink> sourcelinks;
 
-      const auto &layers = evpack["layers"];
-      for (const auto &layer : layers.GetArray()) {
-        size_t id_ext = layer["ext"].GetUint();
-        auto surface_it = surfaces_selected.find(id_ext);
+      for (const auto &aMeasHit : telEvent->measHits()) {
+        auto surface_it = surfaces_selected.find(aMeasHit->detN());
         if (surface_it == surfaces_selected.end()) {
           continue;
         }
-        for (const auto &hit : layer["hit"].GetArray()) {
-          double x_hit = hit["pos"][0].GetDouble() - 0.02924 * 1024 / 2.0;
-          double y_hit = hit["pos"][1].GetDouble() - 0.02688 * 512 / 2.0;
-          Acts::Vector2D loc_hit;
-          loc_hit << x_hit, y_hit;
-          sourcelinks.emplace_back(*(surface_it->second), loc_hit, cov_hit);
-        }
+        Acts::Vector2D loc_hit;
+        loc_hit << aMeasHit->u(), aMeasHit->v();
+        sourcelinks.emplace_back(*(surface_it->second), loc_hit, cov_hit);
       }
 
       // drop multiple hits events
@@ -10,6 +10,8 @@
 
 #include "TelEvent.hpp"
 #include "TelSourceLink.hpp"
+#include "TelSourceLinkSelector.hpp"
+#include "TelHitMatcher.hpp"
 #include "myrapidjson.h"
 
 namespace TelActs{
@@ -26,7 +28,7 @@ namespace TelActs{
                                           Acts::Logging::Level lvl);
 
   using CKFOptions
-  =  Acts::CombinatorialKalmanFilterOptions<Acts::CKFSourceLinkSelector>;
+  =  Acts::CombinatorialKalmanFilterOptions<TelSourceLinkSelector>;
   using TrackFinderResult
   = Acts::Result<Acts::CombinatorialKalmanFilterResult<TelSourceLink>>;
   using TrackFinderFunction
@@ -35,6 +37,15 @@ namespace TelActs{
   TrackFinderFunction makeTrackFinderFunction(std::shared_ptr<const Acts::TrackingGeometry> trackingGeometry,
                                               std::shared_ptr<Acts::ConstantBField> magneticField);
 
+  // the same with Acts::CKFSourceLinkSelector, which tests every source link of a surface
+  using CKFLinearOptions
+  =  Acts::CombinatorialKalmanFilterOptions<Acts::CKFSourceLinkSelector>;
+  using LinearTrackFinderFunction
+  = std::function<TrackFinderResult(const std::vector<TelSourceLink> &,
+                                    const Acts::BoundTrackParameters &, const CKFLinearOptions &)>;
+  LinearTrackFinderFunction makeLinearTrackFinderFunction(std::shared_ptr<const Acts::TrackingGeometry> trackingGeometry,
+                                                          std::shared_ptr<Acts::ConstantBField> magneticField);
+
   Acts::FreeToBoundMatrix
   freeToCurvilinearJacobian(const Acts::Vector3D &direction);
 
@@ -59,12 +70,14 @@ namespace TelActs{
                            std::shared_ptr<altel::TelEvent> telEvent,
                            const std::map<Acts::GeometryIdentifier, size_t>&  mapSurId2DetId);
 
+  // merges the hits of extraEvent into aEvent and matches them to its trajectories by TelHitMatcher
   void mergeAndMatchExtraTelEvent(std::shared_ptr<altel::TelEvent> aEvent,
                                   std::shared_ptr<altel::TelEvent> extraEvent,
                                   double maxHitMatchDist,
-                                  double minFitHitsPerTraj=3);
-
+                                  double minFitHitsPerTraj=3,
+                                  TelHitMatcher::Policy policy=TelHitMatcher::Policy::Greedy);
 
+  // as above, each trajectory taking its closest hit, also one matched by another trajectory
   void mergeAndMatchExtraTelEventForTraj(std::shared_ptr<altel::TelEvent> aEvent,
                                          std::shared_ptr<altel::TelEvent> extraEvent,
                                          double maxMatchDist,
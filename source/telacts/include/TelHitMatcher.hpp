@@ -0,0 +1,51 @@
+#pragma once
+
+#include "TelEvent.hpp"
+
+namespace TelActs{
+
+  // Matching of target (DUT) hits to the fitted hits of trajectories on the same detector.
+  //
+  // Per event, the target hits of a detector are put into a grid of maxMatchDist bins, so
+  // each fitted hit only looks at the hits of the 3x3 bins around it. The origin measure
+  // hit count of a trajectory is taken once. Pairs within maxMatchDist are then assigned one
+  // to one: Greedy takes the closest pairs first, Optimal matches as many pairs as possible
+  // with the least total distance, by Hungarian assignment per group of pairs sharing hits.
+  // With one trajectory both give its fitted hit the closest target hit. Closest is not one
+  // to one, every fitted hit takes its closest target hit, shared or not.
+  class TelHitMatcher{
+  public:
+    enum class Policy{
+      Greedy,
+      Optimal,
+      Closest
+    };
+
+    struct Config{
+      double maxMatchDist{0.4}; // mm
+      double minFitHitsPerTraj{3}; // origin measure hits of trajectory
+      Policy policy{Policy::Greedy};
+    };
+
+    TelHitMatcher(const Config& conf) : m_conf(conf) {}
+
+    // sets the matched measure hit of the trajectory hits without origin measure hit,
+    // returns the number of matched hits
+    size_t match(altel::TelEvent& telEvent,
+                 const std::vector<std::shared_ptr<altel::TelMeasHit>>& measHits) const;
+
+    static bool parsePolicy(const std::string& str, Policy& policy);
+
+  private:
+    struct Candidate{
+      double dist;
+      size_t hit;  // index of measHits
+      size_t fit;  // index of fitted hits
+    };
+
+    // minimal total distance with the most pairs, for pairs of one group
+    static std::vector<size_t> assignOptimal(const std::vector<Candidate>& cands);
+
+    Config m_conf;
+  };
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Acts/EventData/TrackParameters.hpp"
+#include "Acts/Geometry/GeometryContext.hpp"
+#include "Acts/Geometry/PlaneLayer.hpp"
+#include "Acts/Utilities/Definitions.hpp"
+#include "Acts/Utilities/Units.hpp"
+
+#include "TelEvent.hpp"
+
+namespace TelActs{
+
+  // Seeds for the CombinatorialKalmanFilter from the hits of the first planes, instead of one
+  // seed as wide as the beam.
+  //
+  // A seed is a pair of hits on the first and the third plane in beam order, whose direction
+  // is within maxAngle of the beam axis. With tripletWindow > 0 the pair also needs a hit on
+  // the second plane within that distance of its line. Each seed starts just upstream of its
+  // first hit with a narrow covariance, so CKF runs with one branch per plane and one track
+  // per seed. Seeds of the same particle give the same track, removeDuplicates keeps one.
+  //
+  // Hits of the first or the third plane in no such pair are paired with a hit on the second
+  // plane instead, and pairs without the confirming hit on the second plane are kept when
+  // neither of their hits is in a confirmed pair, so that a particle missed by one of the three
+  // planes still gets a seed. These come after the full pairs. An event may get no seed at all,
+  // the caller falls back to the beam seed then.
+  class TelSeedFinder{
+  public:
+    struct Config{
+      double beamPosition{-5000 * Acts::UnitConstants::mm}; // only the direction is used, toward origin
+      double beamEnergy{5 * Acts::UnitConstants::GeV};
+      double particleQ{1};
+      double maxAngle{0.01};
+      double tripletWindow{0.5 * Acts::UnitConstants::mm}; // 0 for pair seeds
+      double seedResPos{0.05 * Acts::UnitConstants::mm};
+      double seedResAngle{0.001};
+      double upstreamDistance{10 * Acts::UnitConstants::mm};
+      size_t maxSeeds{100}; // per event, the pairs closest to the beam direction first
+    };
+
+    TelSeedFinder(const Config& conf, const Acts::GeometryContext& gctx,
+                  const std::map<size_t, std::shared_ptr<const Acts::PlaneLayer>>& mapDetId2PlaneLayer);
+
+    std::vector<Acts::CurvilinearTrackParameters> createSeeds(const altel::TelEvent& telEvent) const;
+
+    // drops trajectories sharing an origin measure hit with a better one, more origin measure
+    // hits first, then smaller sum of squared residuals. Trajectory ids are renumbered.
+    // returns the number of dropped trajectories
+    static size_t removeDuplicates(altel::TelEvent& telEvent);
+
+  private:
+    struct Plane{
+      size_t detId{0};
+      Acts::RotationMatrix3D rotation{Acts::RotationMatrix3D::Identity()};
+      Acts::Vector3D center{Acts::Vector3D::Zero()};
+    };
+
+    Acts::Vector3D globalPosition(const Plane& pl, const altel::TelMeasHit& hit) const;
+
+    Config m_conf;
+    std::vector<Plane> m_planes; // first, second and third plane in beam order
+    double m_beam_dir{1}; // +1 or -1 along x
+  };
+}
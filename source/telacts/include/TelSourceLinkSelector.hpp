@@ -0,0 +1,214 @@
+#pragma once
+
+#include "Acts/TrackFinding/CKFSourceLinkSelector.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <variant>
+#include <vector>
+
+namespace TelActs{
+
+  // Acts::CKFSourceLinkSelector, with a grid index over the source links of a surface.
+  //
+  // The index of a surface is built the first time a track reaches it in an event, the CKF
+  // keeps the source links of a surface in one vector for the whole event. A track then
+  // only computes the chi2 of the links in the bins overlapping the bounding box of its
+  // chi2 cut ellipse, instead of all links of the surface. The candidates and their order
+  // are the same as of Acts::CKFSourceLinkSelector. Only the outlier reported when no link
+  // passes the cut is the best of the visited links instead of the best of all, it is not
+  // used by the filter nor by fillTelTrajectories.
+  struct TelSourceLinkSelector{
+  public:
+    using Config = Acts::CKFSourceLinkSelector::Config;
+
+    // surfaces with fewer source links are searched linearly
+    static constexpr size_t s_min_indexed_links = 8;
+
+    TelSourceLinkSelector() = default;
+    TelSourceLinkSelector(Config cfg) : m_config(std::move(cfg)) {}
+
+    template <typename calibrator_t, typename source_link_t>
+    Acts::Result<void> operator()(
+      const calibrator_t& calibrator,
+      const Acts::BoundTrackParameters& predictedParams,
+      const std::vector<source_link_t>& sourcelinks,
+      std::vector<std::pair<size_t, double>>& sourcelinkChi2,
+      std::vector<size_t>& sourcelinkCandidateIndices, bool& isOutlier,
+      Acts::LoggerWrapper /*logger*/) const {
+      if (sourcelinks.empty()) {
+        return Acts::CombinatorialKalmanFilterError::SourcelinkSelectionFailed;
+      }
+      auto cuts = m_config.find(predictedParams.referenceSurface().geometryId());
+      if (cuts == m_config.end()) {
+        return Acts::CombinatorialKalmanFilterError::SourcelinkSelectionFailed;
+      }
+      const double chi2CutOff = cuts->chi2CutOff;
+      const size_t numSourcelinksCutOff = cuts->numSourcelinksCutOff;
+
+      sourcelinkChi2.resize(sourcelinks.size());
+      double minChi2 = std::numeric_limits<double>::max();
+      size_t minIndex = 0;
+      size_t nInitialCandidates = 0;
+      auto testSourcelink = [&](size_t index){
+        std::visit(
+          [&](const auto& calibrated) {
+            const auto& H = calibrated.projector();
+            const auto& predictedCovariance = *predictedParams.covariance();
+            const auto& residual = calibrated.residual(predictedParams.parameters());
+            double chi2 = (residual.transpose() *
+                           ((calibrated.covariance() +
+                             H * predictedCovariance * H.transpose()))
+                           .inverse() *
+                           residual)
+              .eval()(0, 0);
+            if (chi2 < chi2CutOff) {
+              sourcelinkChi2[nInitialCandidates] = {index, chi2};
+              nInitialCandidates++;
+            }
+            if (chi2 < minChi2) {
+              minChi2 = chi2;
+              minIndex = index;
+            }
+          },
+          calibrator(sourcelinks[index], predictedParams));
+      };
+
+      const Index* index = nullptr;
+      if (sourcelinks.size() >= s_min_indexed_links &&
+          chi2CutOff < std::numeric_limits<double>::max()) {
+        index = &surfaceIndex(calibrator, predictedParams, sourcelinks);
+      }
+      if (!index) {
+        for (size_t n = 0; n < sourcelinks.size(); n++) {
+          testSourcelink(n);
+        }
+      }
+      else {
+        // bounding box of the ellipse r^T (C_pred + C_meas)^-1 r < chi2CutOff
+        const auto& pars = predictedParams.parameters();
+        const auto& cov = *predictedParams.covariance();
+        double halfU = std::sqrt(chi2CutOff * (cov(Acts::eBoundLoc0, Acts::eBoundLoc0) + index->maxVar[0]));
+        double halfV = std::sqrt(chi2CutOff * (cov(Acts::eBoundLoc1, Acts::eBoundLoc1) + index->maxVar[1]));
+        size_t u0 = index->binU(pars[Acts::eBoundLoc0] - halfU);
+        size_t u1 = index->binU(pars[Acts::eBoundLoc0] + halfU);
+        size_t v0 = index->binV(pars[Acts::eBoundLoc1] - halfV);
+        size_t v1 = index->binV(pars[Acts::eBoundLoc1] + halfV);
+        for (size_t v = v0; v <= v1; v++) {
+          for (size_t u = u0; u <= u1; u++) {
+            size_t bin = v * index->nU + u;
+            for (size_t k = index->binStart[bin]; k < index->binStart[bin + 1]; k++) {
+              testSourcelink(index->order[k]);
+            }
+          }
+        }
+      }
+
+      size_t nFinalCandidates = std::min(nInitialCandidates, numSourcelinksCutOff);
+      if (nFinalCandidates == 0) {
+        sourcelinkCandidateIndices.resize(1);
+        sourcelinkCandidateIndices[0] = minIndex;
+        isOutlier = true;
+        return Acts::Result<void>::success();
+      }
+      sourcelinkCandidateIndices.resize(nFinalCandidates);
+      std::sort(sourcelinkChi2.begin(), sourcelinkChi2.begin() + nInitialCandidates,
+                [](const std::pair<size_t, double>& lchi2, const std::pair<size_t, double>& rchi2) {
+                  return lchi2.second < rchi2.second;
+                });
+      for (size_t n = 0; n < nFinalCandidates; n++) {
+        sourcelinkCandidateIndices[n] = sourcelinkChi2[n].first;
+      }
+      isOutlier = false;
+      return Acts::Result<void>::success();
+    }
+
+    Config m_config;
+
+  private:
+    struct Index{
+      const void* key{nullptr}; // data() of the source link vector of the surface
+      size_t linkN{0};
+      double minU{0};
+      double minV{0};
+      double invBinU{0};
+      double invBinV{0};
+      size_t nU{1};
+      size_t nV{1};
+      double maxVar[2]{0, 0}; // largest measurement variance in loc0, loc1
+      std::vector<uint32_t> binStart; // order[binStart[b]] ... order[binStart[b+1]-1] are in bin b
+      std::vector<uint32_t> order;
+
+      size_t binU(double u) const {
+        double b = std::floor((u - minU) * invBinU);
+        return b < 0 ? 0 : (b >= nU ? nU - 1 : size_t(b));
+      }
+      size_t binV(double v) const {
+        double b = std::floor((v - minV) * invBinV);
+        return b < 0 ? 0 : (b >= nV ? nV - 1 : size_t(b));
+      }
+    };
+
+    template <typename calibrator_t, typename source_link_t>
+    const Index& surfaceIndex(const calibrator_t& calibrator,
+                              const Acts::BoundTrackParameters& predictedParams,
+                              const std::vector<source_link_t>& sourcelinks) const {
+      for (const auto& index : m_indices) {
+        if (index.key == sourcelinks.data() && index.linkN == sourcelinks.size()) {
+          return index;
+        }
+      }
+      m_indices.emplace_back();
+      Index& index = m_indices.back();
+      index.key = sourcelinks.data();
+      index.linkN = sourcelinks.size();
+
+      std::vector<Acts::Vector2D> pos(sourcelinks.size());
+      for (size_t n = 0; n < sourcelinks.size(); n++) {
+        std::visit(
+          [&](const auto& calibrated) {
+            pos[n] = Acts::Vector2D(calibrated.parameters()[0], calibrated.parameters()[1]);
+            index.maxVar[0] = std::max<double>(index.maxVar[0], calibrated.covariance()(0, 0));
+            index.maxVar[1] = std::max<double>(index.maxVar[1], calibrated.covariance()(1, 1));
+          },
+          calibrator(sourcelinks[n], predictedParams));
+      }
+      double maxU = pos[0][0];
+      double maxV = pos[0][1];
+      index.minU = pos[0][0];
+      index.minV = pos[0][1];
+      for (const auto& p : pos) {
+        index.minU = std::min(index.minU, p[0]);
+        index.minV = std::min(index.minV, p[1]);
+        maxU = std::max(maxU, p[0]);
+        maxV = std::max(maxV, p[1]);
+      }
+      // about one link per bin
+      size_t binN = size_t(std::ceil(std::sqrt(double(sourcelinks.size()))));
+      index.nU = maxU > index.minU ? binN : 1;
+      index.nV = maxV > index.minV ? binN : 1;
+      index.invBinU = maxU > index.minU ? index.nU / (maxU - index.minU) : 0;
+      index.invBinV = maxV > index.minV ? index.nV / (maxV - index.minV) : 0;
+
+      std::vector<uint32_t> bins(pos.size());
+      index.binStart.assign(index.nU * index.nV + 1, 0);
+      for (size_t n = 0; n < pos.size(); n++) {
+        bins[n] = index.binV(pos[n][1]) * index.nU + index.binU(pos[n][0]);
+        index.binStart[bins[n] + 1]++;
+      }
+      for (size_t b = 0; b + 1 < index.binStart.size(); b++) {
+        index.binStart[b + 1] += index.binStart[b];
+      }
+      index.order.resize(pos.size());
+      std::vector<uint32_t> fill(index.binStart.begin(), index.binStart.end() - 1);
+      for (size_t n = 0; n < pos.size(); n++) {
+        index.order[fill[bins[n]]++] = n;
+      }
+      return index;
+    }
+
+    // per CKF call, the selector is copied into the propagation state with the CKF actor
+    mutable std::vector<Index> m_indices;
+  };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Acts/Geometry/GeometryContext.hpp"
+#include "Acts/Geometry/PlaneLayer.hpp"
+#include "Acts/Utilities/Definitions.hpp"
+#include "Acts/Utilities/Units.hpp"
+
+#include "TelEvent.hpp"
+
+namespace TelActs{
+
+  // Track finder and fitter for runs without magnetic field, an alternative to the
+  // CombinatorialKalmanFilter of makeTrackFinderFunction with the same selection.
+  //
+  // The track is a straight line y0 + ty*(x-x0), z0 + tz*(x-x0) from the collimator at
+  // x0 = beamPosition, plus a lateral displacement per plane from the multiple scattering in
+  // the planes upstream of it. The beam gives the prior of the line, the Highland angles of
+  // the silicon the covariance of the displacements. Hits are taken plane by plane in beam
+  // order, as CKF does: the best hit with chi2 below the cut, or up to maxBranches hits of a
+  // plane as separate tracks. Each taken hit is a linear update of line and displacements, so
+  // that after the last plane the state is the weighted least squares fit of all hits, the
+  // same as the smoothed CKF states. Trajectories are filled as fillTelTrajectories does.
+  class TelStraightLineFinder{
+  public:
+    struct Config{
+      double beamPosition{-5000 * Acts::UnitConstants::mm};
+      double seedResX{20 * Acts::UnitConstants::mm};
+      double seedResY{20 * Acts::UnitConstants::mm};
+      double seedResPhi{0.01};
+      double seedResTheta{0.01};
+      double beamEnergy{5 * Acts::UnitConstants::GeV};
+      double particleMass{0.511 * Acts::UnitConstants::MeV};
+      double particleQ{1};
+      int absPdgCode{211}; // as Acts::PropagatorPlainOptions, Rossi-Greisen for 11, else Highland
+      double measResU{6 * Acts::UnitConstants::um}; // as TelSourceLink
+      double measResV{6 * Acts::UnitConstants::um};
+      double cutChiSquared{13.816};
+      std::map<size_t, size_t> maxBranches; // per detector id, 1 if not set
+    };
+
+    struct Plane{
+      size_t detId{0};
+      Acts::RotationMatrix3D rotation{Acts::RotationMatrix3D::Identity()};
+      Acts::Vector3D center{Acts::Vector3D::Zero()};
+      double xOverX0{0};
+      double minU{0};
+      double maxU{0};
+      double minV{0};
+      double maxV{0};
+    };
+
+    TelStraightLineFinder(const Config& conf, std::vector<Plane> planes);
+
+    // planes of the layers, material and rectangle bounds as TelActs::createPlaneLayer sets them
+    static std::vector<Plane> createPlanes(const Acts::GeometryContext& gctx,
+                                           const std::map<size_t, std::shared_ptr<const Acts::PlaneLayer>>& mapDetId2PlaneLayer);
+
+    // finds tracks in the measure hits of the event and appends them to its trajectories
+    void findTracks(std::shared_ptr<altel::TelEvent> telEvent) const;
+
+  private:
+    struct Branch;
+
+    // local position on plane n of the line and displacement in state, with its jacobian
+    // to line parameters, the columns of the displacement are its first two
+    Acts::Vector2D localPosition(const Eigen::VectorXd& state, size_t n,
+                                 Eigen::Matrix<double, 2, 4>* jac, Acts::Vector3D* global) const;
+    // weighted update of the state by a hit on plane n, linearised at stateLin
+    void update(Branch& br, const Eigen::VectorXd& stateLin, size_t n,
+                const Acts::Vector2D& meas) const;
+    // predicted local position on plane n and inverse covariance of the residual of a hit
+    void predict(const Branch& br, size_t n, Acts::Vector2D& pred, Acts::SymMatrix2D& resInv) const;
+
+    Config m_conf;
+    std::vector<Plane> m_planes; // in beam order
+    std::vector<size_t> m_max_branches;
+    double m_beam_dir{1}; // +1 or -1 along x
+    Eigen::VectorXd m_state0;
+    Eigen::MatrixXd m_cov0;
+  };
+}
@@ -273,45 +273,15 @@ using namespace Acts::UnitLiterals;
 void TelActs::mergeAndMatchExtraTelEvent(std::shared_ptr<altel::TelEvent> aEvent,
                                          std::shared_ptr<altel::TelEvent> extraEvent,
                                          double maxMatchDist,
-                                         double minFitHitsPerTraj){
+                                         double minFitHitsPerTraj,
+                                         TelHitMatcher::Policy policy){
 
   // TODO: test if existing, however it does not hurt ttree write
   aEvent->MRs.insert(aEvent->MRs.end(), extraEvent->MRs.begin(), extraEvent->MRs.end());
   aEvent->MHs.insert(aEvent->MHs.end(), extraEvent->MHs.begin(), extraEvent->MHs.end());
 
-  auto &extraMeasHits = extraEvent->MHs;
-
-  for(auto &aMeasHit : extraMeasHits){
-    size_t id = aMeasHit->DN;
-
-    double bestMatchedDist = HUGE_VAL;
-    std::shared_ptr<altel::TelTrajHit> bestMatchedTrajHit;
-    for(auto &aTraj: aEvent->TJs){
-      size_t fittedHitNum = aTraj->numOriginMeasHit();
-      if(fittedHitNum<minFitHitsPerTraj){
-        continue;
-      }
-      auto aTrajHit = aTraj->trajHit(id);
-      if(!aTrajHit || !aTrajHit->hasFitHit() || aTrajHit->hasOriginMeasHit()){
-        continue;
-      }
-      Acts::Vector2D xy_fit(aTrajHit->FH->PLs[0], aTrajHit->FH->PLs[1]);
-      Acts::Vector2D xy_meas (aMeasHit->PLs[0], aMeasHit->PLs[1]);
-      Acts::Vector2D xy_resid = xy_meas - xy_fit;
-      double dist = xy_resid.norm();
-      if(dist>maxMatchDist || dist>bestMatchedDist){
-        continue;
-      }
-
-      bestMatchedDist = dist;
-      bestMatchedTrajHit = aTrajHit;
-    }
-
-    if(bestMatchedTrajHit){
-      bestMatchedTrajHit->MM=aMeasHit;
-    }
-
-  }
+  TelHitMatcher matcher({maxMatchDist, minFitHitsPerTraj, policy});
+  matcher.match(*aEvent, extraEvent->MHs);
 }
 
 
@@ -320,47 +290,7 @@ void TelActs::mergeAndMatchExtraTelEventForTraj(std::shared_ptr<altel::TelEvent>
                                                 std::shared_ptr<altel::TelEvent> extraEvent,
                                                 double maxMatchDist,
                                                 double minFitHitsPerTraj){
-
-  // TODO: test if existing, however it does not hurt ttree write
-  aEvent->MRs.insert(aEvent->MRs.end(), extraEvent->MRs.begin(), extraEvent->MRs.end());
-  aEvent->MHs.insert(aEvent->MHs.end(), extraEvent->MHs.begin(), extraEvent->MHs.end());
-
-  auto &extraMeasHits = extraEvent->MHs;
-
-  for(auto &aTraj: aEvent->TJs){
-    size_t fittedHitNum = aTraj->numOriginMeasHit();
-    if(fittedHitNum<minFitHitsPerTraj){
-      continue;
-    }
-
-    for(auto &aTrajHit: aTraj->THs){
-      if(!aTrajHit || !aTrajHit->hasFitHit() || aTrajHit->hasOriginMeasHit()){
-        continue;
-      }
-      size_t aTrajHitId = aTrajHit->DN;
-      double bestMatchedDist = HUGE_VAL;
-      std::shared_ptr<altel::TelMeasHit> bestMatchedMeasHit;
-
-      for(auto &aMeasHit : extraMeasHits){
-        size_t aMeasHitId = aMeasHit->DN;
-        if( aMeasHitId != aTrajHitId ){
-          continue;
-        }
-        Acts::Vector2D xy_fit(aTrajHit->FH->PLs[0], aTrajHit->FH->PLs[1]);
-        Acts::Vector2D xy_meas (aMeasHit->PLs[0], aMeasHit->PLs[1]);
-        Acts::Vector2D xy_resid = xy_meas - xy_fit;
-        double dist = xy_resid.norm();
-        if(dist>maxMatchDist || dist>bestMatchedDist){
-          continue;
-        }
-        bestMatchedDist = dist;
-        bestMatchedMeasHit = aMeasHit;
-      }
-      if(bestMatchedMeasHit){
-        aTrajHit->MM=bestMatchedMeasHit;
-      }
-    }
-  }
+  mergeAndMatchExtraTelEvent(aEvent, extraEvent, maxMatchDist, minFitHitsPerTraj, TelHitMatcher::Policy::Closest);
 }
 
 
@@ -0,0 +1,242 @@
+#include "TelHitMatcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+bool TelActs::TelHitMatcher::parsePolicy(const std::string& str, Policy& policy){
+  if(str == "greedy"){
+    policy = Policy::Greedy;
+    return true;
+  }
+  if(str == "optimal"){
+    policy = Policy::Optimal;
+    return true;
+  }
+  if(str == "closest"){
+    policy = Policy::Closest;
+    return true;
+  }
+  return false;
+}
+
+size_t TelActs::TelHitMatcher::match(altel::TelEvent& telEvent,
+                                     const std::vector<std::shared_ptr<altel::TelMeasHit>>& measHits) const{
+  if(measHits.empty()){
+    return 0;
+  }
+
+  // fitted hits without origin measure hit, the first trajectory hit of a detector as TelTrajectory::trajHit
+  std::vector<std::shared_ptr<altel::TelTrajHit>> fits;
+  std::vector<uint16_t> trajDetNs;
+  for(auto& aTraj: telEvent.TJs){
+    if(aTraj->numOriginMeasHit() < m_conf.minFitHitsPerTraj){
+      continue;
+    }
+    trajDetNs.clear();
+    for(auto& aTrajHit: aTraj->THs){
+      if(!aTrajHit || std::find(trajDetNs.begin(), trajDetNs.end(), aTrajHit->DN) != trajDetNs.end()){
+        continue;
+      }
+      trajDetNs.push_back(aTrajHit->DN);
+      if(!aTrajHit->hasFitHit() || aTrajHit->hasOriginMeasHit()){
+        continue;
+      }
+      fits.push_back(aTrajHit);
+    }
+  }
+  if(fits.empty()){
+    return 0;
+  }
+
+  // grid of measure hits, sorted by detector and bin
+  const double binSize = m_conf.maxMatchDist > 0? m_conf.maxMatchDist : 1;
+  using GridKey = std::tuple<uint16_t, int64_t, int64_t>;
+  auto gridKey = [binSize](uint16_t detN, double u, double v)->GridKey{
+                   return GridKey(detN, int64_t(std::floor(u / binSize)), int64_t(std::floor(v / binSize)));
+                 };
+  std::vector<std::pair<GridKey, size_t>> grid;
+  grid.reserve(measHits.size());
+  for(size_t n = 0; n < measHits.size(); n++){
+    grid.emplace_back(gridKey(measHits[n]->DN, measHits[n]->PLs[0], measHits[n]->PLs[1]), n);
+  }
+  std::sort(grid.begin(), grid.end());
+
+  std::vector<Candidate> cands;
+  for(size_t f = 0; f < fits.size(); f++){
+    auto& fh = *fits[f]->FH;
+    auto [detN, bu, bv] = gridKey(fits[f]->DN, fh.PLs[0], fh.PLs[1]);
+    for(int64_t du = -1; du <= 1; du++){
+      auto itBegin = std::lower_bound(grid.begin(), grid.end(), std::make_pair(GridKey(detN, bu + du, bv - 1), size_t(0)));
+      auto itEnd = std::lower_bound(itBegin, grid.end(), std::make_pair(GridKey(detN, bu + du, bv + 2), size_t(0)));
+      for(auto it = itBegin; it != itEnd; ++it){
+        auto& mh = *measHits[it->second];
+        double dist = std::hypot(mh.PLs[0] - fh.PLs[0], mh.PLs[1] - fh.PLs[1]);
+        if(dist > m_conf.maxMatchDist){
+          continue;
+        }
+        cands.push_back({dist, it->second, f});
+      }
+    }
+  }
+
+  std::vector<size_t> chosen;
+  if(m_conf.policy == Policy::Greedy){
+    std::sort(cands.begin(), cands.end(), [](const Candidate& a, const Candidate& b){
+                                            return std::tie(a.dist, a.hit, a.fit) < std::tie(b.dist, b.hit, b.fit);});
+    std::vector<char> hitUsed(measHits.size(), 0);
+    std::vector<char> fitUsed(fits.size(), 0);
+    for(size_t n = 0; n < cands.size(); n++){
+      if(hitUsed[cands[n].hit] || fitUsed[cands[n].fit]){
+        continue;
+      }
+      hitUsed[cands[n].hit] = 1;
+      fitUsed[cands[n].fit] = 1;
+      chosen.push_back(n);
+    }
+  }
+  else if(m_conf.policy == Policy::Closest){
+    // candidates come grouped by fitted hit, ties go to the later measure hit
+    for(size_t n = 0; n < cands.size(); n++){
+      if(!chosen.empty() && cands[chosen.back()].fit == cands[n].fit){
+        auto& best = cands[chosen.back()];
+        if(cands[n].dist < best.dist || (cands[n].dist == best.dist && cands[n].hit > best.hit)){
+          chosen.back() = n;
+        }
+        continue;
+      }
+      chosen.push_back(n);
+    }
+  }
+  else{
+    // groups of pairs connected by shared hits, nodes are measure hits then fitted hits
+    std::vector<size_t> parent(measHits.size() + fits.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto root = [&parent](size_t n){
+                  while(parent[n] != n){
+                    parent[n] = parent[parent[n]];
+                    n = parent[n];
+                  }
+                  return n;
+                };
+    for(auto& c: cands){
+      parent[root(c.hit)] = root(measHits.size() + c.fit);
+    }
+    std::vector<size_t> order(cands.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+                                            return root(cands[a].hit) < root(cands[b].hit);});
+    std::vector<Candidate> group;
+    std::vector<size_t> groupIndex;
+    for(size_t n = 0; n < order.size(); n++){
+      group.push_back(cands[order[n]]);
+      groupIndex.push_back(order[n]);
+      if(n + 1 < order.size() && root(cands[order[n + 1]].hit) == root(cands[order[n]].hit)){
+        continue;
+      }
+      if(group.size() == 1){
+        chosen.push_back(groupIndex[0]);
+      }
+      else{
+        for(size_t k: assignOptimal(group)){
+          chosen.push_back(groupIndex[k]);
+        }
+      }
+      group.clear();
+      groupIndex.clear();
+    }
+  }
+
+  for(size_t n: chosen){
+    fits[cands[n].fit]->MM = measHits[cands[n].hit];
+  }
+  return chosen.size();
+}
+
+std::vector<size_t> TelActs::TelHitMatcher::assignOptimal(const std::vector<Candidate>& cands){
+  std::vector<size_t> rows;
+  std::vector<size_t> cols;
+  for(auto& c: cands){
+    rows.push_back(c.hit);
+    cols.push_back(c.fit);
+  }
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+  std::sort(cols.begin(), cols.end());
+  cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+  size_t n = std::max(rows.size(), cols.size());
+
+  // a pair costs its distance minus a bonus larger than any sum of distances,
+  // so that more pairs always win, no pair costs 0
+  double maxDist = 0;
+  for(auto& c: cands){
+    maxDist = std::max(maxDist, c.dist);
+  }
+  double bonus = (n + 1) * (maxDist + 1);
+  std::vector<std::vector<double>> cost(n + 1, std::vector<double>(n + 1, 0));
+  std::vector<std::vector<int64_t>> candAt(n + 1, std::vector<int64_t>(n + 1, -1));
+  for(size_t k = 0; k < cands.size(); k++){
+    size_t i = std::lower_bound(rows.begin(), rows.end(), cands[k].hit) - rows.begin() + 1;
+    size_t j = std::lower_bound(cols.begin(), cols.end(), cands[k].fit) - cols.begin() + 1;
+    cost[i][j] = cands[k].dist - bonus;
+    candAt[i][j] = k;
+  }
+
+  // Hungarian algorithm with potentials, rows and columns from 1
+  const double inf = std::numeric_limits<double>::max();
+  std::vector<double> potRow(n + 1, 0);
+  std::vector<double> potCol(n + 1, 0);
+  std::vector<size_t> rowOfCol(n + 1, 0);
+  std::vector<size_t> way(n + 1, 0);
+  for(size_t i = 1; i <= n; i++){
+    rowOfCol[0] = i;
+    size_t j0 = 0;
+    std::vector<double> minv(n + 1, inf);
+    std::vector<char> used(n + 1, 0);
+    do{
+      used[j0] = 1;
+      size_t i0 = rowOfCol[j0];
+      size_t j1 = 0;
+      double delta = inf;
+      for(size_t j = 1; j <= n; j++){
+        if(used[j]){
+          continue;
+        }
+        double cur = cost[i0][j] - potRow[i0] - potCol[j];
+        if(cur < minv[j]){
+          minv[j] = cur;
+          way[j] = j0;
+        }
+        if(minv[j] < delta){
+          delta = minv[j];
+          j1 = j;
+        }
+      }
+      for(size_t j = 0; j <= n; j++){
+        if(used[j]){
+          potRow[rowOfCol[j]] += delta;
+          potCol[j] -= delta;
+        }
+        else{
+          minv[j] -= delta;
+        }
+      }
+      j0 = j1;
+    }while(rowOfCol[j0] != 0);
+    do{
+      size_t j1 = way[j0];
+      rowOfCol[j0] = rowOfCol[j1];
+      j0 = j1;
+    }while(j0);
+  }
+
+  std::vector<size_t> chosen;
+  for(size_t j = 1; j <= n; j++){
+    if(rowOfCol[j] && candAt[rowOfCol[j]][j] >= 0){
+      chosen.push_back(candAt[rowOfCol[j]][j]);
+    }
+  }
+  return chosen;
+}
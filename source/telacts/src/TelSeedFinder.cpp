@@ -0,0 +1,206 @@
+#include "TelSeedFinder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+TelActs::TelSeedFinder::TelSeedFinder(const Config& conf, const Acts::GeometryContext& gctx,
+                                      const std::map<size_t, std::shared_ptr<const Acts::PlaneLayer>>& mapDetId2PlaneLayer)
+  :m_conf(conf){
+  m_beam_dir = m_conf.beamPosition<=0? 1 : -1; // toward origin
+  std::vector<Plane> planes;
+  for(auto& [detId, planeLayer]: mapDetId2PlaneLayer){
+    Plane pl;
+    pl.detId = detId;
+    const auto& surface = planeLayer->surfaceRepresentation();
+    pl.rotation = surface.transform(gctx).linear();
+    pl.center = surface.transform(gctx).translation();
+    planes.push_back(pl);
+  }
+  if(planes.size() < 3){
+    std::fprintf(stderr, "TelSeedFinder: 3 planes are needed for seeding, only %zu given\n", planes.size());
+    throw;
+  }
+  std::sort(planes.begin(), planes.end(), [this](const Plane& a, const Plane& b){
+                                            return a.center.x() * m_beam_dir < b.center.x() * m_beam_dir;});
+  m_planes.assign(planes.begin(), planes.begin() + 3);
+}
+
+Acts::Vector3D TelActs::TelSeedFinder::globalPosition(const Plane& pl, const altel::TelMeasHit& hit) const{
+  return pl.center + pl.rotation.col(0) * hit.PLs[0] + pl.rotation.col(1) * hit.PLs[1];
+}
+
+std::vector<Acts::CurvilinearTrackParameters>
+TelActs::TelSeedFinder::createSeeds(const altel::TelEvent& telEvent) const{
+  std::vector<Acts::Vector3D> hitsFirst;
+  std::vector<Acts::Vector3D> hitsSecond;
+  std::vector<Acts::Vector3D> hitsThird;
+  for(auto& aHitMeas: telEvent.MHs){
+    if(aHitMeas->DN == m_planes[0].detId){
+      hitsFirst.push_back(globalPosition(m_planes[0], *aHitMeas));
+    }
+    else if(aHitMeas->DN == m_planes[1].detId){
+      hitsSecond.push_back(globalPosition(m_planes[1], *aHitMeas));
+    }
+    else if(aHitMeas->DN == m_planes[2].detId){
+      hitsThird.push_back(globalPosition(m_planes[2], *aHitMeas));
+    }
+  }
+
+  Acts::Vector3D beamDir(m_beam_dir, 0, 0);
+  double minCos = std::cos(m_conf.maxAngle);
+  Acts::Vector3D normalSecond = m_planes[1].rotation.col(2);
+
+  // pair of hits on two of the first three planes, with the angle to beam
+  struct Pair{
+    Acts::Vector3D start; // hit upstream
+    Acts::Vector3D dir;
+    double angleCos;
+  };
+  auto makePair = [&](const Acts::Vector3D& posUp, const Acts::Vector3D& posDown, Pair& pr){
+                    pr.start = posUp;
+                    pr.dir = (posDown - posUp).normalized();
+                    pr.angleCos = pr.dir.dot(beamDir);
+                    return pr.angleCos >= minCos;
+                  };
+  auto byAngle = [](const Pair& a, const Pair& b){return a.angleCos > b.angleCos;};
+
+  std::vector<Pair> pairs;
+  std::vector<Pair> pairsFallback;
+  std::vector<bool> isUsedFirst(hitsFirst.size(), false);
+  std::vector<bool> isUsedThird(hitsThird.size(), false);
+  std::vector<std::pair<size_t, size_t>> pairsUnconfirmed; // first and third, no hit on the second plane
+  for(size_t i = 0; i < hitsFirst.size(); i++){
+    for(size_t k = 0; k < hitsThird.size(); k++){
+      Pair pr;
+      if(!makePair(hitsFirst[i], hitsThird[k], pr)){
+        continue;
+      }
+      if(m_conf.tripletWindow > 0){
+        double nd = normalSecond.dot(pr.dir);
+        if(std::abs(nd) < 1e-6){
+          continue;
+        }
+        Acts::Vector3D cross = hitsFirst[i] + normalSecond.dot(m_planes[1].center - hitsFirst[i]) / nd * pr.dir;
+        bool isConfirmed = false;
+        for(auto& posSecond: hitsSecond){
+          if((posSecond - cross).squaredNorm() < m_conf.tripletWindow * m_conf.tripletWindow){
+            isConfirmed = true;
+            break;
+          }
+        }
+        if(!isConfirmed){
+          pairsUnconfirmed.emplace_back(i, k);
+          continue;
+        }
+      }
+      isUsedFirst[i] = true;
+      isUsedThird[k] = true;
+      pairs.push_back(pr);
+    }
+  }
+
+  // a particle missed by one of the three planes: the second plane stands in for a missed first
+  // or third one, and a triplet goes without the second one
+  for(auto& [i, k]: pairsUnconfirmed){
+    if(!isUsedFirst[i] && !isUsedThird[k]){
+      Pair pr;
+      makePair(hitsFirst[i], hitsThird[k], pr);
+      pairsFallback.push_back(pr);
+    }
+  }
+  for(auto& posSecond: hitsSecond){
+    for(size_t i = 0; i < hitsFirst.size(); i++){
+      Pair pr;
+      if(!isUsedFirst[i] && makePair(hitsFirst[i], posSecond, pr)){
+        pairsFallback.push_back(pr);
+      }
+    }
+    for(size_t k = 0; k < hitsThird.size(); k++){
+      Pair pr;
+      if(!isUsedThird[k] && makePair(posSecond, hitsThird[k], pr)){
+        pairsFallback.push_back(pr);
+      }
+    }
+  }
+
+  // full pairs first, fallback pairs fill up to maxSeeds
+  if(pairs.size() > m_conf.maxSeeds){
+    std::partial_sort(pairs.begin(), pairs.begin() + m_conf.maxSeeds, pairs.end(), byAngle);
+    pairs.resize(m_conf.maxSeeds);
+  }
+  size_t fallbackN = std::min(pairsFallback.size(), m_conf.maxSeeds - pairs.size());
+  std::partial_sort(pairsFallback.begin(), pairsFallback.begin() + fallbackN, pairsFallback.end(), byAngle);
+  pairs.insert(pairs.end(), pairsFallback.begin(), pairsFallback.begin() + fallbackN);
+
+  std::vector<Acts::CurvilinearTrackParameters> seeds;
+  for(auto& pr: pairs){
+    Acts::Vector3D pos = pr.start - m_conf.upstreamDistance * pr.dir;
+    double phi = std::atan2(pr.dir.y(), pr.dir.x());
+    double theta = std::acos(pr.dir.z());
+    double resPos2 = m_conf.seedResPos * m_conf.seedResPos;
+    double resPhi = m_conf.seedResAngle / std::sin(theta);
+    double resTheta = m_conf.seedResAngle;
+    Acts::BoundSymMatrix seedCov = Acts::BoundSymMatrix::Zero();
+    seedCov(Acts::eBoundLoc0, Acts::eBoundLoc0) = resPos2;
+    seedCov(Acts::eBoundLoc1, Acts::eBoundLoc1) = resPos2;
+    seedCov(Acts::eBoundPhi, Acts::eBoundPhi) = resPhi * resPhi;
+    seedCov(Acts::eBoundTheta, Acts::eBoundTheta) = resTheta * resTheta;
+    seedCov(Acts::eBoundQOverP, Acts::eBoundQOverP) = 0.0001;
+    seedCov(Acts::eBoundTime, Acts::eBoundTime) = 1.;
+    seeds.emplace_back(Acts::Vector4D(pos.x(), pos.y(), pos.z(), 0), phi, theta,
+                       m_conf.beamEnergy, m_conf.particleQ, seedCov);
+  }
+  return seeds;
+}
+
+size_t TelActs::TelSeedFinder::removeDuplicates(altel::TelEvent& telEvent){
+  struct Rank{
+    std::shared_ptr<altel::TelTrajectory> traj;
+    size_t measN;
+    double residual2;
+  };
+  std::vector<Rank> ranks;
+  for(auto& aTraj: telEvent.TJs){
+    double residual2 = 0;
+    for(auto& aTrajHit: aTraj->THs){
+      if(aTrajHit && aTrajHit->hasOriginMeasHit()){
+        double du = aTrajHit->FH->PLs[0] - aTrajHit->FH->OM->PLs[0];
+        double dv = aTrajHit->FH->PLs[1] - aTrajHit->FH->OM->PLs[1];
+        residual2 += du * du + dv * dv;
+      }
+    }
+    ranks.push_back({aTraj, aTraj->numOriginMeasHit(), residual2});
+  }
+  std::stable_sort(ranks.begin(), ranks.end(), [](const Rank& a, const Rank& b){
+                                                 if(a.measN != b.measN){
+                                                   return a.measN > b.measN;
+                                                 }
+                                                 return a.residual2 < b.residual2;
+                                               });
+
+  std::set<const altel::TelMeasHit*> usedHits;
+  std::vector<std::shared_ptr<altel::TelTrajectory>> trajs;
+  for(auto& rk: ranks){
+    bool isShared = false;
+    for(auto& aTrajHit: rk.traj->THs){
+      if(aTrajHit && aTrajHit->hasOriginMeasHit() && usedHits.count(aTrajHit->FH->OM.get())){
+        isShared = true;
+        break;
+      }
+    }
+    if(isShared){
+      continue;
+    }
+    for(auto& aTrajHit: rk.traj->THs){
+      if(aTrajHit && aTrajHit->hasOriginMeasHit()){
+        usedHits.insert(aTrajHit->FH->OM.get());
+      }
+    }
+    rk.traj->TN = trajs.size();
+    trajs.push_back(rk.traj);
+  }
+  size_t droppedN = telEvent.TJs.size() - trajs.size();
+  telEvent.TJs = std::move(trajs);
+  return droppedN;
+}
@@ -0,0 +1,262 @@
+#include "TelStraightLineFinder.hpp"
+
+#include "Acts/Material/ISurfaceMaterial.hpp"
+#include "Acts/Material/MaterialSlab.hpp"
+#include "Acts/Surfaces/RectangleBounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Acts::UnitLiterals;
+
+struct TelActs::TelStraightLineFinder::Branch{
+  Eigen::VectorXd state;
+  Eigen::MatrixXd cov;
+  std::vector<std::shared_ptr<altel::TelMeasHit>> hits; // per plane, nullptr for hole
+  size_t measN{0};
+};
+
+namespace{
+  // as Acts::computeMultipleScatteringTheta0
+  double scatteringTheta0(double xOverX0, double p, double m, double q, int absPdgCode){
+    if(xOverX0 <= 0){
+      return 0;
+    }
+    double q2OverBeta2 = q * q * (1 + m * m / (p * p));
+    double t = std::sqrt(xOverX0 * q2OverBeta2);
+    if(absPdgCode == 11){
+      return 17.5_MeV / p * t * (1 + 0.125 * std::log10(10 * xOverX0));
+    }
+    return 13.6_MeV / p * t * (1 + 0.038 * 2 * std::log(t));
+  }
+}
+
+TelActs::TelStraightLineFinder::TelStraightLineFinder(const Config& conf, std::vector<Plane> planes)
+  :m_conf(conf), m_planes(std::move(planes)){
+  m_beam_dir = m_conf.beamPosition<=0? 1 : -1; // toward origin
+  std::sort(m_planes.begin(), m_planes.end(), [this](const Plane& a, const Plane& b){
+                                                return a.center.x() * m_beam_dir < b.center.x() * m_beam_dir;});
+  for(auto& pl: m_planes){
+    auto it = m_conf.maxBranches.find(pl.detId);
+    m_max_branches.push_back(it == m_conf.maxBranches.end()? 1 : std::max<size_t>(it->second, 1));
+  }
+
+  // state: line y0, z0, ty, tz at the collimator, then y, z displacement per plane
+  size_t planeN = m_planes.size();
+  size_t stateN = 4 + 2 * planeN;
+  m_state0 = Eigen::VectorXd::Zero(stateN);
+  m_cov0 = Eigen::MatrixXd::Zero(stateN, stateN);
+  m_cov0(0, 0) = m_conf.seedResX * m_conf.seedResX;
+  m_cov0(1, 1) = m_conf.seedResY * m_conf.seedResY;
+  m_cov0(2, 2) = m_conf.seedResPhi * m_conf.seedResPhi;
+  m_cov0(3, 3) = m_conf.seedResTheta * m_conf.seedResTheta;
+
+  // kink at plane k displaces planes i, j downstream by theta_k*|x_i - x_k| and theta_k*|x_j - x_k|
+  std::vector<double> theta2;
+  for(auto& pl: m_planes){
+    double pathCorrection = 1. / std::max(std::abs(pl.rotation(0, 2)), 1e-3); // beam along x
+    double theta = scatteringTheta0(pl.xOverX0 * pathCorrection, m_conf.beamEnergy, m_conf.particleMass,
+                                    m_conf.particleQ, m_conf.absPdgCode);
+    theta2.push_back(theta * theta);
+  }
+  for(size_t i = 0; i < planeN; i++){
+    for(size_t j = 0; j < planeN; j++){
+      double c = 0;
+      for(size_t k = 0; k < std::min(i, j); k++){
+        c += theta2[k] *
+          std::abs(m_planes[i].center.x() - m_planes[k].center.x()) *
+          std::abs(m_planes[j].center.x() - m_planes[k].center.x());
+      }
+      m_cov0(4 + 2 * i, 4 + 2 * j) = c;
+      m_cov0(5 + 2 * i, 5 + 2 * j) = c;
+    }
+  }
+}
+
+std::vector<TelActs::TelStraightLineFinder::Plane>
+TelActs::TelStraightLineFinder::createPlanes(const Acts::GeometryContext& gctx,
+                                             const std::map<size_t, std::shared_ptr<const Acts::PlaneLayer>>& mapDetId2PlaneLayer){
+  std::vector<Plane> planes;
+  for(auto& [detId, planeLayer]: mapDetId2PlaneLayer){
+    Plane pl;
+    pl.detId = detId;
+    const auto& surface = planeLayer->surfaceRepresentation();
+    pl.rotation = surface.transform(gctx).linear();
+    pl.center = surface.transform(gctx).translation();
+    auto material = surface.surfaceMaterial();
+    if(material){
+      pl.xOverX0 = material->materialSlab(Acts::Vector2D(0, 0)).thicknessInX0();
+    }
+    auto rectangle = dynamic_cast<const Acts::RectangleBounds*>(&surface.bounds());
+    if(rectangle){
+      pl.minU = rectangle->get(Acts::RectangleBounds::eMinX);
+      pl.minV = rectangle->get(Acts::RectangleBounds::eMinY);
+      pl.maxU = rectangle->get(Acts::RectangleBounds::eMaxX);
+      pl.maxV = rectangle->get(Acts::RectangleBounds::eMaxY);
+    }
+    else{
+      pl.minU = pl.minV = -HUGE_VAL;
+      pl.maxU = pl.maxV = HUGE_VAL;
+    }
+    planes.push_back(pl);
+  }
+  return planes;
+}
+
+Acts::Vector2D TelActs::TelStraightLineFinder::localPosition(const Eigen::VectorXd& state, size_t n,
+                                                            Eigen::Matrix<double, 2, 4>* jac, Acts::Vector3D* global) const{
+  const Plane& pl = m_planes[n];
+  Acts::Vector3D pos(m_conf.beamPosition, state[0] + state[4 + 2 * n], state[1] + state[5 + 2 * n]);
+  Acts::Vector3D dir(1, state[2], state[3]);
+  Acts::Vector3D normal = pl.rotation.col(2);
+  double nd = normal.dot(dir);
+  double s = normal.dot(pl.center - pos) / nd;
+  Acts::Vector3D cross = pos + s * dir;
+  if(global){
+    *global = cross;
+  }
+  Acts::Vector3D rel = cross - pl.center;
+  Acts::Vector2D loc(pl.rotation.col(0).dot(rel), pl.rotation.col(1).dot(rel));
+  if(jac){
+    // d(cross)/d(pos) = proj, d(cross)/d(dir) = s*proj
+    Acts::RotationMatrix3D proj = Acts::RotationMatrix3D::Identity() - dir * normal.transpose() / nd;
+    Eigen::Matrix<double, 2, 3> locProj = pl.rotation.leftCols<2>().transpose() * proj;
+    jac->col(0) = locProj.col(1);
+    jac->col(1) = locProj.col(2);
+    jac->col(2) = s * locProj.col(1);
+    jac->col(3) = s * locProj.col(2);
+  }
+  return loc;
+}
+
+void TelActs::TelStraightLineFinder::predict(const Branch& br, size_t n,
+                                             Acts::Vector2D& pred, Acts::SymMatrix2D& resInv) const{
+  Eigen::Matrix<double, 2, 4> jac;
+  pred = localPosition(br.state, n, &jac, nullptr);
+  size_t col = 4 + 2 * n;
+  Eigen::Matrix<double, Eigen::Dynamic, 2> covLt =
+    br.cov.leftCols<4>() * jac.transpose() + br.cov.middleCols<2>(col) * jac.leftCols<2>().transpose();
+  Acts::SymMatrix2D res = jac * covLt.topRows<4>() + jac.leftCols<2>() * covLt.middleRows<2>(col);
+  res(0, 0) += m_conf.measResU * m_conf.measResU;
+  res(1, 1) += m_conf.measResV * m_conf.measResV;
+  resInv = res.inverse();
+}
+
+void TelActs::TelStraightLineFinder::update(Branch& br, const Eigen::VectorXd& stateLin, size_t n,
+                                            const Acts::Vector2D& meas) const{
+  Eigen::Matrix<double, 2, 4> jac;
+  Acts::Vector2D predLin = localPosition(stateLin, n, &jac, nullptr);
+  size_t col = 4 + 2 * n;
+  Eigen::VectorXd dstate = br.state - stateLin;
+  Acts::Vector2D pred = predLin + jac * dstate.head<4>() + jac.leftCols<2>() * dstate.segment<2>(col);
+
+  Eigen::Matrix<double, Eigen::Dynamic, 2> covLt =
+    br.cov.leftCols<4>() * jac.transpose() + br.cov.middleCols<2>(col) * jac.leftCols<2>().transpose();
+  Acts::SymMatrix2D res = jac * covLt.topRows<4>() + jac.leftCols<2>() * covLt.middleRows<2>(col);
+  res(0, 0) += m_conf.measResU * m_conf.measResU;
+  res(1, 1) += m_conf.measResV * m_conf.measResV;
+  Eigen::Matrix<double, Eigen::Dynamic, 2> gain = covLt * res.inverse();
+  br.state += gain * (meas - pred);
+  br.cov -= gain * covLt.transpose();
+  br.measN++;
+}
+
+void TelActs::TelStraightLineFinder::findTracks(std::shared_ptr<altel::TelEvent> telEvent) const{
+  size_t planeN = m_planes.size();
+  std::vector<std::vector<std::shared_ptr<altel::TelMeasHit>>> planeHits(planeN);
+  for(auto& aHitMeas: telEvent->MHs){
+    for(size_t n = 0; n < planeN; n++){
+      if(m_planes[n].detId == aHitMeas->DN){
+        planeHits[n].push_back(aHitMeas);
+        break;
+      }
+    }
+  }
+
+  std::vector<Branch> branches(1);
+  branches[0].state = m_state0;
+  branches[0].cov = m_cov0;
+  branches[0].hits.resize(planeN);
+  std::vector<std::pair<double, size_t>> candidates;
+  for(size_t n = 0; n < planeN; n++){
+    if(planeHits[n].empty()){
+      continue;
+    }
+    std::vector<Branch> branchesNext;
+    for(auto& br: branches){
+      candidates.clear();
+      Acts::Vector2D pred;
+      Acts::SymMatrix2D resInv;
+      predict(br, n, pred, resInv);
+      for(size_t h = 0; h < planeHits[n].size(); h++){
+        Acts::Vector2D r = Acts::Vector2D(planeHits[n][h]->PLs[0], planeHits[n][h]->PLs[1]) - pred;
+        double chi2 = r.dot(resInv * r);
+        if(chi2 < m_conf.cutChiSquared){
+          candidates.emplace_back(chi2, h);
+        }
+      }
+      if(candidates.empty()){
+        branchesNext.push_back(std::move(br)); // hole
+        continue;
+      }
+      std::sort(candidates.begin(), candidates.end());
+      candidates.resize(std::min(candidates.size(), m_max_branches[n]));
+      for(auto& [chi2, h]: candidates){
+        branchesNext.push_back(br);
+        Branch& brNext = branchesNext.back();
+        Acts::Vector2D meas(planeHits[n][h]->PLs[0], planeHits[n][h]->PLs[1]);
+        update(brNext, brNext.state, n, meas);
+        brNext.hits[n] = planeHits[n][h];
+      }
+    }
+    branches = std::move(branchesNext);
+  }
+
+  size_t indexTrack = 0;
+  for(auto& br: branches){
+    if(!br.measN){
+      continue;
+    }
+    // all hits at once, linearised at the found track
+    Branch fit;
+    fit.state = m_state0;
+    fit.cov = m_cov0;
+    for(size_t n = 0; n < planeN; n++){
+      if(br.hits[n]){
+        update(fit, br.state, n, Acts::Vector2D(br.hits[n]->PLs[0], br.hits[n]->PLs[1]));
+      }
+    }
+
+    std::shared_ptr<altel::TelTrajectory> telTraj(new altel::TelTrajectory);
+    telTraj->TN = indexTrack++;
+    Acts::Vector3D fit_dir_global = m_beam_dir * Acts::Vector3D(1, fit.state[2], fit.state[3]).normalized();
+    for(size_t n = 0; n < planeN; n++){
+      const Plane& pl = m_planes[n];
+      Eigen::Matrix<double, 2, 4> jac;
+      Acts::Vector3D fit_pos_global;
+      Acts::Vector2D fit_pos_local = localPosition(fit.state, n, &jac, &fit_pos_global);
+      if(!br.hits[n] &&
+         (fit_pos_local(0) < pl.minU || fit_pos_local(0) > pl.maxU ||
+          fit_pos_local(1) < pl.minV || fit_pos_local(1) > pl.maxV)){
+        continue; // not crossed
+      }
+      size_t col = 4 + 2 * n;
+      Eigen::Matrix<double, Eigen::Dynamic, 2> covLt =
+        fit.cov.leftCols<4>() * jac.transpose() + fit.cov.middleCols<2>(col) * jac.leftCols<2>().transpose();
+      Acts::SymMatrix2D cov = jac * covLt.topRows<4>() + jac.leftCols<2>() * covLt.middleRows<2>(col);
+
+      std::shared_ptr<altel::TelFitHit> telFitHit;
+      telFitHit.reset(new altel::TelFitHit(
+                        uint16_t(pl.detId),
+                        fit_pos_local(0), fit_pos_local(1),
+                        std::sqrt(cov(0, 0)), std::sqrt(cov(1, 1)),
+                        fit_pos_global(0), fit_pos_global(1), fit_pos_global(2),
+                        fit_dir_global(0), fit_dir_global(1), fit_dir_global(2),
+                        br.hits[n]));
+      std::shared_ptr<altel::TelTrajHit> telTrajHit;
+      telTrajHit.reset(new altel::TelTrajHit{uint16_t(pl.detId), telFitHit, nullptr});
+      telTraj->THs.push_back(telTrajHit);
+    }
+    telEvent->TJs.push_back(telTraj);
+  }
+}
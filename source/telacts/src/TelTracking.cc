@@ -39,7 +39,7 @@
 
 
 namespace {
-template <typename TrackFinder> struct TrackFinderFunctionImpl {
+template <typename TrackFinder, typename Options> struct TrackFinderFunctionImpl {
   TrackFinder trackFinder;
 
   TrackFinderFunctionImpl(TrackFinder &&f) : trackFinder(std::move(f)) {}
@@ -47,17 +47,18 @@ template <typename TrackFinder> struct TrackFinderFunctionImpl {
   TelActs::TrackFinderResult operator()(
       const std::vector<TelActs::PixelSourceLink> &sourceLinks,
       const Acts::BoundTrackParameters &initialParameters,
-      const Acts::CombinatorialKalmanFilterOptions<Acts::CKFSourceLinkSelector>
-          &options) const {
+      const Options &options) const {
     return trackFinder.findTracks(sourceLinks, initialParameters, options);
   }
 };
-} // namespace
 
-TelActs::TrackFinderFunction
-TelActs::makeTrackFinderFunction(
-                                 std::shared_ptr<const Acts::TrackingGeometry> trackingGeometry,
-                                 std::shared_ptr<Acts::ConstantBField> magneticField) {
+template <typename SourceLinkSelector>
+std::function<TelActs::TrackFinderResult(const std::vector<TelActs::TelSourceLink> &,
+                                         const Acts::BoundTrackParameters &,
+                                         const Acts::CombinatorialKalmanFilterOptions<SourceLinkSelector> &)>
+makeTrackFinderFunctionImpl(
+                            std::shared_ptr<const Acts::TrackingGeometry> trackingGeometry,
+                            std::shared_ptr<Acts::ConstantBField> magneticField) {
   using Updater = Acts::GainMatrixUpdater;
   using Smoother = Acts::GainMatrixSmoother;
 
@@ -71,7 +72,7 @@ TelActs::makeTrackFinderFunction(
   using Propagator = Acts::Propagator<Stepper, Navigator>;
   using CKF =
     Acts::CombinatorialKalmanFilter<Propagator, Updater, Smoother,
-                                    Acts::CKFSourceLinkSelector>;
+                                    SourceLinkSelector>;
 
   // construct all components for the track finder
   MagneticField field(std::move(magneticField));
@@ -84,6 +85,20 @@ TelActs::makeTrackFinderFunction(
   CKF trackFinder(std::move(propagator));
 
   // build the track finder functions. owns the track finder object.
-  return TrackFinderFunctionImpl<CKF>(std::move(trackFinder));
+  return TrackFinderFunctionImpl<CKF, Acts::CombinatorialKalmanFilterOptions<SourceLinkSelector>>(std::move(trackFinder));
+}
+} // namespace
+
+TelActs::TrackFinderFunction
+TelActs::makeTrackFinderFunction(
+                                 std::shared_ptr<const Acts::TrackingGeometry> trackingGeometry,
+                                 std::shared_ptr<Acts::ConstantBField> magneticField) {
+  return makeTrackFinderFunctionImpl<TelActs::TelSourceLinkSelector>(trackingGeometry, magneticField);
+}
 
+TelActs::LinearTrackFinderFunction
+TelActs::makeLinearTrackFinderFunction(
+                                       std::shared_ptr<const Acts::TrackingGeometry> trackingGeometry,
+                                       std::shared_ptr<Acts::ConstantBField> magneticField) {
+  return makeTrackFinderFunctionImpl<Acts::CKFSourceLinkSelector>(trackingGeometry, magneticField);
 }
@@ -0,0 +1,180 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "TelEventBuilder.hh"
+#include "DataPack.hh"
+#include "getopt.h"
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -triggers       <INT>        triggers per case (default 20000)
+  -layers         <INT>        number of layers (default 6)
+
+Check of TelEventBuilder against broken trigger ids: each case pushes the sub-events of all
+layers trigger by trigger, with one fault at the middle trigger, and checks the built events and
+the layer statistics:
+  clean          no fault
+  corrupted      one sub-event of layer 1 with a wrong tid
+  layer reset    tids of layer 1 restart from 0
+  global reset   tids of all layers restart from 0
+
+examples:
+./evbstress -triggers 100000
+)";
+
+namespace{
+  using namespace altel;
+
+  DataPackSP makeDataPack(uint8_t daqid, uint16_t tid){
+    uint16_t pixelN = 2;
+    std::string pak;
+    pak.push_back(char(0xaa));
+    pak.push_back(char(daqid));
+    pak.push_back(char(tid>>8));
+    pak.push_back(char(tid));
+    pak.push_back(char(pixelN>>8));
+    pak.push_back(char(pixelN));
+    for(uint32_t n = 0; n < pixelN; n++){
+      // valid(1) tschip(8) raw_dcol[9]  raw_row[10] pattern[4]
+      uint32_t v = (1u<<31) | ((10*n)<<14) | ((tid%1024)<<4);
+      pak.push_back(char(v>>24));
+      pak.push_back(char(v>>16));
+      pak.push_back(char(v>>8));
+      pak.push_back(char(v));
+    }
+    pak.push_back(char(0xcc));
+    pak.push_back(char(0xcc));
+    DataPackSP pack(new DataPack);
+    pack->MakeDataPack(pak);
+    return pack;
+  }
+
+  struct Result{
+    uint64_t n_complete{0};
+    uint64_t n_partial{0};
+    uint64_t n_dropped{0};
+    std::vector<uint64_t> n_late;
+    std::vector<uint64_t> n_outlier;
+  };
+
+  // tidOf(layer, trigger) gives the tid of a sub-event
+  Result runCase(size_t layerN, uint64_t triggerN, bool emitPartial,
+                 const std::function<uint16_t(size_t, uint64_t)>& tidOf){
+    std::vector<std::string> names;
+    for(size_t l = 0; l < layerN; l++){
+      names.push_back("layer" + std::to_string(l));
+    }
+    TelEventBuilder builder(names, std::chrono::seconds(1), 1024, emitPartial);
+    auto now = std::chrono::steady_clock::now();
+    for(uint64_t t = 0; t < triggerN; t++){
+      for(size_t l = 0; l < layerN; l++){
+        builder.Push(l, makeDataPack(uint8_t(l), tidOf(l, t)), now);
+      }
+      while(builder.Pop(now)){
+      }
+    }
+    builder.Flush();
+    while(builder.Pop(now)){
+    }
+
+    Result r;
+    r.n_complete = builder.NumComplete();
+    r.n_partial = builder.NumPartial();
+    r.n_dropped = builder.NumDropped();
+    for(size_t l = 0; l < layerN; l++){
+      r.n_late.push_back(builder.GetLayerStat(l).n_late);
+      r.n_outlier.push_back(builder.GetLayerStat(l).n_outlier);
+    }
+    return r;
+  }
+
+  uint64_t sum(const std::vector<uint64_t>& v){
+    uint64_t s = 0;
+    for(auto n: v){
+      s += n;
+    }
+    return s;
+  }
+}
+
+int main(int argc, char **argv){
+  uint64_t triggerN = 20000;
+  size_t layerN = 6;
+
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"triggers", required_argument, NULL, 't'},
+                                {"layers", required_argument, NULL, 'l'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 't':
+        triggerN = std::stoul(optarg);
+        break;
+      case 'l':
+        layerN = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  if(layerN < 2 || layerN > 64 || triggerN < 100){
+    std::fprintf(stderr, "%s\n", help_usage.c_str());
+    std::exit(1);
+  }
+
+  const uint64_t fault = triggerN / 2;
+  const uint16_t tid0 = 0xff00; // wraps during the run
+  bool ok_all = true;
+  auto report = [&](const char* name, const Result& r, bool ok){
+    std::fprintf(stdout, "%-14s complete %6lu partial %6lu dropped %6lu late %6lu outlier %6lu  %s\n",
+                 name, r.n_complete, r.n_partial, r.n_dropped, sum(r.n_late), sum(r.n_outlier), ok? "PASS" : "FAIL");
+    ok_all = ok_all && ok;
+  };
+
+  {
+    Result r = runCase(layerN, triggerN, false, [&](size_t, uint64_t t){return uint16_t(tid0 + t);});
+    report("clean", r, r.n_complete == triggerN && !r.n_dropped && !sum(r.n_late) && !sum(r.n_outlier));
+  }
+  {
+    Result r = runCase(layerN, triggerN, false, [&](size_t l, uint64_t t){
+                                                  uint16_t tid = tid0 + t;
+                                                  return (l == 1 && t == fault)? uint16_t(tid ^ 0x4000) : tid;});
+    report("corrupted", r, r.n_complete == triggerN - 1 && r.n_dropped == 1 &&
+           !sum(r.n_late) && r.n_outlier[1] == 1 && sum(r.n_outlier) == 1);
+  }
+  {
+    Result r = runCase(layerN, triggerN, true, [&](size_t l, uint64_t t){
+                                                 return (l == 1 && t >= fault)? uint16_t(t - fault) : uint16_t(tid0 + t);});
+    // layer 1 stays out of step, the other layers go on
+    report("layer reset", r, r.n_complete == fault && r.n_partial == triggerN - fault &&
+           !sum(r.n_late) && r.n_outlier[1] == triggerN - fault && sum(r.n_outlier) == r.n_outlier[1]);
+  }
+  {
+    Result r = runCase(layerN, triggerN, false, [&](size_t, uint64_t t){
+                                                  return t >= fault? uint16_t(t - fault) : uint16_t(tid0 + t);});
+    // lost until all layers are out of step and the builder starts over
+    uint64_t lost = TelEventBuilder::s_resync_n;
+    report("global reset", r, r.n_complete == triggerN - lost && !sum(r.n_late) &&
+           sum(r.n_outlier) == layerN * lost);
+  }
+
+  std::fprintf(stdout, "%s\n", ok_all? "PASS" : "FAIL");
+  return ok_all? 0 : 1;
+}
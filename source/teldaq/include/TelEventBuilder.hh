@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <chrono>
+
+#include "TelEvent.hpp"
+
+struct DataPack;
+using DataPackSP = std::shared_ptr<DataPack>;
+
+namespace altel{
+  using TelEventSP = std::shared_ptr<TelEvent>;
+
+  // Assembles sub-events of all layers into telescope events.
+  //
+  // Sub-events are keyed on the 16-bit trigger id. Each layer unwraps its tid
+  // into a 64-bit trigger number relative to its previous packet, so the
+  // wrap-around at 0xffff is transparent as long as layers stay within half
+  // the tid range of each other. Pending triggers live in a ring of slots
+  // indexed by the trigger number, Push() and Pop() are O(1) per sub-event.
+  //
+  // Events leave in trigger order. The oldest pending trigger is emitted when
+  // all layers are present, when it waited longer than the time-out, or when
+  // another layer is more than max_skew triggers ahead of it. Incomplete
+  // events are emitted with the layer presence mask, or dropped.
+  //
+  // A sub-event more than max_skew ahead of all other layers, or behind the
+  // previous one of its layer, is out of step, e.g. a corrupted tid or a tid
+  // reset of the firmware. It is dropped without moving the pending triggers.
+  // After s_resync_n such sub-events in a row, the layer is anchored again at
+  // the oldest pending trigger. When all layers are out of step, the builder
+  // flushes and starts over.
+  //
+  // Push() and Pop() belong to one reader thread, the statistics can be read
+  // from any thread.
+  class TelEventBuilder{
+  public:
+    static constexpr uint64_t s_resync_n = 4;
+
+    // log2 binned, bin n counts values in [2^(n-1), 2^n), bin 0 counts 0
+    struct Histogram{
+      static constexpr size_t s_bin_n = 32;
+      std::array<std::atomic<uint64_t>, s_bin_n> bins{};
+      void Fill(uint64_t v);
+      std::string String() const;
+    };
+
+    struct LayerStat{
+      std::atomic<uint64_t> n_sub{0};     // accepted sub-events
+      std::atomic<uint64_t> n_late{0};    // arrived after their trigger was emitted
+      std::atomic<uint64_t> n_dup{0};     // same trigger twice
+      std::atomic<uint64_t> n_missing{0}; // absent in an emitted or dropped event
+      std::atomic<uint64_t> n_outlier{0}; // out of step with the other layers
+      Histogram latency_us;  // arrival after the first sub-event of the same trigger
+      Histogram skew_trigger;  // triggers behind the leading layer at arrival
+    };
+
+    TelEventBuilder(const std::vector<std::string>& layer_names,
+                    std::chrono::microseconds timeout, uint64_t max_skew, bool emit_partial);
+
+    // false when the sub-event is late or duplicated and has been dropped
+    bool Push(size_t layer, DataPackSP&& pack, std::chrono::steady_clock::time_point now);
+
+    // next event in trigger order, or nullptr. mask gets the present layers, bit n for layer n.
+    TelEventSP Pop(std::chrono::steady_clock::time_point now, uint64_t* mask = nullptr);
+
+    // emits everything pending, e.g. at end of run, incomplete events only with emit_partial
+    void Flush();
+
+    size_t LayerN() const {return m_layer_n;}
+    const LayerStat& GetLayerStat(size_t layer) const {return m_layer_st[layer];}
+    uint64_t NumComplete() const {return m_st_n_complete;}
+    uint64_t NumPartial() const {return m_st_n_partial;}
+    uint64_t NumDropped() const {return m_st_n_dropped;}
+
+    std::string GetStatusString() const;
+
+  private:
+    struct Slot{
+      uint64_t trigger{0};
+      uint64_t mask{0};
+      std::chrono::steady_clock::time_point tp_first;
+      std::vector<DataPackSP> packs;
+    };
+
+    struct Built{
+      TelEventSP ev;
+      uint64_t mask;
+    };
+
+    uint64_t Unwrap(size_t layer, uint16_t tid) const;
+    bool IsInStep(size_t layer, uint64_t trigger) const;
+    void EmitHead();
+    TelEventSP AcquireEvent();
+
+    size_t m_layer_n;
+    std::vector<std::string> m_layer_names;
+    std::chrono::microseconds m_timeout;
+    uint64_t m_max_skew;
+    bool m_emit_partial;
+    uint64_t m_mask_full;
+
+    std::vector<Slot> m_slots;
+    uint64_t m_slot_mask;
+
+    bool m_is_started{false};
+    uint64_t m_head{0};   // oldest trigger not yet emitted
+    uint64_t m_newest{0}; // newest trigger seen by any layer
+    std::vector<uint64_t> m_layer_last; // last accepted trigger, 0 before the first one
+    std::vector<bool> m_layer_is_started;
+    std::vector<uint64_t> m_layer_outlier_n; // in a row
+    std::vector<uint16_t> m_layer_outlier_tid;
+
+    std::deque<Built> m_ready;
+
+    // built events are reused once the consumer released them, their hit objects go back
+    // to the sub-events, so that the clustering of the next packets reuses them in place
+    std::vector<TelEventSP> m_ev_pool;
+    size_t m_ev_cursor{0};
+    std::vector<std::shared_ptr<TelMeasHit>> m_spare_hits;
+
+    std::unique_ptr<LayerStat[]> m_layer_st;
+    std::atomic<uint64_t> m_st_n_complete{0};
+    std::atomic<uint64_t> m_st_n_partial{0};
+    std::atomic<uint64_t> m_st_n_dropped{0};
+  };
+}
@@ -5,24 +5,31 @@
 #include <cstdio>
 #include <set>
 #include <map>
+#include <functional>
 
 #include "myrapidjson.h"
 
 #include "TelEvent.hpp"
+#include "TelEventBuilder.hh"
 
 class Frontend;
+class TcpReactor;
 
 namespace altel{
   using TelEventSP = std::shared_ptr<TelEvent>;
 
   class Telescope{
   public:
+    // receives the data links of all layers, outlives them. nullptr with "threads": 0,
+    // then each layer receives on its own thread
+    std::unique_ptr<TcpReactor> m_reactor;
     std::vector<std::unique_ptr<Frontend>> m_vec_layer;
     std::future<uint64_t> m_fut_async_rd;
     std::future<uint64_t> m_fut_async_watch;
     bool m_is_async_reading{false};
     bool m_is_async_watching{false};
     bool m_is_running{false};
+    bool m_is_flushing{false};
 
     TelEventSP m_ev_last;
     std::atomic<uint64_t> m_mon_ev_read{0};
@@ -32,18 +39,35 @@ namespace altel{
     std::atomic<uint64_t> m_st_n_ev{0};
     std::atomic<uint64_t> m_st_n_ev_tumb{0};
 
+    std::unique_ptr<TelEventBuilder> m_builder;
+    std::chrono::microseconds m_builder_timeout{10000};
+    uint64_t m_builder_max_skew{1024};
+    bool m_builder_emit_partial{false};
+
     ~Telescope();
     Telescope(const std::string& tele_js_str, const std::string& layer_js_str);
-    TelEventSP ReadEvent();
+    // layerMask gets the layers present in the event, bit n for layer n in location order
+    TelEventSP ReadEvent(uint64_t* layerMask = nullptr);
 
-    void BroadcastFirmwareRegister(const std::string& name, uint64_t value);
-    void BroadcastSensorRegister(const std::string& name, uint64_t value);
-    void FlushPixelMask(const std::map<std::string,  std::set<std::pair<uint16_t, uint16_t>>>& mask_col);
+    // layers are handled concurrently, false if any of them failed
+    bool BroadcastFirmwareRegister(const std::string& name, uint64_t value);
+    bool BroadcastSensorRegister(const std::string& name, uint64_t value);
+    bool FlushPixelMask(const std::map<std::string,  std::set<std::pair<uint16_t, uint16_t>>>& mask_col);
 
-    void Init();
-    void Start();
+    bool Init();
+    // false if a layer failed to prepare or start, no layer uploads data then
+    bool Start();
     void Stop();
-    void Start_no_tel_reading();
+    bool Start_no_tel_reading();
+    bool StartLayers();
+    void StopLayers();
+
+    // runs f(layerN, layer) on its own thread per layer and waits for all of them. With
+    // isSynchronised, all threads pass a barrier first, so that f starts on all layers together.
+    // Failures, exceptions or failed register batches, are reported per layer.
+    bool RunPerLayer(const std::string& what, const std::function<void(size_t, Frontend&)>& f,
+                     bool isSynchronised = false);
+    void ResetEventBuilder();
     uint64_t AsyncRead();
     uint64_t AsyncWatchDog();
 
@@ -0,0 +1,327 @@
+#include <cstdio>
+#include <iterator>
+#include <algorithm>
+
+#include "TelEventBuilder.hh"
+#include "DataPack.hh"
+#include "mymetrics.hh"
+
+using namespace altel;
+
+void TelEventBuilder::Histogram::Fill(uint64_t v){
+  size_t n = 0;
+  while(v && n+1 < s_bin_n){
+    v >>= 1;
+    n++;
+  }
+  bins[n].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string TelEventBuilder::Histogram::String() const{
+  std::string str;
+  char buf[64];
+  for(size_t n = 0; n < s_bin_n; n++){
+    uint64_t c = bins[n].load(std::memory_order_relaxed);
+    if(!c){
+      continue;
+    }
+    std::snprintf(buf, sizeof(buf), " <%lu:%lu", n? (1ul<<n) : 1ul, c);
+    str += buf;
+  }
+  return str;
+}
+
+TelEventBuilder::TelEventBuilder(const std::vector<std::string>& layer_names,
+                                 std::chrono::microseconds timeout, uint64_t max_skew, bool emit_partial)
+  :m_layer_n(layer_names.size()), m_layer_names(layer_names), m_timeout(timeout),
+   m_max_skew(max_skew), m_emit_partial(emit_partial){
+  if(m_layer_n == 0 || m_layer_n > 64){
+    std::fprintf(stderr, "TelEventBuilder: unsupported number of layers %zu\n", m_layer_n);
+    throw;
+  }
+  // unwrapping is unambiguous within half the tid range
+  if(m_max_skew == 0 || m_max_skew > 0x4000){
+    m_max_skew = 0x4000;
+  }
+  m_mask_full = (m_layer_n == 64)? ~uint64_t(0) : ((uint64_t(1)<<m_layer_n) - 1);
+
+  size_t slot_n = 1;
+  while(slot_n <= 2*m_max_skew){
+    slot_n <<= 1;
+  }
+  m_slots.resize(slot_n);
+  for(auto &slot: m_slots){
+    slot.packs.resize(m_layer_n);
+  }
+  m_slot_mask = slot_n - 1;
+
+  m_layer_last.resize(m_layer_n, 0);
+  m_layer_is_started.resize(m_layer_n, false);
+  m_layer_outlier_n.resize(m_layer_n, 0);
+  m_layer_outlier_tid.resize(m_layer_n, 0);
+  m_layer_st.reset(new LayerStat[m_layer_n]);
+}
+
+uint64_t TelEventBuilder::Unwrap(size_t layer, uint16_t tid) const{
+  uint64_t ref;
+  if(m_layer_is_started[layer]){
+    ref = m_layer_last[layer];
+  }
+  else if(m_is_started){
+    ref = m_head;
+  }
+  else{
+    // leave room below the first trigger, so that a layer behind it does not underflow
+    ref = 0x10000 + tid;
+  }
+  int16_t delta = int16_t(uint16_t(tid - uint16_t(ref)));
+  return ref + delta;
+}
+
+bool TelEventBuilder::IsInStep(size_t layer, uint64_t trigger) const{
+  if(!m_is_started){
+    return true;
+  }
+  if(m_layer_is_started[layer]){
+    // a layer behind by more than the skew would have been emitted without it long ago
+    if(trigger + m_max_skew < m_layer_last[layer]){
+      return false;
+    }
+  }
+  else if(trigger + m_max_skew < m_head){
+    return false;
+  }
+  // ahead of the other layers, also of those out of step now. Not by a layer alone.
+  uint64_t other_newest = 0;
+  for(size_t l = 0; l < m_layer_n; l++){
+    if(l != layer){
+      other_newest = std::max(other_newest, m_layer_last[l]);
+    }
+  }
+  return !other_newest || trigger <= other_newest + m_max_skew;
+}
+
+bool TelEventBuilder::Push(size_t layer, DataPackSP&& pack, std::chrono::steady_clock::time_point now){
+  if(layer >= m_layer_n || !pack || !pack->telev_pack){
+    return false;
+  }
+  LayerStat &st = m_layer_st[layer];
+  uint64_t trigger = Unwrap(layer, pack->tid);
+  if(!IsInStep(layer, trigger)){
+    st.n_outlier.fetch_add(1, std::memory_order_relaxed);
+    uint64_t &outlier_n = m_layer_outlier_n[layer];
+    uint16_t tid_step = pack->tid - m_layer_outlier_tid[layer];
+    outlier_n = (outlier_n && tid_step && tid_step <= m_max_skew)? outlier_n + 1 : 1;
+    m_layer_outlier_tid[layer] = pack->tid;
+    if(outlier_n < s_resync_n){
+      return false;
+    }
+    // the tids of this layer keep to themselves, anchor them at the oldest pending trigger
+    m_layer_is_started[layer] = false;
+    trigger = Unwrap(layer, pack->tid);
+    if(!IsInStep(layer, trigger)){
+      // other layers are still on the old tids, only this one is off
+      if(std::find(m_layer_is_started.begin(), m_layer_is_started.end(), true) != m_layer_is_started.end()){
+        return false;
+      }
+      // all layers moved to new tids, e.g. a reset of the trigger id, start over
+      Flush();
+      m_is_started = false;
+      std::fill(m_layer_last.begin(), m_layer_last.end(), 0);
+      std::fill(m_layer_outlier_n.begin(), m_layer_outlier_n.end(), 0);
+      trigger = Unwrap(layer, pack->tid);
+    }
+  }
+  m_layer_outlier_n[layer] = 0;
+  m_layer_last[layer] = trigger;
+  m_layer_is_started[layer] = true;
+  if(!m_is_started){
+    m_head = trigger;
+    m_newest = trigger;
+    m_is_started = true;
+  }
+  if(trigger < m_head){
+    st.n_late.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // out of slots, the oldest triggers have to go
+  while(trigger - m_head > m_slot_mask){
+    EmitHead();
+  }
+
+  Slot &slot = m_slots[trigger & m_slot_mask];
+  uint64_t bit = uint64_t(1)<<layer;
+  if(slot.mask & bit){
+    st.n_dup.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if(!slot.mask){
+    slot.trigger = trigger;
+    slot.tp_first = now;
+  }
+  slot.mask |= bit;
+  slot.packs[layer] = std::move(pack);
+
+  st.n_sub.fetch_add(1, std::memory_order_relaxed);
+  st.latency_us.Fill(std::chrono::duration_cast<std::chrono::microseconds>(now - slot.tp_first).count());
+  st.skew_trigger.Fill(m_newest > trigger? m_newest - trigger : 0);
+  if(trigger > m_newest){
+    m_newest = trigger;
+  }
+  return true;
+}
+
+TelEventSP TelEventBuilder::Pop(std::chrono::steady_clock::time_point now, uint64_t* mask){
+  while(m_ready.empty() && m_is_started && m_head <= m_newest){
+    const Slot &slot = m_slots[m_head & m_slot_mask];
+    if(slot.mask == m_mask_full || m_newest - m_head > m_max_skew ||
+       (slot.mask && now - slot.tp_first >= m_timeout)){
+      EmitHead();
+      continue;
+    }
+    // every missing layer is already past this trigger, it will not come
+    bool is_settled = true;
+    for(size_t l = 0; l < m_layer_n; l++){
+      if(!(slot.mask & (uint64_t(1)<<l)) && (!m_layer_is_started[l] || m_layer_last[l] <= m_head)){
+        is_settled = false;
+        break;
+      }
+    }
+    if(!is_settled){
+      break;
+    }
+    EmitHead();
+  }
+
+  if(m_ready.empty()){
+    return nullptr;
+  }
+  Built built = std::move(m_ready.front());
+  m_ready.pop_front();
+  if(mask){
+    *mask = built.mask;
+  }
+  return built.ev;
+}
+
+void TelEventBuilder::Flush(){
+  while(m_is_started && m_head <= m_newest){
+    EmitHead();
+  }
+}
+
+void TelEventBuilder::EmitHead(){
+  static auto& mt = mymetrics::Registry::instance();
+  static auto& s_mt_complete = mt.counter("evb_events_total{kind=\"complete\"}", "triggers leaving the event builder");
+  static auto& s_mt_partial = mt.counter("evb_events_total{kind=\"partial\"}");
+  static auto& s_mt_dropped = mt.counter("evb_events_total{kind=\"dropped\"}");
+  static auto& s_mt_assembly_ns = mt.histogram("evb_assembly_ns", "first sub-event of a trigger to its emission");
+
+  Slot &slot = m_slots[m_head & m_slot_mask];
+  m_head++;
+  if(!slot.mask){
+    return;
+  }
+  s_mt_assembly_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - slot.tp_first).count());
+
+  for(size_t l = 0; l < m_layer_n; l++){
+    if(!(slot.mask & (uint64_t(1)<<l))){
+      m_layer_st[l].n_missing.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  if(slot.mask == m_mask_full || m_emit_partial){
+    size_t mr_n = 0;
+    size_t mh_n = 0;
+    for(auto &pack: slot.packs){
+      if(pack){
+        mr_n += pack->telev_pack->MRs.size();
+        mh_n += pack->telev_pack->MHs.size();
+      }
+    }
+    // runN, eventN and deviceN are filled by the caller, clkN keeps the 16-bit tid
+    TelEventSP ev = AcquireEvent();
+    ev->CK = uint16_t(slot.trigger);
+    ev->MRs.reserve(mr_n);
+    ev->MHs.reserve(mh_n);
+    for(auto &pack: slot.packs){
+      if(pack){
+        // moved out, the sub-event gets spare hit objects in exchange
+        auto &subev = *pack->telev_pack;
+        size_t hit_n = subev.MHs.size();
+        ev->MRs.insert(ev->MRs.end(), std::make_move_iterator(subev.MRs.begin()), std::make_move_iterator(subev.MRs.end()));
+        ev->MHs.insert(ev->MHs.end(), std::make_move_iterator(subev.MHs.begin()), std::make_move_iterator(subev.MHs.end()));
+        subev.MRs.clear();
+        subev.MHs.clear();
+        for(size_t n = 0; n < hit_n && !m_spare_hits.empty(); n++){
+          subev.MHs.push_back(std::move(m_spare_hits.back()));
+          m_spare_hits.pop_back();
+        }
+      }
+    }
+    if(slot.mask == m_mask_full){
+      m_st_n_complete.fetch_add(1, std::memory_order_relaxed);
+      s_mt_complete.add();
+    }
+    else{
+      m_st_n_partial.fetch_add(1, std::memory_order_relaxed);
+      s_mt_partial.add();
+    }
+    m_ready.push_back(Built{std::move(ev), slot.mask});
+  }
+  else{
+    m_st_n_dropped.fetch_add(1, std::memory_order_relaxed);
+    s_mt_dropped.add();
+  }
+
+  // DataPacks go back to the pool of their frontend
+  for(auto &pack: slot.packs){
+    pack.reset();
+  }
+  slot.mask = 0;
+}
+
+TelEventSP TelEventBuilder::AcquireEvent(){
+  // consumers release in order, the oldest handed out event is the likely free one
+  for(size_t n = 0; n < m_ev_pool.size(); n++){
+    TelEventSP &ev = m_ev_pool[m_ev_cursor];
+    m_ev_cursor = (m_ev_cursor + 1) % m_ev_pool.size();
+    if(ev.use_count() == 1){
+      // pairs with the release of the consumer reference
+      std::atomic_thread_fence(std::memory_order_acquire);
+      ev->RN = 0;
+      ev->EN = 0;
+      ev->DN = 0;
+      ev->MRs.clear();
+      ev->TJs.clear();
+      m_spare_hits.insert(m_spare_hits.end(), std::make_move_iterator(ev->MHs.begin()), std::make_move_iterator(ev->MHs.end()));
+      ev->MHs.clear();
+      return ev;
+    }
+  }
+  // consumers hold more events than there are slots, these are not pooled
+  if(m_ev_pool.size() < m_slots.size()){
+    m_ev_pool.push_back(std::make_shared<TelEvent>());
+    return m_ev_pool.back();
+  }
+  return std::make_shared<TelEvent>();
+}
+
+std::string TelEventBuilder::GetStatusString() const{
+  std::string str;
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "EventBuilder: complete(%lu) partial(%lu) dropped(%lu)\n",
+                m_st_n_complete.load(), m_st_n_partial.load(), m_st_n_dropped.load());
+  str += buf;
+  for(size_t l = 0; l < m_layer_n; l++){
+    const LayerStat &st = m_layer_st[l];
+    std::snprintf(buf, sizeof(buf), "  %6s: sub(%lu) missing(%lu) late(%lu) dup(%lu) outlier(%lu)\n",
+                  m_layer_names[l].c_str(), st.n_sub.load(), st.n_missing.load(),
+                  st.n_late.load(), st.n_dup.load(), st.n_outlier.load());
+    str += buf;
+    str += "    latency[us]:" + st.latency_us.String() + "\n";
+    str += "    skew[trigger]:" + st.skew_trigger.String() + "\n";
+  }
+  return str;
+}
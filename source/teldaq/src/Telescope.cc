@@ -2,8 +2,11 @@
 #include <iostream>
 #include <thread>
 #include <string>
+#include <algorithm>
+#include <condition_variable>
 #include "Telescope.hh"
 #include "Frontend.hh"
+#include "TcpReactor.hh"
 
 
 static const std::string builtin_tele_conf_str =
@@ -19,6 +22,27 @@ static const std::string builtin_layer_conf_str =
 
 using namespace altel;
 
+namespace{
+  // the threads of all layers pass together
+  class LayerBarrier{
+  public:
+    explicit LayerBarrier(size_t n):m_n(n){};
+    void arrive_and_wait(){
+      std::unique_lock<std::mutex> lk(m_mx);
+      if(++m_n_arrived >= m_n){
+        m_cv.notify_all();
+        return;
+      }
+      m_cv.wait(lk, [&]{return m_n_arrived >= m_n;});
+    }
+  private:
+    size_t m_n;
+    size_t m_n_arrived{0};
+    std::mutex m_mx;
+    std::condition_variable m_cv;
+  };
+}
+
 Telescope::Telescope(const std::string& tele_js_str, const std::string& layer_js_str){
 
   m_jsd_tele.Parse((tele_js_str=="builtin"||tele_js_str.empty())?builtin_tele_conf_str:tele_js_str);
@@ -53,6 +77,40 @@ Telescope::Telescope(const std::string& tele_js_str, const std::string& layer_js
     throw;
   }
 
+  if(js_telescope.HasMember("config") && js_telescope["config"].HasMember("event_builder")){
+    const auto& js_builder = js_telescope["config"]["event_builder"];
+    if(js_builder.HasMember("timeout_us")){
+      m_builder_timeout = std::chrono::microseconds(js_builder["timeout_us"].GetUint64());
+    }
+    if(js_builder.HasMember("max_skew")){
+      m_builder_max_skew = js_builder["max_skew"].GetUint64();
+    }
+    if(js_builder.HasMember("emit_partial")){
+      m_builder_emit_partial = js_builder["emit_partial"].GetBool();
+    }
+  }
+
+  {
+    uint64_t reactor_threads = 1;
+    uint64_t reactor_rcvbuf = 8<<20;
+    uint64_t reactor_busy_poll_us = 0;
+    if(js_telescope.HasMember("config") && js_telescope["config"].HasMember("reactor")){
+      const auto& js_reactor = js_telescope["config"]["reactor"];
+      if(js_reactor.HasMember("threads")){
+        reactor_threads = js_reactor["threads"].GetUint64();
+      }
+      if(js_reactor.HasMember("rcvbuf")){
+        reactor_rcvbuf = js_reactor["rcvbuf"].GetUint64();
+      }
+      if(js_reactor.HasMember("busy_poll_us")){
+        reactor_busy_poll_us = js_reactor["busy_poll_us"].GetUint64();
+      }
+    }
+    if(reactor_threads){
+      m_reactor.reset(new TcpReactor(reactor_threads, reactor_rcvbuf, reactor_busy_poll_us));
+    }
+  }
+
   // throw;
   for(const auto& l: js_telescope["locations"].GetObject()){
     std::string name = l.name.GetString();
@@ -79,6 +137,7 @@ Telescope::Telescope(const std::string& tele_js_str, const std::string& layer_js
           str_ctrl_link = std::string(sb.GetString(), sb.GetSize());
         }
         std::unique_ptr<Frontend> l(new Frontend("", "", str_ctrl_link, ly_host, ly_name, ly_daqid));
+        l->SetReactor(m_reactor.get());
         m_vec_layer.push_back(std::move(l));
         layer_found = true;
         break;
@@ -97,55 +156,43 @@ Telescope::~Telescope(){
   Stop();
 }
 
-TelEventSP Telescope::ReadEvent(){
+TelEventSP Telescope::ReadEvent(uint64_t* layerMask){
   if (!m_is_running) return nullptr;
 
-  uint32_t trigger_n = -1;
-  for(auto &l: m_vec_layer){
-    if( l->Size() == 0){
-      // TODO check cached size of all layers
-      return nullptr;
-    }
-    else{
-      uint32_t trigger_n_ev = l->Front()->tid;
-      if(trigger_n_ev< trigger_n)
-        trigger_n = trigger_n_ev;
+  auto now = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < m_vec_layer.size(); i++){
+    auto &l = m_vec_layer[i];
+    // bounded per call, so that one busy layer does not hold back the others,
+    // except at the end of run, where every sub-event must be in before the flush
+    for(size_t n = 0; n < 64 || m_is_flushing; n++){
+      DataPackSP &pack = l->Front();
+      if(!pack){
+        break;
+      }
+      m_builder->Push(i, std::move(pack), now);
+      l->PopFront();
     }
   }
 
-  std::vector<TelEventSP> sub_events;
-  for(auto &l: m_vec_layer){
-    auto &ev_front = l->Front()->telev_pack;
-    if(ev_front->clkN() == trigger_n){
-      sub_events.push_back(ev_front);
-      l->PopFront();
-    }
+  if(m_is_flushing){
+    m_builder->Flush();
   }
 
-  if(sub_events.size() < m_vec_layer.size() ){
-    //std::cout<< "dropped assambed event with subevent less than requried "<< m_vec_layer.size() <<" sub events" <<std::endl;
-    std::string dev_numbers;
-    for(auto & ev : sub_events){
-      dev_numbers += std::to_string(ev->detN());
-      dev_numbers +=" ";
-    }
-    //std::cout<< "  TID#"<<trigger_n<<" subevent= "<< dev_numbers <<std::endl;
+  uint64_t mask = 0;
+  TelEventSP telev_sync = m_builder->Pop(now, &mask);
+  if(!telev_sync){
     return nullptr;
   }
-
-  uint32_t runN = 0;
-  uint32_t eventN =  m_st_n_ev;
-  uint32_t deviceN = 0;
-  uint32_t clockN = trigger_n;
-  auto telev_sync = std::make_shared<TelEvent>(runN, eventN, deviceN, clockN);
-  for(auto &subev: sub_events){
-    telev_sync->MRs.insert(telev_sync->MRs.end(), subev->MRs.begin(),subev->MRs.end());
-    telev_sync->MHs.insert(telev_sync->MHs.end(), subev->MHs.begin(),subev->MHs.end());
+  telev_sync->eveN() = m_st_n_ev;
+  if(layerMask){
+    *layerMask = mask;
   }
 
-  size_t none_empty_layer_n = 0;
-  for(auto &subev: sub_events){
-    if(!subev->MRs.empty()){
+  // MRs of one layer are contiguous in the built event
+  auto &mrs = telev_sync->MRs;
+  size_t none_empty_layer_n = mrs.empty()? 0 : 1;
+  for(size_t n = 1; n < mrs.size(); n++){
+    if(mrs[n].detN() != mrs[n-1].detN()){
       none_empty_layer_n ++;
     }
   }
@@ -159,7 +206,6 @@ TelEventSP Telescope::ReadEvent(){
   }
   m_st_n_ev ++;
   return telev_sync;
-
 }
 
 TelEventSP Telescope::ReadEvent_Lastcopy(){
@@ -172,20 +218,117 @@ TelEventSP Telescope::ReadEvent_Lastcopy(){
     return nullptr;
 }
 
-void Telescope::Init(){
-  for(auto & l: m_vec_layer){
-    l->daq_conf_default();
+bool Telescope::RunPerLayer(const std::string& what, const std::function<void(size_t, Frontend&)>& f,
+                            bool isSynchronised){
+  size_t layerN = 0;
+  for(auto &l: m_vec_layer){
+    if(l){
+      layerN ++;
+    }
+  }
+  LayerBarrier barrier(layerN);
+  std::vector<std::future<std::string>> futs(m_vec_layer.size());
+  for(size_t n = 0; n < m_vec_layer.size(); n++){
+    Frontend *fe = m_vec_layer[n].get();
+    if(!fe){
+      continue;
+    }
+    futs[n] = std::async(std::launch::async, [&, n, fe]()->std::string{
+      if(isSynchronised){
+        barrier.arrive_and_wait();
+      }
+      uint64_t n_reg_error_begin = fe->m_st_n_reg_error_now;
+      try{
+        f(n, *fe);
+      }
+      catch(const std::exception &e){
+        return e.what();
+      }
+      catch(...){
+        return "unknown exception";
+      }
+      uint64_t n_reg_error = fe->m_st_n_reg_error_now - n_reg_error_begin;
+      if(n_reg_error){
+        return std::to_string(n_reg_error) + " failed register batches";
+      }
+      return "";
+    });
+  }
+
+  bool isOk = true;
+  for(size_t n = 0; n < futs.size(); n++){
+    if(!futs[n].valid()){
+      continue;
+    }
+    std::string err = futs[n].get();
+    if(!err.empty()){
+      std::fprintf(stderr, "Telescope: %s of layer %s failed, %s\n", what.c_str(), m_vec_layer[n]->GetName().c_str(), err.c_str());
+      isOk = false;
+    }
+  }
+  return isOk;
+}
+
+bool Telescope::Init(){
+  auto tp_begin = std::chrono::steady_clock::now();
+  bool isOk = RunPerLayer("configuration", [](size_t, Frontend& fe){
+    fe.daq_conf_default();
+  });
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_begin).count();
+  std::fprintf(stdout, "tel_init: %zu layers configured in %.3f s%s\n", m_vec_layer.size(), sec, isOk? "" : ", with errors");
+  return isOk;
+}
+
+bool Telescope::StartLayers(){
+  bool isOk = RunPerLayer("run preparation", [](size_t, Frontend& fe){
+    fe.daq_prepare_run();
+  });
+  if(!isOk){
+    // no layer uploads data, the prepared ones are wound down
+    std::fprintf(stderr, "tel_start: run preparation failed, data upload is not enabled\n");
+    StopLayers();
+    return false;
+  }
+  // all layers are ready to receive, data upload is enabled on all of them together
+  std::vector<std::chrono::steady_clock::time_point> tp_upload(m_vec_layer.size());
+  isOk = RunPerLayer("run start", [&](size_t n, Frontend& fe){
+    fe.SetFirmwareRegister("upload_data", 1);
+    tp_upload[n] = std::chrono::steady_clock::now();
+  }, true);
+  if(!tp_upload.empty()){
+    auto [tp_min, tp_max] = std::minmax_element(tp_upload.begin(), tp_upload.end());
+    std::fprintf(stdout, "tel_start: upload_data enabled on %zu layers within %.0f us\n", m_vec_layer.size(),
+                 std::chrono::duration<double, std::micro>(*tp_max - *tp_min).count());
+  }
+  if(!isOk){
+    std::fprintf(stderr, "tel_start: run start failed, data upload is disabled again\n");
+    StopLayers();
   }
+  return isOk;
+}
+
+void Telescope::StopLayers(){
+  RunPerLayer("run stop", [](size_t, Frontend& fe){
+    fe.daq_stop_run();
+  }, true);
+}
 
+void Telescope::ResetEventBuilder(){
+  std::vector<std::string> layer_names;
+  for(auto & l: m_vec_layer){
+    layer_names.push_back(l->GetName());
+  }
+  m_builder.reset(new TelEventBuilder(layer_names, m_builder_timeout, m_builder_max_skew, m_builder_emit_partial));
 }
 
-void Telescope::Start(){
+bool Telescope::Start(){
   m_st_n_ev = 0;
   m_mon_ev_read = 0;
   m_mon_ev_write = 0;
+  ResetEventBuilder();
 
-  for(auto & l: m_vec_layer){
-    l->daq_start_run();
+  if(!StartLayers()){
+    return false;
   }
   std::fprintf(stdout, "tel_start \n");
 
@@ -195,15 +338,17 @@ void Telescope::Start(){
 
   m_fut_async_rd = std::async(std::launch::async, &Telescope::AsyncRead, this);
   m_is_running = true;
+  return true;
 }
 
-void Telescope::Start_no_tel_reading(){ // TO be removed,
+bool Telescope::Start_no_tel_reading(){ // TO be removed,
   m_st_n_ev = 0;
   m_mon_ev_read = 0;
   m_mon_ev_write = 0;
+  ResetEventBuilder();
 
-  for(auto & l: m_vec_layer){
-    l->daq_start_run();
+  if(!StartLayers()){
+    return false;
   }
 
   if(!m_is_async_watching){
@@ -211,9 +356,13 @@ void Telescope::Start_no_tel_reading(){ // TO be removed,
   }
   //m_fut_async_rd = std::async(std::launch::async, &Telescope::AsyncRead, this);
   m_is_running = true;
+  return true;
 }
 
 void Telescope::Stop(){
+  // layers are stopped first, the reader takes in their last data and flushes the builder
+  StopLayers();
+
   m_is_async_reading = false;
   if(m_fut_async_rd.valid())
     m_fut_async_rd.get();
@@ -222,11 +371,10 @@ void Telescope::Stop(){
   if(m_fut_async_watch.valid())
     m_fut_async_watch.get();
 
-  for(auto & l: m_vec_layer){
-    l->daq_stop_run();
-  }
-
   m_is_running = false;
+  if(m_builder){
+    std::fprintf(stdout, "%s\n", m_builder->GetStatusString().c_str());
+  }
 }
 
 uint64_t Telescope::AsyncRead(){
@@ -239,11 +387,23 @@ uint64_t Telescope::AsyncRead(){
   while (m_is_async_reading){
     auto telev = ReadEvent();
     if(!telev){
-      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      // block on the first layer without data, instead of polling
+      for(auto &l: m_vec_layer){
+        if(l->Size() == 0){
+          l->WaitFront(std::chrono::microseconds(1000));
+          break;
+        }
+      }
       continue;
     }
     n_ev ++;
   }
+  // end of run, triggers still pending in the builder are emitted as well
+  m_is_flushing = true;
+  while(ReadEvent()){
+    n_ev ++;
+  }
+  m_is_flushing = false;
   return n_ev;
 }
 
@@ -258,37 +418,35 @@ uint64_t Telescope::AsyncWatchDog(){
     uint64_t st_n_ev = m_st_n_ev;
     uint64_t st_n_ev_tumb = m_st_n_ev_tumb;
 
-    std::fprintf(stdout, "Tele: disk saved events(%lu) event_tumb(%lu) %f%%, \n\n",
+    std::fprintf(stdout, "Tele: disk saved events(%lu) event_tumb(%lu) %f%%, \n",
                  st_n_ev, st_n_ev_tumb, 100.*st_n_ev_tumb/st_n_ev );
+    if(m_builder){
+      std::fprintf(stdout, "%s\n", m_builder->GetStatusString().c_str());
+    }
   }
   //sleep and watch running time status;
   return 0;
 }
 
 
-void Telescope::BroadcastFirmwareRegister(const std::string& name, uint64_t value){
-  for(auto &fe :  m_vec_layer){
-    if(fe){
-      fe->SetFirmwareRegister(name, value);
-    }
-  }
+bool Telescope::BroadcastFirmwareRegister(const std::string& name, uint64_t value){
+  return RunPerLayer("firmware register "+name, [&](size_t, Frontend& fe){
+    fe.SetFirmwareRegister(name, value);
+  });
 }
 
-void Telescope::BroadcastSensorRegister(const std::string& name, uint64_t value){
-  for(auto &fe :  m_vec_layer){
-    if(fe){
-      fe->SetSensorRegister(name, value);
-    }
-  }
+bool Telescope::BroadcastSensorRegister(const std::string& name, uint64_t value){
+  return RunPerLayer("sensor register "+name, [&](size_t, Frontend& fe){
+    fe.SetSensorRegister(name, value);
+  });
 }
 
-void Telescope::FlushPixelMask(const std::map<std::string,  std::set<std::pair<uint16_t, uint16_t>>>& mask_col){
-  for(auto &fe :  m_vec_layer){
-    std::string name = fe->GetName();
-    auto name_mask_it = mask_col.find(name);
+bool Telescope::FlushPixelMask(const std::map<std::string,  std::set<std::pair<uint16_t, uint16_t>>>& mask_col){
+  return RunPerLayer("pixel mask", [&](size_t, Frontend& fe){
+    auto name_mask_it = mask_col.find(fe.GetName());
     if(name_mask_it != mask_col.end()){
       auto & maskset = name_mask_it->second;
-      fe->FlushPixelMask(maskset, Frontend::MaskType::MASK);
+      fe.FlushPixelMask(maskset, Frontend::MaskType::MASK);
     }
-  }
+  });
 }
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "eudaq/Event.hh"
+#include "TelEvent.hpp"
+
+template<typename T> class BoundedQueue;
+
+namespace altel{
+
+  // Reads eudaq native raw files into TelEvents with a pool of decoding threads.
+  //
+  // Each file is memory-mapped and scanned by its own thread, which deserializes
+  // the eudaq events, records their offsets and hands them over in batches.
+  // Decoding of AltelRaw blocks and clustering run on the pool, GetNextEvent()
+  // returns the events in file and event order, as eudaq FileReader does. While
+  // one file is consumed, the next fileAhead files are already scanned and
+  // decoded, each at most batchAhead batches ahead of the consumer.
+  //
+  // The first eventSkip events of all files are deserialized but not decoded.
+  class EudaqRawReader{
+  public:
+    EudaqRawReader(const std::vector<std::string>& paths, size_t threadN,
+                   size_t eventSkip = 0, size_t fileAhead = 1);
+    ~EudaqRawReader();
+
+    // next event, nullptr after the last event of the last file
+    std::shared_ptr<TelEvent> GetNextEvent();
+
+    // number of file the last event came from
+    size_t FileN() const {return m_file_cur;}
+
+    // event offsets of a file, complete once GetNextEvent() has moved past the file
+    const std::vector<uint64_t>& EventOffsets(size_t fileN) const {return m_files[fileN].offsets;}
+
+    // random access through the offset index, nullptr when out of range
+    eudaq::EventSPC ReadEudaqEvent(size_t fileN, size_t eventN);
+
+    static const size_t s_batch_event_n = 256;
+    static const size_t s_batch_ahead_n = 16;
+
+  private:
+    struct Batch{
+      size_t fileN{0};
+      size_t batchN{0};
+      std::vector<eudaq::EventSPC> eudaqEvents;
+    };
+
+    struct File{
+      std::string path;
+      const unsigned char* data{nullptr};
+      size_t size{0};
+      std::vector<uint64_t> offsets;
+      size_t eventN{0};        // scanned events, skipped ones included
+      size_t batchN{0};        // batches given to the pool
+      size_t batchConsumed{0};
+      bool isScanned{false};
+    };
+
+    void ScanFile(size_t fileN);
+    void DecodeBatches();
+
+    std::vector<File> m_files;
+    size_t m_event_skip;
+    size_t m_file_ahead;
+
+    std::unique_ptr<BoundedQueue<Batch>> m_queue_batch;
+    std::vector<std::thread> m_fut_scan;
+    std::vector<std::thread> m_fut_decode;
+
+    std::mutex m_mx;
+    std::condition_variable m_cv;
+    bool m_is_stopped{false};
+    std::map<std::pair<size_t, size_t>, std::vector<std::shared_ptr<TelEvent>>> m_decoded;
+
+    // consumer side
+    size_t m_file_cur{0};
+    size_t m_batch_cur{0};
+    std::vector<std::shared_ptr<TelEvent>> m_events_cur;
+    size_t m_event_pos{0};
+  };
+}
@@ -0,0 +1,258 @@
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "EudaqRawReader.hh"
+#include "CvtEudaqAltelRaw.hh"
+#include "myqueue.hh"
+
+using namespace altel;
+
+namespace{
+  // eudaq deserializer over a memory-mapped file, starting at any event offset
+  class MappedDeserializer: public eudaq::Deserializer{
+  public:
+    MappedDeserializer(const unsigned char* data, size_t size, size_t offset)
+      :m_data(data), m_size(size), m_offset(offset){};
+    bool HasData() override {return m_offset < m_size;}
+    size_t Offset() const {return m_offset;}
+  private:
+    void Deserialize(unsigned char* dst, size_t n) override{
+      PreDeserialize(dst, n);
+      m_offset += n;
+    }
+    void PreDeserialize(unsigned char* dst, size_t n) override{
+      if(n > m_size - m_offset){
+        throw std::runtime_error("end of file within an event");
+      }
+      std::memcpy(dst, m_data + m_offset, n);
+    }
+    const unsigned char* m_data;
+    size_t m_size;
+    size_t m_offset;
+  };
+
+  // next event, nullptr at end of data or at a broken event
+  eudaq::EventSPC deserializeEvent(MappedDeserializer& mds, const std::string& path){
+    eudaq::Deserializer &ds = mds;
+    size_t offset = mds.Offset();
+    try{
+      uint32_t id;
+      ds.PreRead(id);
+      return eudaq::Factory<eudaq::Event>::MakeUnique<eudaq::Deserializer&>(id, ds);
+    }
+    catch(const std::exception& e){
+      std::fprintf(stderr, "EudaqRawReader: %s, at offset %zu of %s, rest of file is ignored\n",
+                   e.what(), offset, path.c_str());
+    }
+    return nullptr;
+  }
+}
+
+EudaqRawReader::EudaqRawReader(const std::vector<std::string>& paths, size_t threadN,
+                               size_t eventSkip, size_t fileAhead)
+  :m_event_skip(eventSkip), m_file_ahead(fileAhead){
+  m_files.resize(paths.size());
+  for(size_t n = 0; n < paths.size(); n++){
+    m_files[n].path = paths[n];
+  }
+  if(threadN == 0){
+    threadN = 1;
+  }
+  m_queue_batch.reset(new BoundedQueue<Batch>(2*threadN));
+  for(size_t n = 0; n < threadN; n++){
+    m_fut_decode.emplace_back(&EudaqRawReader::DecodeBatches, this);
+  }
+  for(size_t n = 0; n < m_files.size(); n++){
+    m_fut_scan.emplace_back(&EudaqRawReader::ScanFile, this, n);
+  }
+}
+
+EudaqRawReader::~EudaqRawReader(){
+  {
+    std::unique_lock<std::mutex> lk(m_mx);
+    m_is_stopped = true;
+  }
+  m_cv.notify_all();
+  m_queue_batch->close();
+  for(auto &fut: m_fut_scan){
+    fut.join();
+  }
+  for(auto &fut: m_fut_decode){
+    fut.join();
+  }
+  for(auto &f: m_files){
+    if(f.data){
+      munmap(const_cast<unsigned char*>(f.data), f.size);
+    }
+  }
+}
+
+void EudaqRawReader::ScanFile(size_t fileN){
+  File &f = m_files[fileN];
+  size_t skipN = 0;
+  {
+    std::unique_lock<std::mutex> lk(m_mx);
+    m_cv.wait(lk, [&]{return m_is_stopped || fileN <= m_file_cur + m_file_ahead;});
+    // events to skip here depend on the number of events in all files before
+    m_cv.wait(lk, [&]{
+      if(m_is_stopped || m_event_skip == 0){
+        return true;
+      }
+      size_t eventN = 0;
+      for(size_t n = 0; n < fileN; n++){
+        if(!m_files[n].isScanned){
+          return false;
+        }
+        eventN += m_files[n].eventN;
+      }
+      skipN = m_event_skip > eventN? m_event_skip - eventN : 0;
+      return true;
+    });
+    if(m_is_stopped){
+      return;
+    }
+  }
+
+  int fd = open(f.path.c_str(), O_RDONLY);
+  struct stat st;
+  if(fd < 0 || fstat(fd, &st) != 0){
+    std::fprintf(stderr, "EudaqRawReader: unable to open file %s\n", f.path.c_str());
+    throw;
+  }
+  size_t size = st.st_size;
+  const unsigned char* data = nullptr;
+  if(size){
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p == MAP_FAILED){
+      std::fprintf(stderr, "EudaqRawReader: unable to map file %s\n", f.path.c_str());
+      throw;
+    }
+    // kernel reads ahead in large chunks
+    madvise(p, size, MADV_SEQUENTIAL);
+    data = static_cast<const unsigned char*>(p);
+  }
+  close(fd);
+
+  std::vector<uint64_t> offsets;
+  size_t eventN = 0;
+  Batch batch;
+  batch.fileN = fileN;
+  auto submit = [&]()->bool{
+    {
+      std::unique_lock<std::mutex> lk(m_mx);
+      m_cv.wait(lk, [&]{return m_is_stopped || f.batchN - f.batchConsumed < s_batch_ahead_n;});
+      if(m_is_stopped){
+        return false;
+      }
+      batch.batchN = f.batchN++;
+    }
+    bool isPushed = m_queue_batch->push(std::move(batch));
+    batch = Batch();
+    batch.fileN = fileN;
+    return isPushed;
+  };
+
+  MappedDeserializer mds(data, size, 0);
+  bool isRunning = true;
+  while(isRunning && mds.HasData()){
+    uint64_t offset = mds.Offset();
+    auto eudaqEvent = deserializeEvent(mds, f.path);
+    if(!eudaqEvent){
+      break;
+    }
+    offsets.push_back(offset);
+    eventN++;
+    if(eventN <= skipN){
+      continue;
+    }
+    batch.eudaqEvents.push_back(std::move(eudaqEvent));
+    if(batch.eudaqEvents.size() >= s_batch_event_n){
+      isRunning = submit();
+    }
+  }
+  if(isRunning && !batch.eudaqEvents.empty()){
+    submit();
+  }
+
+  {
+    std::unique_lock<std::mutex> lk(m_mx);
+    f.data = data;
+    f.size = size;
+    f.offsets = std::move(offsets);
+    f.eventN = eventN;
+    f.isScanned = true;
+  }
+  m_cv.notify_all();
+}
+
+void EudaqRawReader::DecodeBatches(){
+  Batch batch;
+  while(m_queue_batch->pop(batch)){
+    std::vector<std::shared_ptr<TelEvent>> telEvents;
+    telEvents.reserve(batch.eudaqEvents.size());
+    for(auto &eudaqEvent: batch.eudaqEvents){
+      telEvents.push_back(createTelEvent(eudaqEvent));
+      eudaqEvent.reset();
+    }
+    {
+      std::unique_lock<std::mutex> lk(m_mx);
+      m_decoded[std::make_pair(batch.fileN, batch.batchN)] = std::move(telEvents);
+    }
+    m_cv.notify_all();
+  }
+}
+
+std::shared_ptr<TelEvent> EudaqRawReader::GetNextEvent(){
+  while(1){
+    if(m_event_pos < m_events_cur.size()){
+      return std::move(m_events_cur[m_event_pos++]);
+    }
+    m_events_cur.clear();
+    m_event_pos = 0;
+    if(m_file_cur >= m_files.size()){
+      return nullptr;
+    }
+    {
+      std::unique_lock<std::mutex> lk(m_mx);
+      File &f = m_files[m_file_cur];
+      auto key = std::make_pair(m_file_cur, m_batch_cur);
+      m_cv.wait(lk, [&]{return m_decoded.count(key) || (f.isScanned && m_batch_cur == f.batchN);});
+      auto it = m_decoded.find(key);
+      if(it != m_decoded.end()){
+        m_events_cur = std::move(it->second);
+        m_decoded.erase(it);
+        m_batch_cur++;
+        f.batchConsumed++;
+      }
+      else{
+        // file is done, the next one may start scanning
+        m_file_cur++;
+        m_batch_cur = 0;
+      }
+    }
+    m_cv.notify_all();
+  }
+}
+
+eudaq::EventSPC EudaqRawReader::ReadEudaqEvent(size_t fileN, size_t eventN){
+  const unsigned char* data;
+  size_t size;
+  uint64_t offset;
+  {
+    std::unique_lock<std::mutex> lk(m_mx);
+    if(fileN >= m_files.size() || !m_files[fileN].isScanned || eventN >= m_files[fileN].offsets.size()){
+      return nullptr;
+    }
+    data = m_files[fileN].data;
+    size = m_files[fileN].size;
+    offset = m_files[fileN].offsets[eventN];
+  }
+  MappedDeserializer mds(data, size, offset);
+  return deserializeEvent(mds, m_files[fileN].path);
+}
@@ -2,8 +2,10 @@
 #include <cmath>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <cstddef>
 #include <algorithm>
+#include <utility>
 #include <iostream>
 
 namespace altel{
@@ -72,7 +74,12 @@ namespace altel{
                double pitchV = 0.025,
                double offsetU = -0.025 * (1024/2. - 0.5),
                double offsetV = -0.025 * (512/2. - 0.5))
-      :MRs(mrs){
+      :MRs(std::move(mrs)){
+      updateFromMeasRaws(pitchU, pitchV, offsetU, offsetV);
+    };
+
+    // detector id and local position from MRs, as center of gravity
+    void updateFromMeasRaws(double pitchU, double pitchV, double offsetU, double offsetV){
       if(MRs.empty()){
         return;
       }
@@ -87,7 +94,7 @@ namespace altel{
       }
       PLs[0] = double(sumRawU)/rawN*pitchU + offsetU;
       PLs[1] = double(sumRawV)/rawN*pitchV + offsetV;
-    };
+    }
 
     inline const double& u() const  {return PLs[0];}
     inline const double& v() const  {return PLs[1];}
@@ -99,6 +106,10 @@ namespace altel{
     inline uint16_t& detN() {return DN;}
     inline std::vector<TelMeasRaw>& measRaws() {return MRs;}
 
+    // Same output as clustering_UVDCus_naive: clusters ordered by their first raw
+    // hit in the input, raw hits of a cluster in 8-neighbour breadth-first order.
+    // Hits are sorted once by packed index, neighbours are then found by binary
+    // search. O(n log n), scratch buffers are reused per thread.
     static std::vector<std::shared_ptr<TelMeasHit>>
     clustering_UVDCus(const std::vector<TelMeasRaw>& measRaws,
                       double pitchU = 0.025,
@@ -106,6 +117,132 @@ namespace altel{
                       double offsetU = -0.025 * (1024/2 - 0.5),
                       double offsetV = -0.025 * (512/2 - 0.5)){
       std::vector<std::shared_ptr<TelMeasHit>> measHits;
+      clustering_UVDCus(measRaws, measHits, pitchU, pitchV, offsetU, offsetV);
+      return measHits;
+    }
+
+    // As above, result replaces the content of measHits. TelMeasHit objects
+    // in measHits which are not shared elsewhere (use_count()==1) are reused.
+    static void
+    clustering_UVDCus(const std::vector<TelMeasRaw>& measRaws,
+                      std::vector<std::shared_ptr<TelMeasHit>>& measHits,
+                      double pitchU = 0.025,
+                      double pitchV = 0.025,
+                      double offsetU = -0.025 * (1024/2 - 0.5),
+                      double offsetV = -0.025 * (512/2 - 0.5)){
+      size_t hitN = 0;
+      clustering_UVDCus_visit(measRaws, [&](const std::vector<uint32_t>& cluster){
+        if(hitN == measHits.size()){
+          measHits.emplace_back();
+        }
+        std::shared_ptr<TelMeasHit>& measHit = measHits[hitN];
+        if(!measHit || measHit.use_count() != 1){
+          measHit = std::make_shared<TelMeasHit>();
+        }
+        else{
+          // pairs with the release of the last other owner, possibly on another thread
+          std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        measHit->MRs.clear();
+        for(auto pos: cluster){
+          measHit->MRs.push_back(measRaws[pos]);
+        }
+        measHit->updateFromMeasRaws(pitchU, pitchV, offsetU, offsetV);
+        hitN++;
+      });
+      measHits.resize(hitN);
+    }
+
+    // Clustering engine of the above. onCluster(const std::vector<uint32_t>&) is
+    // called once per cluster, with the positions in measRaws of its raw hits.
+    template<typename F>
+    static void
+    clustering_UVDCus_visit(const std::vector<TelMeasRaw>& measRaws, F&& onCluster){
+      const size_t rawN = measRaws.size();
+      if(rawN == 0){
+        return;
+      }
+
+      struct SortedRaw{
+        uint64_t index;
+        uint32_t pos; // position in measRaws
+      };
+      thread_local std::vector<SortedRaw> sorted;
+      thread_local std::vector<uint32_t>  rank;  // position in sorted, by position in measRaws
+      thread_local std::vector<uint8_t>   used;  // by position in measRaws
+      thread_local std::vector<uint32_t>  edge;  // fifo of positions in measRaws
+      sorted.clear();
+      edge.clear();
+      rank.resize(rawN);
+      used.assign(rawN, 0);
+      sorted.reserve(rawN);
+      edge.reserve(rawN);
+      for(size_t i = 0; i < rawN; i++){
+        sorted.push_back({measRaws[i].index(), static_cast<uint32_t>(i)});
+      }
+      // stable order inside equal index keeps duplicated raws picked in input order
+      std::sort(sorted.begin(), sorted.end(), [](const SortedRaw& a, const SortedRaw& b){
+        return a.index < b.index || (a.index == b.index && a.pos < b.pos);
+      });
+      for(size_t i = 0; i < rawN; i++){
+        rank[sorted[i].pos] = static_cast<uint32_t>(i);
+      }
+
+      // Take the first un-identifed raw of each index in [lo, hi], ascending.
+      // Neighbours of one row are consecutive indices, so a single range scan
+      // visits them in the same order as the naive 8-neighbour list.
+      auto takeRange = [&](size_t from, size_t to, uint64_t lo, uint64_t hi, uint64_t skip){
+        auto it = std::lower_bound(sorted.begin() + from, sorted.begin() + to, lo,
+                                   [](const SortedRaw& a, uint64_t b){return a.index < b;});
+        auto end = sorted.begin() + to;
+        uint64_t taken = skip;
+        for(; it != end && it->index <= hi; ++it){
+          if(it->index == skip || it->index == taken || used[it->pos]){
+            continue;
+          }
+          used[it->pos] = 1;
+          edge.push_back(it->pos);
+          taken = it->index;
+        }
+      };
+
+      const uint64_t c = 0x00000001;
+      const uint64_t r = 0x00010000;
+      for(size_t seed = 0; seed < rawN; seed++){
+        if(used[seed]){
+          continue;
+        }
+        used[seed] = 1;
+        edge.clear();
+        edge.push_back(static_cast<uint32_t>(seed));
+        for(size_t head = 0; head < edge.size(); head++){
+          const TelMeasRaw& ph_e = measRaws[edge[head]];
+          if(ph_e.u()>=1024 || ph_e.v()>=512) {
+            std::cout<<"out of size\n"<<std::endl;
+            throw;
+          }
+          uint64_t e = ph_e.index();
+          size_t e_rank = rank[edge[head]];
+          //  8 sorround hits search, same order as the naive version
+          //  e-c+r, e+r, e+c+r,
+          //  e-c  ,      e+c,
+          //  e-c-r, e-r, e+c-r
+          takeRange(e_rank, rawN, e-c+r, e+c+r, e);
+          takeRange(0, rawN, e-c, e+c, e);
+          takeRange(0, e_rank, e-c-r, e+c-r, e);
+        }
+        onCluster(edge);
+      }
+    }
+
+    // reference implementation, quadratic in number of raw hits
+    static std::vector<std::shared_ptr<TelMeasHit>>
+    clustering_UVDCus_naive(const std::vector<TelMeasRaw>& measRaws,
+                      double pitchU = 0.025,
+                      double pitchV = 0.025,
+                      double offsetU = -0.025 * (1024/2 - 0.5),
+                      double offsetV = -0.025 * (512/2 - 0.5)){
+      std::vector<std::shared_ptr<TelMeasHit>> measHits;
 
       auto hit_col_remain= measRaws;
       while(!hit_col_remain.empty()){
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TelEvent.hpp"
+#include "TelEventFlat.hpp"
+
+// Native binary file of altel::TelEvent.
+//
+// file:   FileHeader, Chunk..., IndexRec[chunkN], Trailer
+// chunk:  ChunkHeader, then the columns EventRec[eventN], MR[mrN], MeasHitRec[mhN],
+//         MR[hrN] (raws of measure hits), TrajRec[tjN], TrajHitRec[thN]
+//
+// All records are fixed width, little-endian, 8-byte aligned. Record indices
+// are relative to the chunk. Every chunk holds FileHeader::chunkEventN events
+// except the last one, so event n is in chunk n/chunkEventN and a seek is O(1).
+// The reader maps the whole file and decodes only the requested event, either
+// into a TelEvent or into a reused TelEventFlat without allocation. A file
+// without trailer (writer did not close) is readable, its index is rebuilt by
+// hopping over the chunk headers.
+
+namespace altel{
+  namespace TelEventBinary{
+    static constexpr char s_magic_file[8]  = {'A','L','T','E','L','T','E','B'};
+    static constexpr char s_magic_chunk[8] = {'T','E','B','C','H','U','N','K'};
+    static constexpr char s_magic_index[8] = {'T','E','B','I','N','D','E','X'};
+    static constexpr uint32_t s_version = 1;
+
+    struct FileHeader{
+      char magic[8];
+      uint32_t version;
+      uint32_t chunkEventN;
+    };
+
+    struct ChunkHeader{
+      char magic[8];
+      uint64_t firstEventN;
+      uint32_t eventN;
+      uint32_t mrN;
+      uint32_t mhN;
+      uint32_t hrN;
+      uint32_t tjN;
+      uint32_t thN;
+    };
+
+    struct EventRec{
+      uint32_t RN;
+      uint32_t EN;
+      uint16_t DN;
+      uint16_t reserved;
+      uint32_t mrN;
+      uint64_t CK;
+      uint32_t mrBegin;
+      uint32_t mhBegin;
+      uint32_t mhN;     // MHs of the event
+      uint32_t mhAllN;  // plus measure hits only referred by trajectories
+      uint32_t tjBegin;
+      uint32_t tjN;
+    };
+
+    struct MeasHitRec{
+      uint16_t DN;
+      uint16_t reserved;
+      uint32_t hrN;
+      uint32_t hrBegin;
+      uint32_t reserved2;
+      double PLs[2];
+    };
+
+    struct TrajRec{
+      uint64_t TN;
+      uint32_t thBegin;
+      uint32_t thN;
+    };
+
+    struct TrajHitRec{
+      uint16_t DN;
+      uint16_t hasFitHit;
+      uint16_t fitDN;
+      uint16_t reserved;
+      int32_t originMeasHit;  // measure hit index in the event, -1 for none
+      int32_t matchedMeasHit;
+      double PLs[2];
+      double PLsE[2];
+      double PGs[3];
+      double DGs[3];
+    };
+
+    struct IndexRec{
+      uint64_t offset;
+      uint64_t firstEventN;
+      uint64_t eventN;
+    };
+
+    struct Trailer{
+      char magic[8];
+      uint64_t chunkN;
+      uint64_t indexOffset;
+      uint64_t eventN;
+    };
+
+    static_assert(sizeof(FileHeader) == 16, "");
+    static_assert(sizeof(ChunkHeader) == 40, "");
+    static_assert(sizeof(EventRec) == 48, "");
+    static_assert(sizeof(MeasHitRec) == 32, "");
+    static_assert(sizeof(TrajRec) == 16, "");
+    static_assert(sizeof(TrajHitRec) == 96, "");
+    static_assert(sizeof(TelMeasRaw) == 8, "");
+  }
+
+  class TelEventBinaryWriter{
+  public:
+    TelEventBinaryWriter(const std::string& path, uint32_t chunkEventN = 4096)
+      :m_chunkEventN(chunkEventN>0? chunkEventN : 1){
+      m_fd = std::fopen(path.c_str(), "wb");
+      if(!m_fd){
+        std::fprintf(stderr, "TelEventBinaryWriter: unable to open file %s\n", path.c_str());
+        throw;
+      }
+      TelEventBinary::FileHeader header{};
+      std::memcpy(header.magic, TelEventBinary::s_magic_file, 8);
+      header.version = TelEventBinary::s_version;
+      header.chunkEventN = m_chunkEventN;
+      write(&header, sizeof(header));
+    }
+
+    ~TelEventBinaryWriter(){
+      close();
+    }
+
+    void fillTelEvent(std::shared_ptr<TelEvent> telEvent){
+      m_flat.fromTelEvent(*telEvent);
+      fillTelEvent(m_flat);
+    }
+
+    void fillTelEvent(const TelEventFlat& ev){
+      using namespace TelEventBinary;
+      EventRec evRec{};
+      evRec.RN = ev.RN;
+      evRec.EN = ev.EN;
+      evRec.DN = ev.DN;
+      evRec.CK = ev.CK;
+
+      evRec.mrBegin = m_mrs.size();
+      evRec.mrN = ev.MRs.size();
+      m_mrs.insert(m_mrs.end(), ev.MRs.begin(), ev.MRs.end());
+
+      evRec.mhBegin = m_mhs.size();
+      evRec.mhN = ev.eventMeasHitN;
+      evRec.mhAllN = ev.MHs.size();
+      uint32_t hrBegin = m_hrs.size();
+      m_hrs.insert(m_hrs.end(), ev.hitRaws.begin(), ev.hitRaws.end());
+      for(auto &mh: ev.MHs){
+        MeasHitRec mhRec{};
+        mhRec.DN = mh.DN;
+        mhRec.PLs[0] = mh.PLs[0];
+        mhRec.PLs[1] = mh.PLs[1];
+        mhRec.hrBegin = hrBegin + mh.rawBegin;
+        mhRec.hrN = mh.rawN;
+        m_mhs.push_back(mhRec);
+      }
+
+      evRec.tjBegin = m_tjs.size();
+      evRec.tjN = ev.TJs.size();
+      for(auto &tj: ev.TJs){
+        TrajRec tjRec{};
+        tjRec.TN = tj.TN;
+        tjRec.thBegin = m_ths.size();
+        tjRec.thN = tj.thN;
+        for(uint32_t j = tj.thBegin; j < tj.thBegin + tj.thN; j++){
+          const TelEventFlat::TrajHit &th = ev.THs[j];
+          TrajHitRec thRec{};
+          thRec.DN = th.DN;
+          thRec.originMeasHit = -1;
+          thRec.matchedMeasHit = th.MM;
+          if(th.FH >= 0){
+            const TelEventFlat::FitHit &fh = ev.FHs[th.FH];
+            thRec.hasFitHit = 1;
+            thRec.fitDN = fh.DN;
+            std::memcpy(thRec.PLs, fh.PLs, sizeof(thRec.PLs));
+            std::memcpy(thRec.PLsE, fh.PLsE, sizeof(thRec.PLsE));
+            std::memcpy(thRec.PGs, fh.PGs, sizeof(thRec.PGs));
+            std::memcpy(thRec.DGs, fh.DGs, sizeof(thRec.DGs));
+            thRec.originMeasHit = fh.OM;
+          }
+          m_ths.push_back(thRec);
+        }
+        m_tjs.push_back(tjRec);
+      }
+
+      m_evs.push_back(evRec);
+      if(m_evs.size() >= m_chunkEventN){
+        flushChunk();
+      }
+    }
+
+    // writes pending events, chunk index and trailer. called by destructor.
+    void close(){
+      if(!m_fd){
+        return;
+      }
+      flushChunk();
+      using namespace TelEventBinary;
+      Trailer trailer{};
+      std::memcpy(trailer.magic, s_magic_index, 8);
+      trailer.chunkN = m_index.size();
+      trailer.indexOffset = m_offset;
+      trailer.eventN = m_eventN;
+      write(m_index.data(), m_index.size()*sizeof(IndexRec));
+      write(&trailer, sizeof(trailer));
+      std::fclose(m_fd);
+      m_fd = nullptr;
+    }
+
+  private:
+    void flushChunk(){
+      if(m_evs.empty()){
+        return;
+      }
+      using namespace TelEventBinary;
+      ChunkHeader header{};
+      std::memcpy(header.magic, s_magic_chunk, 8);
+      header.firstEventN = m_eventN;
+      header.eventN = m_evs.size();
+      header.mrN = m_mrs.size();
+      header.mhN = m_mhs.size();
+      header.hrN = m_hrs.size();
+      header.tjN = m_tjs.size();
+      header.thN = m_ths.size();
+      m_index.push_back(IndexRec{m_offset, m_eventN, m_evs.size()});
+
+      write(&header, sizeof(header));
+      write(m_evs.data(), m_evs.size()*sizeof(EventRec));
+      write(m_mrs.data(), m_mrs.size()*sizeof(TelMeasRaw));
+      write(m_mhs.data(), m_mhs.size()*sizeof(MeasHitRec));
+      write(m_hrs.data(), m_hrs.size()*sizeof(TelMeasRaw));
+      write(m_tjs.data(), m_tjs.size()*sizeof(TrajRec));
+      write(m_ths.data(), m_ths.size()*sizeof(TrajHitRec));
+
+      m_eventN += m_evs.size();
+      m_evs.clear();
+      m_mrs.clear();
+      m_mhs.clear();
+      m_hrs.clear();
+      m_tjs.clear();
+      m_ths.clear();
+    }
+
+    void write(const void* p, size_t n){
+      if(n && std::fwrite(p, 1, n, m_fd) != n){
+        std::fprintf(stderr, "TelEventBinaryWriter: write error\n");
+        throw;
+      }
+      m_offset += n;
+    }
+
+    std::FILE *m_fd{nullptr};
+    uint32_t m_chunkEventN;
+    uint64_t m_offset{0};
+    uint64_t m_eventN{0};
+
+    std::vector<TelEventBinary::EventRec> m_evs;
+    std::vector<TelMeasRaw> m_mrs;
+    std::vector<TelEventBinary::MeasHitRec> m_mhs;
+    std::vector<TelMeasRaw> m_hrs;
+    std::vector<TelEventBinary::TrajRec> m_tjs;
+    std::vector<TelEventBinary::TrajHitRec> m_ths;
+    std::vector<TelEventBinary::IndexRec> m_index;
+    TelEventFlat m_flat;
+  };
+
+  class TelEventBinaryReader{
+  public:
+    TelEventBinaryReader(const std::string& path){
+      using namespace TelEventBinary;
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if(fd < 0){
+        std::fprintf(stderr, "TelEventBinaryReader: unable to open file %s\n", path.c_str());
+        throw;
+      }
+      struct stat st;
+      if(::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FileHeader)){
+        ::close(fd);
+        std::fprintf(stderr, "TelEventBinaryReader: %s is not a TelEvent binary file\n", path.c_str());
+        throw;
+      }
+      m_size = st.st_size;
+      void *p = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if(p == MAP_FAILED){
+        std::fprintf(stderr, "TelEventBinaryReader: unable to map file %s\n", path.c_str());
+        throw;
+      }
+      m_data = static_cast<const char*>(p);
+
+      const FileHeader *header = reinterpret_cast<const FileHeader*>(m_data);
+      if(std::memcmp(header->magic, s_magic_file, 8) || header->version != s_version){
+        std::fprintf(stderr, "TelEventBinaryReader: %s is not a TelEvent binary file of version %u\n",
+                     path.c_str(), s_version);
+        throw;
+      }
+      m_chunkEventN = header->chunkEventN;
+
+      if(!loadIndex()){
+        std::fprintf(stderr, "TelEventBinaryReader: no index in %s, rebuilding it\n", path.c_str());
+        rebuildIndex();
+      }
+    }
+
+    ~TelEventBinaryReader(){
+      if(m_data){
+        ::munmap(const_cast<char*>(m_data), m_size);
+      }
+    }
+
+    TelEventBinaryReader(const TelEventBinaryReader&) = delete;
+    TelEventBinaryReader& operator=(const TelEventBinaryReader&) = delete;
+
+    size_t numEvents() const{
+      return m_eventN;
+    }
+
+    // random access, nullptr when n is out of range
+    std::shared_ptr<TelEvent> createTelEvent(size_t n){
+      if(!readTelEvent(n, m_flat)){
+        return nullptr;
+      }
+      return m_flat.toTelEvent();
+    }
+
+    // random access into a reused flat event, false when n is out of range
+    bool readTelEvent(size_t n, TelEventFlat& ev){
+      using namespace TelEventBinary;
+      if(n >= m_eventN){
+        return false;
+      }
+      size_t chunkN = n / m_chunkEventN;
+      if(chunkN >= m_index.size() || n < m_index[chunkN].firstEventN ||
+         n >= m_index[chunkN].firstEventN + m_index[chunkN].eventN){
+        // not written with equal chunks, e.g. concatenated files
+        chunkN = std::upper_bound(m_index.begin(), m_index.end(), n,
+                                  [](size_t v, const IndexRec& r){return v < r.firstEventN;}) - m_index.begin() - 1;
+      }
+      const IndexRec &idx = m_index[chunkN];
+      const char *chunk = m_data + idx.offset;
+      const ChunkHeader *header = reinterpret_cast<const ChunkHeader*>(chunk);
+      const EventRec *evs = reinterpret_cast<const EventRec*>(chunk + sizeof(ChunkHeader));
+      const TelMeasRaw *mrs = reinterpret_cast<const TelMeasRaw*>(evs + header->eventN);
+      const MeasHitRec *mhs = reinterpret_cast<const MeasHitRec*>(mrs + header->mrN);
+      const TelMeasRaw *hrs = reinterpret_cast<const TelMeasRaw*>(mhs + header->mhN);
+      const TrajRec *tjs = reinterpret_cast<const TrajRec*>(hrs + header->hrN);
+      const TrajHitRec *ths = reinterpret_cast<const TrajHitRec*>(tjs + header->tjN);
+
+      const EventRec &evRec = evs[n - idx.firstEventN];
+      ev.clear();
+      ev.RN = evRec.RN;
+      ev.EN = evRec.EN;
+      ev.DN = evRec.DN;
+      ev.CK = evRec.CK;
+      ev.MRs.assign(mrs + evRec.mrBegin, mrs + evRec.mrBegin + evRec.mrN);
+      for(uint32_t i = 0; i < evRec.mhAllN; i++){
+        const MeasHitRec &mhRec = mhs[evRec.mhBegin + i];
+        ev.addMeasHit(mhRec.DN, mhRec.PLs[0], mhRec.PLs[1], hrs + mhRec.hrBegin, mhRec.hrN);
+      }
+      ev.eventMeasHitN = evRec.mhN;
+
+      for(uint32_t i = 0; i < evRec.tjN; i++){
+        const TrajRec &tjRec = tjs[evRec.tjBegin + i];
+        ev.beginTrajectory(tjRec.TN);
+        for(uint32_t j = 0; j < tjRec.thN; j++){
+          const TrajHitRec &thRec = ths[tjRec.thBegin + j];
+          int32_t fitHit = -1;
+          if(thRec.hasFitHit){
+            TelEventFlat::FitHit fh;
+            fh.DN = thRec.fitDN;
+            std::memcpy(fh.PLs, thRec.PLs, sizeof(fh.PLs));
+            std::memcpy(fh.PLsE, thRec.PLsE, sizeof(fh.PLsE));
+            std::memcpy(fh.PGs, thRec.PGs, sizeof(fh.PGs));
+            std::memcpy(fh.DGs, thRec.DGs, sizeof(fh.DGs));
+            fh.OM = thRec.originMeasHit;
+            fitHit = ev.addFitHit(fh);
+          }
+          ev.addTrajHit(thRec.DN, fitHit, thRec.matchedMeasHit);
+        }
+      }
+      return true;
+    }
+
+  private:
+    bool loadIndex(){
+      using namespace TelEventBinary;
+      if(m_size < sizeof(FileHeader) + sizeof(Trailer)){
+        return false;
+      }
+      const Trailer *trailer = reinterpret_cast<const Trailer*>(m_data + m_size - sizeof(Trailer));
+      if(std::memcmp(trailer->magic, s_magic_index, 8) ||
+         trailer->indexOffset + trailer->chunkN*sizeof(IndexRec) + sizeof(Trailer) != m_size){
+        return false;
+      }
+      const IndexRec *index = reinterpret_cast<const IndexRec*>(m_data + trailer->indexOffset);
+      m_index.assign(index, index + trailer->chunkN);
+      m_eventN = trailer->eventN;
+      return true;
+    }
+
+    // for a file which was not closed, drops an incomplete last chunk
+    void rebuildIndex(){
+      using namespace TelEventBinary;
+      m_index.clear();
+      m_eventN = 0;
+      uint64_t offset = sizeof(FileHeader);
+      while(offset + sizeof(ChunkHeader) <= m_size){
+        const ChunkHeader *header = reinterpret_cast<const ChunkHeader*>(m_data + offset);
+        if(std::memcmp(header->magic, s_magic_chunk, 8)){
+          break;
+        }
+        uint64_t chunkSize = sizeof(ChunkHeader) + header->eventN*sizeof(EventRec) +
+          (uint64_t(header->mrN) + header->hrN)*sizeof(TelMeasRaw) + header->mhN*sizeof(MeasHitRec) +
+          header->tjN*sizeof(TrajRec) + header->thN*sizeof(TrajHitRec);
+        if(offset + chunkSize > m_size){
+          break;
+        }
+        m_index.push_back(IndexRec{offset, m_eventN, header->eventN});
+        m_eventN += header->eventN;
+        offset += chunkSize;
+      }
+    }
+
+    const char *m_data{nullptr};
+    size_t m_size{0};
+    uint32_t m_chunkEventN{1};
+    uint64_t m_eventN{0};
+    std::vector<TelEventBinary::IndexRec> m_index;
+    TelEventFlat m_flat;
+  };
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "TelEvent.hpp"
+
+namespace altel{
+
+  // Flat layout of TelEvent.
+  //
+  // Hits and trajectories are stored by value in one array per type and refer
+  // to each other by index, -1 for none. Raw hits of measure hits are ranges
+  // of hitRaws, trajectory hits of a trajectory are ranges of THs. clear()
+  // keeps the capacity of all arrays, so a TelEventFlat reused for every event
+  // is an arena which stops allocating once it has seen the largest event.
+  //
+  // fromTelEvent()/toTelEvent() convert to and from TelEvent, for code which
+  // is not yet migrated. Shared measure hits keep their identity both ways.
+  struct TelEventFlat{
+    struct MeasHit{
+      uint16_t DN{0};
+      double PLs[2]{0.0, 0.0};
+      uint32_t rawBegin{0}; // in hitRaws
+      uint32_t rawN{0};
+    };
+
+    struct FitHit{
+      uint16_t DN{0};
+      double PLs[2]{0.0, 0.0};
+      double PLsE[2]{-1,-1};
+      double PGs[3]{0.0, 0.0, 0.0};
+      double DGs[3]{0.0, 0.0, 0.0};
+      int32_t OM{-1}; // origin measure hit
+    };
+
+    struct TrajHit{
+      uint16_t DN{0};
+      int32_t FH{-1}; // fit hit
+      int32_t MM{-1}; // matched measure hit
+    };
+
+    struct Trajectory{
+      uint64_t TN{0};
+      uint32_t thBegin{0}; // in THs
+      uint32_t thN{0};
+    };
+
+    uint32_t RN{0}; // run id
+    uint32_t EN{0}; // event id
+    uint16_t DN{0}; // detector/setup id
+    uint64_t CK{0}; // timestamp / trigger id;
+    std::vector<TelMeasRaw> MRs;     // measures raw
+    std::vector<MeasHit> MHs;        // measure hits, the first eventMeasHitN are TelEvent::MHs,
+    uint32_t eventMeasHitN{0};       // the others are only referred by trajectories
+    std::vector<TelMeasRaw> hitRaws; // raws of measure hits
+    std::vector<FitHit> FHs;
+    std::vector<TrajHit> THs;
+    std::vector<Trajectory> TJs;
+
+    void clear(){
+      RN = 0;
+      EN = 0;
+      DN = 0;
+      CK = 0;
+      MRs.clear();
+      MHs.clear();
+      eventMeasHitN = 0;
+      hitRaws.clear();
+      FHs.clear();
+      THs.clear();
+      TJs.clear();
+    }
+
+    const TelMeasRaw* measHitRawsBegin(size_t i) const {return hitRaws.data() + MHs[i].rawBegin;}
+    const TelMeasRaw* measHitRawsEnd(size_t i) const {return hitRaws.data() + MHs[i].rawBegin + MHs[i].rawN;}
+
+    int32_t addMeasHit(uint16_t detN, double u, double v, const TelMeasRaw* raws, size_t rawN){
+      MeasHit mh;
+      mh.DN = detN;
+      mh.PLs[0] = u;
+      mh.PLs[1] = v;
+      mh.rawBegin = hitRaws.size();
+      mh.rawN = rawN;
+      hitRaws.insert(hitRaws.end(), raws, raws + rawN);
+      MHs.push_back(mh);
+      return int32_t(MHs.size() - 1);
+    }
+
+    int32_t addFitHit(const FitHit& fh){
+      FHs.push_back(fh);
+      return int32_t(FHs.size() - 1);
+    }
+
+    // trajectory hits added after this call belong to the new trajectory
+    int32_t beginTrajectory(uint64_t trajN){
+      Trajectory tj;
+      tj.TN = trajN;
+      tj.thBegin = THs.size();
+      TJs.push_back(tj);
+      return int32_t(TJs.size() - 1);
+    }
+
+    int32_t addTrajHit(uint16_t detN, int32_t fitHit, int32_t matchedMeasHit){
+      THs.push_back(TrajHit{detN, fitHit, matchedMeasHit});
+      TJs.back().thN++;
+      return int32_t(THs.size() - 1);
+    }
+
+    // replaces measure hits by clusters of MRs, same result as TelMeasHit::clustering_UVDCus
+    void clusterMeasRaws(double pitchU = 0.025,
+                         double pitchV = 0.025,
+                         double offsetU = -0.025 * (1024/2 - 0.5),
+                         double offsetV = -0.025 * (512/2 - 0.5)){
+      MHs.clear();
+      hitRaws.clear();
+      TelMeasHit::clustering_UVDCus_visit(MRs, [&](const std::vector<uint32_t>& cluster){
+        MeasHit mh;
+        mh.DN = MRs[cluster[0]].detN();
+        mh.rawBegin = hitRaws.size();
+        mh.rawN = cluster.size();
+        uint64_t sumRawU=0;
+        uint64_t sumRawV=0;
+        for(auto pos: cluster){
+          hitRaws.push_back(MRs[pos]);
+          sumRawU+= MRs[pos].u();
+          sumRawV+= MRs[pos].v();
+        }
+        mh.PLs[0] = double(sumRawU)/mh.rawN*pitchU + offsetU;
+        mh.PLs[1] = double(sumRawV)/mh.rawN*pitchV + offsetV;
+        MHs.push_back(mh);
+      });
+      eventMeasHitN = MHs.size();
+    }
+
+    void fromTelEvent(const TelEvent& ev){
+      clear();
+      RN = ev.RN;
+      EN = ev.EN;
+      DN = ev.DN;
+      CK = ev.CK;
+      MRs = ev.MRs;
+
+      // identity of measure hits, sorted by address for lookup
+      thread_local std::vector<std::pair<const TelMeasHit*, int32_t>> mapMeasHit;
+      mapMeasHit.clear();
+      for(auto &aMeasHit: ev.MHs){
+        int32_t n = addMeasHit(aMeasHit->DN, aMeasHit->PLs[0], aMeasHit->PLs[1],
+                               aMeasHit->MRs.data(), aMeasHit->MRs.size());
+        mapMeasHit.emplace_back(aMeasHit.get(), n);
+      }
+      eventMeasHitN = MHs.size();
+      std::sort(mapMeasHit.begin(), mapMeasHit.end());
+
+      auto indexOf = [&](const std::shared_ptr<TelMeasHit>& aMeasHit)->int32_t{
+        if(!aMeasHit){
+          return -1;
+        }
+        auto it = std::lower_bound(mapMeasHit.begin(), mapMeasHit.end(),
+                                   std::make_pair(static_cast<const TelMeasHit*>(aMeasHit.get()), int32_t(-1)));
+        if(it != mapMeasHit.end() && it->first == aMeasHit.get()){
+          return it->second;
+        }
+        int32_t n = addMeasHit(aMeasHit->DN, aMeasHit->PLs[0], aMeasHit->PLs[1],
+                               aMeasHit->MRs.data(), aMeasHit->MRs.size());
+        mapMeasHit.insert(it, std::make_pair(static_cast<const TelMeasHit*>(aMeasHit.get()), n));
+        return n;
+      };
+
+      for(auto &aTraj: ev.TJs){
+        beginTrajectory(aTraj->TN);
+        for(auto &aTrajHit: aTraj->THs){
+          int32_t fitHit = -1;
+          if(aTrajHit->FH){
+            const TelFitHit &fh = *aTrajHit->FH;
+            FitHit rec;
+            rec.DN = fh.DN;
+            std::copy(fh.PLs, fh.PLs+2, rec.PLs);
+            std::copy(fh.PLsE, fh.PLsE+2, rec.PLsE);
+            std::copy(fh.PGs, fh.PGs+3, rec.PGs);
+            std::copy(fh.DGs, fh.DGs+3, rec.DGs);
+            rec.OM = indexOf(fh.OM);
+            fitHit = addFitHit(rec);
+          }
+          addTrajHit(aTrajHit->DN, fitHit, indexOf(aTrajHit->MM));
+        }
+      }
+    }
+
+    std::shared_ptr<TelEvent> toTelEvent() const{
+      auto ev = std::make_shared<TelEvent>(RN, EN, DN, CK);
+      ev->MRs = MRs;
+
+      std::vector<std::shared_ptr<TelMeasHit>> measHits;
+      measHits.reserve(MHs.size());
+      for(size_t i = 0; i < MHs.size(); i++){
+        measHits.push_back(std::make_shared<TelMeasHit>
+                           (MHs[i].DN, MHs[i].PLs[0], MHs[i].PLs[1],
+                            std::vector<TelMeasRaw>(measHitRawsBegin(i), measHitRawsEnd(i))));
+      }
+      ev->MHs.assign(measHits.begin(), measHits.begin() + eventMeasHitN);
+
+      auto measHitAt = [&](int32_t i)->std::shared_ptr<TelMeasHit>{
+        return (i >= 0 && size_t(i) < measHits.size())? measHits[i] : nullptr;
+      };
+
+      ev->TJs.reserve(TJs.size());
+      for(auto &tj: TJs){
+        auto aTraj = std::make_shared<TelTrajectory>();
+        aTraj->TN = tj.TN;
+        aTraj->THs.reserve(tj.thN);
+        for(uint32_t j = tj.thBegin; j < tj.thBegin + tj.thN; j++){
+          const TrajHit &th = THs[j];
+          std::shared_ptr<TelFitHit> aFitHit;
+          if(th.FH >= 0){
+            const FitHit &fh = FHs[th.FH];
+            aFitHit = std::make_shared<TelFitHit>(fh.DN, fh.PLs[0], fh.PLs[1],
+                                                  fh.PLsE[0], fh.PLsE[1],
+                                                  fh.PGs[0], fh.PGs[1], fh.PGs[2],
+                                                  fh.DGs[0], fh.DGs[1], fh.DGs[2],
+                                                  measHitAt(fh.OM));
+          }
+          aTraj->THs.push_back(std::make_shared<TelTrajHit>(th.DN, aFitHit, measHitAt(th.MM)));
+        }
+        ev->TJs.push_back(aTraj);
+      }
+      return ev;
+    }
+  };
+}
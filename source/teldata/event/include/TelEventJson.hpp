@@ -0,0 +1,492 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <utility>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "myrapidjson.h"
+#include "TelEvent.hpp"
+#include "TelEventFlat.hpp"
+
+// Reader of json hit files, as written by the DAQ json converter:
+//
+//   [ {"layers":[{"ext":1, "tri":123, "hit":[{"pos":[x,y], "pix":[[u,v],...]}, ...]}, ...]},
+//     ... ]
+//
+// A top-level array, concatenated or newline-delimited events are all accepted.
+// On open the file is mapped and the byte range of every event is found by one
+// structural pass (braces outside of strings), so events are accessible by
+// number. An event is parsed by a SAX handler straight into a TelEventFlat,
+// no DOM is built. Unknown members are skipped.
+namespace altel{
+
+  class TelEventJsonHandler
+    :public rapidjson::BaseReaderHandler<rapidjson::UTF8<char>, TelEventJsonHandler>{
+  public:
+    // measure hit position is pos + offset
+    void reset(TelEventFlat* ev, double offsetU, double offsetV){
+      m_ev = ev;
+      m_offsetU = offsetU;
+      m_offsetV = offsetV;
+      m_depth = 0;
+      m_ctx[0] = Ctx::Top;
+      m_skip = 0;
+    }
+
+    bool StartObject(){
+      if(m_skip){
+        m_skip++;
+        return true;
+      }
+      switch(m_ctx[m_depth]){
+      case Ctx::Top:
+        push(Ctx::Event);
+        break;
+      case Ctx::Layers:
+        m_layerExt = 0;
+        m_layerTri = 0;
+        m_layerHitBegin = m_ev->MHs.size();
+        m_layerRawBegin = m_ev->hitRaws.size();
+        push(Ctx::Layer);
+        break;
+      case Ctx::Hits:
+        m_pos[0] = m_pos[1] = 0;
+        m_posN = 0;
+        m_hitRawBegin = m_ev->hitRaws.size();
+        push(Ctx::Hit);
+        break;
+      default:
+        skipValue();
+        break;
+      }
+      return true;
+    }
+
+    bool EndObject(rapidjson::SizeType){
+      if(m_skip){
+        m_skip--;
+        return true;
+      }
+      switch(m_ctx[m_depth]){
+      case Ctx::Layer:
+        commitLayer();
+        break;
+      case Ctx::Hit:{
+        TelEventFlat::MeasHit mh;
+        mh.PLs[0] = m_pos[0] + m_offsetU;
+        mh.PLs[1] = m_pos[1] + m_offsetV;
+        mh.rawBegin = m_hitRawBegin;
+        mh.rawN = m_ev->hitRaws.size() - m_hitRawBegin;
+        m_ev->MHs.push_back(mh);
+        break;
+      }
+      default:
+        break;
+      }
+      m_depth--;
+      return true;
+    }
+
+    bool StartArray(){
+      if(m_skip){
+        m_skip++;
+        return true;
+      }
+      switch(m_ctx[m_depth]){
+      case Ctx::ValLayers:
+        m_ctx[m_depth] = Ctx::Layers;
+        break;
+      case Ctx::ValHits:
+        m_ctx[m_depth] = Ctx::Hits;
+        break;
+      case Ctx::ValPos:
+        m_ctx[m_depth] = Ctx::Pos;
+        break;
+      case Ctx::ValPix:
+        m_ctx[m_depth] = Ctx::Pix;
+        break;
+      case Ctx::Pix:
+        m_pixN = 0;
+        push(Ctx::PixPair);
+        break;
+      default:
+        skipValue();
+        break;
+      }
+      return true;
+    }
+
+    bool EndArray(rapidjson::SizeType){
+      if(m_skip){
+        m_skip--;
+        return true;
+      }
+      if(m_ctx[m_depth] == Ctx::PixPair && m_pixN >= 2){
+        // detector and trigger are set at the end of the layer
+        m_ev->hitRaws.emplace_back(m_pix[0], m_pix[1], 0, 0);
+      }
+      m_depth--;
+      return true;
+    }
+
+    bool Key(const char* str, rapidjson::SizeType len, bool){
+      if(m_skip){
+        return true;
+      }
+      Ctx next = Ctx::ValSkip;
+      switch(m_ctx[m_depth]){
+      case Ctx::Event:
+        if(isKey(str, len, "layers")) next = Ctx::ValLayers;
+        break;
+      case Ctx::Layer:
+        if(isKey(str, len, "ext")) next = Ctx::ValExt;
+        else if(isKey(str, len, "tri")) next = Ctx::ValTri;
+        else if(isKey(str, len, "hit")) next = Ctx::ValHits;
+        break;
+      case Ctx::Hit:
+        if(isKey(str, len, "pos")) next = Ctx::ValPos;
+        else if(isKey(str, len, "pix")) next = Ctx::ValPix;
+        break;
+      default:
+        break;
+      }
+      push(next);
+      return true;
+    }
+
+    bool Int(int i){return Number(i);}
+    bool Uint(unsigned u){return Number(u);}
+    bool Int64(int64_t i){return Number(double(i));}
+    bool Uint64(uint64_t u){return Number(double(u));}
+    bool Double(double d){return Number(d);}
+
+    // strings, bools and nulls
+    bool Default(){
+      if(!m_skip && isValue(m_ctx[m_depth])){
+        m_depth--;
+      }
+      return true;
+    }
+
+  private:
+    enum class Ctx: uint8_t{
+      Top, Event, Layers, Layer, Hits, Hit, Pos, Pix, PixPair,
+      // a member value is expected
+      ValLayers, ValExt, ValTri, ValHits, ValPos, ValPix, ValSkip
+    };
+
+    static bool isKey(const char* str, rapidjson::SizeType len, const char* key){
+      return std::strlen(key) == len && std::memcmp(str, key, len) == 0;
+    }
+
+    static bool isValue(Ctx c){
+      return c >= Ctx::ValLayers;
+    }
+
+    // contexts nest at most 9 deep, anything deeper is skipped
+    void push(Ctx c){
+      m_ctx[++m_depth] = c;
+    }
+
+    // the container about to start is skipped with everything in it
+    void skipValue(){
+      if(isValue(m_ctx[m_depth])){
+        m_depth--;
+      }
+      m_skip = 1;
+    }
+
+    bool Number(double d){
+      if(m_skip){
+        return true;
+      }
+      switch(m_ctx[m_depth]){
+      case Ctx::ValExt:
+        m_layerExt = uint16_t(d);
+        m_depth--;
+        break;
+      case Ctx::ValTri:
+        m_layerTri = uint16_t(d);
+        m_depth--;
+        break;
+      case Ctx::Pos:
+        if(m_posN < 2){
+          m_pos[m_posN++] = d;
+        }
+        break;
+      case Ctx::PixPair:
+        if(m_pixN < 2){
+          m_pix[m_pixN++] = uint16_t(int(d));
+        }
+        break;
+      default:
+        if(isValue(m_ctx[m_depth])){
+          m_depth--;
+        }
+        break;
+      }
+      return true;
+    }
+
+    // ext and tri may come after the hits
+    void commitLayer(){
+      m_ev->CK = m_layerTri;
+      for(size_t n = m_layerHitBegin; n < m_ev->MHs.size(); n++){
+        m_ev->MHs[n].DN = m_layerExt;
+      }
+      for(size_t n = m_layerRawBegin; n < m_ev->hitRaws.size(); n++){
+        TelMeasRaw &raw = m_ev->hitRaws[n];
+        raw = TelMeasRaw(raw.u(), raw.v(), m_layerExt, m_layerTri);
+      }
+      m_ev->eventMeasHitN = m_ev->MHs.size();
+    }
+
+    TelEventFlat *m_ev{nullptr};
+    double m_offsetU{0};
+    double m_offsetV{0};
+    Ctx m_ctx[16];
+    size_t m_depth{0};
+    size_t m_skip{0};
+
+    uint16_t m_layerExt{0};
+    uint16_t m_layerTri{0};
+    size_t m_layerHitBegin{0}; // in MHs
+    size_t m_layerRawBegin{0}; // in hitRaws
+    size_t m_hitRawBegin{0};
+    double m_pos[2]{0, 0};
+    size_t m_posN{0};
+    uint16_t m_pix[2]{0, 0};
+    size_t m_pixN{0};
+  };
+
+  class TelEventJsonReader{
+  public:
+    static const size_t s_batch_event_n = 256;
+
+    // threadN threads parse ahead for createNextTelEvent()
+    TelEventJsonReader(const std::string& path, size_t threadN = 1,
+                       double offsetU = -0.025 * 1024 / 2.0,
+                       double offsetV = -0.025 * 512 / 2.0)
+      :m_threadN(threadN? threadN : 1), m_offsetU(offsetU), m_offsetV(offsetV){
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if(fd < 0){
+        std::fprintf(stderr, "TelEventJsonReader: unable to open file %s\n", path.c_str());
+        throw;
+      }
+      struct stat st;
+      if(::fstat(fd, &st) != 0){
+        ::close(fd);
+        std::fprintf(stderr, "TelEventJsonReader: unable to stat file %s\n", path.c_str());
+        throw;
+      }
+      m_size = st.st_size;
+      if(m_size){
+        void *p = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED){
+          ::close(fd);
+          std::fprintf(stderr, "TelEventJsonReader: unable to map file %s\n", path.c_str());
+          throw;
+        }
+        ::madvise(p, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(p);
+      }
+      ::close(fd);
+      m_path = path;
+      scanEvents();
+    }
+
+    ~TelEventJsonReader(){
+      // parsing threads still read the mapping
+      m_futs.clear();
+      if(m_data){
+        ::munmap(const_cast<char*>(m_data), m_size);
+      }
+    }
+
+    TelEventJsonReader(const TelEventJsonReader&) = delete;
+    TelEventJsonReader& operator=(const TelEventJsonReader&) = delete;
+
+    size_t numEvents() const{
+      return m_events.size();
+    }
+
+    // random access into a reused flat event, false when n is out of range. Thread safe.
+    bool readTelEvent(size_t n, TelEventFlat& ev) const{
+      if(n >= m_events.size()){
+        return false;
+      }
+      thread_local TelEventJsonHandler handler;
+      thread_local JsonReader reader;
+      ev.clear();
+      ev.EN = n;
+      handler.reset(&ev, m_offsetU, m_offsetV);
+      // the range ends with the closing brace, the parser stops there or at an error before
+      rapidjson::StringStream ms(m_data + m_events[n].first);
+      reader.Parse<rapidjson::kParseStopWhenDoneFlag>(ms, handler);
+      if(reader.HasParseError()){
+        std::fprintf(stderr, "TelEventJsonReader: rapidjson error<%s> in event %zu at offset %zu of %s\n",
+                     rapidjson::GetParseError_En(reader.GetParseErrorCode()), n,
+                     size_t(m_events[n].first + reader.GetErrorOffset()), m_path.c_str());
+        throw;
+      }
+      return true;
+    }
+
+    // random access, nullptr when n is out of range. Thread safe.
+    std::shared_ptr<TelEvent> createTelEvent(size_t n) const{
+      thread_local TelEventFlat flat;
+      if(!readTelEvent(n, flat)){
+        return nullptr;
+      }
+      return flat.toTelEvent();
+    }
+
+    // position of createNextTelEvent(), e.g. to skip events
+    void setNextEvent(size_t n){
+      m_futs.clear();
+      m_batch.clear();
+      m_batchPos = 0;
+      m_next = std::min(n, m_events.size());
+    }
+
+    // next event in file order, nullptr at end of file
+    std::shared_ptr<TelEvent> createNextTelEvent(){
+      if(m_threadN == 1){
+        return m_next < m_events.size()? createTelEvent(m_next++) : nullptr;
+      }
+      while(m_batchPos >= m_batch.size()){
+        while(m_futs.size() < 2*m_threadN && m_next < m_events.size()){
+          size_t begin = m_next;
+          size_t end = std::min(begin + s_batch_event_n, m_events.size());
+          m_futs.push_back(std::async(std::launch::async, [this, begin, end](){
+            std::vector<std::shared_ptr<TelEvent>> evs;
+            evs.reserve(end - begin);
+            for(size_t n = begin; n < end; n++){
+              evs.push_back(createTelEvent(n));
+            }
+            return evs;
+          }));
+          m_next = end;
+        }
+        if(m_futs.empty()){
+          return nullptr;
+        }
+        m_batch = m_futs.front().get();
+        m_futs.pop_front();
+        m_batchPos = 0;
+      }
+      return std::move(m_batch[m_batchPos++]);
+    }
+
+  private:
+    // byte range of each top-level object. Only quotes, backslashes and
+    // brackets matter, with SSE2 they are found 16 bytes at a time.
+    void scanEvents(){
+      const char *p = m_data;
+      size_t depth = 0;
+      size_t begin = 0;
+      bool inString = false;
+      size_t escaped = SIZE_MAX; // position of an escaped character
+      auto step = [&](size_t i){
+        char c = p[i];
+        if(i == escaped){
+          return;
+        }
+        if(inString){
+          if(c == '"'){
+            inString = false;
+          }
+          else if(c == '\\'){
+            escaped = i+1;
+          }
+          return;
+        }
+        switch(c){
+        case '"':
+          inString = depth > 0;
+          break;
+        case '{':
+          if(depth == 0){
+            begin = i;
+          }
+          depth++;
+          break;
+        case '[':
+          // brackets of a top-level array are not counted
+          if(depth){
+            depth++;
+          }
+          break;
+        case '}':
+        case ']':
+          if(depth){
+            depth--;
+            if(depth == 0){
+              m_events.emplace_back(begin, i+1);
+            }
+          }
+          break;
+        default:
+          break;
+        }
+      };
+
+      size_t i = 0;
+#ifdef __SSE2__
+      const __m128i q = _mm_set1_epi8('"');
+      const __m128i bs = _mm_set1_epi8('\\');
+      const __m128i ob = _mm_set1_epi8('{');
+      const __m128i cb = _mm_set1_epi8('}');
+      const __m128i os = _mm_set1_epi8('[');
+      const __m128i cs = _mm_set1_epi8(']');
+      for(; i + 16 <= m_size; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)),
+                                   _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, ob), _mm_cmpeq_epi8(v, cb)),
+                                                _mm_or_si128(_mm_cmpeq_epi8(v, os), _mm_cmpeq_epi8(v, cs))));
+        unsigned mask = _mm_movemask_epi8(hit);
+        while(mask){
+          step(i + __builtin_ctz(mask));
+          mask &= mask - 1;
+        }
+      }
+#endif
+      for(; i < m_size; i++){
+        step(i);
+      }
+      if(depth){
+        std::fprintf(stderr, "TelEventJsonReader: incomplete last event in %s, ignored\n", m_path.c_str());
+      }
+    }
+
+    std::string m_path;
+    const char *m_data{nullptr};
+    size_t m_size{0};
+    std::vector<std::pair<uint64_t, uint64_t>> m_events; // [begin, end) in file
+
+    size_t m_threadN;
+    double m_offsetU;
+    double m_offsetV;
+
+    size_t m_next{0};
+    std::deque<std::future<std::vector<std::shared_ptr<TelEvent>>>> m_futs;
+    std::vector<std::shared_ptr<TelEvent>> m_batch;
+    size_t m_batchPos{0};
+  };
+}
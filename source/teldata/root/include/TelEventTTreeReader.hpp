@@ -2,7 +2,7 @@
 
 #include "TelEvent.hpp"
 
-
+#include <functional>
 
 class TFile;
 class TTree;
@@ -10,11 +10,33 @@ class TTree;
 namespace altel{
   class TelEventTTreeReader{
   public:
+    // branch groups to read, the others are disabled in the TTree and stay empty in events
+    struct Config{
+      bool measRaws{true};    // raw pixels of measure hits, needs measHits
+      bool measHits{true};    // without, fitted hits have no origin or matched measure hit
+      bool trajs{true};       // trajectories and their fitted hits
+      int64_t cacheSize{-1};  // TTreeCache bytes, -1 for ROOT default
+    };
+
+    TelEventTTreeReader() = default;
+    TelEventTTreeReader(const Config& conf) : m_conf(conf) {}
+
     void setTTree(TTree* pTree);
     std::shared_ptr<altel::TelEvent> createTelEvent(size_t n);
     size_t numEvents() const;
 
+    // entries [begin, end) to be read next, TTreeCache fetches their baskets of the read branches in bulk
+    void setEntryRange(size_t begin, size_t end);
+
+    // events [begin, end) of the eventTree of a file, by threadN workers which take one TTree cluster at a time,
+    // each with its own TFile. callback(event, entry) is called concurrently, in entry order within a cluster.
+    // returns the number of events
+    static size_t forEachTelEvent(const std::string& filePath, const Config& conf, size_t threadN,
+                                  size_t begin, size_t end,
+                                  const std::function<void(std::shared_ptr<altel::TelEvent>, size_t)>& callback);
+
   private:
+    Config m_conf;
     TTree* m_pTTree{0};
     size_t m_numEvents{0};
   private:
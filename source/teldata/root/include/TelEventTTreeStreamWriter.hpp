@@ -0,0 +1,53 @@
+#pragma once
+
+#include "TelEvent.hpp"
+#include "TelEventTTreeWriter.hpp"
+
+#include <thread>
+
+class TFile;
+template<typename T> class BoundedQueue;
+
+namespace altel{
+  // TelEventTTreeWriter into a file opened up front, filled by its own I/O thread.
+  //
+  // Baskets go to the file as they are flushed, so memory does not grow with the run,
+  // and the tree header is saved every autoSave, so a crashed run leaves a file that
+  // TFile recovers up to there. fillTelEvent only queues the event, it blocks while
+  // queueSize events wait for the I/O thread. The events must not change after it.
+  class TelEventTTreeStreamWriter{
+  public:
+    struct Config{
+      int64_t autoFlush{-30000000};   // TTree::SetAutoFlush, entries if > 0, bytes if < 0
+      int64_t autoSave{-300000000};   // TTree::SetAutoSave, entries if > 0, bytes if < 0
+      int32_t basketSize{32000};      // bytes per branch
+      int32_t compression{-1};        // algorithm*100 + level as TFile, -1 for ROOT default
+      size_t queueSize{1000};
+      TelEventTTreeWriter::Config branches;
+
+      // default config, overridden by ALTEL_TTREE_AUTOFLUSH, ALTEL_TTREE_AUTOSAVE,
+      // ALTEL_TTREE_BASKETSIZE, ALTEL_TTREE_COMPRESSION, ALTEL_TTREE_QUEUE and
+      // ALTEL_TTREE_DROP, a comma separated list of the branch groups raws, dirs and resids
+      static Config FromEnv();
+    };
+
+    TelEventTTreeStreamWriter(const std::string& filePath, const Config& conf = Config::FromEnv());
+    ~TelEventTTreeStreamWriter();
+
+    void fillTelEvent(std::shared_ptr<altel::TelEvent> ev);
+
+    // writes the remaining events and the tree, closes the file, returns the number of events
+    size_t close();
+
+  private:
+    void writeLoop();
+
+    std::string m_file_path;
+    Config m_conf;
+    TFile* m_file{nullptr};
+    std::unique_ptr<BoundedQueue<std::shared_ptr<altel::TelEvent>>> m_queue;
+    std::thread m_thread;
+    size_t m_event_n{0};
+    bool m_is_closed{false};
+  };
+}
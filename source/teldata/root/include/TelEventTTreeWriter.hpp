@@ -11,12 +11,48 @@ class TTree;
 namespace altel{
   class TelEventTTreeWriter{
   public:
+    // branch groups which can be left out of the tree
+    struct Config{
+      bool measRaws{true};      // MeasRawVec_*, MeasHitVec_NumMeasRaws_PerMeasHit, MeasHitVec_MeasRaw_Index
+      bool fitDirections{true}; // TrajHitVec_DirX/Y/Z
+      bool anaResiduals{true};  // AnaVec_*
+    };
+
+    TelEventTTreeWriter() = default;
+    TelEventTTreeWriter(const Config& conf) : m_conf(conf) {}
+
     void setTTree(TTree* pTTree);
     void fillTelEvent(std::shared_ptr<altel::TelEvent> ev);
 
+    // branch vectors of an event, without TTree::Fill
+    void fillBranches(const altel::TelEvent& telEvent);
+
   private:
+    // object key to branch vector index, open addressing, emptied per event by a new stamp
+    struct IndexTable{
+      std::vector<uint64_t> keys;
+      std::vector<int16_t> values;
+      std::vector<uint32_t> stamps;
+      uint32_t stamp{0};
+      size_t size{0};
+
+      void clear();
+      // index of key, value is inserted if missing, second is true then
+      std::pair<int16_t, bool> emplace(uint64_t key, int16_t value);
+    };
+
+    int16_t fillMeasHit(const altel::TelMeasHit& hit);
+
+    Config m_conf;
+    IndexTable m_index_raw;
+    IndexTable m_index_hit;
+    IndexTable m_index_fit;
+
     TTree *m_pTTree{0};
-  private:
+
+  protected:
+    // branch variables, also filled by the std::map reference of altelTTreeFillBench
+    void clearBranches();
 
     uint32_t rRunN;
     uint32_t rEventN;
@@ -1,8 +1,14 @@
 #include "TelEventTTreeReader.hpp"
 #include <TFile.h>
+#include <TROOT.h>
 #include <TTree.h>
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "mymetrics.hh"
 
 void altel::TelEventTTreeReader::setTTree(TTree *pTTree){
   if(!pTTree){
@@ -14,50 +20,146 @@ void altel::TelEventTTreeReader::setTTree(TTree *pTTree){
   m_numEvents = tree.GetEntries();
   tree.ResetBranchAddresses();
 
-  tree.SetBranchAddress("RunN", &rRunN);
-  tree.SetBranchAddress("EveN", &rEventN);
-  tree.SetBranchAddress("DetN", &rConfigN);
-  tree.SetBranchAddress("ClkN", (ULong64_t*)&rClock);
-  tree.SetBranchAddress("NumTrajs_PerEvent", &rNumTraj_PerEvent);
-  tree.SetBranchAddress("NumMeasHits_PerEvent", &rNumMeasHits_PerEvent);
-
-  tree.SetBranchAddress("MeasRawVec_DetN", &pRawMeasVec_DetN);
-  tree.SetBranchAddress("MeasRawVec_U", &pRawMeasVec_U);
-  tree.SetBranchAddress("MeasRawVec_V", &pRawMeasVec_V);
-  tree.SetBranchAddress("MeasRawVec_Clk", &pRawMeasVec_Clk);
-
-  tree.SetBranchAddress("MeasHitVec_DetN", &pHitMeasVec_DetN);
-  tree.SetBranchAddress("MeasHitVec_U", &pHitMeasVec_U);
-  tree.SetBranchAddress("MeasHitVec_V", &pHitMeasVec_V);
-  tree.SetBranchAddress("MeasHitVec_NumMeasRaws_PerMeasHit", &pHitMeasVec_NumRawMeas_PerHitMeas);
-  tree.SetBranchAddress("MeasHitVec_MeasRaw_Index", &pHitMeasVec_Index_To_RawMeas);
-
-  tree.SetBranchAddress("TrajHitVec_DetN", &pHitFitVec_DetN);
-  tree.SetBranchAddress("TrajHitVec_U", &pHitFitVec_U);
-  tree.SetBranchAddress("TrajHitVec_V", &pHitFitVec_V);
-  
-  tree.SetBranchAddress("TrajHitVec_U_err", &pHitFitVec_U_err);
-  tree.SetBranchAddress("TrajHitVec_V_err", &pHitFitVec_V_err);
-
-  tree.SetBranchAddress("TrajHitVec_X", &pHitFitVec_X);
-  tree.SetBranchAddress("TrajHitVec_Y", &pHitFitVec_Y);
-  tree.SetBranchAddress("TrajHitVec_Z", &pHitFitVec_Z);
-  tree.SetBranchAddress("TrajHitVec_DirX", &pHitFitVec_DirX);
-  tree.SetBranchAddress("TrajHitVec_DirY", &pHitFitVec_DirY);
-  tree.SetBranchAddress("TrajHitVec_DirZ", &pHitFitVec_DirZ);
-  tree.SetBranchAddress("TrajHitVec_OriginMeasHit_Index", &pHitFitVec_Index_To_Origin_HitMeas);
-  tree.SetBranchAddress("TrajHitVec_MatchedMeasHit_Index", &pHitFitVec_Index_To_Matched_HitMeas);
-
-  tree.SetBranchAddress("TrajVec_NumTrajHits_PerTraj", &pTrajVec_NumHitFit_PerTraj);
-  tree.SetBranchAddress("TrajVec_NumOriginMeasHits_PerTraj", &pTrajVec_NumHitMeas_Origin_PerTraj);
-  tree.SetBranchAddress("TrajVec_NumMatchedMeasHits_PerTraj", &pTrajVec_NumHitMeas_Matched_PerTraj);
-
-  tree.SetBranchAddress("TrajVec_TrajHit_Index", &pTrajVec_Index_To_HitFit);
-
-  // ana
-  tree.SetBranchAddress("AnaVec_Matched_DetN", &pAnaVec_Matched_DetN);
-  tree.SetBranchAddress("AnaVec_Matched_ResidU", &pAnaVec_Matched_ResdU);
-  tree.SetBranchAddress("AnaVec_Matched_ResidV", &pAnaVec_Matched_ResdV);
+  // branches not read, or left out by TelEventTTreeWriter::Config, stay empty
+  for(auto pVec: {&rRawMeasVec_DetN, &rRawMeasVec_U, &rRawMeasVec_V, &rRawMeasVec_Clk,
+                  &rHitMeasVec_DetN, &rHitMeasVec_NumRawMeas_PerHitMeas, &rHitMeasVec_Index_To_RawMeas,
+                  &rHitFitVec_DetN, &rHitFitVec_Index_To_Origin_HitMeas, &rHitFitVec_Index_To_Matched_HitMeas,
+                  &rTrajVec_NumHitFit_PerTraj, &rTrajVec_Index_To_HitFit}){
+    pVec->clear();
+  }
+  for(auto pVec: {&rHitMeasVec_U, &rHitMeasVec_V, &rHitFitVec_U, &rHitFitVec_V, &rHitFitVec_U_err, &rHitFitVec_V_err,
+                  &rHitFitVec_X, &rHitFitVec_Y, &rHitFitVec_Z, &rHitFitVec_DirX, &rHitFitVec_DirY, &rHitFitVec_DirZ}){
+    pVec->clear();
+  }
+
+  // only branches with an address are read by GetEntry and cached
+  std::vector<std::string> readBranches;
+  auto setBranch = [&tree, &readBranches](const char* name, auto address){
+                     if(!tree.GetBranch(name)){
+                       return;
+                     }
+                     tree.SetBranchStatus(name, 1);
+                     tree.SetBranchAddress(name, address);
+                     readBranches.push_back(name);
+                   };
+  tree.SetBranchStatus("*", 0);
+
+  setBranch("RunN", &rRunN);
+  setBranch("EveN", &rEventN);
+  setBranch("DetN", &rConfigN);
+  setBranch("ClkN", (ULong64_t*)&rClock);
+
+  if(m_conf.measHits && m_conf.measRaws){
+    setBranch("MeasRawVec_DetN", &pRawMeasVec_DetN);
+    setBranch("MeasRawVec_U", &pRawMeasVec_U);
+    setBranch("MeasRawVec_V", &pRawMeasVec_V);
+    setBranch("MeasRawVec_Clk", &pRawMeasVec_Clk);
+    setBranch("MeasHitVec_NumMeasRaws_PerMeasHit", &pHitMeasVec_NumRawMeas_PerHitMeas);
+    setBranch("MeasHitVec_MeasRaw_Index", &pHitMeasVec_Index_To_RawMeas);
+  }
+
+  if(m_conf.measHits){
+    setBranch("MeasHitVec_DetN", &pHitMeasVec_DetN);
+    setBranch("MeasHitVec_U", &pHitMeasVec_U);
+    setBranch("MeasHitVec_V", &pHitMeasVec_V);
+  }
+
+  if(m_conf.trajs){
+    setBranch("TrajHitVec_DetN", &pHitFitVec_DetN);
+    setBranch("TrajHitVec_U", &pHitFitVec_U);
+    setBranch("TrajHitVec_V", &pHitFitVec_V);
+
+    setBranch("TrajHitVec_U_err", &pHitFitVec_U_err);
+    setBranch("TrajHitVec_V_err", &pHitFitVec_V_err);
+
+    setBranch("TrajHitVec_X", &pHitFitVec_X);
+    setBranch("TrajHitVec_Y", &pHitFitVec_Y);
+    setBranch("TrajHitVec_Z", &pHitFitVec_Z);
+    setBranch("TrajHitVec_DirX", &pHitFitVec_DirX);
+    setBranch("TrajHitVec_DirY", &pHitFitVec_DirY);
+    setBranch("TrajHitVec_DirZ", &pHitFitVec_DirZ);
+    setBranch("TrajHitVec_OriginMeasHit_Index", &pHitFitVec_Index_To_Origin_HitMeas);
+    setBranch("TrajHitVec_MatchedMeasHit_Index", &pHitFitVec_Index_To_Matched_HitMeas);
+
+    setBranch("TrajVec_NumTrajHits_PerTraj", &pTrajVec_NumHitFit_PerTraj);
+    setBranch("TrajVec_TrajHit_Index", &pTrajVec_Index_To_HitFit);
+  }
+  // counters per event and trajectory, and ana residuals, are not needed to rebuild events
+
+  tree.SetCacheSize(m_conf.cacheSize);
+  for(auto& name: readBranches){
+    tree.AddBranchToCache(name.c_str(), false);
+  }
+  tree.StopCacheLearningPhase();
+}
+
+void altel::TelEventTTreeReader::setEntryRange(size_t begin, size_t end){
+  if(!m_pTTree){
+    std::fprintf(stderr, "TTree is not yet set\n");
+    throw;
+  }
+  m_pTTree->SetCacheEntryRange(begin, std::min(end, m_numEvents));
+}
+
+size_t altel::TelEventTTreeReader::forEachTelEvent(const std::string& filePath, const Config& conf, size_t threadN,
+                                                   size_t begin, size_t end,
+                                                   const std::function<void(std::shared_ptr<altel::TelEvent>, size_t)>& callback){
+  // each worker reads with its own TFile
+  ROOT::EnableThreadSafety();
+  auto openTree = [&filePath](std::unique_ptr<TFile>& file){
+                    file.reset(TFile::Open(filePath.c_str(), "READ"));
+                    if(!file || file->IsZombie()){
+                      std::fprintf(stderr, "ROOT TFile opening failed: %s\n", filePath.c_str());
+                      throw;
+                    }
+                    TTree *pTree = nullptr;
+                    file->GetObject("eventTree", pTree);
+                    if(!pTree){
+                      std::fprintf(stderr, "eventTree is not found in %s\n", filePath.c_str());
+                      throw;
+                    }
+                    return pTree;
+                  };
+
+  // entry ranges of TTree clusters, a basket belongs to one cluster only
+  std::vector<std::pair<size_t, size_t>> clusters;
+  {
+    std::unique_ptr<TFile> file;
+    TTree *pTree = openTree(file);
+    end = std::min(end, size_t(pTree->GetEntries()));
+    auto itCluster = pTree->GetClusterIterator(begin);
+    Long64_t clusterBegin = 0;
+    while(begin < end && (clusterBegin = itCluster()) < Long64_t(end)){
+      clusters.emplace_back(std::max(size_t(clusterBegin), begin), std::min(size_t(itCluster.GetNextEntry()), end));
+    }
+  }
+
+  std::atomic<size_t> nextCluster{0};
+  std::atomic<size_t> eventN{0};
+  auto work = [&](){
+                std::unique_ptr<TFile> file;
+                TelEventTTreeReader reader(conf);
+                reader.setTTree(openTree(file));
+                size_t c;
+                while((c = nextCluster++) < clusters.size()){
+                  auto [clusterBegin, clusterEnd] = clusters[c];
+                  reader.setEntryRange(clusterBegin, clusterEnd);
+                  for(size_t n = clusterBegin; n < clusterEnd; n++){
+                    callback(reader.createTelEvent(n), n);
+                  }
+                  eventN += clusterEnd - clusterBegin;
+                }
+              };
+  threadN = std::max<size_t>(1, std::min(threadN, clusters.size()));
+  std::vector<std::thread> workers;
+  for(size_t i = 1; i < threadN; i++){
+    workers.emplace_back(work);
+  }
+  work();
+  for(auto& w: workers){
+    w.join();
+  }
+  return eventN;
 }
 
 size_t altel::TelEventTTreeReader::numEvents() const{
@@ -70,6 +172,9 @@ std::shared_ptr<altel::TelEvent> altel::TelEventTTreeReader::createTelEvent(size
     return nullptr;
   }
 
+  static auto& s_mt_read_ns = mymetrics::Registry::instance().histogram("ttree_read_ns", "TelEventTTreeReader::createTelEvent, TTree::GetEntry and event building");
+  mymetrics::ScopedTimer timer(s_mt_read_ns);
+
   m_pTTree->GetEntry(n);
   // std::printf("GetEntry %d\n", n);
   // std::printf("rRunN %d, rEventN %d, rConfigN %d, rClock %d\n", rRunN, rEventN, rConfigN, rClock);
@@ -125,10 +230,13 @@ std::shared_ptr<altel::TelEvent> altel::TelEventTTreeReader::createTelEvent(size
     it_numRawMeas_PerHitMeas++;
   }
 
+  // without raw measure branches, hits have no cluster
+  size_t numMeasHit = rHitMeasVec_DetN.size();
+  clusterCol.resize(numMeasHit);
+
   // std::cout<< "create cluster number "<<  clusterCol.size()<<std::endl;
   auto it_clusterCol = clusterCol.begin();
 
-  size_t numMeasHit = rHitMeasVec_DetN.size();
   assert(rHitMeasVec_U.size() == numMeasHit && rHitMeasVec_V.size() == numMeasHit);
   auto it_measHitVec_detN = rHitMeasVec_DetN.begin();
   auto it_measHitVec_U = rHitMeasVec_U.begin();
@@ -138,10 +246,12 @@ std::shared_ptr<altel::TelEvent> altel::TelEventTTreeReader::createTelEvent(size
   std::vector<std::shared_ptr<altel::TelMeasHit>> measHits;
   measHits.reserve(rHitMeasVec_DetN.size());
   while(it_measHitVec_detN !=it_measHitVec_detN_end){
-    measHits.emplace_back(new altel::TelMeasHit(*it_measHitVec_detN,
-                                                *it_measHitVec_U,
-                                                *it_measHitVec_V,
-                                                *it_clusterCol));
+    auto measHit = std::make_shared<altel::TelMeasHit>();
+    measHit->DN = *it_measHitVec_detN;
+    measHit->PLs[0] = *it_measHitVec_U;
+    measHit->PLs[1] = *it_measHitVec_V;
+    measHit->MRs = std::move(*it_clusterCol);
+    measHits.push_back(std::move(measHit));
     // HitMeasVec_NumRawMeas_PerHitMeas;
     it_measHitVec_detN++;
     it_measHitVec_U++;
@@ -166,6 +276,12 @@ std::shared_ptr<altel::TelEvent> altel::TelEventTTreeReader::createTelEvent(size
   auto it_fitHitVec_X = rHitFitVec_X.begin();
   auto it_fitHitVec_Y = rHitFitVec_Y.begin();
   auto it_fitHitVec_Z = rHitFitVec_Z.begin();
+  // without direction branches, directions are 0
+  if(rHitFitVec_DirX.size() != numFitHit){
+    rHitFitVec_DirX.assign(numFitHit, 0);
+    rHitFitVec_DirY.assign(numFitHit, 0);
+    rHitFitVec_DirZ.assign(numFitHit, 0);
+  }
   auto it_fitHitVec_DX = rHitFitVec_DirX.begin();
   auto it_fitHitVec_DY = rHitFitVec_DirY.begin();
   auto it_fitHitVec_DZ = rHitFitVec_DirZ.begin();
@@ -180,7 +296,7 @@ std::shared_ptr<altel::TelEvent> altel::TelEventTTreeReader::createTelEvent(size
     int16_t originMeasHitIndex = *it_fitHitVec_OriginMeasHit_index;
     std::shared_ptr<altel::TelMeasHit> originMeasHit;
     // std::cout<< "originMeasHitIndex"<< originMeasHitIndex<<std::endl;
-    if(originMeasHitIndex!=int16_t(-1)){
+    if(m_conf.measHits && originMeasHitIndex!=int16_t(-1)){
       assert( originMeasHitIndex<measHits.size() );
       originMeasHit = measHits[originMeasHitIndex];
     }
@@ -204,14 +320,14 @@ std::shared_ptr<altel::TelEvent> altel::TelEventTTreeReader::createTelEvent(size
     int16_t matchedMeasHitIndex = *it_fitHitVec_MatchedMeasHit_index;
     std::shared_ptr<altel::TelMeasHit> matchedMeasHit;
     // std::cout<< "matchedMeasHitIndex"<< matchedMeasHitIndex<<std::endl;
-    if(matchedMeasHitIndex!= int16_t(-1)){
+    if(m_conf.measHits && matchedMeasHitIndex!= int16_t(-1)){
       assert( matchedMeasHitIndex<measHits.size() );
       matchedMeasHit = measHits[matchedMeasHitIndex];
     }
 
-    trajHits.emplace_back(new altel::TelTrajHit(*it_fitHitVec_detN,
-                                                fitHit,
-                                                matchedMeasHit));
+    trajHits.push_back(std::make_shared<altel::TelTrajHit>(*it_fitHitVec_detN,
+                                                           fitHit,
+                                                           matchedMeasHit));
 
     it_fitHitVec_detN ++;
     it_fitHitVec_U ++;
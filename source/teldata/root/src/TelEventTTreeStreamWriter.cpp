@@ -0,0 +1,114 @@
+#include "TelEventTTreeStreamWriter.hpp"
+#include "TelEventTTreeWriter.hpp"
+
+#include <TFile.h>
+#include <TROOT.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "myqueue.hh"
+#include "mymetrics.hh"
+
+altel::TelEventTTreeStreamWriter::Config altel::TelEventTTreeStreamWriter::Config::FromEnv(){
+  Config conf;
+  if(const char* str = std::getenv("ALTEL_TTREE_AUTOFLUSH")){
+    conf.autoFlush = std::stoll(str);
+  }
+  if(const char* str = std::getenv("ALTEL_TTREE_AUTOSAVE")){
+    conf.autoSave = std::stoll(str);
+  }
+  if(const char* str = std::getenv("ALTEL_TTREE_BASKETSIZE")){
+    conf.basketSize = std::stoi(str);
+  }
+  if(const char* str = std::getenv("ALTEL_TTREE_COMPRESSION")){
+    conf.compression = std::stoi(str);
+  }
+  if(const char* str = std::getenv("ALTEL_TTREE_QUEUE")){
+    conf.queueSize = std::stoul(str);
+  }
+  if(const char* str = std::getenv("ALTEL_TTREE_DROP")){
+    std::string groups = str;
+    size_t begin = 0;
+    while(begin <= groups.size()){
+      size_t end = std::min(groups.find(',', begin), groups.size());
+      std::string group = groups.substr(begin, end - begin);
+      if(group == "raws"){
+        conf.branches.measRaws = false;
+      }
+      else if(group == "dirs"){
+        conf.branches.fitDirections = false;
+      }
+      else if(group == "resids"){
+        conf.branches.anaResiduals = false;
+      }
+      else if(!group.empty()){
+        std::fprintf(stderr, "ALTEL_TTREE_DROP: unknown branch group <%s>, raws, dirs or resids\n", group.c_str());
+        throw;
+      }
+      begin = end + 1;
+    }
+  }
+  return conf;
+}
+
+altel::TelEventTTreeStreamWriter::TelEventTTreeStreamWriter(const std::string& filePath, const Config& conf)
+  :m_file_path(filePath), m_conf(conf){
+  // the I/O thread and the caller may both use ROOT
+  ROOT::EnableThreadSafety();
+  m_file = TFile::Open(m_file_path.c_str(), "recreate");
+  if(!m_file || m_file->IsZombie()){
+    std::fprintf(stderr, "ROOT TFile opening failed: %s\n", m_file_path.c_str());
+    throw;
+  }
+  if(m_conf.compression >= 0){
+    m_file->SetCompressionSettings(m_conf.compression);
+  }
+  m_queue.reset(new BoundedQueue<std::shared_ptr<altel::TelEvent>>(m_conf.queueSize));
+  m_thread = std::thread(&TelEventTTreeStreamWriter::writeLoop, this);
+}
+
+altel::TelEventTTreeStreamWriter::~TelEventTTreeStreamWriter(){
+  close();
+}
+
+void altel::TelEventTTreeStreamWriter::fillTelEvent(std::shared_ptr<altel::TelEvent> ev){
+  static auto& s_mt_queue = mymetrics::Registry::instance().gauge("ttree_queue_events", "events waiting for the TTree I/O thread");
+  if(!m_queue->push(std::move(ev))){
+    std::fprintf(stderr, "TelEventTTreeStreamWriter: event after close of %s\n", m_file_path.c_str());
+    throw;
+  }
+  s_mt_queue.set(m_queue->size());
+}
+
+void altel::TelEventTTreeStreamWriter::writeLoop(){
+  m_file->cd();
+  TTree *pTree = new TTree("eventTree", "eventTree"); // owned by m_file
+  altel::TelEventTTreeWriter ttreeWriter(m_conf.branches);
+  ttreeWriter.setTTree(pTree);
+  pTree->SetBasketSize("*", m_conf.basketSize);
+  pTree->SetAutoFlush(m_conf.autoFlush);
+  pTree->SetAutoSave(m_conf.autoSave);
+
+  std::shared_ptr<altel::TelEvent> ev;
+  while(m_queue->pop(ev)){
+    ttreeWriter.fillTelEvent(ev);
+    ev.reset();
+    m_event_n++;
+  }
+  pTree->Write("", TObject::kOverwrite);
+}
+
+size_t altel::TelEventTTreeStreamWriter::close(){
+  if(m_is_closed){
+    return m_event_n;
+  }
+  m_is_closed = true;
+  m_queue->close();
+  m_thread.join();
+  m_file->Close();
+  delete m_file;
+  m_file = nullptr;
+  return m_event_n;
+}
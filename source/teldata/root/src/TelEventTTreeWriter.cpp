@@ -3,6 +3,9 @@
 #include <TTree.h>
 
 #include <iostream>
+#include <algorithm>
+
+#include "mymetrics.hh"
 
 void altel::TelEventTTreeWriter::setTTree(TTree* pTTree){
   if(!pTTree){
@@ -20,18 +23,22 @@ void altel::TelEventTTreeWriter::setTTree(TTree* pTTree){
   auto bNumTraj_PerEvent = tree.Branch("NumTrajs_PerEvent", &rNumTraj_PerEvent);
   auto bNumMeasHits_PerEvent = tree.Branch("NumMeasHits_PerEvent", &rNumMeasHits_PerEvent);
 
-  auto bRawMeasVec_DetN = tree.Branch("MeasRawVec_DetN", &pRawMeasVec_DetN);
-  auto bRawMeasVec_U = tree.Branch("MeasRawVec_U", &pRawMeasVec_U);
-  auto bRawMeasVec_V = tree.Branch("MeasRawVec_V", &pRawMeasVec_V);
-  auto bRawMeasVec_Clk = tree.Branch("MeasRawVec_Clk", &pRawMeasVec_Clk);
+  if(m_conf.measRaws){
+    auto bRawMeasVec_DetN = tree.Branch("MeasRawVec_DetN", &pRawMeasVec_DetN);
+    auto bRawMeasVec_U = tree.Branch("MeasRawVec_U", &pRawMeasVec_U);
+    auto bRawMeasVec_V = tree.Branch("MeasRawVec_V", &pRawMeasVec_V);
+    auto bRawMeasVec_Clk = tree.Branch("MeasRawVec_Clk", &pRawMeasVec_Clk);
+  }
 
   auto bHitMeasVec_DetN = tree.Branch("MeasHitVec_DetN", &pHitMeasVec_DetN);
   auto bHitMeasVec_U = tree.Branch("MeasHitVec_U", &pHitMeasVec_U);
   auto bHitMeasVec_V = tree.Branch("MeasHitVec_V", &pHitMeasVec_V);
-  auto bHitMeasVec_NumRawMeas_PerHitMeas =
-    tree.Branch("MeasHitVec_NumMeasRaws_PerMeasHit", &pHitMeasVec_NumRawMeas_PerHitMeas);
-  auto bHitMeasVec_Index_To_RawMeas =
-    tree.Branch("MeasHitVec_MeasRaw_Index", &pHitMeasVec_Index_To_RawMeas);
+  if(m_conf.measRaws){
+    auto bHitMeasVec_NumRawMeas_PerHitMeas =
+      tree.Branch("MeasHitVec_NumMeasRaws_PerMeasHit", &pHitMeasVec_NumRawMeas_PerHitMeas);
+    auto bHitMeasVec_Index_To_RawMeas =
+      tree.Branch("MeasHitVec_MeasRaw_Index", &pHitMeasVec_Index_To_RawMeas);
+  }
 
   auto bHitFitVec_DetN = tree.Branch("TrajHitVec_DetN", &pHitFitVec_DetN);
   auto bHitFitVec_U = tree.Branch("TrajHitVec_U", &pHitFitVec_U);
@@ -42,9 +49,11 @@ void altel::TelEventTTreeWriter::setTTree(TTree* pTTree){
   auto bHitFitVec_X = tree.Branch("TrajHitVec_X", &pHitFitVec_X);
   auto bHitFitVec_Y = tree.Branch("TrajHitVec_Y", &pHitFitVec_Y);
   auto bHitFitVec_Z = tree.Branch("TrajHitVec_Z", &pHitFitVec_Z);
-  auto bHitFitVec_DirX = tree.Branch("TrajHitVec_DirX", &pHitFitVec_DirX);
-  auto bHitFitVec_DirY = tree.Branch("TrajHitVec_DirY", &pHitFitVec_DirY);
-  auto bHitFitVec_DirZ = tree.Branch("TrajHitVec_DirZ", &pHitFitVec_DirZ);
+  if(m_conf.fitDirections){
+    auto bHitFitVec_DirX = tree.Branch("TrajHitVec_DirX", &pHitFitVec_DirX);
+    auto bHitFitVec_DirY = tree.Branch("TrajHitVec_DirY", &pHitFitVec_DirY);
+    auto bHitFitVec_DirZ = tree.Branch("TrajHitVec_DirZ", &pHitFitVec_DirZ);
+  }
   auto bHitFitVec_Index_To_Origin_HitMeas =
     tree.Branch("TrajHitVec_OriginMeasHit_Index", &pHitFitVec_Index_To_Origin_HitMeas);
   auto bHitFitVec_Index_To_Matched_HitMeas =
@@ -58,15 +67,22 @@ void altel::TelEventTTreeWriter::setTTree(TTree* pTTree){
     tree.Branch("TrajVec_TrajHit_Index", &pTrajVec_Index_To_HitFit);
 
   // ana
-  auto bAnaVec_Matched_DetN = tree.Branch("AnaVec_Matched_DetN", &pAnaVec_Matched_DetN);
-  auto bAnaVec_Matched_ResdU = tree.Branch("AnaVec_Matched_ResidU", &pAnaVec_Matched_ResdU);
-  auto bAnaVec_Matched_ResdV = tree.Branch("AnaVec_Matched_ResidV", &pAnaVec_Matched_ResdV);
+  if(m_conf.anaResiduals){
+    auto bAnaVec_Matched_DetN = tree.Branch("AnaVec_Matched_DetN", &pAnaVec_Matched_DetN);
+    auto bAnaVec_Matched_ResdU = tree.Branch("AnaVec_Matched_ResidU", &pAnaVec_Matched_ResdU);
+    auto bAnaVec_Matched_ResdV = tree.Branch("AnaVec_Matched_ResidV", &pAnaVec_Matched_ResdV);
+  }
 }
 
 
 void altel::TelEventTTreeWriter::fillTelEvent(std::shared_ptr<altel::TelEvent> telEvent){
+  static auto& s_mt_fill_ns = mymetrics::Registry::instance().histogram("ttree_fill_ns", "TelEventTTreeWriter::fillTelEvent, branch filling and TTree::Fill");
+  mymetrics::ScopedTimer timer(s_mt_fill_ns);
+  fillBranches(*telEvent);
+  m_pTTree->Fill();
+}
 
-///////////////branch vector clear////////////////////////
+void altel::TelEventTTreeWriter::clearBranches(){
     ///rawMeas
     rRawMeasVec_DetN.clear();
     rRawMeasVec_U.clear();
@@ -108,161 +124,154 @@ void altel::TelEventTTreeWriter::fillTelEvent(std::shared_ptr<altel::TelEvent> t
     rAnaVec_Matched_DetN.clear();
     rAnaVec_Matched_ResdU.clear();
     rAnaVec_Matched_ResdV.clear();
-///////////////////////////////////////////////
-
-
-////////////////////////////////////////fill tree////////////////////
-    std::map<altel::TelMeasRaw, int16_t> poolMapRawMeas;
-    std::map<std::shared_ptr<altel::TelMeasHit>, int16_t> poolMapHitMeas;
-    std::map<std::shared_ptr<altel::TelFitHit>, int16_t> poolMapHitFit;
-
-    // for(auto &aRawMeas: telEvent->measRaws()){
-    //   auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()) );
-    //   if(inserted){
-    //     // inserted and return true, when no exist
-    //     rRawMeasVec_U.push_back(aRawMeas.u());
-    //     rRawMeasVec_V.push_back(aRawMeas.v());
-    //     rRawMeasVec_DetN.push_back(aRawMeas.detN());
-    //     rRawMeasVec_Clk.push_back(aRawMeas.clkN());
-    //   }
-    // }
-
-    for(auto &aHitMeas: telEvent->measHits()){
-      auto [it, inserted] = poolMapHitMeas.emplace( aHitMeas, int16_t(rHitMeasVec_DetN.size()) );
+}
+
+void altel::TelEventTTreeWriter::IndexTable::clear(){
+  size = 0;
+  stamp++;
+  if(stamp == 0){
+    std::fill(stamps.begin(), stamps.end(), 0);
+    stamp = 1;
+  }
+}
+
+std::pair<int16_t, bool> altel::TelEventTTreeWriter::IndexTable::emplace(uint64_t key, int16_t value){
+  if((size + 1) * 2 > keys.size()){
+    std::vector<uint64_t> oldKeys = std::move(keys);
+    std::vector<int16_t> oldValues = std::move(values);
+    std::vector<uint32_t> oldStamps = std::move(stamps);
+    size_t capacity = std::max<size_t>(64, oldKeys.size() * 2);
+    keys.assign(capacity, 0);
+    values.assign(capacity, 0);
+    stamps.assign(capacity, 0);
+    size = 0;
+    for(size_t n = 0; n < oldKeys.size(); n++){
+      if(oldStamps[n] == stamp){
+        emplace(oldKeys[n], oldValues[n]);
+      }
+    }
+  }
+  size_t mask = keys.size() - 1;
+  size_t n = size_t((key * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+  while(stamps[n] == stamp){
+    if(keys[n] == key){
+      return {values[n], false};
+    }
+    n = (n + 1) & mask;
+  }
+  keys[n] = key;
+  values[n] = value;
+  stamps[n] = stamp;
+  size++;
+  return {value, true};
+}
+
+int16_t altel::TelEventTTreeWriter::fillMeasHit(const altel::TelMeasHit& hit){
+  int16_t index = int16_t(rHitMeasVec_DetN.size());
+  rHitMeasVec_DetN.push_back(hit.detN());
+  rHitMeasVec_U.push_back(hit.u());
+  rHitMeasVec_V.push_back(hit.v());
+  if(m_conf.measRaws){
+    rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
+    for(auto &aRawMeas: hit.measRaws()){
+      auto [rawIndex, inserted] = m_index_raw.emplace(aRawMeas.index(), int16_t(rRawMeasVec_DetN.size()));
       if(inserted){
-        // inserted and return true, when no exist
-        rHitMeasVec_DetN.push_back(aHitMeas->detN());
-        rHitMeasVec_U.push_back(aHitMeas->u());
-        rHitMeasVec_V.push_back(aHitMeas->v());
-
-        rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
-        for(auto &aRawMeas: aHitMeas->measRaws()){
-          auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()));
-          if(inserted){
-            rRawMeasVec_U.push_back(aRawMeas.u());
-            rRawMeasVec_V.push_back(aRawMeas.v());
-            rRawMeasVec_DetN.push_back(aRawMeas.detN());
-            rRawMeasVec_Clk.push_back(aRawMeas.clkN());
-          }
-          rHitMeasVec_Index_To_RawMeas.push_back(it->second);
-        }
-        rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(aHitMeas->measRaws().size()));
+        rRawMeasVec_U.push_back(aRawMeas.u());
+        rRawMeasVec_V.push_back(aRawMeas.v());
+        rRawMeasVec_DetN.push_back(aRawMeas.detN());
+        rRawMeasVec_Clk.push_back(aRawMeas.clkN());
       }
+      rHitMeasVec_Index_To_RawMeas.push_back(rawIndex);
     }
+    rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(hit.measRaws().size()));
+  }
+  return index;
+}
 
-    rNumTraj_PerEvent = 0;
-    for(auto &aTraj: telEvent->trajs()){
-      size_t fittedHitNum = aTraj->numOriginMeasHit();
-      // if(fittedHitNum<5){
-      //   continue;
-      // }
-
-      rNumTraj_PerEvent ++;
-      rTrajVec_Index_To_HitFit.push_back(-1);//traj: -1 {M-N} -1 {M-N}
-
-      int16_t aNumHitFit_PerTraj = 0;
-      int16_t aNumHitMeas_Origin_PerTraj = 0;
-      int16_t aNumHitMeas_Matched_PerTraj = 0;
-
-      for(auto &aHit: aTraj->trajHits()){
-        aNumHitFit_PerTraj++;
-        auto aHitFit = aHit->fitHit();
-        auto [it, inserted] = poolMapHitFit.emplace( aHitFit, int16_t(rHitFitVec_DetN.size()) );
-        if(!inserted){
-          //TODO: handle this case for ambiguility case
-          std::fprintf(stderr, "a shared hitfit by multi-traj, WRONG\n");
-          throw;
-        }
+void altel::TelEventTTreeWriter::fillBranches(const altel::TelEvent& telEvent){
+  clearBranches();
+  m_index_raw.clear();
+  m_index_hit.clear();
+  m_index_fit.clear();
+
+  // first measure hits of event, then those of trajectories, in order of their first use
+  auto hitIndex = [this](const std::shared_ptr<altel::TelMeasHit>& hit)->int16_t{
+                    auto [index, inserted] = m_index_hit.emplace(uint64_t(uintptr_t(hit.get())), int16_t(rHitMeasVec_DetN.size()));
+                    if(inserted){
+                      fillMeasHit(*hit);
+                    }
+                    return index;
+                  };
+  for(auto &aHitMeas: telEvent.measHits()){
+    hitIndex(aHitMeas);
+  }
+
+  rNumTraj_PerEvent = 0;
+  for(auto &aTraj: telEvent.trajs()){
+    rNumTraj_PerEvent ++;
+    rTrajVec_Index_To_HitFit.push_back(-1);//traj: -1 {M-N} -1 {M-N}
+
+    int16_t aNumHitFit_PerTraj = 0;
+    int16_t aNumHitMeas_Origin_PerTraj = 0;
+    int16_t aNumHitMeas_Matched_PerTraj = 0;
+
+    for(auto &aHit: aTraj->trajHits()){
+      aNumHitFit_PerTraj++;
+      auto &aHitFit = aHit->fitHit();
+      auto [fitIndex, inserted] = m_index_fit.emplace(uint64_t(uintptr_t(aHitFit.get())), int16_t(rHitFitVec_DetN.size()));
+      if(!inserted){
+        //TODO: handle this case for ambiguility case
+        std::fprintf(stderr, "a shared hitfit by multi-traj, WRONG\n");
+        throw;
+      }
 
-        rTrajVec_Index_To_HitFit.push_back(it->second);
-        rHitFitVec_TrajN.push_back(int16_t(rTrajVec_NumHitFit_PerTraj.size()));
-        rHitFitVec_DetN.push_back(aHitFit->detN());
-        rHitFitVec_U.push_back(aHitFit->u());
-        rHitFitVec_V.push_back(aHitFit->v());
-
-        rHitFitVec_U_err.push_back(aHitFit->u_err());
-        rHitFitVec_V_err.push_back(aHitFit->v_err());
-        
-        rHitFitVec_X.push_back(aHitFit->x());
-        rHitFitVec_Y.push_back(aHitFit->y());
-        rHitFitVec_Z.push_back(aHitFit->z());
+      rTrajVec_Index_To_HitFit.push_back(fitIndex);
+      rHitFitVec_TrajN.push_back(int16_t(rTrajVec_NumHitFit_PerTraj.size()));
+      rHitFitVec_DetN.push_back(aHitFit->detN());
+      rHitFitVec_U.push_back(aHitFit->u());
+      rHitFitVec_V.push_back(aHitFit->v());
+
+      rHitFitVec_U_err.push_back(aHitFit->u_err());
+      rHitFitVec_V_err.push_back(aHitFit->v_err());
+
+      rHitFitVec_X.push_back(aHitFit->x());
+      rHitFitVec_Y.push_back(aHitFit->y());
+      rHitFitVec_Z.push_back(aHitFit->z());
+      if(m_conf.fitDirections){
         rHitFitVec_DirX.push_back(aHitFit->dx());
         rHitFitVec_DirY.push_back(aHitFit->dy());
         rHitFitVec_DirZ.push_back(aHitFit->dz());
+      }
 
-        int16_t indexHitMeasOri = -1;
-        auto aHitMeasOri = aHitFit->OM;
-        if(aHitMeasOri){
-          aNumHitMeas_Origin_PerTraj ++;
-          auto [it, inserted] = poolMapHitMeas.emplace( aHitMeasOri, int16_t(rHitMeasVec_DetN.size()));
-          if(inserted){
-            rHitMeasVec_DetN.push_back(aHitMeasOri->detN());
-            rHitMeasVec_U.push_back(aHitMeasOri->u());
-            rHitMeasVec_V.push_back(aHitMeasOri->v());
-
-            rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
-            for(auto &aRawMeas: aHitMeasOri->measRaws()){
-              auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()));
-              if(inserted){
-                rRawMeasVec_U.push_back(aRawMeas.u());
-                rRawMeasVec_V.push_back(aRawMeas.v());
-                rRawMeasVec_DetN.push_back(aRawMeas.detN());
-                rRawMeasVec_Clk.push_back(aRawMeas.clkN());
-              }
-              rHitMeasVec_Index_To_RawMeas.push_back(it->second);
-            }
-            rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(aHitMeasOri->measRaws().size()));
-          }
-          indexHitMeasOri = it->second;
-        }
-        rHitFitVec_Index_To_Origin_HitMeas.push_back(indexHitMeasOri);
-
-        int16_t  indexHitMeasMatched = -1;
-        auto aHitMeasMatched = aHit->MM;
-        if(aHitMeasMatched){
-          aNumHitMeas_Matched_PerTraj++;
-          auto [it, inserted] = poolMapHitMeas.emplace( aHitMeasMatched, int16_t(rHitMeasVec_DetN.size()));
-          if(inserted){
-            rHitMeasVec_DetN.push_back(aHitMeasMatched->detN());
-            rHitMeasVec_U.push_back(aHitMeasMatched->u());
-            rHitMeasVec_V.push_back(aHitMeasMatched->v());
-
-            rHitMeasVec_Index_To_RawMeas.push_back(-1);//: -1 {M-N} -1 {M-N}
-            for(auto &aRawMeas: aHitMeasMatched->measRaws()){
-              auto [it, inserted] = poolMapRawMeas.emplace(aRawMeas, int16_t(rRawMeasVec_DetN.size()));
-              if(inserted){
-                rRawMeasVec_U.push_back(aRawMeas.u());
-                rRawMeasVec_V.push_back(aRawMeas.v());
-                rRawMeasVec_DetN.push_back(aRawMeas.detN());
-                rRawMeasVec_Clk.push_back(aRawMeas.clkN());
-              }
-              rHitMeasVec_Index_To_RawMeas.push_back(it->second);
-            }
-            rHitMeasVec_NumRawMeas_PerHitMeas.push_back(int16_t(aHitMeasMatched->measRaws().size()));
-            //
-
-          }
-          indexHitMeasMatched = it->second;
-        }
-        rHitFitVec_Index_To_Matched_HitMeas.push_back(indexHitMeasMatched);
+      int16_t indexHitMeasOri = -1;
+      if(aHitFit->OM){
+        aNumHitMeas_Origin_PerTraj ++;
+        indexHitMeasOri = hitIndex(aHitFit->OM);
+      }
+      rHitFitVec_Index_To_Origin_HitMeas.push_back(indexHitMeasOri);
 
+      int16_t indexHitMeasMatched = -1;
+      auto &aHitMeasMatched = aHit->MM;
+      if(aHitMeasMatched){
+        aNumHitMeas_Matched_PerTraj++;
+        indexHitMeasMatched = hitIndex(aHitMeasMatched);
         //ana matched
-        if(aHitMeasMatched){
+        if(m_conf.anaResiduals){
           rAnaVec_Matched_DetN.push_back(aHitMeasMatched->detN());
           rAnaVec_Matched_ResdU.push_back(aHitMeasMatched->u() - aHitFit->u());
           rAnaVec_Matched_ResdV.push_back(aHitMeasMatched->v() - aHitFit->v());
         }
       }
-      rTrajVec_NumHitFit_PerTraj.push_back(aNumHitFit_PerTraj);
-      rTrajVec_NumHitMeas_Origin_PerTraj.push_back(aNumHitMeas_Origin_PerTraj);
-      rTrajVec_NumHitMeas_Matched_PerTraj.push_back(aNumHitMeas_Matched_PerTraj);
+      rHitFitVec_Index_To_Matched_HitMeas.push_back(indexHitMeasMatched);
     }
+    rTrajVec_NumHitFit_PerTraj.push_back(aNumHitFit_PerTraj);
+    rTrajVec_NumHitMeas_Origin_PerTraj.push_back(aNumHitMeas_Origin_PerTraj);
+    rTrajVec_NumHitMeas_Matched_PerTraj.push_back(aNumHitMeas_Matched_PerTraj);
+  }
 
-    rRunN = telEvent->runN();
-    rEventN = telEvent->eveN();
-    rConfigN = telEvent->detN();
-    rClock = telEvent->clkN();
-    rNumMeasHits_PerEvent = poolMapHitMeas.size();
-
-    m_pTTree->Fill();
+  rRunN = telEvent.runN();
+  rEventN = telEvent.eveN();
+  rConfigN = telEvent.detN();
+  rClock = telEvent.clkN();
+  rNumMeasHits_PerEvent = rHitMeasVec_DetN.size();
 }
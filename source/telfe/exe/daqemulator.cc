@@ -0,0 +1,200 @@
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include "DataServer.hh"
+#include "RbcpServer.hh"
+#include "getopt.h"
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -layers         <INT>        number of emulated boards (default 6)
+  -ip             <IP>         address of the first board, the next ones count up (default 127.0.0.1)
+  -port           <INT>        data link tcp port (default 24, as Frontend connects to)
+  -rbcpPort       <INT>        register udp port (default 4660)
+  -daqid          <INT>        daqid of the first board, the next ones count up (default 0)
+  -rate           <FLOAT>      triggers per second, 0 for as fast as the client reads (default 1000)
+  -occupancy      <FLOAT>      mean pixels per trigger and layer (default 4)
+  -replay         <PATH>       raw stream as recorded by datatool, replayed instead of synthesised
+                               packets, repeat it for more files, layer n takes file n % count
+  -dropRate       <FLOAT>      fraction of triggers not sent (default 0)
+  -corruptRate    <FLOAT>      fraction of packets with a broken trailer (default 0)
+  -tidSkew        <INT>        trigger id offset of the layer -skewLayer (default 0)
+  -skewLayer      <INT>        layer with the trigger id offset (default the last one)
+  -alwaysUpload                send without waiting for upload_data to be set over rbcp
+
+Emulates DAQ boards without hardware. Each board answers rbcp on its address, as RbcpServer,
+and serves its data link there, as DataServer, while its upload_data register is set. Point
+the data_link ip of a layer configuration at the boards and run Telescope or a producer
+against them. Statistics are printed every 10 seconds. Ports below 1024 need root or
+CAP_NET_BIND_SERVICE.
+
+examples:
+./daqemulator -layers 6 -rate 10000 -occupancy 10
+./daqemulator -layers 2 -replay run0.raw -replay run1.raw -rate 0
+./daqemulator -dropRate 0.001 -corruptRate 0.0001 -tidSkew 3 -skewLayer 2
+)";
+
+namespace{
+  const uint32_t s_addr_upload_data = 0x0003; // firmware_reg.json
+
+  std::atomic<bool> g_is_running{true};
+
+  void handleSignal(int){
+    g_is_running = false;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t layerN = 6;
+  std::string ip = "127.0.0.1";
+  uint16_t port = 24;
+  uint16_t rbcpPort = 4660;
+  uint8_t daqid = 0;
+  DataServer::Config conf;
+  std::vector<std::string> replayFiles;
+  int64_t skewLayer = -1;
+  uint16_t tidSkew = 0;
+  bool isAlwaysUpload = false;
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"layers", required_argument, NULL, 'l'},
+                                {"ip", required_argument, NULL, 'i'},
+                                {"port", required_argument, NULL, 'p'},
+                                {"rbcpPort", required_argument, NULL, 'u'},
+                                {"daqid", required_argument, NULL, 'd'},
+                                {"rate", required_argument, NULL, 'r'},
+                                {"occupancy", required_argument, NULL, 'o'},
+                                {"replay", required_argument, NULL, 'f'},
+                                {"dropRate", required_argument, NULL, 'x'},
+                                {"corruptRate", required_argument, NULL, 'c'},
+                                {"tidSkew", required_argument, NULL, 't'},
+                                {"skewLayer", required_argument, NULL, 's'},
+                                {"alwaysUpload", no_argument, NULL, 'a'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'l':
+        layerN = std::stoul(optarg);
+        break;
+      case 'i':
+        ip = optarg;
+        break;
+      case 'p':
+        port = std::stoul(optarg);
+        break;
+      case 'u':
+        rbcpPort = std::stoul(optarg);
+        break;
+      case 'd':
+        daqid = std::stoul(optarg);
+        break;
+      case 'r':
+        conf.rate = std::stod(optarg);
+        break;
+      case 'o':
+        conf.occupancy = std::stod(optarg);
+        break;
+      case 'f':
+        replayFiles.push_back(optarg);
+        break;
+      case 'x':
+        conf.dropRate = std::stod(optarg);
+        break;
+      case 'c':
+        conf.corruptRate = std::stod(optarg);
+        break;
+      case 't':
+        tidSkew = std::stoul(optarg);
+        break;
+      case 's':
+        skewLayer = std::stol(optarg);
+        break;
+      case 'a':
+        isAlwaysUpload = true;
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  if(skewLayer < 0){
+    skewLayer = layerN - 1;
+  }
+
+  std::vector<std::vector<std::string>> replays;
+  for(auto &f: replayFiles){
+    replays.push_back(DataServer::ReadRawFile(f));
+    std::fprintf(stdout, "replay %s: %zu packets\n", f.c_str(), replays.back().size());
+    if(replays.back().empty()){
+      std::fprintf(stderr, "no packet in %s\n", f.c_str());
+      std::exit(1);
+    }
+  }
+
+  std::vector<std::unique_ptr<RbcpServer>> rbcps;
+  std::vector<std::unique_ptr<DataServer>> datas;
+  uint32_t ipFirst = ntohl(inet_addr(ip.c_str()));
+  for(size_t n = 0; n < layerN; n++){
+    struct in_addr addr;
+    addr.s_addr = htonl(ipFirst + n);
+    std::string layerIp = inet_ntoa(addr);
+    RbcpServer *rbcp = new RbcpServer(layerIp, rbcpPort);
+    rbcps.emplace_back(rbcp);
+
+    DataServer::Config layerConf = conf;
+    layerConf.daqid = daqid + n;
+    layerConf.seed = conf.seed + n;
+    layerConf.tidSkew = (int64_t(n) == skewLayer)? tidSkew : 0;
+    if(!replays.empty()){
+      layerConf.replay = replays[n % replays.size()];
+    }
+    std::function<bool()> isUploading;
+    if(!isAlwaysUpload){
+      isUploading = [rbcp](){return rbcp->Register(s_addr_upload_data) != 0;};
+    }
+    datas.emplace_back(new DataServer(layerIp, port, layerConf, isUploading));
+    std::fprintf(stdout, "board %zu at %s, daqid %u, data port %u, rbcp port %u%s\n", n, layerIp.c_str(),
+                 layerConf.daqid, port, rbcpPort, layerConf.tidSkew? ", trigger id skewed" : "");
+  }
+
+  std::signal(SIGINT, handleSignal);
+  std::signal(SIGTERM, handleSignal);
+  std::vector<uint64_t> byteLast(layerN, 0);
+  auto tp_last = std::chrono::steady_clock::now();
+  while(g_is_running){
+    for(size_t n = 0; n < 100 && g_is_running; n++){
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    auto tp_now = std::chrono::steady_clock::now();
+    double sec = std::chrono::duration<double>(tp_now - tp_last).count();
+    tp_last = tp_now;
+    for(size_t n = 0; n < layerN; n++){
+      auto &d = datas[n];
+      uint64_t byteN = d->NumBytes();
+      std::fprintf(stdout, "board %zu: clients %lu, triggers %lu, packets %lu, dropped %lu, corrupted %lu, %.2f MB/s, rbcp frames %lu\n",
+                   n, d->NumClients(), d->NumTriggers(), d->NumPackets(), d->NumDropped(), d->NumCorrupted(),
+                   (byteN - byteLast[n]) / sec / 1e6, rbcps[n]->NumFrames());
+      byteLast[n] = byteN;
+    }
+  }
+  return 0;
+}
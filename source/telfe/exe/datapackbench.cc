@@ -0,0 +1,157 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <deque>
+#include <atomic>
+#include <new>
+
+#include "DataPack.hh"
+#include "mysystem.hh"
+#include "getopt.h"
+
+// counts heap allocations of the whole process
+static std::atomic<uint64_t> g_n_alloc{0};
+
+void* operator new(std::size_t n){
+  g_n_alloc ++;
+  if(void *p = std::malloc(n ? n : 1)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+  std::free(p);
+}
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -packMax        <INT>        number of packets to decode (default 1000000)
+  -pixelN         <INT>        pixel words per packet (default 4)
+  -inflight       <INT>        packets held by the consumer before release (default 64)
+
+Decodes synthetic data packets of one layer, as Frontend::perConnProcessRecvMesg does,
+once with a new DataPack and a packet copy per packet (previous path) and once with
+DataPackPool and in-place decoding. Prints packets per second and heap allocations per packet.
+
+examples:
+./datapackbench -packMax 2000000 -pixelN 10
+)";
+
+namespace{
+  std::string makePacket(std::mt19937& gen, uint8_t daqid, uint16_t tid, uint16_t pixelN){
+    std::uniform_int_distribution<uint32_t> distDcol(0, 511);
+    std::uniform_int_distribution<uint32_t> distRow(0, 1023);
+    std::string pack;
+    pack.push_back(char(0xaa));
+    pack.push_back(char(daqid));
+    pack.push_back(char(tid>>8));
+    pack.push_back(char(tid));
+    pack.push_back(char(pixelN>>8));
+    pack.push_back(char(pixelN));
+    for(uint16_t n = 0; n < pixelN; n++){
+      // valid(1) tschip(8) raw_dcol[9]  raw_row[10] pattern[4]
+      uint32_t v = (1u<<31) | (distDcol(gen)<<14) | (distRow(gen)<<4);
+      pack.push_back(char(v>>24));
+      pack.push_back(char(v>>16));
+      pack.push_back(char(v>>8));
+      pack.push_back(char(v));
+    }
+    pack.push_back(char(0xcc));
+    pack.push_back(char(0xcc));
+    return pack;
+  }
+
+  template<typename F>
+  void runBench(const char* name, const std::vector<std::string>& packs, size_t packMax, size_t inflight, F&& decode){
+    std::deque<DataPackSP> consumer;
+    // warm up pools and vector capacities
+    for(size_t n = 0; n < packs.size(); n++){
+      consumer.push_back(decode(packs[n]));
+      if(consumer.size() > inflight){
+        consumer.pop_front();
+      }
+    }
+    uint64_t n_alloc_begin = g_n_alloc;
+    auto tp_start = std::chrono::steady_clock::now();
+    for(size_t n = 0; n < packMax; n++){
+      consumer.push_back(decode(packs[n%packs.size()]));
+      if(consumer.size() > inflight){
+        consumer.pop_front();
+      }
+    }
+    auto tp_end = std::chrono::steady_clock::now();
+    uint64_t n_alloc = g_n_alloc - n_alloc_begin;
+    double sec = std::chrono::duration<double>(tp_end - tp_start).count();
+    std::fprintf(stdout, "%-10s %12.0f packets/s   %8.3f allocations/packet\n",
+                 name, packMax/sec, 1.0*n_alloc/packMax);
+  }
+}
+
+int main(int argc, char **argv){
+  size_t packMax = 1000000;
+  uint16_t pixelN = 4;
+  size_t inflight = 64;
+
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"packMax", required_argument, NULL, 'm'},
+                                {"pixelN", required_argument, NULL, 'n'},
+                                {"inflight", required_argument, NULL, 'i'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'm':
+        packMax = std::stoul(optarg);
+        break;
+      case 'n':
+        pixelN = std::stoul(optarg);
+        break;
+      case 'i':
+        inflight = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  std::mt19937 gen(1);
+  std::vector<std::string> packs;
+  for(uint16_t tid = 0; tid < 1024; tid++){
+    packs.push_back(makePacket(gen, 1, tid, pixelN));
+  }
+
+  std::fprintf(stdout, "pixel words per packet: %u, packets in flight: %zu\n", pixelN, inflight);
+
+  runBench("previous", packs, packMax, inflight, [](const std::string& pak){
+    std::string packraw = pak;
+    DataPackSP df(new DataPack);
+    df->MakeDataPack(packraw);
+    return df;
+  });
+
+  DataPackPool pool(inflight + 16);
+  runBench("pooled", packs, packMax, inflight, [&](const std::string& pak){
+    DataPackSP df = pool.Acquire();
+    df->MakeDataPack(pak.data(), pak.size());
+    return df;
+  });
+  std::fprintf(stdout, "pool size %zu, pool misses %lu\n", pool.Size(), pool.NumMiss());
+  return 0;
+}
@@ -37,6 +37,7 @@
 #include "linenoise.h"
 #include "getopt.h"
 #include "mysystem.hh"
+#include "StreamInBuffer.hh"
 
 #include "TFile.h"
 #include "TTree.h"
@@ -213,66 +214,10 @@ Usage:
 
 
 
-//HEAD       DAQ_ID   TS_TID_H  TS_TID_L  LEN_H      LEN_L      TaichuRAW_32bit * N            ENDH       ENDL
-//10101010  xxxxxxxx  xxxxxxxx  xxxxxxxx  xxxxxxxx   xxxxxxxx  {bit_last ---- bit_first} * N   11001100   11001100
-class DataInBuffer{
-public:
-
-  void append(size_t length, const char *data){
-    m_buf += std::string(data, length);
-
-    updatelength(false);
-  };
-
-  bool havepacket() const{
-    return m_buf.length() >= m_len  && m_len!=0;
-  };
-
-
-  bool havepacket_possible() const{
-    bool expectedPack = false;
-    if(m_buf.length() >= m_len  && m_len!=0){
-      expectedPack = true;
-    }
-    return expectedPack;
-  };
-
-
-  void  resyncpacket(){
-    if(!havepacket_possible()){
-      return;
-    }
-
-    std::string packet(m_buf, 0, m_len);
-    while(havepacket_possible() &&
-          (m_buf[0]!=0b10101010 || (m_buf[m_len-2] != 0b11001100 || m_buf[m_len-1] != 0b11001100))){
-      if(m_buf[0]!=0b10101010){
-        std::string::size_type pos = m_buf.find(0b10101010);
-        if(pos != std::string::npos){
-          m_buf.erase(0, pos);
-          updatelength(true);
-        }else{
-          m_buf.clear();
-          updatelength(true);
-        }
-        continue;
-      }
-      if(m_buf[m_len-2] != 0b11001100 || m_buf[m_len-1] != 0b11001100) {
-        std::string::size_type pos = m_buf.find("\xcc\xcc");
-        m_buf.erase(0, pos+2);
-        updatelength(true);
-      }
-    }
-    return ;
-  }
-
-  std::string getpacket(){
-    if (!havepacket()){
-      std::cerr<<"havepacket return false\n";
-      throw;
-    }
-    std::string packet(m_buf, 0, m_len);
-    fprintf(stdout, "extract datapack_string [%04d]:   ", m_len);
+namespace{
+  // datatool's own decoding, kept apart from DataPack of altel-frontend
+  void print_datapack_string(std::string_view packet){
+    fprintf(stdout, "extract datapack_string [%04zu]:   ", packet.size());
     for(size_t n = 0; n< packet.size(); n++){
       if(n!=0 && n%16==0){ std::cout<<"                           "; }
       uint16_t num = (uint8_t)packet[n];
@@ -280,40 +225,7 @@ public:
       if(n%2==1)   std::cout<<" - ";
       if(n%16==15) std::cout<<std::endl;
     }
-
-    m_buf.erase(0, m_len);
-    updatelength(true);
-    return packet;
-  };
-
-
-  void dump(size_t maxN){
-    size_t dumpN = m_buf.size()<maxN ? m_buf.size(): maxN;
-    for(size_t n = 0; n< dumpN; n++){
-      uint16_t num = (uint8_t)m_buf[n];
-      fprintf(stdout, "%02X - ", num);
-      if(n%2==1)   std::cout<<" = ";
-      if(n%16==15) std::cout<<std::endl;
-    }
-  };
-
-private:
-  void updatelength(bool force){
-    // std::cout<< "m_len udpate"<<std::endl;
-    if (force || m_len == 0) {
-      m_len = 0;
-      if (m_buf.length() >= 6) {
-        m_len = ((size_t(uint8_t(m_buf[4]))<<8) + (size_t(uint8_t(m_buf[5]))))  * 4  + 8;
-        // std::cout<< "len update "<< m_len<< std::hex<<" " << size_t(uint8_t(m_buf[4])) << "  "<< size_t(uint8_t(m_buf[5]))<<std::dec<<std::endl;
-      }
-    }
-  };
-  //check 1st pack format in updatelength
-  size_t m_len{0};
-  std::string m_buf;
-  std::string m_temp_buf;
-};
-
+  }
 
 struct PixelWord{
   PixelWord(const uint32_t v){ //BE32TOH
@@ -335,7 +247,7 @@ struct PixelWord{
 };
 
 struct DataPack{
-  DataPack(const std::string&  packstr){
+  DataPack(std::string_view  packstr){
     packraw = packstr;
     const uint8_t *p = reinterpret_cast<const uint8_t*>(packraw.data());
     packhead = *p;
@@ -414,6 +326,8 @@ struct DataPack{
 };
 
 
+}
+
 ///////////////////////////////////////////////////////////////////////////////////
 
 
@@ -570,7 +484,7 @@ int main(int argc, char **argv){
     
   }
 
-  DataInBuffer inbuf;
+  StreamInBuffer inbuf;
 
   std::vector<char> buf(128*5);
   size_t len_actual;
@@ -578,7 +492,8 @@ int main(int argc, char **argv){
   while ( (   len_actual = socketfd0? socketread(&buf[0], sizeof buf[0], buf.size(), socketfd0 ):  std::fread(&buf[0], sizeof buf[0], buf.size(), fp0 )      ) != 0 ){
     inbuf.append(len_actual, &buf[0]);
     while(inbuf.havepacket()){
-      std::string packstr = inbuf.getpacket();
+      std::string_view packstr = inbuf.getpacket();
+      print_datapack_string(packstr);
       DataPack dp(packstr);
       dp.print();
 
@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <memory>
+
+#include "Frontend.hh"
+#include "rbcp.hh"
+#include "RbcpClient.hh"
+#include "RbcpServer.hh"
+#include "getopt.h"
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -ip             <IP>         address of a board or rbcpserver, (default: in-process stand-in server)
+  -port           <INT>        rbcp udp port (default 4660)
+  -rowMax         <INT>        raw rows of the mask flush stream (default 1024)
+  -window         <INT>        transactions in flight (default 32)
+  -dropRate       <FLOAT>      fraction of frames the stand-in server drops (default 0)
+  -latency        <INT>        microseconds the stand-in server delays each ack (default 100)
+  -legacyRowMax   <INT>        raw rows sent through class rbcp, one socket and round trip per byte (default 64)
+  -server                      only run the stand-in server until killed
+
+Sends the register write stream of Frontend::FlushPixelMask, three indirect writes per mask
+byte and per row load, once through class rbcp as before, once through RbcpClient
+stop-and-wait and once pipelined and coalesced. Then times Frontend::FlushPixelMask and
+daq_conf_default twice, which needs port 4660. With the in-process server, the sensor write
+sequences are compared and the frames of each configuration are counted.
+
+examples:
+./rbcpbench
+./rbcpbench -rowMax 1024 -window 64 -dropRate 0.001 -latency 200
+./rbcpbench -server -ip 127.0.0.1 &  ./rbcptool -i 127.0.0.1 -s ... -f ...
+)";
+
+namespace{
+  struct RegWrite{
+    uint32_t address;
+    uint8_t value;
+  };
+
+  std::vector<RegWrite> makeMaskStream(size_t rowMax){
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<uint32_t> distByte(0, 255);
+    std::vector<RegWrite> ws;
+    for(size_t rawRowN = 0; rawRowN < rowMax; rawRowN++){
+      for(size_t n = 0; n < 64; n++){
+        ws.push_back({0x0022, 6});
+        ws.push_back({0x0023, uint8_t(distByte(gen))});
+        ws.push_back({0x0021, 0});
+      }
+      ws.push_back({0x0022, 7});
+      ws.push_back({0x0023, 0});
+      ws.push_back({0x0021, 0});
+    }
+    return ws;
+  }
+
+  template<typename F>
+  double timeIt(F&& f){
+    auto tp_start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_start).count();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::string ip;
+  uint16_t port = 4660;
+  size_t rowMax = 1024;
+  size_t window = 32;
+  double dropRate = 0;
+  uint64_t latency = 100;
+  size_t legacyRowMax = 64;
+  bool isServerOnly = false;
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"ip", required_argument, NULL, 'i'},
+                                {"port", required_argument, NULL, 'p'},
+                                {"rowMax", required_argument, NULL, 'r'},
+                                {"window", required_argument, NULL, 'w'},
+                                {"dropRate", required_argument, NULL, 'd'},
+                                {"latency", required_argument, NULL, 't'},
+                                {"legacyRowMax", required_argument, NULL, 'l'},
+                                {"server", no_argument, NULL, 's'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'i':
+        ip = optarg;
+        break;
+      case 'p':
+        port = std::stoul(optarg);
+        break;
+      case 'r':
+        rowMax = std::stoul(optarg);
+        break;
+      case 'w':
+        window = std::stoul(optarg);
+        break;
+      case 'd':
+        dropRate = std::stod(optarg);
+        break;
+      case 't':
+        latency = std::stoul(optarg);
+        break;
+      case 'l':
+        legacyRowMax = std::stoul(optarg);
+        break;
+      case 's':
+        isServerOnly = true;
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  if(isServerOnly){
+    RbcpServer server(ip.empty()? "0.0.0.0" : ip, port, dropRate, std::chrono::microseconds(latency));
+    std::fprintf(stdout, "rbcp stand-in server at %s:%u\n", ip.empty()? "0.0.0.0" : ip.c_str(), port);
+    while(1){
+      std::this_thread::sleep_for(std::chrono::seconds(10));
+      std::fprintf(stdout, "frames %lu, dropped %lu, sensor writes %lu\n",
+                   server.NumFrames(), server.NumDropped(), server.NumSensorWrites());
+    }
+    return 0;
+  }
+
+  std::unique_ptr<RbcpServer> server;
+  if(ip.empty()){
+    ip = "127.0.0.1";
+    server.reset(new RbcpServer(ip, port, dropRate, std::chrono::microseconds(latency)));
+  }
+
+  auto ws = makeMaskStream(rowMax);
+  auto wsLegacy = makeMaskStream(legacyRowMax);
+  uint64_t digestRef = 0;
+
+  // drops make the client replay writes, the sequences are compared only without
+  auto report = [&](const char* name, size_t writeN, double sec, uint64_t frameN, uint64_t retransmitN){
+    std::fprintf(stdout, "%-12s %8zu writes %8.3f s %10.0f writes/s  frames %lu  retransmits %lu",
+                 name, writeN, sec, writeN/sec, frameN, retransmitN);
+    if(server){
+      uint64_t digest = server->SensorWriteDigest();
+      std::fprintf(stdout, "  sensor writes %lu", server->NumSensorWrites());
+      if(dropRate == 0 && writeN == ws.size()){
+        if(!digestRef){
+          digestRef = digest;
+        }
+        std::fprintf(stdout, digest == digestRef? " (same sequence)" : " (DIFFERENT sequence)");
+      }
+      server->ResetCounters();
+    }
+    std::fprintf(stdout, "\n");
+  };
+
+  if(legacyRowMax){
+    double sec = timeIt([&](){
+      for(auto &w: wsLegacy){
+        rbcp r(ip, port, 0);
+        r.DispatchCommand("wrb", w.address, w.value, NULL);
+      }
+    });
+    report("rbcp", wsLegacy.size(), sec, wsLegacy.size(), 0);
+  }
+
+  {
+    RbcpClient client(ip, port, 1, false);
+    double sec = timeIt([&](){
+      for(auto &w: ws){
+        client.Write(w.address, w.value);
+      }
+      client.Flush();
+    });
+    report("stop-and-wait", ws.size(), sec, client.NumFrames(), client.NumRetransmits());
+  }
+
+  {
+    RbcpClient client(ip, port, window, true);
+    double sec = timeIt([&](){
+      for(auto &w: ws){
+        client.Write(w.address, w.value);
+      }
+      client.Flush();
+    });
+    report("pipelined", ws.size(), sec, client.NumFrames(), client.NumRetransmits());
+  }
+
+  if(port == 4660){
+    Frontend fe("", "", "", ip, "rbcpbench", 0);
+    double sec = timeIt([&](){
+      fe.FlushPixelMask({{1, 1}, {100, 200}}, Frontend::MaskType::MASK);
+    });
+    std::fprintf(stdout, "Frontend::FlushPixelMask %.3f s\n", sec);
+
+    // the second configuration only writes what differs from the shadow
+    for(size_t n = 0; n < 2; n++){
+      uint64_t frameN = server? server->NumFrames() : 0;
+      sec = timeIt([&](){
+        fe.daq_conf_default();
+      });
+      std::fprintf(stdout, "Frontend::daq_conf_default %.3f s", sec);
+      if(server){
+        std::fprintf(stdout, ", frames %lu", server->NumFrames() - frameN);
+      }
+      std::fprintf(stdout, "\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <memory>
+
+#include "myspscring.hh"
+#include "getopt.h"
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -rate           <INT>        events per second pushed by producer, 0 for unlimited (default 1000000)
+  -seconds        <INT>        duration of the test (default 10)
+  -ringSize       <INT>        ring capacity (default 200000, as Frontend)
+
+Stress test of SpscRing as used by Frontend: one producer pushes numbered events
+(single and batch push), one consumer reads them (front/pop, batch pop, blocking wait).
+The consumer checks that every event arrives exactly once and in order.
+
+examples:
+./ringstress -rate 1000000 -seconds 20
+)";
+
+int main(int argc, char **argv){
+  uint64_t rate = 1000000;
+  uint64_t seconds = 10;
+  size_t ringSize = 200000;
+
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"rate", required_argument, NULL, 'r'},
+                                {"seconds", required_argument, NULL, 's'},
+                                {"ringSize", required_argument, NULL, 'n'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'r':
+        rate = std::stoul(optarg);
+        break;
+      case 's':
+        seconds = std::stoul(optarg);
+        break;
+      case 'n':
+        ringSize = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  using Event = std::shared_ptr<uint64_t>;
+  SpscRing<Event> ring(ringSize);
+  std::atomic<bool> producing{true};
+  uint64_t n_pushed = 0;
+  uint64_t n_full = 0;
+
+  auto tp_start = std::chrono::steady_clock::now();
+  auto tp_end = tp_start + std::chrono::seconds(seconds);
+
+  std::thread producer([&](){
+    std::mt19937 gen(1);
+    std::vector<Event> batch;
+    uint64_t seq = 0;
+    while(std::chrono::steady_clock::now() < tp_end){
+      if(rate){
+        // pace to the requested rate
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_start).count();
+        if(seq > sec * rate){
+          std::this_thread::yield();
+          continue;
+        }
+      }
+      if(gen()%4){
+        Event ev = std::make_shared<uint64_t>(seq);
+        if(ring.push(std::move(ev))){
+          seq++;
+        }
+        else{
+          n_full++;
+        }
+      }
+      else{
+        size_t n = gen()%32 + 1;
+        for(size_t i = 0; i < n; i++){
+          batch.push_back(std::make_shared<uint64_t>(seq + i));
+        }
+        size_t m = ring.push_batch(batch.begin(), batch.size());
+        if(m < n){
+          n_full++;
+        }
+        seq += m;
+        batch.clear();
+      }
+    }
+    n_pushed = seq;
+    producing = false;
+    ring.notify();
+  });
+
+  uint64_t n_popped = 0;
+  uint64_t n_lost = 0;
+  uint64_t n_dup = 0;
+  uint64_t n_wait = 0;
+  std::mt19937 gen(2);
+  std::vector<Event> batch(64);
+  auto check = [&](const Event& ev){
+    if(*ev > n_popped){
+      n_lost += *ev - n_popped;
+      n_popped = *ev + 1;
+    }
+    else if(*ev < n_popped){
+      n_dup++;
+    }
+    else{
+      n_popped++;
+    }
+  };
+  while(producing || !ring.empty()){
+    switch(gen()%3){
+    case 0:{
+      Event *p = ring.front();
+      if(p){
+        check(*p);
+        ring.pop();
+      }
+      break;
+    }
+    case 1:{
+      size_t m = ring.pop_batch(batch.begin(), batch.size());
+      for(size_t i = 0; i < m; i++){
+        check(batch[i]);
+        batch[i].reset();
+      }
+      break;
+    }
+    default:
+      if(!ring.wait_for(std::chrono::milliseconds(10))){
+        n_wait++;
+      }
+      break;
+    }
+  }
+  producer.join();
+
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_start).count();
+  std::fprintf(stdout, "pushed %lu, received %lu, lost %lu, duplicated %lu, ring full %lu times, wait timeout %lu times\n",
+               n_pushed, n_popped, n_lost, n_dup, n_full, n_wait);
+  std::fprintf(stdout, "%.0f events/s\n", n_popped/sec);
+  bool ok = (n_lost == 0 && n_dup == 0 && n_popped == n_pushed);
+  std::fprintf(stdout, "%s\n", ok? "PASS" : "FAIL");
+  return ok? 0 : 1;
+}
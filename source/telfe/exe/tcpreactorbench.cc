@@ -0,0 +1,271 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "TcpConnection.hh"
+#include "TcpReactor.hh"
+#include "getopt.h"
+
+static const std::string help_usage = R"(
+Usage:
+  -help                        help message
+  -layerMax       <INT>        largest number of simulated layers, runs 1, 2, 4 ... up to it (default 16)
+  -pixelN         <INT>        pixel words per packet (default 64)
+  -seconds        <FLOAT>      duration of each run (default 1)
+  -rate           <INT>        packets per second and layer of the latency runs (default 10000)
+  -threads        <INT>        reactor threads (default 1)
+  -rcvbuf         <INT>        reactor socket receive buffer in bytes (default 8388608)
+  -busyPoll       <INT>        microseconds the reactor spins before it blocks (default 0)
+  -port           <INT>        first loopback port of the simulated layers (default 24000)
+
+Each simulated layer is a thread serving framed data packets on a loopback tcp port, the
+first two words carry the send time. The layers are received once with a thread per
+TcpConnection as before and once through one TcpReactor. Full speed runs report the sustained
+MB/s of all layers, paced runs at -rate report the packet latency from send to callback.
+
+examples:
+./tcpreactorbench
+./tcpreactorbench -layerMax 16 -threads 2 -busyPoll 50 -rate 20000
+)";
+
+namespace{
+  uint64_t nowNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  struct Layer{
+    int sockListen{-1};
+    std::thread sender;
+    std::unique_ptr<TcpConnection> conn;
+    // written by the one thread receiving this layer
+    std::atomic<uint64_t> nByte{0};
+    std::atomic<uint64_t> nPack{0};
+    std::vector<uint32_t> latencyNs;
+    bool isLatency{false};
+  };
+
+  int recvPacket(void* pobj, void* /*pconn*/, std::string_view pak){
+    Layer *l = static_cast<Layer*>(pobj);
+    l->nByte += pak.size();
+    l->nPack ++;
+    if(l->isLatency && pak.size() >= 14){
+      uint64_t ts = 0;
+      for(size_t n = 0; n < 8; n++){
+        ts = (ts<<8) | uint8_t(pak[6 + n]);
+      }
+      l->latencyNs.push_back(uint32_t(std::min<uint64_t>(nowNs() - ts, 0xffffffff)));
+    }
+    return 0;
+  }
+
+  int listenLoopback(uint16_t port){
+    int sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int one = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sockfd, 1) != 0){
+      std::fprintf(stderr, "tcpreactorbench: unable to listen on port %u\n", port);
+      throw;
+    }
+    return sockfd;
+  }
+
+  void sendLayer(int sockListen, uint8_t daqid, uint16_t pixelN, uint64_t rate, const std::atomic<bool>* isRunning){
+    int sockfd = accept(sockListen, nullptr, nullptr);
+    if(sockfd < 0){
+      return;
+    }
+    std::vector<char> pack(8 + 4 * size_t(pixelN), 0);
+    pack[0] = char(0xaa);
+    pack[1] = char(daqid);
+    pack[4] = char(pixelN>>8);
+    pack[5] = char(pixelN);
+    pack[pack.size()-2] = char(0xcc);
+    pack[pack.size()-1] = char(0xcc);
+    uint16_t tid = 0;
+    auto tp_next = std::chrono::steady_clock::now();
+    while(*isRunning){
+      if(rate){
+        tp_next += std::chrono::nanoseconds(1000000000 / rate);
+        std::this_thread::sleep_until(tp_next);
+      }
+      pack[2] = char(tid>>8);
+      pack[3] = char(tid);
+      tid++;
+      uint64_t ts = nowNs();
+      for(size_t n = 0; n < 8; n++){
+        pack[6 + n] = char(ts>>(56 - 8*n));
+      }
+      const char *p = pack.data();
+      size_t len = pack.size();
+      while(len){
+        ssize_t written = send(sockfd, p, len, MSG_NOSIGNAL);
+        if(written <= 0){
+          close(sockfd);
+          return;
+        }
+        p += written;
+        len -= written;
+      }
+    }
+    close(sockfd);
+  }
+
+  void runLayers(const char* name, size_t layerN, uint16_t port, uint16_t pixelN, double seconds,
+                 uint64_t rate, TcpReactor* reactor){
+    std::vector<std::unique_ptr<Layer>> layers;
+    std::atomic<bool> isRunning{true};
+    for(size_t n = 0; n < layerN; n++){
+      std::unique_ptr<Layer> l(new Layer);
+      l->sockListen = listenLoopback(port + n);
+      l->sender = std::thread(&sendLayer, l->sockListen, uint8_t(n), pixelN, rate, &isRunning);
+      l->isLatency = rate;
+      if(rate){
+        l->latencyNs.reserve(size_t(rate * seconds * 2) + 1024);
+      }
+      layers.push_back(std::move(l));
+    }
+    for(auto &l: layers){
+      l->conn = TcpConnection::connectToServer("127.0.0.1", port + (&l - &layers[0]), &recvPacket, nullptr, l.get(), reactor);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // warm up
+    uint64_t nByte0 = 0;
+    uint64_t nPack0 = 0;
+    for(auto &l: layers){
+      nByte0 += l->nByte;
+      nPack0 += l->nPack;
+    }
+    auto tp_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    uint64_t nByte = 0;
+    uint64_t nPack = 0;
+    for(auto &l: layers){
+      nByte += l->nByte;
+      nPack += l->nPack;
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_start).count();
+
+    isRunning = false;
+    for(auto &l: layers){
+      shutdown(l->sockListen, SHUT_RDWR); // in case the layer was never connected
+      l->sender.join();
+      close(l->sockListen);
+    }
+    std::vector<uint32_t> latency;
+    for(auto &l: layers){
+      l->conn.reset(); // the receiving thread is done with the layer here
+      latency.insert(latency.end(), l->latencyNs.begin(), l->latencyNs.end());
+    }
+
+    std::fprintf(stdout, "%-10s layers %2zu  %9.1f MB/s  %10.0f packets/s", name, layerN,
+                 (nByte - nByte0) / sec / 1e6, (nPack - nPack0) / sec);
+    if(rate && !latency.empty()){
+      std::sort(latency.begin(), latency.end());
+      std::fprintf(stdout, "  latency median %7.1f us  p99 %8.1f us",
+                   latency[latency.size()/2] / 1e3, latency[latency.size()*99/100] / 1e3);
+    }
+    std::fprintf(stdout, "\n");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t layerMax = 16;
+  uint16_t pixelN = 64;
+  double seconds = 1;
+  uint64_t rate = 10000;
+  size_t threadN = 1;
+  size_t rcvbuf = 8<<20;
+  uint32_t busyPoll = 0;
+  uint16_t port = 24000;
+  {////////////getopt begin//////////////////
+    struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+                                {"layerMax", required_argument, NULL, 'l'},
+                                {"pixelN", required_argument, NULL, 'n'},
+                                {"seconds", required_argument, NULL, 's'},
+                                {"rate", required_argument, NULL, 'r'},
+                                {"threads", required_argument, NULL, 't'},
+                                {"rcvbuf", required_argument, NULL, 'b'},
+                                {"busyPoll", required_argument, NULL, 'p'},
+                                {"port", required_argument, NULL, 'o'},
+                                {0, 0, 0, 0}};
+    int c;
+    int longindex;
+    opterr = 1;
+    while ((c = getopt_long_only(argc, argv, "-", longopts, &longindex)) != -1) {
+      switch (c) {
+      case 'l':
+        layerMax = std::stoul(optarg);
+        break;
+      case 'n':
+        pixelN = std::stoul(optarg);
+        break;
+      case 's':
+        seconds = std::stod(optarg);
+        break;
+      case 'r':
+        rate = std::stoul(optarg);
+        break;
+      case 't':
+        threadN = std::stoul(optarg);
+        break;
+      case 'b':
+        rcvbuf = std::stoul(optarg);
+        break;
+      case 'p':
+        busyPoll = std::stoul(optarg);
+        break;
+      case 'o':
+        port = std::stoul(optarg);
+        break;
+      case 'h':
+        std::fprintf(stdout, "%s\n", help_usage.c_str());
+        std::exit(0);
+        break;
+      default:
+        std::fprintf(stderr, "%s\n", help_usage.c_str());
+        std::exit(1);
+        break;
+      }
+    }
+  }/////////getopt end////////////////
+
+  TcpReactor reactor(threadN, rcvbuf, busyPoll);
+  std::vector<uint64_t> rates{0};
+  if(rate){
+    rates.push_back(rate);
+  }
+  // a fresh port range per run, the previous ones may linger in TIME_WAIT
+  uint16_t portNext = port;
+  for(uint64_t r: rates){
+    if(r){
+      std::fprintf(stdout, "paced at %lu packets/s per layer, %u words per packet\n", r, pixelN);
+    }
+    else{
+      std::fprintf(stdout, "full speed, %u words per packet\n", pixelN);
+    }
+    for(size_t layerN = 1; layerN <= layerMax; layerN *= 2){
+      runLayers("threads", layerN, portNext, pixelN, seconds, r, nullptr);
+      portNext += layerN;
+      runLayers("reactor", layerN, portNext, pixelN, seconds, r, &reactor);
+      portNext += layerN;
+    }
+  }
+  return 0;
+}
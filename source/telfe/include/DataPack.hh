@@ -27,12 +27,33 @@ struct DataPack{
     uint16_t tid;
     uint16_t len;
     uint16_t packend;
-    std::string packraw;
   std::shared_ptr<altel::TelEvent> telev_pack;
-  
+
+    // decodes straight from the receive buffer, no copy of the packet is kept.
+    // a re-used DataPack keeps the capacity of vecpixel and of its TelEvent.
+    int MakeDataPack(const char* data, size_t size);
     int MakeDataPack(const std::string& str);
     bool CheckDataPack();
 };
 
 
 using DataPackSP = std::shared_ptr<DataPack>;
+
+// Recycles DataPacks of one data link. A pooled DataPack is handed out again
+// once nobody else holds it (use_count()==1), so the consumer side needs no
+// change: dropping the DataPackSP returns it. Acquire() is for the single
+// producer thread only.
+class DataPackPool{
+public:
+  DataPackPool(size_t capacity);
+  DataPackSP Acquire();
+
+  size_t Size() const {return m_pool.size();}
+  uint64_t NumMiss() const {return m_n_miss;}
+
+private:
+  std::vector<DataPackSP> m_pool;
+  size_t m_capacity{0};
+  size_t m_cursor{0};
+  uint64_t m_n_miss{0};
+};
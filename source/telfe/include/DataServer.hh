@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <random>
+
+// Stand-in for the TCP data link of a DAQ board, the counterpart of RbcpServer, to run
+// Frontend, Telescope and the producers without hardware.
+//
+// Accepts one client at a time on a TCP port, as Frontend connects to port 24 of a board,
+// and sends the packets DataPack::MakeDataPack parses: 0xaa, daqid, tid, length, big-endian
+// pixel words, 0xcccc. Packets are synthesised, with a Poisson number of random pixels per
+// trigger, or replayed from a raw stream as datatool records it. Triggers come at a fixed
+// rate, 0 for as fast as the client takes them, and only while isUploading() returns true,
+// which e.g. follows the upload_data register of an RbcpServer.
+//
+// Faults: a fraction of the triggers is not sent (dropRate), a fraction of the packets gets
+// a broken trailer (corruptRate), and the trigger id sent runs tidSkew ahead of the trigger.
+class DataServer{
+public:
+  struct Config{
+    uint8_t daqid{0};
+    double rate{1000};      // triggers per second
+    double occupancy{4};    // mean pixels per trigger
+    double dropRate{0};
+    double corruptRate{0};
+    uint16_t tidSkew{0};
+    uint64_t seed{1};
+    // replayed in a loop instead of synthesised packets when not empty, the daqid of each
+    // is replaced by the one above
+    std::vector<std::string> replay;
+  };
+
+  DataServer(const std::string& ip, uint16_t port, const Config& conf,
+             std::function<bool()> isUploading = nullptr);
+  ~DataServer();
+  DataServer(const DataServer&) =delete;
+  DataServer& operator=(const DataServer&) =delete;
+
+  // splits a raw stream into packets, bytes outside of the framing are skipped
+  static std::vector<std::string> ReadRawFile(const std::string& path);
+
+  uint64_t NumTriggers() const {return m_n_trigger;}
+  uint64_t NumPackets() const {return m_n_pack;}
+  uint64_t NumBytes() const {return m_n_byte;}
+  uint64_t NumDropped() const {return m_n_dropped;}
+  uint64_t NumCorrupted() const {return m_n_corrupted;}
+  uint64_t NumClients() const {return m_n_client;}
+
+private:
+  void AsyncServe();
+  // returns once the client is gone
+  void ServeClient(int sockfd);
+  void MakePacket(uint16_t tid, std::string& pack);
+  bool SendAll(int sockfd, const char* p, size_t len);
+
+  int m_sock{-1};
+  Config m_conf;
+  std::function<bool()> m_is_uploading;
+  std::vector<std::string> m_replay;
+  size_t m_replay_n{0};
+  std::mt19937_64 m_gen;
+
+  std::atomic<uint64_t> m_n_trigger{0};
+  std::atomic<uint64_t> m_n_pack{0};
+  std::atomic<uint64_t> m_n_byte{0};
+  std::atomic<uint64_t> m_n_dropped{0};
+  std::atomic<uint64_t> m_n_corrupted{0};
+  std::atomic<uint64_t> m_n_client{0};
+
+  std::atomic<bool> m_is_running{true};
+  std::thread m_fut_serve;
+};
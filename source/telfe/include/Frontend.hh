@@ -10,7 +10,9 @@
 #include <ctime>
 #include <regex>
 #include <map>
+#include <unordered_map>
 #include <set>
+#include <array>
 #include <vector>
 #include <utility>
 #include <algorithm>
@@ -24,9 +26,14 @@
 #include "DataPack.hh"
 #include "mysystem.hh"
 #include "myrapidjson.h"
+#include "myspscring.hh"
 
 #include "Utility.hh"
 
+class RbcpClient;
+class TcpReactor;
+namespace mymetrics{class Counter; class Gauge; class Histogram;}
+
 class Frontend{
 public:
   enum MaskType {MASK, CAL, UNMASK, UNCAL};
@@ -42,6 +49,9 @@ public:
 
   const std::string& GetName(){return m_name;};
 
+  // data link of the next run is received by the reactor instead of an own thread, nullptr for the latter
+  void SetReactor(TcpReactor* reactor){m_reactor = reactor;};
+
   // bool OpenTCP(const std::string& ip);
   // bool OpenUDP(const std::string& ip);
 
@@ -64,6 +74,33 @@ private:
   void  WriteByte(uint64_t address, uint64_t value);
   uint64_t ReadByte(uint64_t address);
 
+  // register writes until the outermost EndBatch() are pipelined and acknowledged there
+  void BeginBatch();
+  void EndBatch();
+  bool FlushRegisters();
+
+  // indirect sensor register access through 0x0021-0x0024, writes equal to the shadow are skipped
+  void WriteSensorByte(uint64_t address, uint8_t value);
+  uint8_t ReadSensorByte(uint64_t address);
+
+  struct RegDesc{
+    uint64_t address{0};
+    uint64_t mask{0xff};
+    uint8_t offset{0};
+    bool isReadable{true};
+    bool isWritable{true};
+  };
+
+  static void CompileRegisterMap(const rapidjson::Value& json_array, const std::string& array_name,
+                                 bool isSensor, std::unordered_map<std::string, RegDesc>& mapReg);
+  static const RegDesc& FindRegister(const std::unordered_map<std::string, RegDesc>& mapReg,
+                                     const std::string& array_name, const std::string& name);
+
+public:
+  // forgets the shadow of sensor registers and pixel masks, e.g. after a reset or a power cycle,
+  // so that the next configuration writes everything again
+  void ClearShadow();
+
 public:
 
 
@@ -87,6 +124,8 @@ public:
 private:
 
   std::string m_netip;
+  std::unique_ptr<RbcpClient> m_rbcp;
+  uint64_t m_batch_level{0};
   uint64_t m_daqid{0};
   std::string m_name{"unamed"};
   
@@ -94,18 +133,31 @@ private:
   rapidjson::Document m_jsdoc_firmware;
   rapidjson::Document m_jsdoc_setup;
 
+  // compiled once from the json documents
+  std::unordered_map<std::string, RegDesc> m_map_firmware_reg;
+  std::unordered_map<std::string, RegDesc> m_map_sensor_reg;
+
+  // last written value per sensor register address. Cleared with every chip_reset/global_reset
+  // sequence, so the configuration after daq_stop_run or daq_reset writes everything again.
+  std::array<bool, 32> m_sensor_cacheable;
+  std::array<bool, 32> m_sensor_shadow_valid;
+  std::array<uint8_t, 32> m_sensor_shadow;
+
+  // last flushed pixel mask, [0] latched by load_m, [1] by load_c
+  std::array<bool, 2> m_mask_shadow_valid;
+  std::array<MaskType, 2> m_mask_shadow_type;
+  std::array<std::set<std::pair<uint16_t, uint16_t>>, 2> m_mask_shadow;
+
   /////////////////////////////////////////////////////
 
 
 public:
   std::future<uint64_t> m_fut_async_watch;
-  std::vector<DataPackSP> m_vec_ring_ev;
+  std::unique_ptr<SpscRing<DataPackSP>> m_ring_ev; // written by tcp recv thread, read by one consumer
   DataPackSP m_ring_end;
+  std::unique_ptr<DataPackPool> m_pack_pool;
 
   uint64_t m_size_ring{200000};
-  std::atomic<uint64_t> m_count_ring_write;
-  std::atomic<uint64_t> m_hot_p_read;
-  uint64_t m_count_ring_read;
   bool m_is_async_watching{false};
 
   uint64_t m_extension{0};
@@ -116,6 +168,7 @@ public:
   std::atomic<uint64_t> m_st_n_ev_output_now{0};
   std::atomic<uint64_t> m_st_n_ev_bad_now{0};
   std::atomic<uint64_t> m_st_n_ev_overflow_now{0};
+  std::atomic<uint64_t> m_st_n_reg_error_now{0}; // failed register batches, never reset
   std::atomic<uint64_t> m_st_n_tg_ev_begin{0};
 
   uint64_t m_st_n_tg_ev_old{0};
@@ -129,22 +182,33 @@ public:
   uint32_t m_tg_expected{0};
   uint32_t m_flag_wait_first_event{true};
 
+  // cumulative over runs, in mymetrics::Registry labelled by layer name
+  mymetrics::Counter* m_mt_packets{nullptr};
+  mymetrics::Counter* m_mt_bad{nullptr};
+  mymetrics::Counter* m_mt_overflow{nullptr};
+  mymetrics::Gauge* m_mt_ring_fill{nullptr};
+  mymetrics::Histogram* m_mt_decode_ns{nullptr};
+
   bool m_isDataAccept{false};
+  TcpReactor* m_reactor{nullptr};
   std::unique_ptr<TcpConnection> m_tcpcon;
 public:
 
   ~Frontend();
 
   void daq_start_run();
+  // everything of daq_start_run() but enabling upload_data
+  void daq_prepare_run();
   void daq_stop_run();
   void daq_reset();
   void daq_conf_default();
 
-  int perConnProcessRecvMesg(void* pconn, const std::string& pak);
+  int perConnProcessRecvMesg(void* pconn, std::string_view pak);
 
   DataPackSP& Front();
   void PopFront();
   uint64_t Size();
+  bool WaitFront(const std::chrono::microseconds& timeout);
 
   void ClearBuffer();
   std::string GetStatusString();
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <array>
+#include <chrono>
+
+// RBCP (SiTCP register access over UDP) with one socket per board and a
+// window of transactions in flight.
+//
+// Write() and Read() only queue a transaction. Writes to consecutive addresses
+// are merged into one frame of up to 255 bytes; the frame is sent when it is
+// closed by a non-consecutive access, a read or Flush(). Frames are sent in
+// queue order while fewer than window are unacknowledged, and acks are matched
+// to frames by the 8-bit RBCP id. When the oldest frame times out, it and all
+// later frames in flight are sent again in order (go-back-N): writes behind a
+// lost frame may be executed twice, but the board always ends with them applied
+// in the order of the caller. A window of 1 without coalescing is the plain
+// stop-and-wait of class rbcp, on a persistent socket. An instance is used by one thread at a time.
+class RbcpClient{
+public:
+  RbcpClient(const std::string& ip, uint16_t port = 4660, size_t window = 32, bool isCoalescing = true);
+  ~RbcpClient();
+  RbcpClient() = delete;
+  RbcpClient(const RbcpClient&) =delete;
+  RbcpClient& operator=(const RbcpClient&) =delete;
+
+  void Write(uint32_t address, uint8_t value);
+  void Write(uint32_t address, const uint8_t* data, size_t n);
+
+  // dst is filled when the ack arrives, at the latest when Flush() returns
+  void Read(uint32_t address, uint8_t* dst, size_t n);
+
+  // sends all queued transactions and waits for their acks, false if any of
+  // them failed since the last Flush()
+  bool Flush();
+
+  size_t Window() const {return m_window;}
+  uint64_t NumFrames() const {return m_n_frame;}
+  uint64_t NumRetransmits() const {return m_n_retransmit;}
+
+  static const size_t s_header_size = 8;
+  static const size_t s_frame_data_max = 255;
+
+private:
+  struct Frame{
+    std::array<uint8_t, s_header_size + s_frame_data_max> buf;
+    uint16_t size{0};
+    uint8_t* dst{nullptr};
+    std::chrono::steady_clock::time_point tp_sent;
+    size_t retransmit{0};
+    bool isAcked{false};
+
+    uint8_t  command() const {return buf[1];}
+    uint8_t  id() const {return buf[2];}
+    uint8_t  length() const {return buf[3];}
+    uint32_t address() const {
+      return (uint32_t(buf[4])<<24) | (uint32_t(buf[5])<<16) | (uint32_t(buf[6])<<8) | buf[7];
+    }
+  };
+
+  void OpenFrame(uint8_t command, uint32_t address);
+  void CloseFrame();
+  void SendFrame(Frame& f);
+  // sends what the window allows and handles acks, waits for at least one ack when blocking
+  void Pump(bool isBlocking);
+  void ReceiveAcks(int timeout_ms);
+  void FailAll(const char* reason);
+
+  std::string m_ip;
+  uint16_t m_port;
+  size_t m_window;
+  bool m_is_coalescing;
+  int m_sock{-1};
+
+  std::chrono::milliseconds m_timeout{200};
+  size_t m_retransmit_max{3};
+
+  Frame m_open;             // frame being filled, not queued yet
+  bool m_is_open{false};
+  std::deque<Frame> m_frames; // [0, m_n_inflight) sent, the rest waiting for the window
+  size_t m_n_inflight{0};
+  uint8_t m_id{0};
+  bool m_is_failed{false};
+
+  uint64_t m_n_frame{0};
+  uint64_t m_n_retransmit{0};
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <array>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+
+// Stand-in for the RBCP register interface of a DAQ board, to run Frontend and
+// benchmarks without hardware.
+//
+// Answers RBCP frames on a UDP port from a 64 kB register space, byte by byte in
+// address order as the SiTCP bus does. Writes to 0x0021 emulate the indirect
+// sensor access of the firmware: value 0 writes register 0x0023 to sensor
+// register [0x0022], value 1 copies sensor register [0x0022] to 0x0024.
+// A fraction dropRate of the incoming frames is dropped unanswered, and acks
+// leave latency after the frame came in, to mimic the round trip to a board.
+class RbcpServer{
+public:
+  RbcpServer(const std::string& ip, uint16_t port = 4660, double dropRate = 0,
+             std::chrono::microseconds latency = std::chrono::microseconds(0));
+  ~RbcpServer();
+  RbcpServer(const RbcpServer&) =delete;
+  RbcpServer& operator=(const RbcpServer&) =delete;
+
+  uint8_t Register(uint32_t address);
+  uint8_t SensorRegister(uint8_t address);
+
+  // hash over the sequence of (sensor register, value) writes, comparable between runs
+  uint64_t SensorWriteDigest();
+  void ResetCounters();
+
+  uint64_t NumFrames() const {return m_n_frame;}
+  uint64_t NumDropped() const {return m_n_dropped;}
+  uint64_t NumSensorWrites() const {return m_n_sensor_write;}
+
+private:
+  void AsyncServe();
+  void WriteRegister(uint32_t address, uint8_t value);
+
+  int m_sock{-1};
+  double m_drop_rate;
+  std::chrono::microseconds m_latency;
+  std::mt19937 m_gen{1};
+
+  std::mutex m_mx;
+  std::vector<uint8_t> m_regs;
+  std::array<uint8_t, 32> m_sensor_regs;
+  uint64_t m_digest;
+
+  std::atomic<uint64_t> m_n_frame{0};
+  std::atomic<uint64_t> m_n_dropped{0};
+  std::atomic<uint64_t> m_n_sensor_write{0};
+
+  std::atomic<bool> m_is_running{true};
+  std::thread m_fut_serve;
+};
@@ -1,10 +1,26 @@
 #pragma once
 
 #include<cstddef>
+#include<cstdint>
 #include<string>
-
+#include<string_view>
+#include<vector>
+
+//HEAD       DAQ_ID   TS_TID_H  TS_TID_L  LEN_H      LEN_L      TaichuRAW_32bit * N            ENDH       ENDL
+//10101010  xxxxxxxx  xxxxxxxx  xxxxxxxx  xxxxxxxx   xxxxxxxx  {bit_last ---- bit_first} * N   11001100   11001100
+//
+// Fixed-capacity circular byte buffer with packet framing.
+// getpacket() returns a view into the ring, valid until the next append().
+// A packet crossing the ring end is made contiguous by copying its wrapped
+// part behind the ring (mirror area of one maximum packet), so the stream is
+// never shifted.
 class StreamInBuffer{
 public:
+    static constexpr size_t s_max_packet_size = 8 + 0xffff * 4;
+
+    // capacity is rounded up to power of 2
+    StreamInBuffer(size_t capacity = (1<<22));
+
     void append(size_t length, const char *data);
 
     bool havepacket() const;
@@ -12,15 +28,24 @@ public:
     bool havepacket_possible() const;
     void  resyncpacket();
 
-    std::string getpacket();
+    std::string_view getpacket();
 
     void dump(size_t maxN);
 
     void resyncpackethead();
+
+    size_t size() const {return m_tail - m_head;}
 private:
     void updatelength(bool force);
+    uint8_t at(size_t offset) const {return m_buf[(m_head + offset) & m_mask];}
+    void erase(size_t n);
+    size_t find(uint8_t c, size_t from) const;
+    size_t findtrailer() const;
+
+    size_t m_capacity{0};
+    size_t m_mask{0};
+    std::vector<char> m_buf;
+    uint64_t m_head{0}; // read position, not wrapped
+    uint64_t m_tail{0}; // write position, not wrapped
     size_t m_len{0};
-    std::string m_buf;
 };
-
-
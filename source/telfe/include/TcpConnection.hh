@@ -5,6 +5,7 @@
 #include <cstdlib>
 
 #include <string>
+#include <string_view>
 #include <future>
 #include <memory>
 #include <chrono>
@@ -13,9 +14,10 @@
 #include "StreamInBuffer.hh"
 
 class TcpConnection;
+class TcpReactor;
 
 //callback
-typedef int (*FunProcessMessage)(void* pobj, void* pconn,  const std::string& pak);
+typedef int (*FunProcessMessage)(void* pobj, void* pconn,  std::string_view pak);
 typedef int (*FunSendDeamon)(void* pobj, void*pconn);
 
 class TcpConnection{
@@ -23,14 +25,21 @@ public:
   TcpConnection() = delete;
   TcpConnection(const TcpConnection&) =delete;
   TcpConnection& operator=(const TcpConnection&) =delete;
-  TcpConnection(int sockfd, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj);
+  // with a reactor, recvFun is called from a thread of the reactor instead of an own thread
+  TcpConnection(int sockfd, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj, TcpReactor* reactor = nullptr);
 
   ~TcpConnection();
 
   operator bool() const;
 
   //forked thread
-  uint64_t threadConnRecv(FunProcessMessage recvFun, void* pobj);
+  uint64_t threadConnRecv();
+
+  // recv until the socket is drained or after readMax reads, and pass on the complete packets.
+  // false once the connection is closed or recvFun failed
+  bool readSocket(char* buffer, size_t size, size_t readMax);
+
+  int sockfd() const {return m_sockfd;}
 
   void sendRaw(const char* buf, size_t len);
 
@@ -39,7 +48,7 @@ public:
   static void closeSocket(int& sockfd);
 
   //client side
-  static std::unique_ptr<TcpConnection> connectToServer(const std::string& host,  short int port, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj);
+  static std::unique_ptr<TcpConnection> connectToServer(const std::string& host,  short int port, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj, TcpReactor* reactor = nullptr);
   //server side
   static int createServerSocket(short int port);
   static std::unique_ptr<TcpConnection> waitForNewClient(int sockfd, const std::chrono::milliseconds &timeout, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj);
@@ -53,6 +62,9 @@ private:
   std::future<int> m_fut_send;
   bool m_isAlive{false};
   int m_sockfd{-1};
+  FunProcessMessage m_recv_fun{nullptr};
+  void* m_pobj{nullptr};
+  TcpReactor* m_reactor{nullptr};
 
   StreamInBuffer m_tcpbuf;
 };
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+class TcpConnection;
+
+// Receives on the data sockets of many TcpConnections from a few epoll threads,
+// instead of one polling thread per connection.
+//
+// Each connection is served by one thread, assigned round-robin, so packets of a
+// connection reach its callback in order and from one thread. Sockets get a
+// receive buffer of rcvbuf bytes. With busyPollUs, a thread spins on epoll for
+// that long before it blocks, and asks the kernel for SO_BUSY_POLL, trading cpu
+// for latency.
+class TcpReactor{
+public:
+  TcpReactor(size_t threadN = 1, size_t rcvbuf = (8<<20), uint32_t busyPollUs = 0);
+  ~TcpReactor();
+  TcpReactor(const TcpReactor&) =delete;
+  TcpReactor& operator=(const TcpReactor&) =delete;
+
+  // applied to a socket before it connects, so the tcp window scales with it
+  void setupSocket(int sockfd) const;
+
+  void add(TcpConnection* conn, int sockfd);
+  // returns once no thread of the reactor touches conn any more
+  void remove(TcpConnection* conn);
+
+  size_t threadN() const {return m_workers.size();}
+
+  static const size_t s_read_size = (1<<18);
+  static const size_t s_read_max_per_event = 4; // reads of one socket before the next gets its turn
+
+private:
+  struct Worker{
+    int epfd{-1};
+    std::mutex mx;          // held while callbacks run, remove() waits on it
+    std::map<uint64_t, TcpConnection*> conns;
+    std::thread thread;
+  };
+
+  void threadServe(Worker* w);
+
+  size_t m_rcvbuf;
+  uint32_t m_busy_poll_us;
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::atomic<bool> m_is_running{true};
+
+  std::mutex m_mx;
+  uint64_t m_id_next{1};
+  size_t m_worker_next{0};
+  std::map<TcpConnection*, std::pair<Worker*, uint64_t>> m_conn_worker;
+};
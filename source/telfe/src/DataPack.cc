@@ -2,8 +2,15 @@
 
 #include <iostream>
 #include <bitset>
+#include <cstring>
+#include <atomic>
 
 #include "mysystem.hh"
+#include "mymetrics.hh"
+
+#ifndef DEBUG_PRINT
+#define DEBUG_PRINT 0
+#endif
 
 PixelWord::PixelWord(const uint32_t v){ //BE32TOH
     // valid(1) tschip(8) raw_dcol[9]  raw_row[10] pattern[4]
@@ -33,27 +40,32 @@ PixelWord::PixelWord(const uint32_t v){ //BE32TOH
 }
 
 int DataPack::MakeDataPack(const std::string& str){
-    static size_t n = 0;
-    if(n<100){
-        n++;
-        std::cout<< "==============="<<std::endl;
-        std::cout<< "0------0 1------1 2------2 3------3 4------4 5------5 6------6 7------7 "<<std::endl;
-        for(auto e: str){
-            std::bitset<8> rawbit(e);
-            std::cout<< rawbit<<" ";
+    return MakeDataPack(str.data(), str.size());
+}
+
+int DataPack::MakeDataPack(const char* data, size_t size){
+    if(DEBUG_PRINT){
+        static size_t n = 0;
+        if(n<100){
+            n++;
+            std::cout<< "==============="<<std::endl;
+            std::cout<< "0------0 1------1 2------2 3------3 4------4 5------5 6------6 7------7 "<<std::endl;
+            for(size_t i = 0; i < size; i++){
+                std::bitset<8> rawbit(data[i]);
+                std::cout<< rawbit<<" ";
+            }
+            std::cout<<std::endl<<"==============="<<std::endl;
         }
-        std::cout<<std::endl<<"==============="<<std::endl;
     }
 
-    int miniPackLength=8;
-    if(str.size()<miniPackLength){
-        std::cout<<"DataPack::MakeDataPack: str size wrong="<<str.size()<<std::endl;
+    size_t miniPackLength=8;
+    if(size<miniPackLength){
+        std::cout<<"DataPack::MakeDataPack: str size wrong="<<size<<std::endl;
         throw;
         return -1;
     }
 
-    packraw = str;
-    const uint8_t *p = reinterpret_cast<const uint8_t*>(packraw.data());
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
     packhead = *p;
     p++;
     daqid = *p;
@@ -69,18 +81,41 @@ int DataPack::MakeDataPack(const std::string& str){
     len += *p;
     p++;
 
-    telev_pack = std::make_shared<altel::TelEvent>(0, 0, daqid, tid);
+    if(size < miniPackLength + size_t(len)*4){
+        std::cout<<"DataPack::MakeDataPack: str size="<<size<<" is shorter than pixel word number="<<len<<std::endl;
+        return -1;
+    }
+
+    if(telev_pack && telev_pack.use_count() == 1){
+        // nobody else holds the previous event, reuse it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        telev_pack->RN = 0;
+        telev_pack->EN = 0;
+        telev_pack->DN = daqid;
+        telev_pack->CK = tid;
+        telev_pack->MRs.clear();
+        telev_pack->TJs.clear();
+    }
+    else{
+        telev_pack = std::make_shared<altel::TelEvent>(0, 0, daqid, tid);
+    }
+    vecpixel.clear();
+
     uint16_t pixelwordN = len;
     for(size_t n = 0; n< pixelwordN; n++){
-        uint32_t v  = BE32TOH(*reinterpret_cast<const uint32_t*>(p));
-        vecpixel.emplace_back(v);
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v)); // receive buffer is not aligned
+        vecpixel.emplace_back(BE32TOH(v));
         if(vecpixel.back().isvalid){
           telev_pack->MRs.emplace_back(vecpixel.back().xcol, vecpixel.back().yrow, daqid, tid);
         }
         p += 4;
     }
-    if(telev_pack->MRs.size()){
-      telev_pack->MHs = altel::TelMeasHit::clustering_UVDCus(telev_pack->MRs);
+    // MHs of a reused event are recycled by the clustering
+    static auto& s_mt_clustering_ns = mymetrics::Registry::instance().histogram("daq_clustering_ns", "clustering of one data packet");
+    {
+      mymetrics::ScopedTimer timer(s_mt_clustering_ns);
+      altel::TelMeasHit::clustering_UVDCus(telev_pack->MRs, telev_pack->MHs);
     }
     packend = *p;
     p++;
@@ -109,3 +144,31 @@ bool DataPack::CheckDataPack(){
     }
     return check_pack && check_pixel;
 };
+
+DataPackPool::DataPackPool(size_t capacity)
+  :m_capacity(capacity){
+  m_pool.reserve(capacity);
+}
+
+DataPackSP DataPackPool::Acquire(){
+  static auto& s_mt_pool_miss = mymetrics::Registry::instance().counter("daq_pack_pool_miss_total", "DataPacks allocated beyond the pools, all pooled ones in use");
+  // consumer releases in fifo order, the oldest pooled pack is the likely free one.
+  // Packs held longer, e.g. by a pending event, are stepped over.
+  for(size_t n = 0; n < m_pool.size(); n++){
+    DataPackSP& dp = m_pool[m_cursor];
+    m_cursor = (m_cursor + 1) % m_pool.size();
+    if(dp.use_count() == 1){
+      // pairs with the release of the last consumer reference
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return dp;
+    }
+  }
+  if(m_pool.size() < m_capacity){
+    m_pool.push_back(std::make_shared<DataPack>());
+    return m_pool.back();
+  }
+  // all pooled packs are in use, ring is (nearly) full
+  m_n_miss ++;
+  s_mt_pool_miss.add();
+  return std::make_shared<DataPack>();
+}
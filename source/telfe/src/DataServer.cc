@@ -0,0 +1,213 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "DataServer.hh"
+#include "StreamInBuffer.hh"
+
+namespace{
+  // packets of a trigger burst are sent together, when the client lags behind or at rate 0
+  const size_t s_send_batch_size = 64 * 1024;
+}
+
+DataServer::DataServer(const std::string& ip, uint16_t port, const Config& conf,
+                       std::function<bool()> isUploading)
+  :m_conf(conf), m_is_uploading(std::move(isUploading)), m_gen(conf.seed){
+  m_replay = std::move(m_conf.replay);
+  for(auto &pack: m_replay){
+    pack[1] = char(m_conf.daqid);
+  }
+  m_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if(m_sock < 0){
+    std::fprintf(stderr, "DataServer: unable to create socket\n");
+    throw;
+  }
+  int reuse = 1;
+  setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = inet_addr(ip.c_str());
+  if(bind(m_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_sock, 1) != 0){
+    std::fprintf(stderr, "DataServer: unable to listen on %s:%u, errno %d\n", ip.c_str(), port, errno);
+    close(m_sock);
+    throw;
+  }
+  m_fut_serve = std::thread(&DataServer::AsyncServe, this);
+}
+
+DataServer::~DataServer(){
+  m_is_running = false;
+  if(m_fut_serve.joinable()){
+    m_fut_serve.join();
+  }
+  close(m_sock);
+}
+
+std::vector<std::string> DataServer::ReadRawFile(const std::string& path){
+  std::ifstream ifs(path, std::ios::binary);
+  if(!ifs.good()){
+    std::fprintf(stderr, "DataServer: unable to open raw file %s\n", path.c_str());
+    throw;
+  }
+  std::vector<std::string> packs;
+  StreamInBuffer buf;
+  std::vector<char> chunk(1<<20);
+  while(ifs){
+    ifs.read(chunk.data(), chunk.size());
+    buf.append(ifs.gcount(), chunk.data());
+    while(buf.havepacket()){
+      std::string_view pak = buf.getpacket();
+      if(pak.size() >= 8 && uint8_t(pak[0]) == 0xaa &&
+         uint8_t(pak[pak.size()-2]) == 0xcc && uint8_t(pak[pak.size()-1]) == 0xcc){
+        packs.emplace_back(pak);
+      }
+      else{
+        buf.resyncpacket();
+      }
+    }
+  }
+  return packs;
+}
+
+void DataServer::MakePacket(uint16_t tid, std::string& pack){
+  pack.clear();
+  if(!m_replay.empty()){
+    pack = m_replay[m_replay_n];
+    m_replay_n = (m_replay_n + 1) % m_replay.size();
+    pack[2] = char(tid>>8);
+    pack[3] = char(tid);
+    return;
+  }
+  std::poisson_distribution<uint32_t> distN(m_conf.occupancy);
+  std::uniform_int_distribution<uint32_t> distDcol(0, 511);
+  std::uniform_int_distribution<uint32_t> distRow(0, 1023);
+  uint16_t pixelN = std::min<uint32_t>(distN(m_gen), 0xffff);
+  pack.push_back(char(0xaa));
+  pack.push_back(char(m_conf.daqid));
+  pack.push_back(char(tid>>8));
+  pack.push_back(char(tid));
+  pack.push_back(char(pixelN>>8));
+  pack.push_back(char(pixelN));
+  for(uint16_t n = 0; n < pixelN; n++){
+    // valid(1) tschip(8) raw_dcol[9]  raw_row[10] pattern[4]
+    uint32_t v = (1u<<31) | (distDcol(m_gen)<<14) | (distRow(m_gen)<<4);
+    pack.push_back(char(v>>24));
+    pack.push_back(char(v>>16));
+    pack.push_back(char(v>>8));
+    pack.push_back(char(v));
+  }
+  pack.push_back(char(0xcc));
+  pack.push_back(char(0xcc));
+}
+
+bool DataServer::SendAll(int sockfd, const char* p, size_t len){
+  while(len && m_is_running){
+    ssize_t written = send(sockfd, p, len, MSG_NOSIGNAL);
+    if(written < 0){
+      if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR){
+        continue; // SO_SNDTIMEO, the client is not reading
+      }
+      return false;
+    }
+    p += written;
+    len -= written;
+  }
+  return m_is_running;
+}
+
+void DataServer::ServeClient(int sockfd){
+  std::uniform_real_distribution<double> distFault(0, 1);
+  std::string pack;
+  std::string batch;
+  uint64_t triggerN = 0;
+  auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(m_conf.rate > 0? 1. / m_conf.rate : 0));
+  auto tp_next = std::chrono::steady_clock::now();
+  bool isUploadingLast = false;
+  while(m_is_running){
+    // Frontend closes the link between runs
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN | POLLRDHUP;
+    if(poll(&pfd, 1, 0) > 0){
+      char c;
+      if(recv(sockfd, &c, 1, MSG_DONTWAIT) <= 0){
+        return;
+      }
+    }
+
+    bool isUploading = !m_is_uploading || m_is_uploading();
+    if(!isUploading){
+      isUploadingLast = false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    auto tp_now = std::chrono::steady_clock::now();
+    if(!isUploadingLast || tp_next + std::chrono::seconds(1) < tp_now){
+      tp_next = tp_now; // no burst for the time not uploading or the client lagged behind
+    }
+    isUploadingLast = true;
+    if(tp_next > tp_now){
+      std::this_thread::sleep_until(tp_next);
+    }
+
+    // all triggers due, up to a batch
+    batch.clear();
+    tp_now = std::chrono::steady_clock::now();
+    while(tp_next <= tp_now && batch.size() < s_send_batch_size){
+      tp_next += period;
+      uint16_t tid = uint16_t(triggerN + m_conf.tidSkew);
+      triggerN++;
+      m_n_trigger++;
+      if(m_conf.dropRate > 0 && distFault(m_gen) < m_conf.dropRate){
+        m_n_dropped++;
+        continue;
+      }
+      MakePacket(tid, pack);
+      if(m_conf.corruptRate > 0 && distFault(m_gen) < m_conf.corruptRate){
+        pack.back() = char(0x00);
+        m_n_corrupted++;
+      }
+      batch += pack;
+      m_n_pack++;
+    }
+    if(!batch.empty()){
+      if(!SendAll(sockfd, batch.data(), batch.size())){
+        return;
+      }
+      m_n_byte += batch.size();
+    }
+  }
+}
+
+void DataServer::AsyncServe(){
+  struct pollfd pfd;
+  pfd.fd = m_sock;
+  pfd.events = POLLIN;
+  while(m_is_running){
+    if(poll(&pfd, 1, 100) <= 0){
+      continue;
+    }
+    int sockfd = accept(m_sock, nullptr, nullptr);
+    if(sockfd < 0){
+      continue;
+    }
+    m_n_client++;
+    timeval tv_timeout;
+    tv_timeout.tv_sec = 0;
+    tv_timeout.tv_usec = 100000;
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv_timeout, sizeof(tv_timeout));
+    ServeClient(sockfd);
+    close(sockfd);
+  }
+}
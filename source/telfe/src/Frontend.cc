@@ -6,8 +6,9 @@
 #include <iostream>
 #include <thread>
 
-#include "rbcp.hh"
+#include "RbcpClient.hh"
 #include "TcpConnection.hh"
+#include "mymetrics.hh"
 
 
 #pragma GCC diagnostic ignored "-Wpmf-conversions"
@@ -60,219 +61,217 @@ Frontend::Frontend(const std::string& sensor_jsstr,
 
   m_jsdoc_setup.Parse(setup_jsstr.empty()? "{}":setup_jsstr.c_str());
 
+  CompileRegisterMap(m_jsdoc_firmware["FIRMWARE_REG"], "FIRMWARE_REG", false, m_map_firmware_reg);
+  CompileRegisterMap(m_jsdoc_sensor["SENSOR_REG"], "SENSOR_REG", true, m_map_sensor_reg);
+  // an address is shadowed only if all of its registers are plain read-write ones
+  std::array<bool, 32> sensor_has_reg;
+  sensor_has_reg.fill(false);
+  m_sensor_cacheable.fill(true);
+  for(auto& [name, desc]: m_map_sensor_reg){
+    uint64_t global_address = SensorRegAddr2GlobalRegAddr(desc.address);
+    sensor_has_reg[global_address] = true;
+    if(!desc.isReadable || !desc.isWritable){
+      m_sensor_cacheable[global_address] = false;
+    }
+  }
+  for(size_t n = 0; n < m_sensor_cacheable.size(); n++){
+    m_sensor_cacheable[n] = m_sensor_cacheable[n] && sensor_has_reg[n];
+  }
+  ClearShadow();
+
   m_netip = netip;
+  // optional, for firmware which needs one register transaction at a time
+  uint64_t rbcp_window = 32;
+  bool rbcp_coalesce = true;
+  if(m_jsdoc_setup.HasMember("rbcp_window") && m_jsdoc_setup["rbcp_window"].IsUint()){
+    rbcp_window = m_jsdoc_setup["rbcp_window"].GetUint();
+  }
+  if(m_jsdoc_setup.HasMember("rbcp_coalesce") && m_jsdoc_setup["rbcp_coalesce"].IsBool()){
+    rbcp_coalesce = m_jsdoc_setup["rbcp_coalesce"].GetBool();
+  }
+  m_rbcp.reset(new RbcpClient(m_netip, 4660, rbcp_window, rbcp_coalesce));
   m_name = name;
   m_daqid = daqid;
   m_extension = daqid;
+
+  m_ring_ev.reset(new SpscRing<DataPackSP>(m_size_ring));
+
+  auto& mt = mymetrics::Registry::instance();
+  std::string label = "{layer=\"" + m_name + "\"}";
+  m_mt_packets = &mt.counter("daq_packets_total" + label, "data packets decoded");
+  m_mt_bad = &mt.counter("daq_bad_packets_total" + label, "data packets failed to decode");
+  m_mt_overflow = &mt.counter("daq_overflow_packets_total" + label, "data packets lost to a full ring");
+  m_mt_ring_fill = &mt.gauge("daq_ring_fill" + label, "data packets waiting in the ring");
+  m_mt_decode_ns = &mt.histogram("daq_decode_ns" + label, "data packet decoding and clustering");
 }
 
 void  Frontend::WriteByte(uint64_t address, uint64_t value){
-
   debug_print("WriteByte( address= %#016x ,  value= %#016x )\n", address, value);
-  rbcp r(m_netip);
-  std::string recvStr(100, 0);
-  r.DispatchCommand("wrb",  address, value, NULL);
-  // r.DispatchCommand("wrb",  address, value, NULL);
+  m_rbcp->Write(address, value);
+  if(!m_batch_level){
+    FlushRegisters();
+  }
 };
 
 uint64_t Frontend::ReadByte(uint64_t address){
   debug_print("ReadByte( address= %#016x)\n", address);
   uint8_t reg_value=0;
-  rbcp r(m_netip);
-  std::string recvStr(100, 0);
   // TODO: wait readback compatible firmware, always return zero
-  r.DispatchCommand("rd", address, 1, &recvStr);
-  reg_value=recvStr[0];
+  // queued writes go first, the read sees them applied
+  m_rbcp->Read(address, &reg_value, 1);
+  FlushRegisters();
   debug_print( "ReadByte( address= %#016x) return value= %#016x\n", address, reg_value);
   return reg_value;
 };
 
-void Frontend::SetFirmwareRegister(const std::string& name, uint64_t value){
-  debug_print( "INFO<%s>: %s( name= %s ,  value= %#016x )\n", __func__, __func__, name.c_str(), value);
-  static const std::string array_name("FIRMWARE_REG");
-  auto& json_array = m_jsdoc_firmware[array_name];
-  if(json_array.Empty()){
-    FormatPrint(std::cerr, "ERROR<%s>:   unable to find array<%s>\n", __func__, array_name.c_str());
-    throw;
-  }
-  bool flag_found_reg = false;
-  for(auto& json_reg: json_array.GetArray()){
-    if( json_reg["name"] != name )
-      continue;
-    auto& json_addr = json_reg["address"];
-    if(!json_addr.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown address format, requires a json string<%s>\n", __func__, Stringify(json_addr).c_str());
-      throw;
-    }
-
-    uint64_t address = String2Uint64(json_addr.GetString());
+void Frontend::BeginBatch(){
+  m_batch_level++;
+}
 
-    WriteByte(address, value);
-    flag_found_reg = true;
-    break;
+void Frontend::EndBatch(){
+  if(m_batch_level && --m_batch_level == 0){
+    FlushRegisters();
   }
+}
 
-  if(!flag_found_reg){
-    FormatPrint(std::cerr, "ERROR<%s>: unable to find register<%s> in array<%s>\n", __func__, name.c_str(), array_name.c_str());
-    throw;
+bool Frontend::FlushRegisters(){
+  if(!m_rbcp->Flush()){
+    // unknown which of the queued writes made it
+    ClearShadow();
+    m_st_n_reg_error_now ++;
+    FormatPrint(std::cerr, "ERROR<%s>: register access of %s at %s failed\n", __func__, m_name.c_str(), m_netip.c_str());
+    return false;
   }
+  return true;
 }
 
-void Frontend::SetSensorRegisters(const std::map<std::string, uint64_t>& mapRegValue ){
-  static const std::string array_name("SENSOR_REG");
-  auto& json_array = m_jsdoc_sensor[array_name];
-  if(json_array.Empty()){
+void Frontend::CompileRegisterMap(const rapidjson::Value& json_array, const std::string& array_name,
+                                  bool isSensor, std::unordered_map<std::string, RegDesc>& mapReg){
+  if(!json_array.IsArray() || json_array.Empty()){
     FormatPrint(std::cerr, "ERROR<%s>:   unable to find array<%s>\n", __func__, array_name.c_str());
     throw;
   }
-
-  std::map<uint64_t, std::pair<uint64_t, uint64_t>> mapRegMaskValue;
-  std::map<uint64_t, bool> mapRegReadable;
-  for(auto & [name, value]: mapRegValue){
-    bool flag_found_reg = false;
-    for(auto& json_reg: json_array.GetArray()){
-      if( json_reg["name"] != name )
-        continue;
-      auto& json_addr = json_reg["address"];
-      if(!json_addr.IsString()){
-        FormatPrint(std::cerr, "ERROR<%s>: unknown address format, requires a json string<%s>\n", __func__, Stringify(json_addr).c_str());
-        throw;
-      }
-      uint64_t address = String2Uint64(json_addr.GetString());
-
+  for(auto& json_reg: json_array.GetArray()){
+    if(!json_reg.HasMember("name") || !json_reg["name"].IsString()){
+      FormatPrint(std::cerr, "ERROR<%s>: register without name in array<%s>\n", __func__, array_name.c_str());
+      throw;
+    }
+    std::string name = json_reg["name"].GetString();
+    RegDesc desc;
+    auto& json_addr = json_reg["address"];
+    if(!json_addr.IsString()){
+      // e.g. multi-byte DAC_CFG, not accessible by name
+      debug_print( "INFO<%s>: skip register<%s> of address<%s>\n", __func__, name.c_str(), Stringify(json_addr).c_str());
+      continue;
+    }
+    desc.address = String2Uint64(json_addr.GetString());
+    if(isSensor){
       auto& json_mask = json_reg["mask"];
       if(!json_mask.IsString()){
         FormatPrint(std::cerr, "ERROR<%s>: unknown mask format, requires a json string<%s>\n", __func__, Stringify(json_mask).c_str());
         throw;
       }
-      uint64_t mask = String2Uint64(json_mask.GetString());
-      uint8_t offset = LeastNoneZeroOffset(mask);
-      debug_print( "INFO<%s>:sensor reg  name=%s  mask=%#08x bitoffset=%u \n", __func__, name.c_str(),  mask, offset);
-
+      desc.mask = String2Uint64(json_mask.GetString());
+      desc.offset = LeastNoneZeroOffset(desc.mask);
       auto& json_mode = json_reg["mode"];
       if(!json_mode.IsString()){
         FormatPrint(std::cerr, "ERROR<%s>: unknown mode format, requires a json string<%s>\n", __func__, Stringify(json_mode).c_str());
         throw;
       }
-      if(std::string(json_mode.GetString()).find('r')||std::string(json_mode.GetString()).find('R')){
-        mapRegReadable[address] = true;
-      }
-      else{
-        mapRegReadable[address] = false;
-      }
-
-      if(mapRegMaskValue.find(address)==mapRegMaskValue.end()){
-        mapRegMaskValue.insert({address, {mask, value<<offset}});
-      }
-      else{
-        auto& [mask_ori, value_ori]  = mapRegMaskValue[address];
-        if( (mask_ori & mask) != 0 ){
-          FormatPrint(std::cerr, "ERROR<%s>: mask overlap\n", __func__);
-          throw;
-        }
-        mapRegMaskValue[address] = {(mask | mask_ori) ,  ((value<<offset) & mask) | (value_ori & ~mask)};
-      }
-      flag_found_reg = true;
-      break;
-    }
-    if(!flag_found_reg){
-      FormatPrint(std::cerr, "ERROR<%s>: unable to find register<%s> in array<%s>\n", __func__, name.c_str(), array_name.c_str());
-      throw;
+      std::string mode = json_mode.GetString();
+      desc.isReadable = mode.find_first_of("rR") != std::string::npos;
+      desc.isWritable = mode.find_first_of("wW") != std::string::npos;
     }
+    debug_print( "INFO<%s>: reg  name=%s  address=%#08x mask=%#08x bitoffset=%u \n", __func__, name.c_str(), desc.address, desc.mask, desc.offset);
+    mapReg[name] = desc;
   }
-
-  for(auto & [address, maskValue]: mapRegMaskValue){
-    auto &[mask, value] = maskValue;
-
-    uint64_t value_ori = 0;
-    if(mapRegReadable[address]){
-      // value_ori = ReadByte(SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0023,0);
-      WriteByte(0x0021,1);
-      value_ori = ReadByte(0x0024);
-    }
-    // WriteByte(SensorRegAddr2GlobalRegAddr(address), (value & mask) | (value_ori & ~mask) );
-    if(SensorRegAddr2GlobalRegAddr(address)==0b00110){
-      WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0023,value);
-      WriteByte(0x0021,0);
-    }
-    else
-    {
-      WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0023,(value & mask) | (value_ori & ~mask));
-      WriteByte(0x0021,0);
-    }
-  }
-
 }
 
-void Frontend::SetSensorRegister(const std::string& name, uint64_t value){
-  debug_print( "INFO<%s>: %s( name=%s ,  value=%#016x )\n", __func__, __func__, name.c_str(), value);
-  static const std::string array_name("SENSOR_REG");
-  auto& json_array = m_jsdoc_sensor[array_name];
-  if(json_array.Empty()){
-    FormatPrint(std::cerr, "ERROR<%s>:   unable to find array<%s>\n", __func__, array_name.c_str());
+const Frontend::RegDesc& Frontend::FindRegister(const std::unordered_map<std::string, RegDesc>& mapReg,
+                                                const std::string& array_name, const std::string& name){
+  auto it = mapReg.find(name);
+  if(it == mapReg.end()){
+    FormatPrint(std::cerr, "ERROR<%s>: unable to find register<%s> in array<%s>\n", __func__, name.c_str(), array_name.c_str());
     throw;
   }
+  return it->second;
+}
 
-  bool flag_found_reg = false;
-  for(auto& json_reg: json_array.GetArray()){
-    if( json_reg["name"] != name )
-      continue;
-    auto& json_addr = json_reg["address"];
-    if(!json_addr.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown address format, requires a json string<%s>\n", __func__, Stringify(json_addr).c_str());
-      throw;
-    }
-    uint64_t address = String2Uint64(json_addr.GetString());
-
-    auto& json_mask = json_reg["mask"];
-    if(!json_mask.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown mask format, requires a json string<%s>\n", __func__, Stringify(json_mask).c_str());
-      throw;
-    }
-    uint64_t mask = String2Uint64(json_mask.GetString());
-    uint8_t offset = LeastNoneZeroOffset(mask);
-    debug_print("INFO<%s>:sensor reg  name=%s  mask=%#08x bitoffset=%u \n", __func__, name.c_str(),  mask, offset);
+void Frontend::ClearShadow(){
+  m_sensor_shadow_valid.fill(false);
+  m_mask_shadow_valid.fill(false);
+}
 
-    auto& json_mode = json_reg["mode"];
-    if(!json_mode.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown mode format, requires a json string<%s>\n", __func__, Stringify(json_mode).c_str());
-      throw;
+void Frontend::WriteSensorByte(uint64_t address, uint8_t value){
+  uint64_t global_address = SensorRegAddr2GlobalRegAddr(address);
+  if(m_sensor_cacheable[global_address]){
+    if(m_sensor_shadow_valid[global_address] && m_sensor_shadow[global_address] == value){
+      return;
     }
+    m_sensor_shadow[global_address] = value;
+    m_sensor_shadow_valid[global_address] = true;
+  }
+  WriteByte(0x0022,global_address);
+  WriteByte(0x0023,value);
+  WriteByte(0x0021,0);
+}
 
-    uint64_t value_ori = 0;
-    if(std::string(json_mode.GetString()).find('r')||std::string(json_mode.GetString()).find('R')){
-      // value_ori = ReadByte(SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0023,0);
-      WriteByte(0x0021,1);
-      value_ori = ReadByte(0x0024);
-
-    }
+uint8_t Frontend::ReadSensorByte(uint64_t address){
+  WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
+  WriteByte(0x0023,0);
+  WriteByte(0x0021,1);
+  return ReadByte(0x0024);
+}
 
-    // WriteByte(SensorRegAddr2GlobalRegAddr(address), ((value<<offset) & mask) | (value_ori & ~mask) );
+void Frontend::SetFirmwareRegister(const std::string& name, uint64_t value){
+  debug_print( "INFO<%s>: %s( name= %s ,  value= %#016x )\n", __func__, __func__, name.c_str(), value);
+  // firmware registers are written every time, many of them are strobes
+  WriteByte(FindRegister(m_map_firmware_reg, "FIRMWARE_REG", name).address, value);
+}
 
-    if(SensorRegAddr2GlobalRegAddr(address)==0b00110){
-      WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0023,value);
-      WriteByte(0x0021,0);
+void Frontend::SetSensorRegisters(const std::map<std::string, uint64_t>& mapRegValue ){
+  std::map<uint64_t, std::pair<uint64_t, uint64_t>> mapRegMaskValue;
+  std::map<uint64_t, bool> mapRegReadable;
+  for(auto & [name, value]: mapRegValue){
+    const RegDesc& desc = FindRegister(m_map_sensor_reg, "SENSOR_REG", name);
+    uint64_t address = desc.address;
+    uint64_t mask = desc.mask;
+    mapRegReadable[address] = desc.isReadable;
+    if(mapRegMaskValue.find(address)==mapRegMaskValue.end()){
+      mapRegMaskValue.insert({address, {mask, (value<<desc.offset) & mask}});
     }
     else{
-      WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-      WriteByte(0x0023,((value<<offset) & mask) | (value_ori & ~mask));
-      WriteByte(0x0021,0);
+      auto& [mask_ori, value_ori]  = mapRegMaskValue[address];
+      if( (mask_ori & mask) != 0 ){
+        FormatPrint(std::cerr, "ERROR<%s>: mask overlap\n", __func__);
+        throw;
+      }
+      mapRegMaskValue[address] = {(mask | mask_ori) ,  ((value<<desc.offset) & mask) | (value_ori & ~mask)};
     }
-
-    flag_found_reg = true;
-    break;
   }
-  if(!flag_found_reg){
-    FormatPrint(std::cerr, "ERROR<%s>: unable to find register<%s> in array<%s>\n", __func__, name.c_str(), array_name.c_str());
-    throw;
+
+  BeginBatch();
+  for(auto & [address, maskValue]: mapRegMaskValue){
+    auto &[mask, value] = maskValue;
+    uint64_t global_address = SensorRegAddr2GlobalRegAddr(address);
+    uint64_t value_ori = 0;
+    if((mask & 0xff) != 0xff){
+      // bits outside of mask are kept, from the shadow if known
+      if(m_sensor_cacheable[global_address] && m_sensor_shadow_valid[global_address]){
+        value_ori = m_sensor_shadow[global_address];
+      }
+      else if(mapRegReadable[address]){
+        value_ori = ReadSensorByte(address);
+      }
+    }
+    WriteSensorByte(address, (value & mask) | (value_ori & ~mask));
   }
+  EndBatch();
+}
+
+void Frontend::SetSensorRegister(const std::string& name, uint64_t value){
+  debug_print( "INFO<%s>: %s( name=%s ,  value=%#016x )\n", __func__, __func__, name.c_str(), value);
+  SetSensorRegisters({{name, value}});
 }
 
 uint64_t Frontend::SensorRegAddr2GlobalRegAddr(uint64_t addr){
@@ -295,31 +294,7 @@ uint64_t Frontend::SensorRegAddr2GlobalRegAddr(uint64_t addr){
 
 uint64_t Frontend::GetFirmwareRegister(const std::string& name){
   debug_print( "INFO<%s>:  %s( name=%s )\n", __func__, __func__, name.c_str());
-  static const std::string array_name("FIRMWARE_REG");
-  auto& json_array = m_jsdoc_firmware[array_name];
-  if(json_array.Empty()){
-    FormatPrint(std::cerr, "ERROR<%s>:   unable to find array<%s>\n", __func__, array_name.c_str());
-    throw;
-  }
-  uint64_t value=-1;
-  bool flag_found_reg = false;
-  for(auto& json_reg: json_array.GetArray()){
-    if( json_reg["name"] != name )
-      continue;
-    auto& json_addr = json_reg["address"];
-    if(!json_addr.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown address format, requires a json string<%s>\n", __func__, Stringify(json_addr).c_str());
-      throw;
-    } 
-    uint64_t address = String2Uint64(json_addr.GetString());
-    value = ReadByte(address);
-    flag_found_reg = true;
-    break;
-  }
-  if(!flag_found_reg){
-    FormatPrint(std::cerr, "ERROR<%s>: unable to find register<%s> in array<%s>\n", __func__, name.c_str(), array_name.c_str());
-    throw;
-  }
+  uint64_t value = ReadByte(FindRegister(m_map_firmware_reg, "FIRMWARE_REG", name).address);
   debug_print( "INFO<%s>: %s( name=%s ) return value=%#016x \n", __func__, __func__, name.c_str(), value);
   return value;
 }
@@ -327,46 +302,10 @@ uint64_t Frontend::GetFirmwareRegister(const std::string& name){
 
 uint64_t Frontend::GetSensorRegister(const std::string& name){
   debug_print( "INFO<%s>:  %s( name=%s )\n",__func__, __func__, name.c_str());
-  static const std::string array_name("SENSOR_REG");
-  auto& json_array = m_jsdoc_sensor[array_name];
-  if(json_array.Empty()){
-    FormatPrint(std::cerr, "ERROR<%s>:   unable to find array<%s>\n", __func__, array_name.c_str());
-    throw;
-  }
-  uint64_t value;
-  bool flag_found_reg = false;
-  for(auto& json_reg: json_array.GetArray()){
-    if( json_reg["name"] != name )
-      continue;
-    auto& json_addr = json_reg["address"];
-    if(!json_addr.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown address format, requires a json string<%s>\n", __func__, Stringify(json_addr).c_str());
-      throw;
-    }
-    uint64_t address = String2Uint64(json_addr.GetString());
-    // uint64_t valueRead  = ReadByte(SensorRegAddr2GlobalRegAddr(address));
-    WriteByte(0x0022,SensorRegAddr2GlobalRegAddr(address));
-    WriteByte(0x0023,0);
-    WriteByte(0x0021,1);
-    uint64_t valueRead = ReadByte(0x0024);
-
-    auto& json_mask = json_reg["mask"];
-    if(!json_mask.IsString()){
-      FormatPrint(std::cerr, "ERROR<%s>: unknown mask format, requires a json string<%s>\n", __func__, Stringify(json_mask).c_str());
-      throw;
-    }
-    uint64_t mask = String2Uint64(json_mask.GetString());
-    uint8_t offset = LeastNoneZeroOffset(mask);
-
-    value  = (valueRead & mask) >> offset;
-
-    flag_found_reg = true;
-    break;
-  }
-  if(!flag_found_reg){
-    FormatPrint(std::cerr, "ERROR<%s>: unable to find register<%s> in array<%s>\n", __func__, name.c_str(), array_name.c_str());
-    throw;
-  }
+  const RegDesc& desc = FindRegister(m_map_sensor_reg, "SENSOR_REG", name);
+  // always from the sensor, the shadow only holds what was written
+  uint64_t valueRead = ReadSensorByte(desc.address);
+  uint64_t value  = (valueRead & desc.mask) >> desc.offset;
   debug_print( "INFO<%s>: %s( name=%s ) return value=%#016x \n", __func__, __func__, name.c_str(), value);
   return value;
 }
@@ -400,6 +339,15 @@ void Frontend::SetBoardDAC(uint32_t ch, double voltage){
 
 
 void Frontend::FlushPixelMask(const std::set<std::pair<uint16_t, uint16_t>> &colMaskXY, MaskType maskType){
+  // mask and cal are latched separately, by load_m and load_c
+  size_t latchN = (maskType == MaskType::CAL || maskType == MaskType::UNCAL)? 1 : 0;
+  if(m_mask_shadow_valid[latchN] && m_mask_shadow_type[latchN] == maskType && m_mask_shadow[latchN] == colMaskXY){
+    return;
+  }
+  m_mask_shadow_valid[latchN] = true;
+  m_mask_shadow_type[latchN] = maskType;
+  m_mask_shadow[latchN] = colMaskXY;
+
   std::array<std::array<bool, 512>, 1024> rawMaskMat; // index -> [0-1023][0-511]   [rawRowN][rawDColN]
   for(auto &pixMask_aRawRow : rawMaskMat){
     for(auto &pixMask : pixMask_aRawRow){
@@ -428,6 +376,7 @@ void Frontend::FlushPixelMask(const std::set<std::pair<uint16_t, uint16_t>> &col
   // std::cout<< "56    63 48    55 40    47 32    39 24    31 16    23 8     15 0      7"<<std::endl;
   // std::cout<< "0------- 1------- 2------- 3------- 4------- 5------- 6------- 7-------"<<std::endl;
   std::vector<uint8_t> vecRawRowMaskByte_latest;
+  BeginBatch();
   for(int rawRowN= 0; rawRowN<=1023; rawRowN++){
     std::vector<uint8_t> vecRawRowMaskByte;
     uint8_t  maskByte = 0;
@@ -452,15 +401,11 @@ void Frontend::FlushPixelMask(const std::set<std::pair<uint16_t, uint16_t>> &col
         // std::bitset<8> rawbit(maskByte);
         // std::cout<< rawbit<<" ";
         // SetSensorRegister("PIXELMASK_DATA", maskByte);
-        WriteByte(0x0022,6);
-        WriteByte(0x0023,maskByte);
-        WriteByte(0x0021,0);
+        WriteSensorByte(0b00110, maskByte);
       }
       vecRawRowMaskByte_latest = vecRawRowMaskByte;
     }
-    WriteByte(0x0022,7);
-    WriteByte(0x0023,0);
-    WriteByte(0x0021,0);
+    WriteSensorByte(0b00111, 0);
     // SetSensorRegisters({{"LOADC_E", 0},{"LOADM_E", 0}});
     // std::cout<<"  col #"<<xCol<<std::endl;
   }
@@ -476,6 +421,7 @@ void Frontend::FlushPixelMask(const std::set<std::pair<uint16_t, uint16_t>> &col
     SetFirmwareRegister("load_m", 0);
     // std::cout<<"load m successfully"<<std::endl;
   }
+  EndBatch();
 }
 
 std::set<std::pair<uint16_t, uint16_t>> Frontend::ReadPixelMask_from_file(const std::string& filename)
@@ -547,11 +493,17 @@ Frontend::~Frontend(){
 }
 
 void Frontend::daq_start_run(){
-  m_vec_ring_ev.clear();
-  m_vec_ring_ev.resize(m_size_ring);
-  m_count_ring_write = 0;
-  m_count_ring_read = 0;
-  m_hot_p_read = m_size_ring -1; // tail
+  daq_prepare_run();
+  SetFirmwareRegister("upload_data",1);
+  return;
+}
+
+void Frontend::daq_prepare_run(){
+  m_tcpcon.reset(); // connection of the previous run, it must not write the ring any more
+  m_ring_ev->clear(); // no writer yet, tcp connection is created below
+  if(!m_pack_pool){
+    m_pack_pool.reset(new DataPackPool(m_size_ring + 16));
+  }
 
   m_flag_wait_first_event = true;
 
@@ -563,13 +515,11 @@ void Frontend::daq_start_run(){
   m_st_n_tg_ev_begin = 0;
 
   m_isDataAccept= true;
-  m_tcpcon =  TcpConnection::connectToServer(m_netip,  24, reinterpret_cast<FunProcessMessage>(&Frontend::perConnProcessRecvMesg), nullptr, this);
+  m_tcpcon =  TcpConnection::connectToServer(m_netip,  24, reinterpret_cast<FunProcessMessage>(&Frontend::perConnProcessRecvMesg), nullptr, this, m_reactor);
 
   if(!m_is_async_watching){
     m_fut_async_watch = std::async(std::launch::async, &Frontend::AsyncWatchDog, this);
   }
-
-  SetFirmwareRegister("upload_data",1);
   return;
 }
 
@@ -589,6 +539,8 @@ void Frontend::daq_stop_run(){
   SetFirmwareRegister("chip_reset", 1);
   SetFirmwareRegister("global_reset", 1);
   SetFirmwareRegister("all_buffer_reset", 1);
+  // the sensor is reset as well, its registers no longer hold the shadowed values
+  ClearShadow();
   return;
 }
 
@@ -606,6 +558,7 @@ void Frontend::daq_reset(){
   SetFirmwareRegister("chip_reset", 1);
   SetFirmwareRegister("global_reset", 1);
   SetFirmwareRegister("all_buffer_reset", 1);
+  ClearShadow();
 
   return;
 }
@@ -683,11 +636,13 @@ void Frontend::daq_conf_default(){
   }
 
 
+  BeginBatch();
   SetFirmwareRegister("upload_data", 0);
   SetFirmwareRegister("chip_reset", 0);
   SetFirmwareRegister("chip_reset", 1);
   SetFirmwareRegister("global_reset", 1);
   SetFirmwareRegister("all_buffer_reset", 1);
+  ClearShadow();
   SetFirmwareRegister("set_daq_id", m_daqid);
   SetFirmwareRegister("global_work_mode", 0);
 
@@ -737,6 +692,7 @@ void Frontend::daq_conf_default(){
 
   // SetFirmwareRegister("SER_DELAY", 0x04);
   SetFirmwareRegister("load_m", 0xff);
+  FlushRegisters(); // the wait starts once load_m is written
   std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
 
@@ -803,22 +759,31 @@ void Frontend::daq_conf_default(){
   SetSensorRegisters({{"REG_CDAC_8NA_TRIM", 0b00}, {"REG_CDAC_8NA5", 0}});
   //  00000 REG_CDAC_8NA_TRIM 00 REG_CDAC_8NA5 0
 
-
+  EndBatch();
     
   return;
 }
 
-int Frontend::perConnProcessRecvMesg(void* pconn, const std::string& str){
+int Frontend::perConnProcessRecvMesg(void* pconn, std::string_view str){
   static size_t s_n = 0;
   if(!m_isDataAccept){
     std::cout<< "msg is dropped"<<std::endl;
     return 0;
   }
 
-  DataPackSP df(new DataPack);
-
-  df->MakeDataPack(str);
+  DataPackSP df = m_pack_pool->Acquire();
+  int re;
+  {
+    mymetrics::ScopedTimer timer(*m_mt_decode_ns);
+    re = df->MakeDataPack(str.data(), str.size());
+  }
+  if(re < 0){
+    m_st_n_ev_bad_now ++;
+    m_mt_bad->add();
+    return 0;
+  }
   s_n ++;
+  m_mt_packets->add();
 
   m_st_n_ev_input_now ++;
 
@@ -828,15 +793,12 @@ int Frontend::perConnProcessRecvMesg(void* pconn, const std::string& str){
   m_st_n_tg_ev_now = df->tid;
 
   
-  uint64_t next_p_ring_write = m_count_ring_write % m_size_ring;
-  if(next_p_ring_write == m_hot_p_read){
+  if(!m_ring_ev->push(std::move(df))){
     // buffer full, permanent data lose
     m_st_n_ev_overflow_now ++;
+    m_mt_overflow->add();
     return 0;
   }
-
-  m_vec_ring_ev[next_p_ring_write] = df;
-  m_count_ring_write ++;
   return 1;
 }
 
@@ -846,11 +808,9 @@ std::string Frontend::GetStatusString(){
 }
 
 DataPackSP& Frontend::Front(){
-  if(m_count_ring_write > m_count_ring_read) {
-    uint64_t next_p_ring_read = m_count_ring_read % m_size_ring;
-    m_hot_p_read = next_p_ring_read;
-    // keep hot read to prevent write-overlapping
-    return m_vec_ring_ev[next_p_ring_read];
+  DataPackSP* p = m_ring_ev->front();
+  if(p){
+    return *p;
   }
   else{
     return m_ring_end;
@@ -858,25 +818,20 @@ DataPackSP& Frontend::Front(){
 }
 
 void Frontend::PopFront(){
-  if(m_count_ring_write > m_count_ring_read) {
-    uint64_t next_p_ring_read = m_count_ring_read % m_size_ring;
-    m_hot_p_read = next_p_ring_read;
-    // keep hot read to prevent write-overlapping
-    m_vec_ring_ev[next_p_ring_read].reset();
-    m_count_ring_read ++;
-  }
+  m_ring_ev->pop();
 }
 
 uint64_t Frontend::Size(){
-  return  m_count_ring_write - m_count_ring_read;
+  return m_ring_ev->size();
 }
 
+bool Frontend::WaitFront(const std::chrono::microseconds& timeout){
+  return m_ring_ev->wait_for(timeout);
+}
 
-
-
+// by reader side, safe while data is still arriving
 void Frontend::ClearBuffer(){
-  m_count_ring_write = m_count_ring_read;
-  m_vec_ring_ev.clear();
+  m_ring_ev->clear();
 }
 
 
@@ -902,6 +857,7 @@ uint64_t Frontend::AsyncWatchDog(){
     uint64_t st_n_ev_input_now = m_st_n_ev_input_now;
     uint64_t st_n_ev_bad_now = m_st_n_ev_bad_now;
     uint64_t st_n_ev_overflow_now = m_st_n_ev_overflow_now;
+    m_mt_ring_fill->set(m_ring_ev->size());
 
     // time
     auto tp_now = std::chrono::system_clock::now();
@@ -0,0 +1,202 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "RbcpClient.hh"
+
+#define RBCP_VER 0xFF
+#define RBCP_CMD_WR 0x80
+#define RBCP_CMD_RD 0xC0
+#define RBCP_UDP_BUF_SIZE 2048
+
+RbcpClient::RbcpClient(const std::string& ip, uint16_t port, size_t window, bool isCoalescing)
+  :m_ip(ip), m_port(port), m_window(std::min<size_t>(std::max<size_t>(window, 1), 128)), m_is_coalescing(isCoalescing){
+  // acks are matched by the 8-bit id, a window of at most half of the id space keeps them unambiguous
+  m_sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if(m_sock < 0){
+    std::fprintf(stderr, "RbcpClient: unable to create socket\n");
+    throw;
+  }
+  struct sockaddr_in sitcpAddr;
+  std::memset(&sitcpAddr, 0, sizeof(sitcpAddr));
+  sitcpAddr.sin_family      = AF_INET;
+  sitcpAddr.sin_port        = htons(port);
+  sitcpAddr.sin_addr.s_addr = inet_addr(ip.c_str());
+  // connected, so only datagrams of this board are received
+  if(connect(m_sock, (struct sockaddr *)&sitcpAddr, sizeof(sitcpAddr)) != 0){
+    std::fprintf(stderr, "RbcpClient: unable to connect to %s:%u\n", ip.c_str(), port);
+    close(m_sock);
+    throw;
+  }
+}
+
+RbcpClient::~RbcpClient(){
+  Flush();
+  close(m_sock);
+}
+
+void RbcpClient::OpenFrame(uint8_t command, uint32_t address){
+  m_open.buf[0] = RBCP_VER;
+  m_open.buf[1] = command;
+  m_open.buf[2] = 0;
+  m_open.buf[3] = 0;
+  m_open.buf[4] = address>>24;
+  m_open.buf[5] = address>>16;
+  m_open.buf[6] = address>>8;
+  m_open.buf[7] = address;
+  m_open.size = s_header_size;
+  m_open.dst = nullptr;
+  m_open.retransmit = 0;
+  m_open.isAcked = false;
+  m_is_open = true;
+}
+
+void RbcpClient::CloseFrame(){
+  if(!m_is_open){
+    return;
+  }
+  m_is_open = false;
+  m_open.buf[2] = m_id++;
+  m_frames.push_back(m_open);
+  Pump(false);
+  // bounds the queue, the caller runs at most one window ahead of the acks
+  while(m_frames.size() > 2*m_window){
+    Pump(true);
+  }
+}
+
+void RbcpClient::Write(uint32_t address, uint8_t value){
+  Write(address, &value, 1);
+}
+
+void RbcpClient::Write(uint32_t address, const uint8_t* data, size_t n){
+  for(size_t i = 0; i < n; i++){
+    uint32_t addr = address + i;
+    if(!m_is_open || !m_is_coalescing || m_open.command() != RBCP_CMD_WR || m_open.length() >= s_frame_data_max
+       || m_open.address() + m_open.length() != addr){
+      CloseFrame();
+      OpenFrame(RBCP_CMD_WR, addr);
+    }
+    m_open.buf[m_open.size++] = data[i];
+    m_open.buf[3]++;
+  }
+}
+
+void RbcpClient::Read(uint32_t address, uint8_t* dst, size_t n){
+  while(n){
+    size_t len = std::min(n, s_frame_data_max);
+    CloseFrame();
+    OpenFrame(RBCP_CMD_RD, address);
+    m_open.buf[3] = len;
+    m_open.dst = dst;
+    CloseFrame();
+    address += len;
+    dst += len;
+    n -= len;
+  }
+}
+
+bool RbcpClient::Flush(){
+  CloseFrame();
+  while(!m_frames.empty()){
+    Pump(true);
+  }
+  bool isOk = !m_is_failed;
+  m_is_failed = false;
+  return isOk;
+}
+
+void RbcpClient::SendFrame(Frame& f){
+  f.tp_sent = std::chrono::steady_clock::now();
+  if(send(m_sock, f.buf.data(), f.size, 0) < 0){
+    // lost like a dropped datagram, the timeout sends it again
+    std::fprintf(stderr, "RbcpClient: send to %s failed, %s\n", m_ip.c_str(), std::strerror(errno));
+  }
+  m_n_frame++;
+}
+
+void RbcpClient::Pump(bool isBlocking){
+  while(m_n_inflight < m_frames.size() && m_n_inflight < m_window){
+    SendFrame(m_frames[m_n_inflight]);
+    m_n_inflight++;
+  }
+  if(m_n_inflight == 0){
+    return;
+  }
+
+  size_t frameN = m_frames.size();
+  ReceiveAcks(0);
+  if(!isBlocking || m_frames.size() < frameN){
+    return;
+  }
+
+  auto tp_timeout = m_frames.front().tp_sent + m_timeout;
+  auto tp_now = std::chrono::steady_clock::now();
+  if(tp_now < tp_timeout){
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(tp_timeout - tp_now).count() + 1;
+    ReceiveAcks(ms);
+    if(m_frames.size() < frameN || std::chrono::steady_clock::now() < tp_timeout){
+      return;
+    }
+  }
+
+  Frame &oldest = m_frames.front();
+  if(oldest.retransmit >= m_retransmit_max){
+    FailAll("ack timeout");
+    return;
+  }
+  std::fprintf(stderr, "RbcpClient: ack timeout of %s, resend %zu frames from id %u\n",
+               m_ip.c_str(), m_n_inflight, oldest.id());
+  oldest.retransmit++;
+  for(size_t n = 0; n < m_n_inflight; n++){
+    SendFrame(m_frames[n]);
+    m_n_retransmit++;
+  }
+}
+
+void RbcpClient::ReceiveAcks(int timeout_ms){
+  uint8_t rcvdBuf[RBCP_UDP_BUF_SIZE];
+  struct pollfd pfd;
+  pfd.fd = m_sock;
+  pfd.events = POLLIN;
+  while(m_n_inflight && poll(&pfd, 1, timeout_ms) > 0){
+    timeout_ms = 0; // only drain what is already there
+    ssize_t rcvdBytes = recv(m_sock, rcvdBuf, sizeof(rcvdBuf), 0);
+    if(rcvdBytes < (ssize_t)s_header_size || rcvdBuf[0] != RBCP_VER){
+      // also ECONNREFUSED from an earlier datagram, the timeout handles it
+      continue;
+    }
+    uint8_t id = rcvdBuf[2];
+    auto it = std::find_if(m_frames.begin(), m_frames.begin() + m_n_inflight,
+                           [id](const Frame& f){return f.id() == id;});
+    if(it == m_frames.begin() + m_n_inflight || it->isAcked){
+      continue; // ack of a frame sent twice
+    }
+    it->isAcked = true;
+    if((0x0f & rcvdBuf[1]) != 0x8){
+      std::fprintf(stderr, "RbcpClient: detected bus error at %s, address %#x\n", m_ip.c_str(), it->address());
+      m_is_failed = true;
+    }
+    else if(it->dst){
+      size_t n = std::min<size_t>(it->length(), rcvdBytes - s_header_size);
+      std::memcpy(it->dst, rcvdBuf + s_header_size, n);
+    }
+  }
+  while(m_n_inflight && m_frames.front().isAcked){
+    m_frames.pop_front();
+    m_n_inflight--;
+  }
+}
+
+void RbcpClient::FailAll(const char* reason){
+  std::fprintf(stderr, "RbcpClient: %s of %s, %zu transactions are dropped\n", reason, m_ip.c_str(), m_frames.size());
+  m_frames.clear();
+  m_n_inflight = 0;
+  m_is_failed = true;
+}
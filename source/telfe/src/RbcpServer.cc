@@ -0,0 +1,163 @@
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "RbcpServer.hh"
+
+#define RBCP_VER 0xFF
+#define RBCP_CMD_WR 0x80
+#define RBCP_CMD_RD 0xC0
+#define RBCP_UDP_BUF_SIZE 2048
+
+namespace{
+  struct Ack{
+    std::chrono::steady_clock::time_point tp_due;
+    struct sockaddr_in peer;
+    socklen_t peerLen;
+    std::vector<uint8_t> buf;
+  };
+
+  const uint64_t s_fnv_offset = 0xcbf29ce484222325ULL;
+  const uint64_t s_fnv_prime = 0x100000001b3ULL;
+}
+
+RbcpServer::RbcpServer(const std::string& ip, uint16_t port, double dropRate,
+                       std::chrono::microseconds latency)
+  :m_drop_rate(dropRate), m_latency(latency), m_regs(0x10000, 0), m_digest(s_fnv_offset){
+  m_sensor_regs.fill(0);
+  m_sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if(m_sock < 0){
+    std::fprintf(stderr, "RbcpServer: unable to create socket\n");
+    throw;
+  }
+  int reuse = 1;
+  setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = inet_addr(ip.c_str());
+  if(bind(m_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+    std::fprintf(stderr, "RbcpServer: unable to bind %s:%u\n", ip.c_str(), port);
+    close(m_sock);
+    throw;
+  }
+  m_fut_serve = std::thread(&RbcpServer::AsyncServe, this);
+}
+
+RbcpServer::~RbcpServer(){
+  m_is_running = false;
+  if(m_fut_serve.joinable()){
+    m_fut_serve.join();
+  }
+  close(m_sock);
+}
+
+uint8_t RbcpServer::Register(uint32_t address){
+  std::unique_lock<std::mutex> lk(m_mx);
+  return m_regs[address & 0xffff];
+}
+
+uint8_t RbcpServer::SensorRegister(uint8_t address){
+  std::unique_lock<std::mutex> lk(m_mx);
+  return m_sensor_regs[address & 0x1f];
+}
+
+uint64_t RbcpServer::SensorWriteDigest(){
+  std::unique_lock<std::mutex> lk(m_mx);
+  return m_digest;
+}
+
+void RbcpServer::ResetCounters(){
+  std::unique_lock<std::mutex> lk(m_mx);
+  m_digest = s_fnv_offset;
+  m_n_frame = 0;
+  m_n_dropped = 0;
+  m_n_sensor_write = 0;
+}
+
+void RbcpServer::WriteRegister(uint32_t address, uint8_t value){
+  address &= 0xffff;
+  m_regs[address] = value;
+  if(address != 0x0021){
+    return;
+  }
+  uint8_t sensorAddr = m_regs[0x0022] & 0x1f;
+  if(value == 0){
+    m_sensor_regs[sensorAddr] = m_regs[0x0023];
+    m_digest = (m_digest ^ sensorAddr) * s_fnv_prime;
+    m_digest = (m_digest ^ m_regs[0x0023]) * s_fnv_prime;
+    m_n_sensor_write++;
+  }
+  else if(value == 1){
+    m_regs[0x0024] = m_sensor_regs[sensorAddr];
+  }
+}
+
+void RbcpServer::AsyncServe(){
+  std::uniform_real_distribution<double> distDrop(0, 1);
+  uint8_t rcvdBuf[RBCP_UDP_BUF_SIZE];
+  std::deque<Ack> acks; // in order of their due time
+  struct pollfd pfd;
+  pfd.fd = m_sock;
+  pfd.events = POLLIN;
+  while(m_is_running){
+    // ppoll, the latency is well below a millisecond
+    struct timespec timeout = {0, 100000000};
+    if(!acks.empty()){
+      auto tp_now = std::chrono::steady_clock::now();
+      auto ns = acks.front().tp_due <= tp_now? 0 :
+        std::chrono::duration_cast<std::chrono::nanoseconds>(acks.front().tp_due - tp_now).count();
+      timeout.tv_sec = ns / 1000000000;
+      timeout.tv_nsec = ns % 1000000000;
+    }
+    if(ppoll(&pfd, 1, &timeout, nullptr) > 0){
+      Ack ack;
+      ack.peerLen = sizeof(ack.peer);
+      ssize_t rcvdBytes = recvfrom(m_sock, rcvdBuf, sizeof(rcvdBuf), 0, (struct sockaddr *)&ack.peer, &ack.peerLen);
+      if(rcvdBytes >= 8 && rcvdBuf[0] == RBCP_VER){
+        m_n_frame++;
+        if(m_drop_rate > 0 && distDrop(m_gen) < m_drop_rate){
+          m_n_dropped++;
+        }
+        else{
+          uint8_t command = rcvdBuf[1];
+          uint8_t length = rcvdBuf[3];
+          uint32_t address = (uint32_t(rcvdBuf[4])<<24) | (uint32_t(rcvdBuf[5])<<16) | (uint32_t(rcvdBuf[6])<<8) | rcvdBuf[7];
+          ack.buf.assign(rcvdBuf, rcvdBuf + 8);
+          {
+            std::unique_lock<std::mutex> lk(m_mx);
+            if(command == RBCP_CMD_WR && rcvdBytes >= 8 + length){
+              for(size_t n = 0; n < length; n++){
+                WriteRegister(address + n, rcvdBuf[8 + n]);
+              }
+              ack.buf.insert(ack.buf.end(), rcvdBuf + 8, rcvdBuf + 8 + length);
+              ack.buf[1] = command | 0x08;
+            }
+            else if(command == RBCP_CMD_RD){
+              for(size_t n = 0; n < length; n++){
+                ack.buf.push_back(m_regs[(address + n) & 0xffff]);
+              }
+              ack.buf[1] = command | 0x08;
+            }
+            else{
+              ack.buf[1] = command | 0x09; // bus error
+            }
+          }
+          ack.tp_due = std::chrono::steady_clock::now() + m_latency;
+          acks.push_back(std::move(ack));
+        }
+      }
+    }
+    auto tp_now = std::chrono::steady_clock::now();
+    while(!acks.empty() && acks.front().tp_due <= tp_now){
+      Ack &ack = acks.front();
+      sendto(m_sock, ack.buf.data(), ack.buf.size(), 0, (struct sockaddr *)&ack.peer, ack.peerLen);
+      acks.pop_front();
+    }
+  }
+}
@@ -1,21 +1,47 @@
 #include "StreamInBuffer.hh"
 
 #include <iostream>
-#include <chrono>
-#include <thread>
+#include <cstring>
+#include <algorithm>
+
+namespace{
+  constexpr size_t npos = size_t(-1);
+}
+
+StreamInBuffer::StreamInBuffer(size_t capacity){
+    m_capacity = 1;
+    while(m_capacity < capacity || m_capacity < s_max_packet_size){
+        m_capacity <<= 1;
+    }
+    m_mask = m_capacity - 1;
+    m_buf.resize(m_capacity + s_max_packet_size);
+}
 
 void StreamInBuffer::append(size_t length, const char *data){
-    m_buf += std::string(data, length);
+    if(length > m_capacity - size()){
+        std::cout<<"StreamInBuffer::append(): buffer overflow, drop pending bytes="<<size()<<std::endl;
+        m_head = m_tail;
+        m_len = 0; // framing restarts on the appended bytes
+        if(length > m_capacity){
+            data += length - m_capacity;
+            length = m_capacity;
+        }
+    }
+    size_t p = m_tail & m_mask;
+    size_t n1 = std::min(length, m_capacity - p);
+    std::memcpy(&m_buf[p], data, n1);
+    std::memcpy(&m_buf[0], data + n1, length - n1);
+    m_tail += length;
     updatelength(false);
 }
 
 bool StreamInBuffer::havepacket() const{
-    return m_buf.length() >= m_len  && m_len!=0;
+    return size() >= m_len  && m_len!=0;
 }
 
 bool StreamInBuffer::havepacket_possible() const{
     bool expectedPack = false;
-    if(m_buf.length() >= m_len  && m_len!=0){
+    if(size() >= m_len  && m_len!=0){
         expectedPack = true;
     }
     return expectedPack;
@@ -29,50 +55,53 @@ void StreamInBuffer::resyncpacket(){
         return;
     }
 
-    std::string packet(m_buf, 0, m_len);
     while(havepacket_possible() &&
-          (m_buf[0]!=0b10101010 || (m_buf[m_len-2] != 0b11001100 || m_buf[m_len-1] != 0b11001100))){
-        std::this_thread::sleep_for(std::chrono::milliseconds(1)); //avoid fast loop
-        if(m_buf[0]!=0b10101010){
-            std::string::size_type pos = m_buf.find(0b10101010);
-            if(pos != std::string::npos){
+          (at(0)!=0b10101010 || (at(m_len-2) != 0b11001100 || at(m_len-1) != 0b11001100))){
+        if(at(0)!=0b10101010){
+            size_t pos = find(0b10101010, 0);
+            if(pos != npos){
                 if(pos>0){
                     std::cout<<"resyncpacket(): erase bytes to pack head="<<pos<<std::endl;
-                    m_buf.erase(0, pos);
+                    erase(pos);
                 }
                 updatelength(true);
             }else{
-                std::cout<<"resyncpacket(): no head found, clean buffer size="<<m_buf.size()<<std::endl;
-                m_buf.clear();
+                std::cout<<"resyncpacket(): no head found, clean buffer size="<<size()<<std::endl;
+                erase(size());
                 updatelength(true);
             }
             continue;
         }
-        if(m_buf[m_len-2] != 0b11001100 || m_buf[m_len-1] != 0b11001100) {
-            std::string::size_type pos = m_buf.find("\xcc\xcc");
+        if(at(m_len-2) != 0b11001100 || at(m_len-1) != 0b11001100) {
+            size_t pos = findtrailer();
             std::cout<<"resyncpacket(): erase bytes to pack tail="<<pos+2<<std::endl;
-            m_buf.erase(0, pos+2);
+            erase(pos == npos? 1 : pos+2);
             updatelength(true);
         }
     }
     return ;
 }
 
-std::string StreamInBuffer::getpacket(){
+std::string_view StreamInBuffer::getpacket(){
     if (!havepacket()){
         std::cerr<<"havepacket return false\n";
         throw;
     }
-    std::string packet(m_buf, 0, m_len);
-    m_buf.erase(0, m_len);
+    size_t p = m_head & m_mask;
+    if(p + m_len > m_capacity){
+        // wrapped packet, complete it in the mirror area
+        std::memcpy(&m_buf[m_capacity], &m_buf[0], p + m_len - m_capacity);
+    }
+    std::string_view packet(&m_buf[p], m_len);
+    m_head += m_len;
     updatelength(true);
     return packet;
 }
 
 void StreamInBuffer::dump(size_t maxN){
-    size_t dumpN = m_buf.size()<maxN ? m_buf.size(): maxN;
+    size_t dumpN = size()<maxN ? size(): maxN;
     for(size_t n = 0; n< dumpN; n++){
-        uint16_t num = (uint8_t)m_buf[n];
+        uint16_t num = at(n);
         fprintf(stdout, "%02X - ", num);
         if(n%2==1)   std::cout<<" = ";
         if(n%16==15) std::cout<<std::endl;
@@ -80,28 +109,58 @@ void StreamInBuffer::dump(size_t maxN){
 }
 
 void StreamInBuffer::resyncpackethead(){ //resync to make sure buffer starts from 0b10101010
-    if(m_buf.length()==0) return;
-    if(static_cast<unsigned char>(m_buf[0])!=0b10101010){ // match package header=0xaa
-        std::string::size_type pos = m_buf.find(0b10101010);
-        if(pos != std::string::npos){ //header is found
+    if(size()==0) return;
+    if(at(0)!=0b10101010){ // match package header=0xaa
+        size_t pos = find(0b10101010, 0);
+        if(pos != npos){ //header is found
             std::cout<<"resyncpackethead(): erase bytes to pack head="<<pos<<std::endl;
-            m_buf.erase(0, pos);
+            erase(pos);
         }
         else{ //no head is found
-            std::cout<<"resyncpackethead(): no head found, clean buffer, size="<<m_buf.size()<<std::endl;
-            m_buf.clear();
+            std::cout<<"resyncpackethead(): no head found, clean buffer, size="<<size()<<std::endl;
+            erase(size());
         }
     }
 }
 
 void StreamInBuffer::updatelength(bool force){
-    // std::cout<< "m_len udpate"<<std::endl;
     if (force || m_len == 0) {
         m_len = 0;
         resyncpackethead();
-        if (m_buf.length() >= 6) {
-            m_len = ((size_t(uint8_t(m_buf[4]))<<8) + (size_t(uint8_t(m_buf[5]))))  * 4  + 8;
-            // std::cout<< "len update "<< m_len<< std::hex<<" " << size_t(uint8_t(m_buf[4])) << "  "<< size_t(uint8_t(m_buf[5]))<<std::dec<<std::endl;
+        if (size() >= 6) {
+            m_len = ((size_t(at(4))<<8) + (size_t(at(5))))  * 4  + 8;
+        }
+    }
+}
+
+void StreamInBuffer::erase(size_t n){
+    m_head += std::min(n, size());
+}
+
+// offset of first byte c at or after offset from, or npos.
+// memchr is vectorised by libc, at most two segments are scanned.
+size_t StreamInBuffer::find(uint8_t c, size_t from) const{
+    size_t n = size();
+    while(from < n){
+        size_t p = (m_head + from) & m_mask;
+        size_t seg = std::min(n - from, m_capacity - p);
+        const void* hit = std::memchr(&m_buf[p], c, seg);
+        if(hit){
+            return from + (static_cast<const char*>(hit) - &m_buf[p]);
+        }
+        from += seg;
+    }
+    return npos;
+}
+
+// offset of first 0xcccc trailer, or npos
+size_t StreamInBuffer::findtrailer() const{
+    size_t pos = find(0b11001100, 0);
+    while(pos != npos && pos + 1 < size()){
+        if(at(pos+1) == 0b11001100){
+            return pos;
         }
+        pos = find(0b11001100, pos+1);
     }
+    return npos;
 }
@@ -11,6 +11,8 @@
 #include <thread>
 
 #include "TcpConnection.hh"
+#include "TcpReactor.hh"
+#include "mymetrics.hh"
 
 
 
@@ -85,12 +87,18 @@ namespace{
 
 
 
-TcpConnection::TcpConnection(int sockfd, FunProcessMessage recvFun,  FunSendDeamon sendFun, void* pobj){
+TcpConnection::TcpConnection(int sockfd, FunProcessMessage recvFun,  FunSendDeamon sendFun, void* pobj, TcpReactor* reactor){
   m_sockfd = sockfd;
+  m_recv_fun = recvFun;
+  m_pobj = pobj;
   if(m_sockfd>=0){
     m_isAlive = true;
-    if(recvFun)
-      m_fut = std::async(std::launch::async, &TcpConnection::threadConnRecv, this, recvFun, pobj);
+    if(recvFun && reactor){
+      m_reactor = reactor;
+      m_reactor->add(this, m_sockfd);
+    }
+    else if(recvFun)
+      m_fut = std::async(std::launch::async, &TcpConnection::threadConnRecv, this);
     if(sendFun)
       m_fut_send = std::async(std::launch::async, sendFun, pobj, this);
   }
@@ -99,6 +107,10 @@ TcpConnection::TcpConnection(int sockfd, FunProcessMessage recvFun,  FunSendDeam
 
 TcpConnection::~TcpConnection(){
   printf("TcpConnnection deconstructing\n");
+  if(m_reactor){
+    m_reactor->remove(this);
+    m_isAlive = false;
+  }
   if(m_fut.valid()){
     m_isAlive = false;
     m_fut.get();
@@ -114,7 +126,7 @@ TcpConnection::operator bool() const {
   return m_isAlive;
 }
 
-uint64_t TcpConnection::threadConnRecv(FunProcessMessage processMessage, void* pobj){
+uint64_t TcpConnection::threadConnRecv(){
   static const int MAX_BUFFER_SIZE = 10000;
   
   timeval tv_timeout;
@@ -135,32 +147,53 @@ uint64_t TcpConnection::threadConnRecv(FunProcessMessage processMessage, void* p
       continue;
     }
 
-    int count = recv(m_sockfd, buffer, (unsigned int)MAX_BUFFER_SIZE,0);
-    if(count == 0 && errno != EWOULDBLOCK && errno != EAGAIN){
-      m_isAlive = false; // closed connection
-      std::printf("connection is closed by remote peer\n");
+    if(!readSocket(buffer, MAX_BUFFER_SIZE, 1)){
       break;
     }
+  }
+  m_isAlive = false;
+  printf("threadConnRecv exited\n");
+  return 0;
+}
+
+
+bool TcpConnection::readSocket(char* buffer, size_t size, size_t readMax){
+  static auto& s_mt_bytes = mymetrics::Registry::instance().counter("tcp_recv_bytes_total", "bytes received by TcpConnections");
+  static auto& s_mt_reads = mymetrics::Registry::instance().counter("tcp_recv_calls_total", "recv calls returning data");
+  for(size_t n = 0; n < readMax; n++){
+    ssize_t count = recv(m_sockfd, buffer, size, 0);
+    if(count < 0){
+      if(errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR){
+        break; // drained
+      }
+      std::fprintf(stderr, "ERROR reading the TCP socket. errno: %d\n", errno);
+      m_isAlive = false;
+      return false;
+    }
     if(count == 0){
-      continue;
+      m_isAlive = false; // closed connection
+      std::printf("connection is closed by remote peer\n");
+      return false;
     }
-    
-    m_tcpbuf.append(count, buffer);    
+
+    s_mt_bytes.add(count);
+    s_mt_reads.add();
+    m_tcpbuf.append(count, buffer);
     while (m_tcpbuf.havepacket()){
-      int re = (*processMessage)(pobj, this, m_tcpbuf.getpacket());
+      int re = (*m_recv_fun)(m_pobj, this, m_tcpbuf.getpacket());
       if(re < 0){
         std::fprintf(stderr, "error: processMessage return error \n");
         m_isAlive = false;
-        break;
+        return false;
       }
     }
+    if(size_t(count) < size){
+      break; // drained, saves the recv returning EAGAIN
+    }
   }
-  m_isAlive = false;
-  printf("threadConnRecv exited\n");
-  return 0;
+  return true;
 }
 
-
 void TcpConnection::sendRaw(const char* buf, size_t len){
   const char* remain_bufptr = buf;
   size_t remain_len = len;
@@ -180,7 +213,7 @@ void TcpConnection::sendRaw(const char* buf, size_t len){
   }
 }
 
-std::unique_ptr<TcpConnection> TcpConnection::connectToServer(const std::string& host,  short int port, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj){
+std::unique_ptr<TcpConnection> TcpConnection::connectToServer(const std::string& host,  short int port, FunProcessMessage recvFun, FunSendDeamon sendFun, void* pobj, TcpReactor* reactor){
   auto now = std::chrono::system_clock::now();
   auto now_c = std::chrono::system_clock::to_time_t(now);
   printf("AsyncTcpClientConn is running...\n");
@@ -194,6 +227,9 @@ std::unique_ptr<TcpConnection> TcpConnection::connectToServer(const std::string&
   serv_addr.sin_family = AF_INET;
   serv_addr.sin_port = htons(port);
   serv_addr.sin_addr.s_addr = inet_addr(host.c_str());
+  if(reactor){
+    reactor->setupSocket(sockfd); // receive buffer has to be set before the window is negotiated
+  }
   if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0){
     if(errno != EINPROGRESS){
       std::fprintf(stderr, "ERROR<%s>: unable to start TCP connection, error code %i \n", __func__, errno);
@@ -206,7 +242,7 @@ std::unique_ptr<TcpConnection> TcpConnection::connectToServer(const std::string&
     return nullptr;
   }
   setupSocket(sockfd);
-  return std::make_unique<TcpConnection>(sockfd, recvFun, sendFun, pobj);
+  return std::make_unique<TcpConnection>(sockfd, recvFun, sendFun, pobj, reactor);
 }
 
 int TcpConnection::createServerSocket(short int port){
@@ -0,0 +1,129 @@
+#include <cstdio>
+#include <cerrno>
+#include <chrono>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "TcpReactor.hh"
+#include "TcpConnection.hh"
+
+TcpReactor::TcpReactor(size_t threadN, size_t rcvbuf, uint32_t busyPollUs)
+  :m_rcvbuf(rcvbuf), m_busy_poll_us(busyPollUs){
+  if(threadN == 0){
+    threadN = 1;
+  }
+  for(size_t n = 0; n < threadN; n++){
+    std::unique_ptr<Worker> w(new Worker);
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(w->epfd < 0){
+      std::fprintf(stderr, "TcpReactor: unable to create epoll, errno %d\n", errno);
+      throw;
+    }
+    m_workers.push_back(std::move(w));
+  }
+  for(auto &w: m_workers){
+    w->thread = std::thread(&TcpReactor::threadServe, this, w.get());
+  }
+}
+
+TcpReactor::~TcpReactor(){
+  m_is_running = false;
+  for(auto &w: m_workers){
+    if(w->thread.joinable()){
+      w->thread.join();
+    }
+    close(w->epfd);
+  }
+}
+
+void TcpReactor::setupSocket(int sockfd) const{
+  if(m_rcvbuf){
+    int size = m_rcvbuf;
+    // capped by net.core.rmem_max, the kernel doubles the value for its bookkeeping
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  }
+#ifdef SO_BUSY_POLL
+  if(m_busy_poll_us){
+    int us = m_busy_poll_us;
+    // needs CAP_NET_ADMIN, spinning in threadServe works without
+    setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us));
+  }
+#endif
+}
+
+void TcpReactor::add(TcpConnection* conn, int sockfd){
+  Worker *w;
+  uint64_t id;
+  {
+    std::unique_lock<std::mutex> lk(m_mx);
+    w = m_workers[m_worker_next++ % m_workers.size()].get();
+    id = m_id_next++;
+    m_conn_worker[conn] = {w, id};
+  }
+  {
+    std::unique_lock<std::mutex> lk(w->mx);
+    w->conns[id] = conn;
+  }
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.u64 = id;
+  if(epoll_ctl(w->epfd, EPOLL_CTL_ADD, sockfd, &ev) != 0){
+    std::fprintf(stderr, "TcpReactor: unable to add socket to epoll, errno %d\n", errno);
+    throw;
+  }
+}
+
+void TcpReactor::remove(TcpConnection* conn){
+  Worker *w;
+  uint64_t id;
+  {
+    std::unique_lock<std::mutex> lk(m_mx);
+    auto it = m_conn_worker.find(conn);
+    if(it == m_conn_worker.end()){
+      return;
+    }
+    std::tie(w, id) = it->second;
+    m_conn_worker.erase(it);
+  }
+  // events of it which are already fetched are dropped by id
+  std::unique_lock<std::mutex> lk(w->mx);
+  auto it = w->conns.find(id);
+  if(it != w->conns.end()){
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, it->second->sockfd(), nullptr);
+    w->conns.erase(it);
+  }
+}
+
+void TcpReactor::threadServe(Worker* w){
+  static const int s_event_max = 64;
+  epoll_event events[s_event_max];
+  std::vector<char> buffer(s_read_size);
+  auto tp_last_event = std::chrono::steady_clock::now();
+  while(m_is_running){
+    int timeout_ms = 100;
+    if(m_busy_poll_us &&
+       std::chrono::steady_clock::now() - tp_last_event < std::chrono::microseconds(m_busy_poll_us)){
+      timeout_ms = 0;
+    }
+    int n = epoll_wait(w->epfd, events, s_event_max, timeout_ms);
+    if(n <= 0){
+      continue;
+    }
+    tp_last_event = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lk(w->mx);
+    for(int i = 0; i < n; i++){
+      auto it = w->conns.find(events[i].data.u64);
+      if(it == w->conns.end()){
+        continue;
+      }
+      TcpConnection *conn = it->second;
+      if(!conn->readSocket(buffer.data(), buffer.size(), s_read_max_per_event)){
+        // closed by the peer or refused by the callback, as threadConnRecv ends
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, conn->sockfd(), nullptr);
+        w->conns.erase(it);
+      }
+    }
+  }
+}
@@ -16,6 +16,7 @@
 #include <unistd.h>
 
 #include "myrapidjson.h"
+#include "myspscring.hh"
 
 namespace altel{
   class TelViewer{
@@ -32,13 +33,10 @@ namespace altel{
     uint64_t asyncLoop();
 
   private:
-    std::vector<std::shared_ptr<JsonValue>> m_vec_ring_ev;
     std::shared_ptr<JsonValue> m_ring_end; // ring end is nullptr,therefore real data as nullptr should not go into the ring.
 
     uint64_t m_size_ring{200000};
-    std::atomic_uint64_t m_count_ring_write;
-    std::atomic_uint64_t m_count_ring_read;
-    std::atomic_uint64_t m_hot_p_read;
+    SpscRing<std::shared_ptr<JsonValue>> m_ring_ev{m_size_ring};
     bool m_is_async_thread_running{false};
     std::future<uint64_t> m_fut_async_thread;
   };
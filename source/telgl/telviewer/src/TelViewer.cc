@@ -10,27 +10,21 @@ TelViewer::~TelViewer(){
   stopAsyncLoop();
 }
 
-void TelViewer::clearObjects(){ // by write thread
-  uint64_t count_ring_read = m_count_ring_read;
-  m_count_ring_write = count_ring_read;
+void TelViewer::clearObjects(){ // by read thread
+  m_ring_ev.clear();
 }
 
 void TelViewer::pushObject(std::shared_ptr<JsonValue> dp){ //by write thread
-  uint64_t next_p_ring_write = m_count_ring_write % m_size_ring;
-  if(next_p_ring_write == m_hot_p_read){
+  if(!m_ring_ev.push(std::move(dp))){
     std::fprintf(stderr, "buffer full, unable to write into buffer, monitor data lose\n");
     return;
   }
-  m_vec_ring_ev[next_p_ring_write] = dp;
-  m_count_ring_write ++;
 }
 
 std::shared_ptr<JsonValue>& TelViewer::frontObject(){ //by read thread
-  if(m_count_ring_write > m_count_ring_read) {
-    uint64_t next_p_ring_read = m_count_ring_read % m_size_ring;
-    m_hot_p_read = next_p_ring_read;
-    // keep hot read to prevent write-overlapping
-    return m_vec_ring_ev[next_p_ring_read];
+  std::shared_ptr<JsonValue>* p = m_ring_ev.front();
+  if(p){
+    return *p;
   }
   else{
     return m_ring_end;
@@ -38,13 +32,7 @@ std::shared_ptr<JsonValue>& TelViewer::frontObject(){ //by read thread
 }
 
 void TelViewer::popFrontObject(){ //by read thread
-  if(m_count_ring_write > m_count_ring_read) {
-    uint64_t next_p_ring_read = m_count_ring_read % m_size_ring;
-    m_hot_p_read = next_p_ring_read;
-    // keep hot read to prevent write-overlapping
-    m_vec_ring_ev[next_p_ring_read].reset();
-    m_count_ring_read ++;
-  }
+  m_ring_ev.pop();
 }
 
 void TelViewer::stopAsyncLoop(){
@@ -57,11 +45,7 @@ void TelViewer::startAsyncLoop(){
   if(m_is_async_thread_running){
     std::fprintf(stderr, "unable to start up new async thread.  already running\n");
   }
-  m_vec_ring_ev.clear();
-  m_vec_ring_ev.resize(m_size_ring);
-  m_count_ring_write = 0;
-  m_count_ring_read = 0;
-  m_hot_p_read = m_size_ring -1; // tail
+  m_ring_ev.clear(); // async read thread is not yet running
   m_fut_async_thread = std::async(std::launch::async, &TelViewer::asyncLoop, this);
 }
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <vector>
+
+#include "TelMille.hh"
+
+namespace altel{
+
+// Global alignment of the TelMille x, y, rz parameters in memory, in place of the Mille
+// binary and pede.
+//
+// Tracks are kept as local hit positions. Every iteration refits them with the current
+// geometry of TelMille, accumulates the normal equations reduced by the 4 local line
+// parameters per track, solves them for the parameters not fixed by isFixedXYRz and
+// shifts the geometry. From the second iteration, measurements beyond huberCut sigma
+// are down-weighted and tracks beyond chi2NdfCut are dropped.
+class TelAlignSolver{
+public:
+  struct Config{
+    size_t iterations{3};
+    double huberCut{3};     // |residual|/sigma, 0 for no down-weighting
+    double chi2NdfCut{0};   // 0 for no cut
+    size_t threadN{1};
+  };
+
+  TelAlignSolver(TelMille& telmille, const Config& conf) : m_telmille(telmille), m_conf(conf) {}
+
+  // hits of a track as for TelMille::fillTrackXYRz
+  void addTrack(const JsonValue& js);
+  size_t numTracks() const;
+
+  // runs the iterations, returns the sum of the corrections {x, y, rz} by detector id
+  std::map<size_t, std::array<double, 3>> solve();
+
+private:
+  struct Normal{
+    std::vector<double> matrix; // nGL x nGL
+    std::vector<double> vector;
+    double chi2{0};
+    size_t trackN{0};
+  };
+
+  // reduced normal equations of tracks [begin, end)
+  void accumulate(size_t begin, size_t end, bool isDownWeighted, Normal& normal) const;
+
+  TelMille& m_telmille;
+  Config m_conf;
+  std::vector<double> m_hits; // x, y per plane per track
+};
+}
@@ -33,6 +33,28 @@ public:
   void fillTrackXYRz(const JsonValue& js);
   void createPedeStreeringModeXYRz(const std::string& path);
 
+  // one measurement of a track as written by fillTrackXYRz, global derivatives of its plane only
+  struct TrackMeasure{
+    size_t plane{0};             // index by z
+    float derLC[4]{0, 0, 0, 0};  // x, y, xa, ya
+    float derGL[3]{0, 0, 0};     // x, y, rz of the plane
+    float residual{0};
+    float sigma{0};
+  };
+
+  // local hit positions of a track, by plane index
+  void localHitsXY(const JsonValue& js, std::vector<double>& xLocal, std::vector<double>& yLocal) const;
+  // straight line fit through the hits of all planes with the current geometry, 2 measurements per plane
+  void measureTrackXYRz(const std::vector<double>& xLocal, const std::vector<double>& yLocal,
+                        std::vector<TrackMeasure>& measures) const;
+
+  size_t numPlanes() const {return m_nPlanes;}
+  size_t planeId(size_t n) const;
+  // parameter k (x, y, rz) of plane n fixed in alignment
+  bool isFixedXYRz(size_t n, size_t k) const;
+  // adds an alignment result to the geometry
+  void shiftGeometryXYRz(size_t id, double dx, double dy, double drz);
+
   static void FitTrack(unsigned int nMeasures,
                        const std::vector<double>& xPosMeasure,
                        const std::vector<double>& yPosMeasure,
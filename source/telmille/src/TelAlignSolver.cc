@@ -0,0 +1,161 @@
+#include "TelAlignSolver.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <Eigen/Dense>
+
+void altel::TelAlignSolver::addTrack(const JsonValue& js){
+  std::vector<double> xLocal;
+  std::vector<double> yLocal;
+  m_telmille.localHitsXY(js, xLocal, yLocal);
+  for(size_t n = 0; n < xLocal.size(); n++){
+    m_hits.push_back(xLocal[n]);
+    m_hits.push_back(yLocal[n]);
+  }
+}
+
+size_t altel::TelAlignSolver::numTracks() const{
+  size_t nPlanes = m_telmille.numPlanes();
+  return nPlanes? m_hits.size() / (2 * nPlanes) : 0;
+}
+
+void altel::TelAlignSolver::accumulate(size_t begin, size_t end, bool isDownWeighted, Normal& normal) const{
+  const size_t nPlanes = m_telmille.numPlanes();
+  const size_t nGL = nPlanes * 3;
+  normal.matrix.assign(nGL * nGL, 0);
+  normal.vector.assign(nGL, 0);
+  normal.chi2 = 0;
+  normal.trackN = 0;
+  Eigen::Map<Eigen::MatrixXd> matA(normal.matrix.data(), nGL, nGL);
+  Eigen::Map<Eigen::VectorXd> vecB(normal.vector.data(), nGL);
+
+  std::vector<double> xLocal(nPlanes);
+  std::vector<double> yLocal(nPlanes);
+  std::vector<TelMille::TrackMeasure> measures;
+  std::vector<double> weights;
+  Eigen::MatrixXd matG(nGL, 4);
+  for(size_t t = begin; t < end; t++){
+    for(size_t n = 0; n < nPlanes; n++){
+      xLocal[n] = m_hits[(t * nPlanes + n) * 2];
+      yLocal[n] = m_hits[(t * nPlanes + n) * 2 + 1];
+    }
+    m_telmille.measureTrackXYRz(xLocal, yLocal, measures);
+
+    double chi2 = 0;
+    weights.clear();
+    for(auto& meas: measures){
+      double pull = meas.residual / meas.sigma;
+      chi2 += pull * pull;
+      double weight = 1. / (meas.sigma * meas.sigma);
+      if(isDownWeighted && m_conf.huberCut > 0 && std::abs(pull) > m_conf.huberCut){
+        weight *= m_conf.huberCut / std::abs(pull);
+      }
+      weights.push_back(weight);
+    }
+    size_t ndf = measures.size() > 4? measures.size() - 4 : 1;
+    if(isDownWeighted && m_conf.chi2NdfCut > 0 && chi2 / ndf > m_conf.chi2NdfCut){
+      continue;
+    }
+    normal.chi2 += chi2;
+    normal.trackN++;
+
+    // local part C, mixed part G, local vector bL; global part goes directly to A and bG
+    Eigen::Matrix4d matC = Eigen::Matrix4d::Zero();
+    Eigen::Vector4d vecL = Eigen::Vector4d::Zero();
+    matG.setZero();
+    for(size_t m = 0; m < measures.size(); m++){
+      auto& meas = measures[m];
+      double w = weights[m];
+      Eigen::Vector4d derLC(meas.derLC[0], meas.derLC[1], meas.derLC[2], meas.derLC[3]);
+      Eigen::Vector3d derGL(meas.derGL[0], meas.derGL[1], meas.derGL[2]);
+      size_t g = meas.plane * 3;
+      matC += w * derLC * derLC.transpose();
+      vecL += w * meas.residual * derLC;
+      matG.block<3, 4>(g, 0) += w * derGL * derLC.transpose();
+      matA.block<3, 3>(g, g) += w * derGL * derGL.transpose();
+      vecB.segment<3>(g) += w * meas.residual * derGL;
+    }
+    // eliminate the local parameters
+    Eigen::Matrix4d invC = matC.ldlt().solve(Eigen::Matrix4d::Identity());
+    Eigen::MatrixXd matGinvC = matG * invC;
+    matA -= matGinvC * matG.transpose();
+    vecB -= matGinvC * vecL;
+  }
+}
+
+std::map<size_t, std::array<double, 3>> altel::TelAlignSolver::solve(){
+  const size_t nPlanes = m_telmille.numPlanes();
+  const size_t nGL = nPlanes * 3;
+  const size_t trackN = numTracks();
+
+  std::vector<size_t> freeIndex;
+  for(size_t n = 0; n < nPlanes; n++){
+    for(size_t k = 0; k < 3; k++){
+      if(!m_telmille.isFixedXYRz(n, k)){
+        freeIndex.push_back(n * 3 + k);
+      }
+    }
+  }
+
+  std::map<size_t, std::array<double, 3>> corrections;
+  for(size_t n = 0; n < nPlanes; n++){
+    corrections[m_telmille.planeId(n)] = {0, 0, 0};
+  }
+
+  size_t threadN = std::max<size_t>(1, std::min(m_conf.threadN, trackN));
+  std::vector<Normal> normals(threadN);
+  for(size_t iter = 0; iter < m_conf.iterations; iter++){
+    // tracks split into contiguous ranges per thread, summed in thread order
+    std::vector<std::thread> workers;
+    for(size_t i = 0; i < threadN; i++){
+      size_t begin = trackN * i / threadN;
+      size_t end = trackN * (i + 1) / threadN;
+      workers.emplace_back(&TelAlignSolver::accumulate, this, begin, end, iter > 0, std::ref(normals[i]));
+    }
+    for(auto& w: workers){
+      w.join();
+    }
+    Eigen::MatrixXd matA = Eigen::MatrixXd::Zero(nGL, nGL);
+    Eigen::VectorXd vecB = Eigen::VectorXd::Zero(nGL);
+    double chi2 = 0;
+    size_t usedN = 0;
+    for(auto& normal: normals){
+      matA += Eigen::Map<Eigen::MatrixXd>(normal.matrix.data(), nGL, nGL);
+      vecB += Eigen::Map<Eigen::VectorXd>(normal.vector.data(), nGL);
+      chi2 += normal.chi2;
+      usedN += normal.trackN;
+    }
+
+    Eigen::MatrixXd matFree(freeIndex.size(), freeIndex.size());
+    Eigen::VectorXd vecFree(freeIndex.size());
+    for(size_t i = 0; i < freeIndex.size(); i++){
+      vecFree(i) = vecB(freeIndex[i]);
+      for(size_t j = 0; j < freeIndex.size(); j++){
+        matFree(i, j) = matA(freeIndex[i], freeIndex[j]);
+      }
+    }
+    Eigen::LLT<Eigen::MatrixXd> llt(matFree);
+    if(llt.info() != Eigen::Success){
+      std::fprintf(stderr, "TelAlignSolver: normal equations are not positive definite, %zu tracks used\n", usedN);
+      throw;
+    }
+    Eigen::VectorXd result = llt.solve(vecFree);
+
+    std::fprintf(stdout, "alignment iteration %zu: %zu of %zu tracks, chi2/ndf %f\n",
+                 iter, usedN, trackN, usedN? chi2 / (usedN * (2 * nPlanes - 4.)) : 0.);
+    std::vector<std::array<double, 3>> shifts(nPlanes, {0, 0, 0});
+    for(size_t i = 0; i < freeIndex.size(); i++){
+      shifts[freeIndex[i] / 3][freeIndex[i] % 3] = result(i);
+    }
+    for(size_t n = 0; n < nPlanes; n++){
+      size_t id = m_telmille.planeId(n);
+      m_telmille.shiftGeometryXYRz(id, shifts[n][0], shifts[n][1], shifts[n][2]);
+      for(size_t k = 0; k < 3; k++){
+        corrections[id][k] += shifts[n][k];
+      }
+    }
+  }
+  return corrections;
+}
@@ -309,9 +309,54 @@ void altel::TelMille::endMilleBinary(){
   m_mille.reset();
 }
 
-void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
-  double stdevFact = 0.09;
+void altel::TelMille::localHitsXY(const JsonValue& js, std::vector<double>& xLocal, std::vector<double>& yLocal) const {
+  if(js.Size()!= m_nPlanes){
+    std::fprintf(stderr, "hits number[%i] is less than detector number[%i] \n", js.Size(), m_nPlanes);
+    throw;
+  }
+  xLocal.assign(m_nPlanes, 0);
+  yLocal.assign(m_nPlanes, 0);
+  for(const auto& js_hit : js.GetArray()){
+    size_t id =js_hit["id"].GetUint();
+    size_t detN = m_indexDet.at(id);
+    xLocal[detN] = js_hit["x"].GetDouble();
+    yLocal[detN] = js_hit["y"].GetDouble();
+  }
+}
+
+size_t altel::TelMille::planeId(size_t n) const {
+  for(auto [the_id, the_n]: m_indexDet){
+    if(the_n == n){
+      return the_id;
+    }
+  }
+  std::cout<< "not find id by n number"<<std::endl;
+  throw;
+}
+
+bool altel::TelMille::isFixedXYRz(size_t n, size_t k) const {
+  // first (minimium z) plane are all fixed; last plane is center fixed, but rotatable
+  if(n == 0){
+    return true;
+  }
+  if(n == m_nPlanes-1){
+    return k != 2;
+  }
+  return false;
+}
+
+void altel::TelMille::shiftGeometryXYRz(size_t id, double dx, double dy, double drz) {
+  m_xPosDet.at(id) += dx;
+  m_yPosDet.at(id) += dy;
+  m_gammaPosDet.at(id) += drz;
+  double rz = m_gammaPosDet.at(id);
+  m_dets[id]=CreateLayerSit_UVonXY("PIX"+std::to_string(id), id,
+                                   m_xPosDet.at(id), m_yPosDet.at(id), m_zPosDet.at(id), 0.001,
+                                   rz, 0.02, rz+90., 0.02);
+}
 
+void altel::TelMille::measureTrackXYRz(const std::vector<double>& xLocal, const std::vector<double>& yLocal,
+                                       std::vector<TrackMeasure>& measures) const {
   std::vector<double> xPosHit(m_nPlanes,0);
   std::vector<double> yPosHit(m_nPlanes,0);
   std::vector<double> zPosHit(m_nPlanes,0);
@@ -319,15 +364,8 @@ void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
   std::vector<double> xResolHit(m_nPlanes, 0);
   std::vector<double> yResolHit(m_nPlanes, 0);
 
-  std::vector<size_t> idHit(m_nPlanes,0);
-
-  if(js.Size()!= m_nPlanes){
-    std::fprintf(stderr, "hits number[%i] is less than detector number[%i] \n", js.Size(), m_nPlanes);
-    throw;
-  }
-  for(const auto& js_hit : js.GetArray()){
-    size_t id =js_hit["id"].GetUint();
-    size_t detN = m_indexDet.at(id);
+  for (unsigned int detN = 0; detN < m_nPlanes; detN++) {
+    size_t id = planeId(detN);
     double xPosDet = m_xPosDet.at(id);
     double yPosDet = m_yPosDet.at(id);
     double zPosDet = m_zPosDet.at(id);
@@ -344,7 +382,7 @@ void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
     trafoGlobalFromMeas.rotate(rotZ);
     trafoGlobalFromMeas.translation() =  Eigen::Vector3d(xPosDet, yPosDet, zPosDet);
 
-    Eigen::Vector3d measPos(js_hit["x"].GetDouble(), js_hit["y"].GetDouble(), 0);
+    Eigen::Vector3d measPos(xLocal[detN], yLocal[detN], 0);
     Eigen::Vector3d globalPos =  trafoGlobalFromMeas * measPos;
 
     xPosHit[detN]=globalPos[0];
@@ -354,8 +392,6 @@ void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
     //TODO: from meas UV to XY
     xResolHit[detN]=m_xResolution.at(id);
     yResolHit[detN]=m_yResolution.at(id);
-
-    idHit[detN]=id;
   }
 
 
@@ -389,26 +425,57 @@ void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
            yResidHit
     );
 
+  measures.clear();
+  // loop over all planes
+  for (unsigned int n = 0; n < m_nPlanes; n++) {
+    size_t id = planeId(n);
+    Eigen::Vector3d posPredit( xPosHit[n]-xResidHit[n], yPosHit[n]-yResidHit[n], zPosHit[n]);
+    Eigen::Vector3d dirLine( tan(xAngleTrack), tan(yAngleTrack), 1);
+
+    auto& det = m_dets.at(id);
+    Eigen::Matrix<double, 2, 6> fullDerGL = det->getRigidBodyDerLocal_mod(posPredit, dirLine); // global
+// or global cordination?
+
+    TrackMeasure measX;
+    measX.plane = n;
+    measX.derLC[0] = 1;
+    measX.derLC[2] = zPosHit[n];
+    measX.derGL[0] = fullDerGL(0,0); // 1
+    measX.derGL[1] = fullDerGL(0,1); // 0
+    measX.derGL[2] = fullDerGL(0,5); // y
+    measX.residual = xResidHit[n];
+    measX.sigma    = xResolHit[n];
+    measures.push_back(measX);
+
+    TrackMeasure measY;
+    measY.plane = n;
+    measY.derLC[1] = 1;
+    measY.derLC[3] = zPosHit[n];
+    measY.derGL[0] = fullDerGL(1,0); // 0
+    measY.derGL[1] = fullDerGL(1,1); // 1
+    measY.derGL[2] = fullDerGL(1,5); // -x
+    measY.residual = yResidHit[n];
+    measY.sigma    = yResolHit[n];
+    measures.push_back(measY);
+  } // end loop over all planes
+}
+
+void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
+  std::vector<double> xLocal;
+  std::vector<double> yLocal;
+  localHitsXY(js, xLocal, yLocal);
+  std::vector<TrackMeasure> measures;
+  measureTrackXYRz(xLocal, yLocal, measures);
+
   const int nLC = 4; // number of local parameters, x, y, xa, ya
   const int nGL = m_nPlanes * 3; // number of global parameters, x, y, rz
 
-  std::vector<float> derLC(nLC, 0);
   std::vector<float> derGL(nGL, 0);
 
   std::vector<int> label(nGL, 0);
 
   for (unsigned int n = 0; n < m_nPlanes; n++) {
-    unsigned int id=-1;
-    for(auto [the_id, the_n]: m_indexDet){
-      if(the_n == n){
-        id = the_id;
-        break;
-      }
-    }
-    if(id == -1){
-      std::cout<< "not find id by n number"<<std::endl;
-      throw;
-    }
+    size_t id = planeId(n);
     auto it_label_layer_begin = std::begin(label);
     std::advance(it_label_layer_begin, 3*n);
     auto it_label_layer_end   = std::begin(label);
@@ -418,68 +485,11 @@ void altel::TelMille::fillTrackXYRz(const JsonValue& js) {
 
   // std::iota(std::begin(label), std::end(label), 1);
 
-  // loop over all planes
-  for (unsigned int n = 0; n < m_nPlanes; n++) {
-    unsigned int id=-1;
-    for(auto [the_id, the_n]: m_indexDet){
-      if(the_n == n){
-        id = the_id;
-        break;
-      }
-    }
-    if(id == -1){
-      std::cout<< "not find id by n number"<<std::endl;
-      throw;
-    }
-    Eigen::Vector3d posPredit( xPosHit[n]-xResidHit[n], yPosHit[n]-yResidHit[n], zPosHit[n]);
-    Eigen::Vector3d dirLine( tan(xAngleTrack), tan(yAngleTrack), 1);
-
-    auto& det = m_dets.at(id);
-    Eigen::Matrix<double, 2, 6> fullDerGL = det->getRigidBodyDerLocal_mod(posPredit, dirLine); // global
-// or global cordination?
-
-
-    float residual;
-    float sigma;
-
-    // derGL[((n * 3) + 0)] = -1;
-    // derGL[((n * 3) + 2)] = yPosHit[n];
-    derGL[((n * 3) + 0)] = fullDerGL(0,0); // 1
-    derGL[((n * 3) + 1)] = fullDerGL(0,1); // 0
-    derGL[((n * 3) + 2)] = fullDerGL(0,5); // y
-
-    derLC[0] = 1;
-    derLC[2] = zPosHit[n];
-    residual = xResidHit[n];
-    sigma    = xResolHit[n];
-    m_mille->mille(nLC,derLC.data(),nGL,derGL.data(),label.data(),residual,sigma);
-
-    derGL[((n * 3) + 0)] = 0;
-    derGL[((n * 3) + 1)] = 0;
-    derGL[((n * 3) + 2)] = 0;
-    derLC[0] = 0;
-    derLC[2] = 0;
-
-    // derGL[((n * 3) + 1)] = -1;
-    // derGL[((n * 3) + 2)] = -1 * xPosHit[n];
-    derGL[((n * 3) + 0)] = fullDerGL(1,0); // 0
-    derGL[((n * 3) + 1)] = fullDerGL(1,1); // 1
-    derGL[((n * 3) + 2)] = fullDerGL(1,5); // -x
-
-
-    derLC[1] = 1;
-    derLC[3] = zPosHit[n];
-    residual = yResidHit[n];
-    sigma    = yResolHit[n];
-    m_mille->mille(nLC,derLC.data(),nGL,derGL.data(),label.data(),residual,sigma);
-
-    derGL[((n * 3) + 0)] = 0;
-    derGL[((n * 3) + 1)] = 0;
-    derGL[((n * 3) + 2)] = 0;
-    derLC[1] = 0;
-    derLC[3] = 0;
-
-  } // end loop over all planes
+  for(auto& meas: measures){
+    std::copy(std::begin(meas.derGL), std::end(meas.derGL), derGL.begin() + meas.plane * 3);
+    m_mille->mille(nLC,meas.derLC,nGL,derGL.data(),label.data(),meas.residual,meas.sigma);
+    std::fill(derGL.begin() + meas.plane * 3, derGL.begin() + (meas.plane + 1) * 3, 0);
+  }
 
   m_mille->end();
 }
@@ -495,27 +505,11 @@ void altel::TelMille::createPedeStreeringModeXYRz(const std::string& path){
 
   steerFile << "Parameter" << endl;
 
-  // first (minimium z) plane are all fixed; last plane is center fixed, but rotatable
+  // presigma -1.0 for fixed parameters, see isFixedXYRz
   for (unsigned int n = 0; n < m_nPlanes; n++) {
-    for(auto &[id, detN]: m_indexDet ){
-      if(detN == n){
-        if(n == 0){
-          steerFile << (id*10 + 1) << " " << "0.0" << " -1.0" << endl;
-          steerFile << (id*10 + 2) << " " << "0.0" << " -1.0" << endl;
-          steerFile << (id*10 + 3) << " " << "0.0" << " -1.0" << endl;
-        }
-        else if(n == m_nPlanes-1){
-          steerFile << (id*10 + 1) << " " << "0.0" << " -1.0" << endl;
-          steerFile << (id*10 + 2) << " " << "0.0" << " -1.0" << endl;
-          steerFile << (id*10 + 3) << " " << "0.0" << " 0.0" << endl;
-        }
-        else{
-          steerFile << (id*10 + 1) << " " << "0.0" << " 0.0" << endl;
-          steerFile << (id*10 + 2) << " " << "0.0" << " 0.0" << endl;
-          steerFile << (id*10 + 3) << " " << "0.0" << " 0.0" << endl;
-        }
-        break;
-      }
+    size_t id = planeId(n);
+    for (unsigned int k = 0; k < 3; k++) {
+      steerFile << (id*10 + k + 1) << " " << "0.0" << (isFixedXYRz(n, k)? " -1.0" : " 0.0") << endl;
     }
   }
 